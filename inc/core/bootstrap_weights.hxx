@@ -0,0 +1,43 @@
+#ifndef H_BOOTSTRAP_WEIGHTS
+#define H_BOOTSTRAP_WEIGHTS
+
+#include "Rtypes.h"
+#include "ROOT/RVec.hxx"
+
+/**
+ * functor returning Poisson bootstrap weights of an event, for RInterface::Define with columns {key, nominal_weight}
+ * where key holds (run, luminosityBlock, event); element 0 is the nominal weight and element i the nominal weight
+ * times a count drawn from a Poisson distribution of mean 1
+ * counts come from a counter-based generator keyed by (seed, run, luminosityBlock, event, i), so replicas are
+ * reproducible and do not depend on the number of threads or the order in which events are processed
+ */
+class BootstrapWeights {
+  private:
+    unsigned int num_replicas;
+    ULong64_t seed;
+
+  public:
+    /**
+     * constructor
+     * i_num_replicas - number of bootstrap replicas, i.e. weights besides the nominal one
+     * i_seed - seed shared by all events, replicas with different seeds are independent
+     */
+    BootstrapWeights(unsigned int i_num_replicas, ULong64_t i_seed=0);
+
+    /**
+     * returns nominal weight followed by the weights of all replicas
+     */
+    ROOT::RVec<double> operator()(const ROOT::RVec<ULong64_t> &event_key, double nominal_weight) const;
+
+    /**
+     * returns 64 random bits for counter, a bijective mix (SplitMix64 finalizer) of its argument
+     */
+    static ULong64_t mix(ULong64_t counter);
+
+    /**
+     * returns count drawn from a Poisson distribution of mean 1 by inverting its cumulative distribution at random_bits
+     */
+    static unsigned int poisson_count(ULong64_t random_bits);
+};
+
+#endif
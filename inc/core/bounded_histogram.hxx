@@ -0,0 +1,152 @@
+#ifndef H_BOUNDED_HISTOGRAM
+#define H_BOUNDED_HISTOGRAM
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "TH1.h"
+#include "TH2.h"
+#include "TTreeReader.h"
+#include "ROOT/RDF/RActionImpl.hxx"
+
+/**
+ * histogram storage options
+ * per_slot - RDataFrame default, one full copy of each histogram per thread slot
+ * shared_atomic - one bin array shared by all slots and updated atomically, memory independent of number of slots
+ * sparse_slots - per-slot maps of filled bins merged at the end of the loop, for rarely-filled histograms
+ */
+enum class HistogramStorage {
+  per_slot,
+  shared_atomic,
+  sparse_slots
+};
+
+/**
+ * bin precision options for shared_atomic storage
+ * integer_counts is only appropriate for unweighted histograms, weights are rounded to the nearest integer and a
+ * warning is printed the first time a non-integer weight is filled; contents and sums of squared weights are kept in
+ * separate signed 64-bit counters, so negative weights and large counts are exact, and bins are updated with a single
+ * atomic add instead of a compare-exchange loop
+ */
+enum class BinPrecision {
+  double_precision,
+  float_precision,
+  integer_counts
+};
+
+/**
+ * entry counter of one thread slot, aligned to a cache line so that slots do not share lines
+ */
+struct alignas(64) SlotEntryCount {
+  double entries = 0.;
+};
+
+/**
+ * class holding the bins of one histogram filled from all thread slots with bounded memory
+ */
+class BoundedBinStorage {
+  private:
+    HistogramStorage storage;
+    BinPrecision precision;
+    uint64_t num_cells;
+    std::unique_ptr<std::atomic<double>[]> double_contents;
+    std::unique_ptr<std::atomic<double>[]> double_sumw2;
+    std::unique_ptr<std::atomic<float>[]> float_contents;
+    std::unique_ptr<std::atomic<float>[]> float_sumw2;
+    std::unique_ptr<std::atomic<int64_t>[]> integer_contents;
+    std::unique_ptr<std::atomic<int64_t>[]> integer_sumw2;
+    std::vector<std::unordered_map<uint64_t, std::pair<double, double>>> slot_sparse_cells;
+    std::vector<SlotEntryCount> slot_entries;
+    std::atomic<bool> warned_non_integer_weight;
+
+  public:
+    /**
+     * constructor
+     * i_num_cells - number of bins including under/overflow, see TH1::GetNcells
+     */
+    BoundedBinStorage(HistogramStorage i_storage, BinPrecision i_precision, uint64_t i_num_cells, unsigned int num_slots);
+
+    /**
+     * returns projected number of bytes used by this storage, excluding sparse buffers which grow with filled bins
+     */
+    static uint64_t projected_bytes(HistogramStorage storage, BinPrecision precision, uint64_t num_cells, unsigned int num_slots);
+
+    /**
+     * method to add weight to bin cell from slot slot
+     */
+    void fill(unsigned int slot, uint64_t cell, double weight);
+
+    /**
+     * method to write merged bins into histogram
+     */
+    void write_to(TH1* histogram);
+};
+
+/**
+ * RDataFrame action filling a TH1D with bounded memory, use with RInterface::Book<double, double>(helper, {value, weight})
+ */
+class BoundedHistogram1DHelper : public ROOT::Detail::RDF::RActionImpl<BoundedHistogram1DHelper> {
+  public:
+    using Result_t = TH1D;
+
+  private:
+    std::shared_ptr<TH1D> result;
+    std::unique_ptr<BoundedBinStorage> bin_storage;
+
+  public:
+    /**
+     * constructor, result is initialized as an empty copy of model
+     */
+    BoundedHistogram1DHelper(std::shared_ptr<TH1D> model, HistogramStorage storage, BinPrecision precision, unsigned int num_slots);
+
+    BoundedHistogram1DHelper(BoundedHistogram1DHelper &&) = default;
+    BoundedHistogram1DHelper(const BoundedHistogram1DHelper &) = delete;
+
+    /**
+     * methods required by RDataFrame for custom actions
+     */
+    std::shared_ptr<TH1D> GetResultPtr() const;
+    void Initialize();
+    void InitTask(TTreeReader *, unsigned int);
+    void Exec(unsigned int slot, double value, double weight);
+    void Finalize();
+    std::string GetActionName();
+};
+
+/**
+ * RDataFrame action filling a TH2D with bounded memory, use with RInterface::Book<double, double, double>(helper, {x, y, weight})
+ */
+class BoundedHistogram2DHelper : public ROOT::Detail::RDF::RActionImpl<BoundedHistogram2DHelper> {
+  public:
+    using Result_t = TH2D;
+
+  private:
+    std::shared_ptr<TH2D> result;
+    std::unique_ptr<BoundedBinStorage> bin_storage;
+
+  public:
+    /**
+     * constructor, result is initialized as an empty copy of model
+     */
+    BoundedHistogram2DHelper(std::shared_ptr<TH2D> model, HistogramStorage storage, BinPrecision precision, unsigned int num_slots);
+
+    BoundedHistogram2DHelper(BoundedHistogram2DHelper &&) = default;
+    BoundedHistogram2DHelper(const BoundedHistogram2DHelper &) = delete;
+
+    /**
+     * methods required by RDataFrame for custom actions
+     */
+    std::shared_ptr<TH2D> GetResultPtr() const;
+    void Initialize();
+    void InitTask(TTreeReader *, unsigned int);
+    void Exec(unsigned int slot, double x_value, double y_value, double weight);
+    void Finalize();
+    std::string GetActionName();
+};
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef H_CHECKPOINT
+#define H_CHECKPOINT
+
+#include <string>
+#include <vector>
+
+#include "core/result_cache.hxx"
+
+/**
+ * class to periodically save partial results of a long event loop together with the work units they cover,
+ * so that a restarted job only processes the remaining units
+ * checkpoints are stored under a subdirectory named after a hash of the computation graph and its units, so a
+ * job whose inputs, selection, or bookings changed never resumes from a stale checkpoint
+ * each save writes a new generation of results and then atomically replaces the state file pointing to it,
+ * so a job killed while saving resumes from the previous checkpoint
+ */
+class Checkpoint {
+  private:
+    std::string checkpoint_directory;
+    unsigned int generation;
+
+    /**
+     * internal function returning directory holding the results of generation i_generation
+     */
+    std::string generation_directory(unsigned int i_generation);
+
+  public:
+    /**
+     * constructor
+     * i_checkpoint_directory - directory in which checkpoints are stored, created if it does not exist
+     * graph_hash - hash of everything determining the results of the units, see ResultCache::hash
+     */
+    Checkpoint(std::string i_checkpoint_directory, std::string graph_hash);
+
+    /**
+     * method to read the indices of completed units and add their results to results
+     * returns false if there is no checkpoint
+     */
+    bool load(std::vector<unsigned int> &completed_units, ResultCache* results);
+
+    /**
+     * method to replace the checkpoint with completed_units and the sum of their results held in results
+     */
+    void save(std::vector<unsigned int> completed_units, ResultCache* results);
+};
+
+#endif
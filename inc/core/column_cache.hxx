@@ -0,0 +1,229 @@
+#ifndef H_COLUMN_CACHE
+#define H_COLUMN_CACHE
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+#include "Rtypes.h"
+#include "ROOT/RDataSource.hxx"
+#include "ROOT/RVec.hxx"
+
+/**
+ * on-disk layout of a column cache file, all offsets are in bytes from the start of the file
+ * [ColumnCacheHeader][block 0][block 1]...[column names][column table][block table]
+ * each block holds, for each column, [offsets][values] for entries_per_block entries: offsets (jagged columns only)
+ * are num_entries+1 element indices into the values of the block, values are a flat array, either raw or
+ * LZ4-compressed. Arrays are padded to 8 bytes so that raw values can be read in place from a mapping.
+ * the block table holds num_columns*num_blocks ColumnCacheBlock, block-major
+ */
+struct ColumnCacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t num_columns;
+  uint64_t num_entries;
+  uint64_t entries_per_block;
+  uint64_t num_blocks;
+  uint64_t column_table_offset;
+  uint64_t block_table_offset;
+};
+
+struct ColumnCacheColumn {
+  uint64_t name_offset;
+  uint64_t name_length;
+  uint32_t type;
+  uint32_t is_jagged;
+};
+
+struct ColumnCacheBlock {
+  uint64_t offsets_offset;
+  uint64_t values_offset;
+  uint64_t stored_size;
+  uint64_t raw_size;
+  uint64_t is_compressed;
+};
+
+/**
+ * value types of cached columns, the branch types of flat trees such as NanoAOD
+ */
+enum class ColumnCacheType : uint32_t {
+  float32,
+  float64,
+  int8,
+  uint8,
+  boolean,
+  int16,
+  uint16,
+  int32,
+  uint32,
+  int64,
+  uint64
+};
+
+/**
+ * class to build column cache files: flat value arrays of selected branches of a TTree, with offset arrays for
+ * jagged (variable or fixed length array) branches, stored in blocks of entries that are optionally LZ4-compressed
+ */
+class ColumnCacheWriter {
+  public:
+    /**
+     * returns path of the cache of columns of tree_name in root_filename under cache_directory
+     * the name includes the size and modification time of the input file, so caches of changed files are rebuilt
+     */
+    static std::string get_cache_filename(std::string cache_directory, std::string root_filename, std::string tree_name, std::vector<std::string> columns, bool compress);
+
+    /**
+     * method to write columns of tree_name in root_filename to cache_filename, returns false on failure
+     * the cache is written to a temporary file and renamed, so readers never see partial caches
+     */
+    static bool build(std::string root_filename, std::string tree_name, std::vector<std::string> columns, std::string cache_filename, bool compress=false, uint64_t entries_per_block=10000);
+};
+
+/**
+ * internal class holding the current value of a cached column for each slot, as RDataFrame column readers expect
+ */
+class ColumnCacheReaderBase {
+  protected:
+    std::vector<void*> value_pointers;
+
+  public:
+    /**
+     * constructor
+     */
+    ColumnCacheReaderBase(unsigned int num_slots);
+
+    /**
+     * destructor
+     */
+    virtual ~ColumnCacheReaderBase();
+
+    /**
+     * returns pointers to the value pointer of each slot, see RDataSource::GetColumnReadersImpl
+     */
+    std::vector<void*> get_readers();
+
+    /**
+     * method to point the value of slot to elements [begin, end) of values
+     */
+    virtual void set_value(unsigned int slot, char* values, uint64_t begin, uint64_t end) = 0;
+
+    /**
+     * returns type of column values as read by RDataFrame
+     */
+    virtual const std::type_info& get_type() = 0;
+};
+
+/**
+ * internal class holding values of a scalar (is_jagged false) or array (is_jagged true, read as RVec<T>) column
+ * arrays are RVec views adopting the cached values, so they are not copied
+ */
+template<typename T>
+class ColumnCacheReader : public ColumnCacheReaderBase {
+  private:
+    bool is_jagged;
+    std::vector<ROOT::RVec<T>> slot_views;
+
+  public:
+    /**
+     * constructor
+     */
+    ColumnCacheReader(unsigned int num_slots, bool i_is_jagged);
+
+    void set_value(unsigned int slot, char* values, uint64_t begin, uint64_t end) override;
+    const std::type_info& get_type() override;
+};
+
+/**
+ * RDataFrame data source reading column cache files through memory mappings, see ColumnCacheWriter
+ * entries of the files are chained in order; each entry range handed to a slot is (the selected part of) one block,
+ * and compressed blocks are decompressed once per slot into a buffer, while raw blocks are read in place without copying
+ */
+class ColumnCacheDataSource : public ROOT::RDF::RDataSource {
+  private:
+    struct MappedCacheFile {
+      char* mapped_data;
+      uint64_t mapped_size;
+      const ColumnCacheHeader* header;
+      const ColumnCacheBlock* block_table;
+      ULong64_t first_entry;
+    };
+
+    struct SlotBlock {
+      int file_idx;
+      uint64_t block_idx;
+      ULong64_t first_entry;
+      ULong64_t end_entry;
+      std::vector<std::vector<char>> buffers;
+    };
+
+    std::vector<std::string> cache_filenames;
+    std::vector<MappedCacheFile> files;
+    std::vector<std::string> column_names;
+    std::vector<ColumnCacheType> column_types;
+    std::vector<bool> column_jagged;
+    unsigned int num_slots;
+    bool ranges_returned;
+    bool entries_selected;
+    std::vector<std::pair<ULong64_t, ULong64_t>> selected_ranges;
+    std::vector<unsigned int> reader_columns;
+    std::vector<std::unique_ptr<ColumnCacheReaderBase>> readers;
+    std::vector<SlotBlock> slot_blocks;
+
+    /**
+     * internal function returning index of column name, or -1 if absent
+     */
+    int find_column(std::string_view name) const;
+
+    /**
+     * internal function to make the block holding entry current for slot, decompressing it if needed
+     */
+    void load_block(unsigned int slot, ULong64_t entry);
+
+  protected:
+    Record_t GetColumnReadersImpl(std::string_view name, const std::type_info &type_info) override;
+
+  public:
+    /**
+     * constructor, maps i_cache_filenames into memory; all files must hold the same columns
+     */
+    ColumnCacheDataSource(std::vector<std::string> i_cache_filenames);
+
+    /**
+     * destructor, unmaps cache files
+     */
+    ~ColumnCacheDataSource();
+
+    ColumnCacheDataSource(const ColumnCacheDataSource&) = delete;
+    ColumnCacheDataSource& operator=(const ColumnCacheDataSource&) = delete;
+
+    /**
+     * returns true if all cache files were mapped successfully
+     */
+    bool is_open();
+
+    /**
+     * method to read only entries in i_selected_ranges, sorted [begin, end) ranges of chained entries, in the next
+     * event loops; blocks outside the ranges are never touched
+     */
+    void set_entry_ranges(std::vector<std::pair<ULong64_t, ULong64_t>> i_selected_ranges);
+
+    /**
+     * methods required by RDataFrame for data sources
+     */
+    void SetNSlots(unsigned int i_num_slots) override;
+    const std::vector<std::string> &GetColumnNames() const override;
+    bool HasColumn(std::string_view name) const override;
+    std::string GetTypeName(std::string_view name) const override;
+    std::vector<std::pair<ULong64_t, ULong64_t>> GetEntryRanges() override;
+    bool SetEntry(unsigned int slot, ULong64_t entry) override;
+    void Initialize() override;
+    std::string GetLabel() override;
+};
+
+#include "../../src/core/column_cache.tpp"
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef H_COMPILED_EXPRESSION_CACHE
+#define H_COMPILED_EXPRESSION_CACHE
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "TH1.h"
+#include "TH2.h"
+
+#include "ROOT/RResultPtr.hxx"
+#include "ROOT/RDF/RInterface.hxx"
+#include "ROOT/RDF/HistoModels.hxx"
+
+/**
+ * class to book string defines, filters, and untyped actions with ahead-of-time compiled code instead of Cling
+ * each expression is keyed by its text, the types of the columns it reads, the ROOT version and flags, and the
+ * version reported by the g++ that compiles it
+ * expressions missing from the cache are booked as usual (jitted) and compiled with g++ into a shared library in the
+ * cache directory when compile is called, so later runs load them without the interpreter; an index maps keys to
+ * libraries, so only libraries holding expressions that are used are loaded
+ * expressions that do not compile (ex. calling functions only declared to the interpreter) are remembered and stay jitted
+ */
+class CompiledExpressionCache {
+  private:
+    std::string cache_directory;
+    std::vector<std::string> headers;
+    std::vector<std::string> compile_flags;
+    std::vector<std::string> root_flags;
+    std::string compiler_version;
+    std::string key_context;
+    std::map<std::string, std::string> library_filenames;
+    std::map<std::string, void*> library_handles;
+    std::map<std::string, void*> functions;
+    std::set<std::string> failed_keys;
+    std::map<std::string, std::string> pending_sources;
+    std::map<std::string, std::string> pending_expressions;
+
+    /**
+     * internal function returning names of columns of node used as identifiers in expression, in order of appearance
+     */
+    std::vector<std::string> get_expression_columns(ROOT::RDF::RNode &node, std::string expression);
+
+    /**
+     * internal function returning the type of column as a parameter declaration, ex. "const Float_t &MET_pt"
+     */
+    std::string get_parameter(ROOT::RDF::RNode &node, std::string column);
+
+    /**
+     * internal function returning key of an expression described by description
+     */
+    std::string get_key(std::string description);
+
+    /**
+     * internal function returning function compiled for key, or nullptr after adding source to pending expressions
+     */
+    void* get_function(std::string key, std::string source, std::string expression);
+
+    /**
+     * internal function compiling keys of pending expressions into one library, splitting batches that fail
+     */
+    void compile_batch(std::vector<std::string> keys);
+
+    /**
+     * internal function returning handle of a compiled library, loaded on first use, or nullptr if it cannot be loaded
+     */
+    void* load_library(std::string library_filename);
+
+    /**
+     * internal function returning output (stdout and stderr) of running arguments, or an empty string if it fails
+     */
+    std::string get_program_output(std::vector<std::string> arguments);
+
+  public:
+    /**
+     * constructor
+     * i_cache_directory - directory holding compiled libraries, a subdirectory is used for each ROOT version
+     * i_headers - headers included in compiled code, ex. declaring functions called by expressions
+     * i_compile_flags - additional g++ flags separated by spaces, ex. include directories of the headers; they are
+     *   passed to g++ as separate arguments without a shell
+     */
+    CompiledExpressionCache(std::string i_cache_directory="expression_cache", std::vector<std::string> i_headers={},
+        std::string i_compile_flags="");
+
+    /**
+     * destructor, pending expressions are not compiled (see compile); libraries stay loaded since booked data frames
+     * run their code
+     */
+    ~CompiledExpressionCache();
+
+    CompiledExpressionCache(const CompiledExpressionCache&) = delete;
+    CompiledExpressionCache& operator=(const CompiledExpressionCache&) = delete;
+
+    /**
+     * methods to book compiled versions of RInterface::Define(name, expression) and RInterface::Filter(expression, name)
+     * on node, returns false (leaving node unchanged) if the expression is not compiled yet
+     */
+    bool define(ROOT::RDF::RNode &node, std::string name, std::string expression);
+    bool filter(ROOT::RDF::RNode &node, std::string expression, std::string filter_name="");
+
+    /**
+     * methods to book typed versions of RInterface::Sum, Histo1D and Histo2D on columns of node (weight_column may be
+     * empty), returns false if they are not compiled yet
+     */
+    bool sum(ROOT::RDF::RNode &node, std::string column, ROOT::RDF::RResultPtr<double> &result);
+    bool histo_1d(ROOT::RDF::RNode &node, const ROOT::RDF::TH1DModel &model, std::string column,
+        std::string weight_column, ROOT::RDF::RResultPtr<TH1D> &result);
+    bool histo_2d(ROOT::RDF::RNode &node, const ROOT::RDF::TH2DModel &model, std::string x_column,
+        std::string y_column, std::string weight_column, ROOT::RDF::RResultPtr<TH2D> &result);
+
+    /**
+     * method to compile pending expressions into a new library of the cache, should be called once booked
+     * expressions were run (ex. at the end of main) so that later runs use compiled code
+     */
+    void compile();
+};
+
+#endif
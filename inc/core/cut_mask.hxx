@@ -0,0 +1,136 @@
+#ifndef H_CUT_MASK
+#define H_CUT_MASK
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Rtypes.h"
+#include "TTreeReader.h"
+#include "ROOT/RDF/RActionImpl.hxx"
+
+/**
+ * cutflow views that can be derived from per-event cut bitmasks
+ * sequential - events passing all cuts up to and including each cut, in declared order
+ * n_minus_one - events passing all cuts except (possibly) each cut
+ * first_failing - events for which each cut is the first one failed
+ */
+enum class CutflowView {
+  sequential,
+  n_minus_one,
+  first_failing
+};
+
+/**
+ * result of a cut bitmask action, cuts and regions are limited to 64 each by the width of the masks
+ * only two numbers per event and region are accumulated (the first failing cut and, if exactly one cut fails,
+ * that cut) and all views are derived from them, so views do not require extra passes or bookkeeping
+ * region index num_regions is the inclusive selection (no region cut)
+ */
+struct CutMaskYields {
+  unsigned int num_cuts;
+  unsigned int num_regions;
+  //indexed [region*(num_cuts+1)+first failing cut], index num_cuts holds events passing all cuts
+  std::vector<double> first_failing_yields;
+  std::vector<double> first_failing_sumw2;
+  std::vector<double> first_failing_counts;
+  //indexed [region*num_cuts+cut] for events failing only that cut
+  std::vector<double> only_failing_yields;
+  std::vector<double> only_failing_sumw2;
+  std::vector<double> only_failing_counts;
+
+  /**
+   * returns weighted (or unweighted, if weighted is false) yield of view for cut cut_idx in region region_idx
+   * for the sequential and n_minus_one views, cut_idx num_cuts gives events passing all cuts
+   * for first_failing, cut_idx num_cuts gives events passing all cuts as well
+   */
+  double get_yield(CutflowView view, unsigned int region_idx, unsigned int cut_idx, bool weighted=true) const;
+
+  /**
+   * returns statistical uncertainty of get_yield
+   */
+  double get_uncertainty(CutflowView view, unsigned int region_idx, unsigned int cut_idx, bool weighted=true) const;
+
+  /**
+   * returns yield of events entering the cutflow in region region_idx
+   */
+  double get_total(unsigned int region_idx, bool weighted=true) const;
+
+  /**
+   * method to add yields of another result with the same cuts and regions (ex. from another branch of the graph)
+   */
+  void add(const CutMaskYields &other);
+
+  /**
+   * method to add yields of another result scaled by yield_scale, its sums of squared weights scaled by sumw2_scale,
+   * and its counts scaled by count_scale, ex. to extrapolate yields measured on a subset of events
+   */
+  void add_scaled(const CutMaskYields &other, double yield_scale, double sumw2_scale, double count_scale);
+
+  /**
+   * returns number of values in get_values for num_cuts cuts and num_regions regions
+   */
+  static unsigned int num_values(unsigned int num_cuts, unsigned int num_regions);
+
+  /**
+   * returns all yields as one list, used to store results in a ResultCache; lists add elementwise
+   */
+  std::vector<double> get_values() const;
+
+  /**
+   * method to set yields from get_values of a result with the same num_cuts and num_regions
+   * returns false if the number of values does not match
+   */
+  bool set_values(std::vector<double> values);
+};
+
+/**
+ * RDataFrame action accumulating cutflow yields from per-event bitmasks of cut results and region membership
+ * bit i of the cut mask is set if cut i passes, bit r of the region mask is set if the event is in region r
+ * use with RInterface::Book<ULong64_t, ULong64_t, double>(helper, {cut mask, region mask, weight})
+ */
+class CutMaskHelper : public ROOT::Detail::RDF::RActionImpl<CutMaskHelper> {
+  public:
+    using Result_t = CutMaskYields;
+
+  private:
+    std::shared_ptr<CutMaskYields> result;
+    ULong64_t all_cuts_mask;
+    std::vector<std::vector<double>> slot_first_failing_yields;
+    std::vector<std::vector<double>> slot_first_failing_sumw2;
+    std::vector<std::vector<double>> slot_first_failing_counts;
+    std::vector<std::vector<double>> slot_only_failing_yields;
+    std::vector<std::vector<double>> slot_only_failing_sumw2;
+    std::vector<std::vector<double>> slot_only_failing_counts;
+
+    /**
+     * internal function to add an event with given cut mask to region region_idx
+     */
+    void fill_region(unsigned int slot, unsigned int region_idx, ULong64_t failed_cuts, double weight);
+
+  public:
+    /**
+     * constructor
+     */
+    CutMaskHelper(unsigned int num_cuts, unsigned int num_regions, unsigned int num_slots);
+
+    CutMaskHelper(CutMaskHelper &&) = default;
+    CutMaskHelper(const CutMaskHelper &) = delete;
+
+    /**
+     * methods required by RDataFrame for custom actions
+     */
+    std::shared_ptr<CutMaskYields> GetResultPtr() const;
+    void Initialize();
+    void InitTask(TTreeReader *, unsigned int);
+    void Exec(unsigned int slot, ULong64_t cut_mask, ULong64_t region_mask, double weight);
+    void Finalize();
+    std::string GetActionName();
+};
+
+/**
+ * returns jitted expression packing the results of cuts into a ULong64_t bitmask, bit i set if cuts[i] passes
+ */
+std::string get_cut_mask_expression(std::vector<std::string> cuts);
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef H_DATASET_MANIFEST
+#define H_DATASET_MANIFEST
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Rtypes.h"
+#include "TChain.h"
+
+/**
+ * description of one input file of a dataset manifest
+ * modification_time is in nanoseconds, cluster_starts holds the (file-local) first entry of each cluster, branches
+ * holds "name:type" of each branch
+ */
+struct ManifestFile {
+  std::string filename;
+  long long size;
+  unsigned long long inode;
+  long long modification_time;
+  ULong64_t entries;
+  std::vector<ULong64_t> cluster_starts;
+  std::vector<std::string> branches;
+};
+
+/**
+ * class holding file list, entries, cluster boundaries, and tree schema of the files matching a list of patterns
+ * the manifest is stored in manifest_directory, keyed by the patterns and tree name, and reused as long as the
+ * matched files keep their inode, size, and modification time (in nanoseconds, so files rewritten within a second are
+ * noticed on filesystems that record it); new and changed files are opened in parallel to update it, so chains can be
+ * built (see add_to_chain) without opening every file at startup
+ * only local files (including mounted network filesystems) can be checked: remote files (ex. root:// URLs) are
+ * opened at every startup to get their entries, clusters, and branches
+ */
+class DatasetManifest {
+  private:
+    std::string manifest_filename;
+    std::string tree_name;
+    std::vector<ManifestFile> files;
+    bool valid;
+
+    /**
+     * internal function opening file.filename to fill its entries, clusters, and branches, returns false on failure
+     */
+    bool scan_file(ManifestFile &file);
+
+    /**
+     * internal function returning files stored in the manifest file, empty if there is none
+     */
+    std::vector<ManifestFile> load();
+
+    /**
+     * internal function writing the manifest file
+     */
+    void store();
+
+  public:
+    /**
+     * constructor, loads the manifest and updates it if any matched file changed
+     * i_filename_patterns - file names or glob patterns, as passed to SampleWrapper
+     * i_tree_name - name of the tree in each file
+     * manifest_directory - local directory in which manifests are stored, created if it does not exist
+     * num_threads - number of threads opening files, hardware concurrency if 0
+     */
+    DatasetManifest(std::vector<std::string> i_filename_patterns, std::string i_tree_name,
+        std::string manifest_directory="manifest_cache", unsigned int num_threads=0);
+
+    /**
+     * returns false if any matched file could not be read
+     */
+    bool is_valid();
+
+    /**
+     * returns names of all matched files, in chain order
+     */
+    std::vector<std::string> get_filenames();
+
+    /**
+     * returns number of entries of each matched file
+     */
+    std::vector<ULong64_t> get_file_entries();
+
+    /**
+     * returns (file-local) first entry of each cluster of file file_idx
+     */
+    std::vector<ULong64_t> get_cluster_starts(unsigned int file_idx);
+
+    /**
+     * returns "name:type" of each branch of the tree of the first file
+     */
+    std::vector<std::string> get_branches();
+
+    /**
+     * method to add all files to chain with their known number of entries, so that they are not opened
+     */
+    void add_to_chain(TChain &chain);
+};
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef H_FRIEND_COLUMN_CACHE
+#define H_FRIEND_COLUMN_CACHE
+
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Rtypes.h"
+#include "TFile.h"
+#include "TTree.h"
+#include "TTreeReader.h"
+#include "ROOT/RDF/RActionImpl.hxx"
+
+/**
+ * functions locating friend trees holding defined columns materialized once per input file
+ * each friend file holds one tree with one column, aligned entry by entry with the tree of its input file, and is
+ * named by a hash of the column definition (name, type of the defining callable and of its result, input columns
+ * with their definitions, version) and the identity (name, size, modification time) of its input file, so any
+ * executable with the same definition reuses it. The callable type tells lambdas and functors apart, but not edits
+ * of their bodies, so the version must change with them
+ */
+class FriendColumnCache {
+  public:
+    /**
+     * returns name of the friend tree holding column_name
+     */
+    static std::string get_tree_name(std::string column_name);
+
+    /**
+     * returns name of the friend file holding a column with definition for tree tree_name of root_filename
+     */
+    static std::string get_filename(std::string cache_directory, std::string root_filename, std::string tree_name, std::string definition);
+
+    /**
+     * returns true if all friend_filenames exist
+     */
+    static bool all_exist(std::vector<std::string> friend_filenames);
+};
+
+/**
+ * RDataFrame action writing a column to one friend file per input file, use with
+ * RInterface::Book<T, ULong64_t>(helper, {column, "rdfentry_"}) on a data frame without filters
+ * each slot collects runs of consecutive entries in chunks; chunks are written to the friend tree of their input file
+ * as soon as all entries before them were written, so files are aligned with their input even in multithreaded loops
+ * and only values processed out of order are kept in memory. A file is closed once all its entries were written,
+ * files with entries outside the processed entry range are not written; nothing is written by event loops started
+ * while *enabled is false, ex. when the input is restricted to part of the entries; the result is the number of
+ * entries written
+ */
+template<typename T>
+class FriendColumnHelper : public ROOT::Detail::RDF::RActionImpl<FriendColumnHelper<T>> {
+  public:
+    using Result_t = ULong64_t;
+
+  private:
+    /**
+     * friend file being written, with chunks waiting for earlier entries
+     */
+    struct FriendFile {
+      std::unique_ptr<TFile> file;
+      std::unique_ptr<TTree> tree;
+      T value = T();
+      ULong64_t num_written = 0;
+      bool failed = false;
+      std::map<ULong64_t, std::vector<T>> pending_chunks;
+    };
+
+    std::string column_name;
+    std::vector<std::string> friend_filenames;
+    std::vector<ULong64_t> file_begin_entries;
+    std::vector<std::unique_ptr<FriendFile>> friend_files;
+    std::vector<std::vector<T>> slot_chunks;
+    std::vector<ULong64_t> slot_chunk_begins;
+    std::vector<unsigned int> slot_files;
+    std::shared_ptr<bool> enabled;
+    bool active;
+    std::shared_ptr<ULong64_t> result;
+
+    /**
+     * internal function handing the chunk of slot to its friend file and writing the chunks that are ready
+     */
+    void flush_chunk(unsigned int slot);
+
+    /**
+     * internal function writing chunks of input file file_idx that follow the entries already written, and closing
+     * its friend file once complete; the write mutex must be held
+     */
+    void write_chunks(unsigned int file_idx);
+
+  public:
+    /**
+     * constructor
+     * i_friend_filenames - friend file of each input file
+     * file_entries - number of entries of each input file
+     * i_enabled - flag read when the event loop starts, nothing is written if it is false
+     */
+    FriendColumnHelper(std::string i_column_name, std::vector<std::string> i_friend_filenames,
+        std::vector<ULong64_t> file_entries, unsigned int num_slots, std::shared_ptr<bool> i_enabled);
+
+    FriendColumnHelper(FriendColumnHelper &&) = default;
+    FriendColumnHelper(const FriendColumnHelper &) = delete;
+
+    /**
+     * methods required by RDataFrame for custom actions
+     */
+    std::shared_ptr<ULong64_t> GetResultPtr() const;
+    void Initialize();
+    void InitTask(TTreeReader *, unsigned int slot);
+    void Exec(unsigned int slot, const T &value, ULong64_t entry);
+    void Finalize();
+    std::string GetActionName();
+};
+
+#include "../../src/core/friend_column_cache.tpp"
+
+#endif
@@ -0,0 +1,171 @@
+#ifndef H_HISTOGRAM_ARCHIVE
+#define H_HISTOGRAM_ARCHIVE
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "TH1.h"
+#include "TH2.h"
+
+/**
+ * on-disk layout of a histogram archive, all offsets are in bytes from the start of the file
+ * [ArchiveHeader][entry 0][entry 1]...[slot table]
+ * each entry is [ArchiveEntryHeader][name][title][key][x edges][y edges][contents][sumw2],
+ * with strings padded to 8 bytes so that the double arrays can be read in place from a mapping
+ */
+struct ArchiveHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t num_entries;
+  uint64_t num_slots;
+  uint64_t slot_table_offset;
+};
+
+struct ArchiveSlot {
+  uint64_t key_hash;
+  uint64_t entry_offset;
+};
+
+struct ArchiveEntryHeader {
+  uint32_t num_dimensions;
+  uint32_t nbins_x;
+  uint32_t nbins_y;
+  uint32_t num_cells;
+  uint64_t name_length;
+  uint64_t title_length;
+  uint64_t key_length;
+  double entries;
+};
+
+/**
+ * function returning the archive key for a (variable, sample, region, kind) tuple
+ */
+std::string histogram_archive_key(std::string variable, std::string sample, std::string region, std::string kind);
+
+/**
+ * class to write realized histograms into a compact, indexed archive file
+ * entries are streamed to disk as they are added; the index is written on close
+ */
+class HistogramArchiveWriter {
+  private:
+    std::string filename;
+    std::ofstream output_file;
+    std::vector<ArchiveSlot> entry_index;
+    uint64_t current_offset;
+    bool is_closed;
+
+    /**
+     * internal function to append a single entry with given bin edges and bin arrays
+     */
+    void add_entry(std::string key, std::string name, std::string title, uint32_t num_dimensions, std::vector<double> x_edges, std::vector<double> y_edges, const double* contents, const double* sumw2, uint32_t num_cells, double entries);
+
+    /**
+     * internal function to write raw bytes and advance current offset
+     */
+    void write_bytes(const void* data, uint64_t size);
+
+  public:
+    /**
+     * constructor, opens archive file for writing
+     */
+    HistogramArchiveWriter(std::string i_filename);
+
+    /**
+     * destructor, closes archive if not already closed
+     */
+    ~HistogramArchiveWriter();
+
+    /**
+     * method to add a 1d histogram under key (variable, sample, region, kind)
+     */
+    HistogramArchiveWriter* add(TH1D* histogram, std::string variable, std::string sample, std::string region, std::string kind);
+
+    /**
+     * method to add a 2d histogram under key (variable, sample, region, kind)
+     */
+    HistogramArchiveWriter* add(TH2D* histogram, std::string variable, std::string sample, std::string region, std::string kind);
+
+    /**
+     * method to add a list of named values (ex. cutflow yields) under key (variable, sample, region, kind)
+     */
+    HistogramArchiveWriter* add(std::vector<std::string> labels, std::vector<double> values, std::string variable, std::string sample, std::string region, std::string kind);
+
+    /**
+     * method to write index and close file
+     */
+    void close();
+};
+
+/**
+ * class to read a histogram archive through a read-only memory mapping
+ * lookups are O(1) through a hash table stored in the file, bin arrays are not copied until histograms are built
+ * all entries are bounds-checked when the archive is opened; truncated or corrupt archives are not opened
+ */
+class HistogramArchive {
+  private:
+    std::string filename;
+    const char* mapped_data;
+    uint64_t mapped_size;
+    const ArchiveHeader* header;
+    const ArchiveSlot* slot_table;
+
+    /**
+     * internal function returning true if the entry at entry_offset, including its strings and arrays, lies within
+     * the mapping and its number of cells matches its binning
+     */
+    bool is_valid_entry(uint64_t entry_offset);
+
+    /**
+     * internal function returning entry header for a key, or nullptr if absent
+     */
+    const ArchiveEntryHeader* find(std::string key);
+
+  public:
+    /**
+     * constructor, maps archive file into memory
+     */
+    HistogramArchive(std::string i_filename);
+
+    /**
+     * destructor, unmaps archive
+     */
+    ~HistogramArchive();
+
+    HistogramArchive(const HistogramArchive&) = delete;
+    HistogramArchive& operator=(const HistogramArchive&) = delete;
+
+    /**
+     * returns true if archive was mapped successfully
+     */
+    bool is_open();
+
+    /**
+     * returns true if archive contains key (variable, sample, region, kind)
+     */
+    bool contains(std::string variable, std::string sample, std::string region, std::string kind);
+
+    /**
+     * returns pointer to the contiguous bin contents (including under/overflow) for a key without copying, or nullptr
+     * num_cells is set to the number of bins
+     */
+    const double* get_contents(std::string variable, std::string sample, std::string region, std::string kind, unsigned int &num_cells);
+
+    /**
+     * returns a new 1d histogram for a key, or nullptr if absent; caller owns histogram
+     */
+    TH1D* get_1d_histogram(std::string variable, std::string sample, std::string region, std::string kind);
+
+    /**
+     * returns a new 2d histogram for a key, or nullptr if absent; caller owns histogram
+     */
+    TH2D* get_2d_histogram(std::string variable, std::string sample, std::string region, std::string kind);
+
+    /**
+     * returns labels and values stored with add(labels, values, ...), false if absent
+     */
+    bool get_values(std::string variable, std::string sample, std::string region, std::string kind, std::vector<std::string> &labels, std::vector<double> &values);
+};
+
+#endif
@@ -0,0 +1,253 @@
+#ifndef H_MERGED_SAMPLE_LOOP
+#define H_MERGED_SAMPLE_LOOP
+
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "TH1.h"
+#include "TH2.h"
+#include "TTreeReader.h"
+#include "ROOT/RDataFrame.hxx"
+#include "ROOT/RDF/RInterface.hxx"
+#include "ROOT/RDF/RActionImpl.hxx"
+#include "ROOT/RResultPtr.hxx"
+
+#include "core/sample_wrapper.hxx"
+
+/**
+ * per-sample sums of a demultiplexing action, indexed by sample
+ */
+struct SampleSums {
+  std::vector<double> yields;
+  std::vector<double> counts;
+};
+
+/**
+ * per-sample histograms of a demultiplexing action, indexed by sample
+ * entries are null for samples that were not booked (ex. loaded from a result cache)
+ */
+struct SampleHistograms {
+  std::vector<std::shared_ptr<TH1D>> histograms;
+  std::vector<std::shared_ptr<TH2D>> twodim_histograms;
+};
+
+/**
+ * RDataFrame action accumulating weighted and unweighted sums per sample in a merged event loop
+ * use with RInterface::Book<double, unsigned int>(helper, {weight, sample index})
+ */
+class SampleSumHelper : public ROOT::Detail::RDF::RActionImpl<SampleSumHelper> {
+  public:
+    using Result_t = SampleSums;
+
+  private:
+    std::shared_ptr<SampleSums> result;
+    std::vector<std::vector<double>> slot_yields;
+    std::vector<std::vector<double>> slot_counts;
+
+  public:
+    /**
+     * constructor
+     */
+    SampleSumHelper(unsigned int num_samples, unsigned int num_slots);
+
+    SampleSumHelper(SampleSumHelper &&) = default;
+    SampleSumHelper(const SampleSumHelper &) = delete;
+
+    /**
+     * methods required by RDataFrame for custom actions
+     */
+    std::shared_ptr<SampleSums> GetResultPtr() const;
+    void Initialize();
+    void InitTask(TTreeReader *, unsigned int);
+    void Exec(unsigned int slot, double weight, unsigned int sample_idx);
+    void Finalize();
+    std::string GetActionName();
+};
+
+/**
+ * RDataFrame action filling one 1d histogram per sample in a merged event loop
+ * per-slot copies are only made for samples that slot actually sees
+ * use with RInterface::Book<double, double, unsigned int>(helper, {value, weight, sample index})
+ */
+class SampleHistogram1DHelper : public ROOT::Detail::RDF::RActionImpl<SampleHistogram1DHelper> {
+  public:
+    using Result_t = SampleHistograms;
+
+  private:
+    std::shared_ptr<SampleHistograms> result;
+    std::vector<std::vector<std::unique_ptr<TH1D>>> slot_histograms;
+
+  public:
+    /**
+     * constructor, models[sample] gives the (empty) histogram of each sample, null to skip a sample
+     */
+    SampleHistogram1DHelper(std::vector<std::shared_ptr<TH1D>> models, unsigned int num_slots);
+
+    SampleHistogram1DHelper(SampleHistogram1DHelper &&) = default;
+    SampleHistogram1DHelper(const SampleHistogram1DHelper &) = delete;
+
+    /**
+     * methods required by RDataFrame for custom actions
+     */
+    std::shared_ptr<SampleHistograms> GetResultPtr() const;
+    void Initialize();
+    void InitTask(TTreeReader *, unsigned int);
+    void Exec(unsigned int slot, double value, double weight, unsigned int sample_idx);
+    void Finalize();
+    std::string GetActionName();
+};
+
+/**
+ * RDataFrame action filling one 2d histogram per sample in a merged event loop
+ * use with RInterface::Book<double, double, double, unsigned int>(helper, {x value, y value, weight, sample index})
+ */
+class SampleHistogram2DHelper : public ROOT::Detail::RDF::RActionImpl<SampleHistogram2DHelper> {
+  public:
+    using Result_t = SampleHistograms;
+
+  private:
+    std::shared_ptr<SampleHistograms> result;
+    std::vector<std::vector<std::unique_ptr<TH2D>>> slot_histograms;
+
+  public:
+    /**
+     * constructor, models[sample] gives the (empty) histogram of each sample, null to skip a sample
+     */
+    SampleHistogram2DHelper(std::vector<std::shared_ptr<TH2D>> models, unsigned int num_slots);
+
+    SampleHistogram2DHelper(SampleHistogram2DHelper &&) = default;
+    SampleHistogram2DHelper(const SampleHistogram2DHelper &) = delete;
+
+    /**
+     * methods required by RDataFrame for custom actions
+     */
+    std::shared_ptr<SampleHistograms> GetResultPtr() const;
+    void Initialize();
+    void InitTask(TTreeReader *, unsigned int);
+    void Exec(unsigned int slot, double x_value, double y_value, double weight, unsigned int sample_idx);
+    void Finalize();
+    std::string GetActionName();
+};
+
+/**
+ * class holding a single data frame chaining the files of several samples, with a sample_idx column giving the
+ * index of the sample each entry belongs to. Defines and filters are built (and jitted) once for all samples,
+ * sample-specific ones are resolved by sample_idx, and results are demultiplexed per sample inside single actions
+ * all samples must be read from trees with the same name and branches, see SampleCollection::set_merged_event_loop
+ * jitted expressions get all their input columns, so sample-specific defines and filters read their columns for
+ * entries of all samples; samples sharing few defines and filters are better processed separately
+ */
+class MergedSampleLoop {
+  private:
+    std::vector<SampleWrapper*> samples;
+    ROOT::RDF::RNode merged_data_frame;
+    std::string weight_column;
+    unsigned int num_weight_columns;
+    unsigned int num_nodes;
+    std::map<std::string, unsigned int> num_column_definitions;
+    ROOT::RDF::RResultPtr<SampleSums> entry_sums;
+    ROOT::RDF::RResultPtr<SampleSums> total_sums;
+    std::vector<ROOT::RDF::RResultPtr<SampleSums>> filter_sums;
+
+    /**
+     * internal function returning the first entry of the chained files after each sample
+     */
+    static std::vector<ULong64_t> get_sample_end_entries(std::vector<SampleWrapper*> samples);
+
+    /**
+     * internal function to book per-sample sums of column weight on the current data frame
+     */
+    ROOT::RDF::RResultPtr<SampleSums> book_sums(std::string weight);
+
+  public:
+    /**
+     * constructor
+     * i_samples - samples to chain, the sample_idx column gives the index of an entry's sample in this vector
+     * tree_name - name of TTree to read from files of all samples
+     */
+    MergedSampleLoop(std::vector<SampleWrapper*> i_samples, const char* tree_name="tree");
+
+    /**
+     * returns jitted expression true for entries of samples sample_indices
+     */
+    std::string get_sample_selection(std::vector<unsigned int> sample_indices);
+
+    /**
+     * returns jitted expression evaluating sample_expressions[sample_idx] for each entry
+     * the expressions should have compatible types; identical expressions are evaluated without a branch
+     */
+    std::string get_sample_expression(std::vector<std::string> sample_expressions);
+
+    /**
+     * method to define a column for samples sample_indices (all samples if empty), see RInterface::Define
+     * columns defined for some samples only are default-constructed for other samples; a column defined again
+     * for other samples keeps its previous definition for samples not in sample_indices
+     */
+    void define(std::string name, std::string expression, std::vector<unsigned int> sample_indices={});
+
+    /**
+     * method to define a column for all samples, see RInterface::Define
+     * compiled columns are evaluated for all samples and cannot be redefined for other samples
+     */
+    template<typename F>
+    void define(std::string name, F expression, const std::vector<std::string> columns);
+
+    /**
+     * method to filter samples sample_indices (all samples if empty), see RInterface::Filter
+     * entries of other samples pass. Returns index of the filter, used to get its per-sample yields
+     */
+    unsigned int filter(std::string expression, std::string filter_description, std::vector<unsigned int> sample_indices={});
+
+    /**
+     * method to rebuild the merged weight column from the weight branches of all samples and book sums of lumi
+     * weights, should be called after the weight branches of samples change and before filtering
+     */
+    void update_weights();
+
+    /**
+     * returns name of the column holding the weight of each entry (1 for unweighted samples)
+     */
+    std::string get_weight_column();
+
+    /**
+     * returns weighted (or unweighted) yield of sample sample_idx before any filter
+     */
+    double get_entry_yield(unsigned int sample_idx, bool weighted=true);
+
+    /**
+     * returns sum of lumi weights of sample sample_idx, see SampleWrapper::get_total_yield
+     */
+    double get_total_yield(unsigned int sample_idx);
+
+    /**
+     * returns weighted (or unweighted) yield of sample sample_idx after filter filter_idx
+     */
+    double get_filter_yield(unsigned int filter_idx, unsigned int sample_idx, bool weighted=true);
+
+    /**
+     * returns number of defines and filters added so far, used to notice changes of the data frame
+     */
+    unsigned int get_num_nodes();
+
+    /**
+     * returns data frame of the entries of sample sample_idx, selected without jitting
+     */
+    ROOT::RDF::RNode get_sample_data_frame(unsigned int sample_idx);
+
+    /**
+     * returns data frame of entries of all samples selected by sample_cuts[sample_idx] (no cut if empty)
+     */
+    ROOT::RDF::RNode get_selected_data_frame(std::vector<std::string> sample_cuts);
+
+    /**
+     * internal RDataFrame object
+     */
+    ROOT::RDF::RNode & data_frame();
+};
+
+#include "../../src/core/merged_sample_loop.tpp"
+
+#endif
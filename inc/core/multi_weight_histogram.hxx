@@ -0,0 +1,94 @@
+#ifndef H_MULTI_WEIGHT_HISTOGRAM
+#define H_MULTI_WEIGHT_HISTOGRAM
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "TH1.h"
+#include "TTreeReader.h"
+#include "ROOT/RDF/RActionImpl.hxx"
+#include "ROOT/RVec.hxx"
+
+#include "core/variable_axis.hxx"
+
+/**
+ * result of a multi-weight fill: one 1d histogram per weight variation, stored as a contiguous
+ * [variation x bin] array (bins include under/overflow) so that every variation of an event is filled
+ * from a single bin lookup
+ */
+struct MultiWeightHistogram {
+  std::vector<double> bin_edges;
+  unsigned int num_variations;
+  std::vector<double> contents;
+  std::vector<double> sumw2;
+  double entries;
+
+  /**
+   * returns number of bins per variation, including under/overflow
+   */
+  unsigned int num_cells() const;
+
+  /**
+   * returns a new histogram for variation variation_idx; caller owns histogram
+   */
+  TH1D* make_histogram(unsigned int variation_idx, std::string name, std::string title) const;
+
+  /**
+   * returns entries, contents, and sumw2 as one list, used to store results in a ResultCache; lists add elementwise
+   */
+  std::vector<double> get_values() const;
+
+  /**
+   * method to set entries, contents, and sumw2 from get_values of a result with the same binning and variations
+   * returns false if the number of values does not match
+   */
+  bool set_values(std::vector<double> values);
+};
+
+/**
+ * RDataFrame action filling a MultiWeightHistogram from a scalar value column and an RVec<double> weight column
+ * use with RInterface::Book<double, ROOT::RVec<double>>
+ */
+class MultiWeightHistogramHelper : public ROOT::Detail::RDF::RActionImpl<MultiWeightHistogramHelper> {
+  public:
+    using Result_t = MultiWeightHistogram;
+
+  private:
+    std::shared_ptr<MultiWeightHistogram> result;
+    std::vector<std::vector<double>> slot_contents;
+    std::vector<std::vector<double>> slot_sumw2;
+    std::vector<double> slot_entries;
+    bool uniform_bins;
+    double low, high;
+    unsigned int nbins;
+
+    /**
+     * internal function returning the bin (0 = underflow, nbins+1 = overflow) of value
+     */
+    unsigned int find_bin(double value) const;
+
+  public:
+    /**
+     * constructor
+     * axis - binning of the histograms
+     * num_variations - number of weights per event, i.e. the size of the weight RVec
+     * num_slots - number of processing slots of the data frame, see RInterface::GetNSlots
+     */
+    MultiWeightHistogramHelper(VariableAxis axis, unsigned int num_variations, unsigned int num_slots);
+
+    MultiWeightHistogramHelper(MultiWeightHistogramHelper &&) = default;
+    MultiWeightHistogramHelper(const MultiWeightHistogramHelper &) = delete;
+
+    /**
+     * methods required by RDataFrame for custom actions
+     */
+    std::shared_ptr<MultiWeightHistogram> GetResultPtr() const;
+    void Initialize();
+    void InitTask(TTreeReader *, unsigned int);
+    void Exec(unsigned int slot, double value, const ROOT::RVec<double> &weights);
+    void Finalize();
+    std::string GetActionName();
+};
+
+#endif
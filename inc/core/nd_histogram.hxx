@@ -0,0 +1,127 @@
+#ifndef H_ND_HISTOGRAM
+#define H_ND_HISTOGRAM
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "TH1.h"
+#include "TH2.h"
+#include "TTreeReader.h"
+#include "ROOT/RDF/RActionImpl.hxx"
+#include "ROOT/RVec.hxx"
+
+#include "core/variable_axis.hxx"
+
+/**
+ * cut on one axis of an n-dimensional histogram used when slicing, keeps bins whose center is in [low, high)
+ * under/overflow bins have centers at -/+ infinity, so they are kept by unbounded cuts
+ */
+struct NdAxisCut {
+  std::string variable_name;
+  double low = -std::numeric_limits<double>::infinity();
+  double high = std::numeric_limits<double>::infinity();
+};
+
+/**
+ * result of an n-dimensional fill, stored densely or, for large bin counts, as a sparse map of filled cells
+ * cells are indexed as sum over axes of bin*stride, with bins including under/overflow
+ */
+struct NdHistogram {
+  std::vector<std::string> variable_names;
+  std::vector<std::vector<double>> bin_edges;
+  bool is_sparse;
+  std::vector<double> dense_contents;
+  std::vector<double> dense_sumw2;
+  std::unordered_map<uint64_t, std::pair<double, double>> sparse_cells;
+  double entries;
+
+  /**
+   * returns number of cells, including under/overflow on every axis
+   */
+  uint64_t num_cells() const;
+
+  /**
+   * returns index of axis for variable_name, or number of axes if absent
+   */
+  unsigned int axis_index(std::string variable_name) const;
+
+  /**
+   * returns a new 1d projection on axis axis_idx of the cells passing cuts; caller owns histogram
+   */
+  TH1D* project_1d(unsigned int axis_idx, std::vector<NdAxisCut> cuts, std::string name, std::string title) const;
+
+  /**
+   * returns a new 2d projection on axes x_axis_idx, y_axis_idx of the cells passing cuts; caller owns histogram
+   */
+  TH2D* project_2d(unsigned int x_axis_idx, unsigned int y_axis_idx, std::vector<NdAxisCut> cuts, std::string name, std::string title) const;
+
+  /**
+   * returns filled cells as (cell, content, sumw2) triples followed by (-1, entries, 0), used to store results in a ResultCache
+   * lists of histograms with the same binning are merged by concatenation, see ResultCache::store_values
+   */
+  std::vector<double> get_cell_values() const;
+
+  /**
+   * method to set contents from (concatenated) get_cell_values of histograms with the same binning, duplicate cells are added
+   * returns false if the values are not triples of cells in range
+   */
+  bool set_cell_values(std::vector<double> values);
+
+  /**
+   * internal function to loop over filled cells passing cuts, calling fill(bins, content, sumw2)
+   */
+  template <typename F>
+  void for_each_cell(std::vector<NdAxisCut> cuts, F fill) const;
+};
+
+/**
+ * RDataFrame action filling an NdHistogram from an RVec<double> of values (one per axis) and a weight column
+ * use with RInterface::Book<ROOT::RVec<double>, double>
+ */
+class NdHistogramHelper : public ROOT::Detail::RDF::RActionImpl<NdHistogramHelper> {
+  public:
+    using Result_t = NdHistogram;
+
+  private:
+    std::shared_ptr<NdHistogram> result;
+    std::vector<VariableAxis> axes;
+    std::vector<uint64_t> strides;
+    std::vector<std::vector<double>> slot_dense_contents;
+    std::vector<std::vector<double>> slot_dense_sumw2;
+    std::vector<std::unordered_map<uint64_t, std::pair<double, double>>> slot_sparse_cells;
+    std::vector<double> slot_entries;
+
+    /**
+     * internal function returning the bin (0 = underflow, nbins+1 = overflow) of value on axis axis_idx
+     */
+    uint64_t find_bin(unsigned int axis_idx, double value) const;
+
+  public:
+    /**
+     * constructor
+     * i_axes - axes of the histogram, values are given in the same order
+     * num_slots - number of processing slots of the data frame, see RInterface::GetNSlots
+     * max_dense_cells - histograms with more cells are stored sparsely
+     */
+    NdHistogramHelper(std::vector<VariableAxis> i_axes, unsigned int num_slots, uint64_t max_dense_cells=1000000);
+
+    NdHistogramHelper(NdHistogramHelper &&) = default;
+    NdHistogramHelper(const NdHistogramHelper &) = delete;
+
+    /**
+     * methods required by RDataFrame for custom actions
+     */
+    std::shared_ptr<NdHistogram> GetResultPtr() const;
+    void Initialize();
+    void InitTask(TTreeReader *, unsigned int);
+    void Exec(unsigned int slot, const ROOT::RVec<double> &values, double weight);
+    void Finalize();
+    std::string GetActionName();
+};
+
+#endif
@@ -0,0 +1,113 @@
+#ifndef H_ND_HISTOGRAM_COLLECTION
+#define H_ND_HISTOGRAM_COLLECTION
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ROOT/RResultPtr.hxx"
+
+#include "core/sample_wrapper.hxx"
+#include "core/variable_axis.hxx"
+#include "core/region_collection.hxx"
+#include "core/plot_collection.hxx"
+#include "core/output_sink.hxx"
+#include "core/result_cache.hxx"
+#include "core/nd_histogram.hxx"
+
+/**
+ * class to hold a collection of booked n-dimensional histograms
+ * 1d/2d projections and slices are derived from the filled histograms, so new plots in the booked space
+ * do not require another event loop
+ */
+class NdHistogramCollection {
+  private:
+    std::vector<VariableAxis> axes;
+    std::vector<std::vector<ROOT::RDF::RResultPtr<NdHistogram>>> nd_histograms;
+    std::vector<std::vector<std::shared_ptr<NdHistogram>>> loaded_nd_histograms;
+    std::shared_ptr<NdHistogram> empty_nd_histogram;
+    std::vector<SampleWrapper*> samples;
+    RegionCollection* regions;
+    OutputSink* output_sink;
+    OutputSink* default_output_sink;
+    ResultCache* result_cache;
+    std::vector<std::vector<std::string>> result_keys;
+    std::vector<std::vector<bool>> results_stored;
+
+    /**
+     * internal function returning number of regions (1 if there is no RegionCollection)
+     */
+    unsigned int num_regions();
+
+    /**
+     * internal function returning the (booked or loaded) n-dimensional histogram for a sample and region
+     * booked histograms are stored in the result cache once realized
+     */
+    const NdHistogram& get_nd_histogram(unsigned int sample_idx, unsigned int region_idx);
+
+    /**
+     * internal function returning index of axis for variable_name, or number of axes if absent
+     */
+    unsigned int axis_index(std::string variable_name);
+
+    /**
+     * internal function returning formatted description of slice cuts, used in histogram titles
+     */
+    std::string cuts_description(std::vector<NdAxisCut> cuts);
+
+    /**
+     * internal function returning the common part of projection titles for a sample and region
+     */
+    std::string selection_description(unsigned int sample_idx, unsigned int region_idx, std::vector<NdAxisCut> cuts);
+
+  public:
+    /**
+     * constructor, n-dimensional histograms are indexed [sample][region]
+     * max_dense_cells must match the booked histograms, see NdHistogramHelper
+     */
+    NdHistogramCollection(std::vector<VariableAxis> i_axes, std::vector<std::vector<ROOT::RDF::RResultPtr<NdHistogram>>> i_nd_histograms, std::vector<SampleWrapper*> i_samples, RegionCollection* i_regions, uint64_t max_dense_cells);
+
+    /**
+     * function to use results memoized in a ResultCache; entries of loaded histograms that are not null replace booked results
+     */
+    NdHistogramCollection* set_cached_results(ResultCache* i_result_cache, std::vector<std::vector<std::shared_ptr<NdHistogram>>> i_loaded_nd_histograms, std::vector<std::vector<std::string>> i_result_keys);
+
+    /**
+     * function returning keys under which booked histograms are stored, see set_cached_results
+     */
+    std::vector<std::string> get_result_keys();
+
+    /**
+     * function to realize booked histograms and store them in shard_cache under their keys, used by shard processes
+     * if only_sample is not null, only histograms of that sample are realized and stored
+     */
+    void store_shard_results(ResultCache* shard_cache, SampleWrapper* only_sample=nullptr);
+
+    /**
+     * function to replace booked histograms with the sum of the histograms stored by all shards
+     * entries missing from any shard keep their booked result
+     */
+    void merge_shard_results(std::vector<ResultCache*> shard_caches);
+
+    /**
+     * method to set a shared output file used by all projections
+     */
+    NdHistogramCollection* set_output_sink(OutputSink* i_output_sink);
+
+    /**
+     * method to set the default output file of all projections, see PlotCollection::set_default_output_sink
+     */
+    NdHistogramCollection* set_default_output_sink(OutputSink* i_default_output_sink);
+
+    /**
+     * method returning 1d projections on variable_name, keeping only bins passing cuts on the other axes
+     */
+    PlotCollection* project_1d(std::string variable_name, std::vector<NdAxisCut> cuts={});
+
+    /**
+     * method returning 2d projections on (x_variable_name, y_variable_name), keeping only bins passing cuts on the other axes
+     */
+    PlotCollection* project_2d(std::string x_variable_name, std::string y_variable_name, std::vector<NdAxisCut> cuts={});
+};
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef H_OUTPUT_SINK
+#define H_OUTPUT_SINK
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include "TFile.h"
+#include "TObject.h"
+
+/**
+ * class that holds a single output root file open for the duration of a job
+ * objects are written into a directory hierarchy (ex. region/sample) and the file is
+ * only closed (and its key list written) once at the end, optionally from a background thread
+ * the file is opened on the first write, so a sink that is never written to creates no file
+ */
+class OutputSink {
+  private:
+    std::string filename;
+    std::string file_option;
+    TFile* output_file;
+    bool use_writer_thread;
+    bool is_closed;
+    bool open_failed;
+    bool stop_writer;
+    std::thread writer_thread;
+    std::mutex queue_mutex;
+    std::condition_variable queue_condition;
+    std::deque<std::pair<std::string, TObject*>> write_queue;
+
+    /**
+     * internal function to open the output file, returns false if it cannot be opened
+     */
+    bool open_file();
+
+    /**
+     * internal function to write a single object to a (possibly new) directory and free it
+     */
+    void write_object(std::string directory, TObject* object);
+
+    /**
+     * internal function run by background writer thread
+     */
+    void writer_loop();
+
+  public:
+    /**
+     * constructor
+     * i_filename - name of output root file
+     * option - TFile option, ex. RECREATE or UPDATE
+     * i_use_writer_thread - if true, objects are written from a background thread, ROOT thread safety is then enabled
+     */
+    OutputSink(std::string i_filename="ntuples/output.root", std::string option="RECREATE", bool i_use_writer_thread=false);
+
+    /**
+     * destructor, closes file if not already closed
+     */
+    ~OutputSink();
+
+    OutputSink(const OutputSink&) = delete;
+    OutputSink& operator=(const OutputSink&) = delete;
+
+    /**
+     * method to write an object to the file in directory (ex. "region/sample")
+     * the sink takes ownership of object, so callers should pass a clone
+     */
+    OutputSink* write(TObject* object, std::string directory="");
+
+    /**
+     * method to finish all pending writes and close the file
+     */
+    void close();
+
+    /**
+     * returns name of output file
+     */
+    std::string get_filename();
+};
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef H_PHASE_REPORT
+#define H_PHASE_REPORT
+
+#include <string>
+
+#include "ROOT/RDF/RInterface.hxx"
+
+/**
+ * class recording wall time, peak resident memory, and number of jitted expressions of each phase of a run
+ * phases are startup (process start until enable, including static initialization), graph (building data frames,
+ * the default phase), jit, loop, and merge (timed from RDataFrame log messages; merge is the finalization of
+ * per-slot results after each loop), and phases opened with PhaseScope (ex. draw, save)
+ * times are exclusive: time spent jitting and looping while drawing is not counted as drawing; jit, loop, and merge
+ * times of each event loop are also listed separately
+ * peak memory of a phase is the largest resident memory sampled (every 20 ms) while it ran
+ * all methods are static since phases are properties of the process
+ */
+class PhaseReport {
+  public:
+    /**
+     * method to start recording phases, should be called at the start of main
+     * a summary is printed at exit, and written to json_filename as JSON if it is not empty
+     */
+    static void enable(std::string json_filename="");
+
+    /**
+     * method to stop recording phases: the summary is printed, and the RDataFrame log verbosity and handlers are restored
+     */
+    static void disable();
+
+    /**
+     * returns true if phases are being recorded
+     */
+    static bool is_enabled();
+
+    /**
+     * methods to open a phase (nested in the current one) and close the current phase, see PhaseScope
+     */
+    static void begin(std::string phase_name);
+    static void end();
+
+    /**
+     * method to count jitted expressions (string defines, filters, and actions) declared in the current phase
+     * they are also counted in the next jit phase, when they are compiled
+     */
+    static void add_jitted_expressions(unsigned int num_expressions=1);
+
+    /**
+     * methods applying a string define, redefine, or filter to node and counting it with add_jitted_expressions
+     * every string define and filter should go through them, so that jitted expressions are not undercounted
+     */
+    static ROOT::RDF::RNode jitted_define(ROOT::RDF::RNode node, std::string name, std::string expression);
+    static ROOT::RDF::RNode jitted_redefine(ROOT::RDF::RNode node, std::string name, std::string expression);
+    static ROOT::RDF::RNode jitted_filter(ROOT::RDF::RNode node, std::string expression, std::string filter_name="");
+
+    /**
+     * returns seconds recorded so far in phase phase_name, 0 if phases are not recorded
+     */
+    static double get_seconds(std::string phase_name);
+
+    /**
+     * method to print the summary (and write it to JSON if set)
+     */
+    static void print();
+};
+
+/**
+ * class opening a phase of PhaseReport for the duration of a scope
+ */
+class PhaseScope {
+  public:
+    /**
+     * constructor, opens phase phase_name
+     */
+    PhaseScope(std::string phase_name);
+
+    /**
+     * destructor, closes the phase
+     */
+    ~PhaseScope();
+
+    PhaseScope(const PhaseScope&) = delete;
+    PhaseScope& operator=(const PhaseScope&) = delete;
+};
+
+#endif
@@ -1,17 +1,25 @@
 #ifndef H_PLOT_COLLECTION
 #define H_PLOT_COLLECTION
 
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "TCanvas.h"
+#include "TPad.h"
 #include "TH1.h"
+#include "TGraphAsymmErrors.h"
 #include "ROOT/RResultPtr.hxx"
 #include "ROOT/RDF/InterfaceUtils.hxx"
 
 #include "core/sample_wrapper.hxx"
 #include "core/variable_axis.hxx"
 #include "core/region_collection.hxx"
+#include "core/output_sink.hxx"
+#include "core/histogram_archive.hxx"
+#include "core/result_cache.hxx"
+#include "core/multi_weight_histogram.hxx"
+#include "core/merged_sample_loop.hxx"
 
 /**
  * struct to be used when sorting histograms
@@ -36,6 +44,24 @@ enum class BottomStyle {
   upper_cut_significance,
   lower_cut_significance
 };
+enum class SignificanceStyle {
+  s_over_sqrt_b,
+  asimov
+};
+
+/**
+ * struct holding the optimal threshold found by a cut scan
+ * upper cuts keep events with variable < threshold, lower cuts keep events with variable > threshold
+ */
+struct CutScanResult {
+  std::string variable;
+  std::string region;
+  bool is_upper_cut;
+  double threshold;
+  double significance;
+  double signal_yield;
+  double background_yield;
+};
 
 /**
  * sorting function to sort histograms by integrated area
@@ -64,39 +90,154 @@ class PlotCollection {
     std::vector<std::vector<ROOT::RDF::RResultPtr<TH2D>>> twodim_histograms;
     std::vector<std::vector<ROOT::RDF::RResultPtr<TH1D>>> denominator_histograms;
     std::vector<std::vector<ROOT::RDF::RResultPtr<TH2D>>> twodim_denominator_histograms;
+    std::vector<std::vector<std::shared_ptr<TH1D>>> loaded_histograms;
+    std::vector<std::vector<std::shared_ptr<TH2D>>> loaded_twodim_histograms;
+    std::vector<std::vector<std::shared_ptr<TH1D>>> loaded_denominator_histograms;
+    std::vector<std::vector<std::shared_ptr<TH2D>>> loaded_twodim_denominator_histograms;
+    std::vector<std::vector<ROOT::RDF::RResultPtr<MultiWeightHistogram>>> variation_results;
+    std::vector<std::vector<std::shared_ptr<MultiWeightHistogram>>> loaded_variation_results;
+    std::shared_ptr<MultiWeightHistogram> empty_variation_result;
+    std::vector<std::vector<std::vector<std::shared_ptr<TH1D>>>> variation_histograms;
+    std::vector<std::string> variation_names;
+    std::vector<ROOT::RDF::RResultPtr<SampleHistograms>> merged_results;
+    std::vector<ROOT::RDF::RResultPtr<SampleHistograms>> merged_denominator_results;
+    bool is_loaded;
+    ResultCache* result_cache;
+    std::vector<std::vector<std::string>> result_keys;
+    std::vector<std::vector<std::string>> denominator_result_keys;
+    bool results_stored;
+    std::vector<bool> samples_stored;
     std::vector<SampleWrapper*> samples;
     RegionCollection* regions;
     float luminosity;
     bool x_log, y_log, z_log;
     bool is_2d, is_efficiency;
     bool save_as_root;
+    OutputSink* output_sink;
+    OutputSink* default_output_sink;
     PlotCombineStyle plot_combine_style;
     BottomStyle bottom_style;
+    std::unique_ptr<TCanvas> canvas;
+    std::vector<bool> histograms_normalized;
+    std::string signal_flag;
+    SignificanceStyle significance_style;
+    std::vector<CutScanResult> optimal_cuts;
+
+    /**
+     * internal function to set the axis, regions, and default options shared by all constructors
+     */
+    void init(VariableAxis axis, RegionCollection* i_regions);
+
+    /**
+     * internal functions returning the (booked or loaded) histogram for a sample and region
+     * histograms are loaded per entry, so collections may mix cached and booked results
+     */
+    TH1D* get_histogram(unsigned int sample_idx, unsigned int region_idx);
+    TH1D* get_denominator_histogram(unsigned int sample_idx, unsigned int region_idx);
+    TH2D* get_twodim_histogram(unsigned int sample_idx, unsigned int region_idx);
+    TH2D* get_twodim_denominator_histogram(unsigned int sample_idx, unsigned int region_idx);
+
+    /**
+     * internal function returning the (booked or loaded) multi-weight result for a sample and region
+     */
+    const MultiWeightHistogram& get_variation_result(unsigned int sample_idx, unsigned int region_idx);
+
+    /**
+     * internal function to build (unscaled) per-variation histograms of a sample and region from a multi-weight result
+     */
+    void realize_variations(unsigned int sample_idx, unsigned int region_idx);
+
+    /**
+     * internal function to scale the non-nominal variations of a sample and region, the nominal is scaled as a regular histogram
+     */
+    void scale_variations(unsigned int sample_idx, unsigned int region_idx, double scale);
+
+    /**
+     * internal function to store realized results that were not loaded from the result cache
+     * must be called before histograms are scaled in place; if only_sample is not null, only its results are stored
+     */
+    void store_cached_results(SampleWrapper* only_sample=nullptr);
+
+    /**
+     * internal function returning number of regions (1 if there is no RegionCollection)
+     */
+    unsigned int num_regions();
+
+    /**
+     * internal function returning true if any histograms are booked or loaded
+     */
+    bool is_booked();
+
+    /**
+     * internal function returning name used for this collection in archives
+     */
+    std::string archive_variable_name();
+
+    /**
+     * internal function returning name used for a region in archives and output files
+     */
+    std::string archive_region_name(unsigned int region_idx);
+
+    /**
+     * internal function to scale MC histograms in place by their sample scale weight
+     * if only_sample is not null, only its histograms are realized and scaled
+     */
+    void normalize_histograms(SampleWrapper* only_sample=nullptr);
+
+    /**
+     * internal function returning the canvas shared by all draws of this collection
+     */
+    TCanvas* get_canvas();
     
     /**
-     * function to draw a histogram for a single region
+     * function to draw a histogram for a single region, drawn objects are also written to sink unless it is nullptr
      */
-    void draw_histogram_single_region(unsigned int region_idx);
+    void draw_histogram_single_region(unsigned int region_idx, OutputSink* sink);
 
     /**
-     * function to draw an efficiency plot for a single region
+     * function to draw an efficiency plot for a single region, drawn objects are also written to sink unless it is nullptr
      */
-    void draw_efficiency_plot_single_region(unsigned int region_idx);
+    void draw_efficiency_plot_single_region(unsigned int region_idx, OutputSink* sink);
 
     /**
-     * function to draw a 2d histogram for a single region
+     * function to draw a 2d histogram for a single region, drawn objects are also written to sink unless it is nullptr
      */
-    void draw_2d_histogram_single_region(unsigned int region_idx);
+    void draw_2d_histogram_single_region(unsigned int region_idx, OutputSink* sink);
 
     /**
-     * function to draw a 2d efficiency plot for a single region
+     * function to draw a 2d efficiency plot for a single region, drawn objects are also written to sink unless it is nullptr
      */
-    void draw_2d_efficiency_plot_single_region(unsigned int region_idx);
+    void draw_2d_efficiency_plot_single_region(unsigned int region_idx, OutputSink* sink);
 
     /**
-     * internal function for plotting several plots together for a single region
+     * internal function for plotting several plots together for a single region, histograms are also written to sink
+     * unless it is nullptr
      */
-    void draw_together_single_region(bool sort_histograms, bool is_region, unsigned int region_idx);
+    void draw_together_single_region(bool sort_histograms, bool is_region, unsigned int region_idx, OutputSink* sink);
+
+    /**
+     * internal function returning a histogram of cut significance vs threshold for a single region, computed with
+     * prefix (upper cut) or suffix (lower cut) sums over the signal and background histograms; caller owns histogram
+     * the optimal cut is recorded in optimal_cuts and written to plots/<name>_cut_scan[_<region>].json
+     */
+    TH1D* make_cut_significance(bool is_region, unsigned int region_idx);
+
+    /**
+     * internal function to draw cut significance in the bottom pad, returns the drawn histogram
+     */
+    TH1D* draw_cut_significance(TPad* bottom_pad, bool is_region, unsigned int region_idx);
+
+    /**
+     * internal function returning the output file set by set_output_sink, or else the default one
+     * prints an error and returns nullptr if saving root files is requested without any output file
+     * draw functions look it up once and pass clones to it, which the sink frees once written
+     */
+    OutputSink* get_output_sink();
+
+    /**
+     * internal function returning directory (region/sample) in output file for a given plot
+     */
+    std::string output_directory(unsigned int sample_idx, unsigned int region_idx);
   
   public:
     /**
@@ -118,6 +259,96 @@ class PlotCollection {
      */
     PlotCollection(VariableAxis x_axis, VariableAxis y_axis, std::vector<std::vector<ROOT::RDF::RResultPtr<TH2D>>> i_twodim_histograms, std::vector<std::vector<ROOT::RDF::RResultPtr<TH2D>>> i_twodim_denominator_histograms, std::vector<SampleWrapper*> i_samples, std::string numerator_description, RegionCollection* i_regions);
     
+    /**
+     * constructor to generate collection of 1d histograms with weight variations from multi-weight results
+     * variation 0 is the nominal histogram used by draw_together/draw_separate
+     */
+    PlotCollection(VariableAxis axis, std::vector<std::vector<ROOT::RDF::RResultPtr<MultiWeightHistogram>>> i_variation_results, std::vector<std::string> i_variation_names, std::vector<SampleWrapper*> i_samples, RegionCollection* i_regions);
+
+    /**
+     * constructor to generate collection from already realized 1d histograms (ex. projections), indexed [sample][region]
+     * histograms are not yet normalized, i.e. they are scaled like booked histograms when drawn
+     */
+    PlotCollection(VariableAxis axis, std::vector<std::vector<std::shared_ptr<TH1D>>> i_histograms, std::vector<SampleWrapper*> i_samples, RegionCollection* i_regions);
+
+    /**
+     * constructor to generate collection from already realized 2d histograms (ex. projections), indexed [sample][region]
+     */
+    PlotCollection(VariableAxis x_axis, VariableAxis y_axis, std::vector<std::vector<std::shared_ptr<TH2D>>> i_twodim_histograms, std::vector<SampleWrapper*> i_samples, RegionCollection* i_regions);
+
+    /**
+     * constructor to rebuild a 1d histogram or efficiency collection from an archive written by save_archive
+     * no input data is read; samples are only used for names and styles
+     */
+    PlotCollection(HistogramArchive* archive, VariableAxis axis, std::vector<SampleWrapper*> i_samples, RegionCollection* i_regions);
+
+    /**
+     * constructor to rebuild a 2d histogram or efficiency collection from an archive written by save_archive
+     */
+    PlotCollection(HistogramArchive* archive, VariableAxis x_axis, VariableAxis y_axis, std::vector<SampleWrapper*> i_samples, RegionCollection* i_regions);
+
+    /**
+     * function to use results memoized in a ResultCache; entries of loaded histograms that are not null replace booked results
+     * results that were booked are stored under their key once realized, before any scaling is applied
+     */
+    PlotCollection* set_cached_results(ResultCache* i_result_cache, std::vector<std::vector<std::shared_ptr<TH1D>>> i_loaded_histograms, std::vector<std::vector<std::shared_ptr<TH1D>>> i_loaded_denominator_histograms, std::vector<std::vector<std::string>> i_result_keys, std::vector<std::vector<std::string>> i_denominator_result_keys);
+    PlotCollection* set_cached_results(ResultCache* i_result_cache, std::vector<std::vector<std::shared_ptr<TH2D>>> i_loaded_histograms, std::vector<std::vector<std::shared_ptr<TH2D>>> i_loaded_denominator_histograms, std::vector<std::vector<std::string>> i_result_keys, std::vector<std::vector<std::string>> i_denominator_result_keys);
+    PlotCollection* set_cached_results(ResultCache* i_result_cache, std::vector<std::vector<std::shared_ptr<MultiWeightHistogram>>> i_loaded_variation_results, std::vector<std::vector<std::string>> i_result_keys);
+
+    /**
+     * function to use per-sample histograms filled by a merged event loop, indexed by region, see MergedSampleLoop
+     * samples loaded from the result cache keep their loaded histograms
+     */
+    PlotCollection* set_merged_results(std::vector<ROOT::RDF::RResultPtr<SampleHistograms>> i_merged_results, std::vector<ROOT::RDF::RResultPtr<SampleHistograms>> i_merged_denominator_results={});
+
+    /**
+     * function returning keys under which booked histograms (and denominators) are stored, see set_cached_results
+     */
+    std::vector<std::string> get_result_keys();
+
+    /**
+     * function to realize booked histograms and store them in shard_cache under their keys, used by shard processes
+     * histograms loaded from the result cache are not stored, so they are not counted once per shard
+     * if only_sample is not null, only histograms of that sample are realized and stored
+     */
+    void store_shard_results(ResultCache* shard_cache, SampleWrapper* only_sample=nullptr);
+
+    /**
+     * function to replace booked histograms with the sum of the histograms stored by all shards
+     * entries missing from any shard keep their booked result
+     */
+    void merge_shard_results(std::vector<ResultCache*> shard_caches);
+
+    /**
+     * function returning names of weight variations, empty if collection was not booked with variations
+     */
+    std::vector<std::string> get_variation_names();
+
+    /**
+     * function returning (normalized) histogram of a weight variation; histogram is owned by the collection
+     */
+    TH1D* get_variation_histogram(unsigned int sample_idx, unsigned int region_idx, unsigned int variation_idx);
+
+    /**
+     * function returning band around the nominal histogram spanning the minimum and maximum of all variations in each bin
+     * caller owns graph
+     */
+    TGraphAsymmErrors* get_envelope(unsigned int sample_idx, unsigned int region_idx);
+
+    /**
+     * function returning band around the nominal histogram with the standard deviation of the variations in each bin,
+     * ex. the statistical uncertainty estimated by bootstrap replicas (see SampleCollection::book_1d_histogram_bootstrap)
+     * caller owns graph
+     */
+    TGraphAsymmErrors* get_replica_band(unsigned int sample_idx, unsigned int region_idx);
+
+    /**
+     * function to write realized (normalized) histograms to an archive, keyed by (variable, sample, region, kind)
+     * if only_sample is not null, only its histograms are written, ex. as soon as its event loop has finished (see
+     * SampleCollection::for_each_finished_sample) without waiting for the other samples
+     */
+    void save_archive(HistogramArchiveWriter* archive_writer, SampleWrapper* only_sample=nullptr);
+
     /**
      * function to set luminosity
      * FIXME: does this need to be modified?
@@ -128,6 +359,18 @@ class PlotCollection {
      * function to save root file
      */
     PlotCollection* set_save_root_file(bool i_set_save_root_file);
+
+    /**
+     * function to set a shared output file; implies set_save_root_file(true)
+     * the sink is not owned by the PlotCollection and should be closed by the caller
+     */
+    PlotCollection* set_output_sink(OutputSink* i_output_sink);
+
+    /**
+     * function to set the output file used by set_save_root_file(true) if no sink is set by set_output_sink
+     * set by SampleCollection to its default file (ntuples/output.root), shared by all its plots
+     */
+    PlotCollection* set_default_output_sink(OutputSink* i_default_output_sink);
     
     /**
      * function to set log options
@@ -148,6 +391,17 @@ class PlotCollection {
      * function to set bottom style option
      */
     PlotCollection* set_bottom_style(BottomStyle i_bottom_style);
+
+    /**
+     * function to set options for cut significance bottom styles
+     * samples with flag i_signal_flag are signal, all other non-data samples are background
+     */
+    PlotCollection* set_cut_significance(std::string i_signal_flag="signal", SignificanceStyle i_significance_style=SignificanceStyle::s_over_sqrt_b);
+
+    /**
+     * function returning optimal cuts found by cut significance bottom panels in previous draws
+     */
+    std::vector<CutScanResult> get_optimal_cuts();
     
     /**
      * function to draw several 1d plots together (stacked/overlayed)
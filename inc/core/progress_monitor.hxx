@@ -0,0 +1,96 @@
+#ifndef H_PROGRESS_MONITOR
+#define H_PROGRESS_MONITOR
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Rtypes.h"
+
+/**
+ * class printing periodic progress records of running event loops: entries processed per sample, entries/s,
+ * MB/s read from ROOT files, files completed, an ETA, and thread utilization (process CPU time / wall time / threads)
+ * event loops update lock-free per-slot counters, which a background thread reads every interval_seconds; a
+ * record is only emitted when entries were processed since the previous one
+ */
+class ProgressMonitor {
+  private:
+    /**
+     * entries processed by one slot, on its own cache line so that slots do not contend
+     */
+    struct alignas(64) SlotCounter {
+      std::atomic<ULong64_t> entries;
+    };
+
+    std::vector<std::string> sample_names;
+    std::vector<std::vector<ULong64_t>> file_entries;
+    std::vector<std::unique_ptr<SlotCounter[]>> slot_counters;
+    std::vector<unsigned int> num_sample_slots;
+    unsigned int num_threads;
+    double interval_seconds;
+    std::ofstream json_file;
+    std::thread report_thread;
+    std::mutex report_mutex;
+    std::condition_variable stop_condition;
+    bool stop_requested;
+    std::chrono::steady_clock::time_point start_time;
+    std::chrono::steady_clock::time_point last_report_time;
+    ULong64_t last_entries;
+    long long last_bytes_read;
+    double last_cpu_seconds;
+
+    /**
+     * internal function returning entries processed so far by sample sample_idx
+     */
+    ULong64_t get_sample_entries(unsigned int sample_idx);
+
+    /**
+     * internal function run by the background thread
+     */
+    void run();
+
+  public:
+    /**
+     * constructor
+     * i_interval_seconds - time between progress records
+     * json_filename - if not empty, records are also appended to this file as JSON lines
+     */
+    ProgressMonitor(double i_interval_seconds=10., std::string json_filename="");
+
+    /**
+     * destructor, emits a last record and stops the background thread
+     */
+    ~ProgressMonitor();
+
+    ProgressMonitor(const ProgressMonitor&) = delete;
+    ProgressMonitor& operator=(const ProgressMonitor&) = delete;
+
+    /**
+     * method to register a sample processed by num_slots slots with i_file_entries entries per input file
+     * returns index of the sample, used to update its counters; should be called before start
+     */
+    unsigned int add_sample(std::string sample_name, std::vector<ULong64_t> i_file_entries, unsigned int num_slots);
+
+    /**
+     * method to set entries processed so far by slot of sample sample_idx, safe to call from event loop threads
+     */
+    void set_slot_entries(unsigned int sample_idx, unsigned int slot, ULong64_t entries);
+
+    /**
+     * method to start the background thread emitting records
+     */
+    void start();
+
+    /**
+     * method to emit one progress record to the terminal (and JSON file) if entries were processed since the last one
+     */
+    void report();
+};
+
+#endif
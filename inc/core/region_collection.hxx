@@ -46,6 +46,11 @@ class RegionCollection {
      */
     unsigned int size();
     
+    /**
+     * returns new collection holding the first num_regions regions (including flag cuts), caller owns it
+     */
+    RegionCollection* get_first_regions(unsigned int num_regions);
+
     /**
      * get the cuts for an appropriate flag type in an appropriate region
      */
@@ -0,0 +1,93 @@
+#ifndef H_RESULT_CACHE
+#define H_RESULT_CACHE
+
+#include <string>
+#include <vector>
+
+#include "TH1.h"
+#include "TH2.h"
+
+/**
+ * class to memoize realized results (histograms, sums, cutflow yields) on disk
+ * results are keyed by a hash of the computation graph that produced them: input files with size/mtime,
+ * defines and filters, and the booked action, so reruns with unchanged inputs skip the event loop
+ */
+class ResultCache {
+  private:
+    std::string cache_directory;
+    bool verbose;
+
+    /**
+     * internal function returning path of cache file for a key
+     */
+    std::string key_filename(std::string key);
+
+    /**
+     * internal function to load values stored under key with archive kind kind, returns false on a cache miss
+     */
+    bool load_values(std::string key, std::string kind, std::vector<double> &values);
+
+  public:
+    /**
+     * constructor
+     * i_cache_directory - local directory in which results are stored, created if it does not exist
+     */
+    ResultCache(std::string i_cache_directory="cache", bool i_verbose=false);
+
+    /**
+     * returns hexadecimal 64-bit hash of text, used to build cache keys
+     */
+    static std::string hash(std::string text);
+
+    /**
+     * returns canonical description of input files matching filename_pattern, including size and modification time
+     */
+    static std::string file_identity(std::string filename_pattern);
+
+    /**
+     * returns description of the running executable (size and modification time), used as identity of compiled functions
+     */
+    static std::string executable_identity();
+
+    /**
+     * methods returning a new histogram for key, or nullptr on a cache miss; caller owns histogram
+     */
+    TH1D* load_1d_histogram(std::string key);
+    TH2D* load_2d_histogram(std::string key);
+
+    /**
+     * method to load a list of values for key, returns false on a cache miss
+     */
+    bool load_values(std::string key, std::vector<double> &values);
+
+    /**
+     * methods to store realized results under key
+     * values stored with concatenate set are merged by accumulate as a longer list instead of elementwise
+     */
+    void store(std::string key, TH1D* histogram);
+    void store(std::string key, TH2D* histogram);
+    void store_values(std::string key, std::vector<double> values, bool concatenate=false);
+
+    /**
+     * returns keys of all results stored in the cache directory
+     */
+    std::vector<std::string> list_keys();
+
+    /**
+     * returns path of the file holding the result stored under key
+     */
+    std::string get_filename(std::string key);
+
+    /**
+     * method to remove all results stored in the cache directory
+     */
+    void clear();
+
+    /**
+     * method to add the result stored under key in source to the result stored under key here, or copy it if absent
+     * used to merge partial results (ex. from shards or work units); values are added elementwise or concatenated
+     */
+    void accumulate(std::string key, ResultCache* source);
+};
+
+#endif
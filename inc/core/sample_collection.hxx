@@ -1,9 +1,18 @@
 #ifndef H_SAMPLE_COLLECTION
 #define H_SAMPLE_COLLECTION
 
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string_view>
 #include <string>
+#include <thread>
+#include <typeinfo>
 #include <vector>
 
 #include "ROOT/RDF/RInterface.hxx"
@@ -14,6 +23,16 @@
 #include "core/region_collection.hxx"
 #include "core/plot_collection.hxx"
 #include "core/table_collection.hxx"
+#include "core/output_sink.hxx"
+#include "core/result_cache.hxx"
+#include "core/multi_weight_histogram.hxx"
+#include "core/nd_histogram_collection.hxx"
+#include "core/bounded_histogram.hxx"
+#include "core/cut_mask.hxx"
+#include "core/work_distribution.hxx"
+#include "core/merged_sample_loop.hxx"
+#include "core/progress_monitor.hxx"
+#include "core/compiled_expression_cache.hxx"
 //#include "core/column_definition.hxx"
 
 //class to hold a collection of samples which can be used to make histograms, tables, etc.
@@ -21,21 +40,129 @@
 class SampleCollection {
   private:
     std::vector<SampleWrapper*> samples;
+    OutputSink* output_sink;
+    std::unique_ptr<OutputSink> default_output_sink;
+    ResultCache* result_cache;
+    CompiledExpressionCache* expression_cache;
+    HistogramStorage histogram_storage;
+    BinPrecision bin_precision;
+    unsigned long bounded_min_cells;
+    double histogram_memory_limit;
+    std::map<std::string, unsigned long> projected_histogram_bytes;
+    std::vector<PlotCollection*> booked_plots;
+    std::vector<TableCollection*> booked_tables;
+    std::vector<NdHistogramCollection*> booked_nd_histograms;
+    std::vector<std::unique_ptr<RegionCollection>> truncated_regions;
+    std::unique_ptr<MergedSampleLoop> merged_loop;
+    std::string checkpoint_directory;
+    unsigned int checkpoint_seconds;
+    std::unique_ptr<ProgressMonitor> progress_monitor;
+    std::vector<ROOT::RDF::RResultPtr<ULong64_t>> progress_counts;
+    std::chrono::steady_clock::time_point sampled_run_start;
+    long long sampled_run_start_bytes;
+    double sampled_run_start_loop_seconds;
+    std::vector<std::thread> loop_threads;
+    std::vector<std::shared_future<void>> sample_loops;
+    std::vector<unsigned int> started_booked_results;
+    std::vector<unsigned int> finished_samples;
+    std::mutex finished_mutex;
+    std::condition_variable finished_condition;
 
     ROOT::RDF::TH1DModel get_1d_histogram_model(VariableAxis axis, unsigned int sample_idx, RegionCollection* regions=nullptr, unsigned int region_idx=0);
     ROOT::RDF::TH2DModel get_2d_histogram_model(VariableAxis x_axis, VariableAxis y_axis, unsigned int sample_idx, RegionCollection* regions=nullptr, unsigned int region_idx=0);
+
+    /**
+     * internal function returning data frame of a sample filtered to a region (unfiltered if regions is nullptr)
+     */
+    ROOT::RDF::RNode get_region_data_frame(unsigned int sample_idx, RegionCollection* regions, unsigned int region_idx);
+
+    /**
+     * internal function to set the output files of a booked plot collection: the sink set by set_output_sink if
+     * any, and the default output file used by set_save_root_file(true) otherwise
+     */
+    void set_plot_output(PlotCollection* plot_collection);
+
+    /**
+     * internal function returning canonical description of an axis (name, labels, and binning) for cache keys
+     */
+    std::string axis_description(VariableAxis axis);
+
+    /**
+     * internal function returning cache key of a result booked on a sample in a region
+     */
+    std::string get_result_key(unsigned int sample_idx, RegionCollection* regions, unsigned int region_idx, std::string action_description);
+
+    /**
+     * internal functions to book a (weighted, if the sample is weighted) histogram on a data frame
+     */
+    ROOT::RDF::RResultPtr<TH1D> book_1d_result(ROOT::RDF::RNode data_frame, ROOT::RDF::TH1DModel model, VariableAxis axis, unsigned int sample_idx);
+    ROOT::RDF::RResultPtr<TH2D> book_2d_result(ROOT::RDF::RNode data_frame, ROOT::RDF::TH2DModel model, VariableAxis x_axis, VariableAxis y_axis, unsigned int sample_idx);
+
+    /**
+     * internal function to add projected memory of a booked histogram under category (ex. storage mode)
+     * warns once the total exceeds the memory limit
+     */
+    void add_projected_memory(std::string category, unsigned long bytes);
+
+    /**
+     * internal function returning hash of the graphs, bookings, and work units of all samples, used to name checkpoints
+     */
+    std::string get_checkpoint_hash(std::vector<WorkUnit> units);
+
+    /**
+     * internal function returning indices of samples with any of flags, or of all samples if flags is empty
+     */
+    std::vector<unsigned int> get_flagged_samples(std::vector<std::string> flags);
+
+    /**
+     * internal functions to book per-sample histograms of each region in the merged event loop, see MergedSampleLoop
+     * samples with cached histograms are skipped; if numerator_cut is not empty, it is applied to all samples
+     */
+    std::vector<ROOT::RDF::RResultPtr<SampleHistograms>> book_merged_1d_results(VariableAxis axis, RegionCollection* regions, std::vector<std::vector<std::shared_ptr<TH1D>>> cached_histograms, std::string numerator_cut="");
+    std::vector<ROOT::RDF::RResultPtr<SampleHistograms>> book_merged_2d_results(VariableAxis x_axis, VariableAxis y_axis, RegionCollection* regions, std::vector<std::vector<std::shared_ptr<TH2D>>> cached_histograms, std::string numerator_cut="");
+
+    /**
+     * internal function to book multi-weight histograms given a jitted expression for the RVec of weights of each sample
+     */
+    PlotCollection* book_1d_multi_weight_histogram(VariableAxis axis, std::vector<std::string> weights_expressions, std::vector<std::string> variation_names, RegionCollection* regions);
+
+    /**
+     * internal function to book multi-weight histograms given a function defining the RVec of weights of each sample
+     * as a column (second argument) of a data frame; weights_descriptions identify the definitions in result cache keys
+     */
+    PlotCollection* book_1d_multi_weight_histogram(VariableAxis axis, std::vector<std::function<ROOT::RDF::RNode(ROOT::RDF::RNode, std::string)>> weights_definitions, std::vector<std::string> weights_descriptions, std::vector<std::string> variation_names, RegionCollection* regions);
   
   public:
     /**
      * default constructor
      */
     SampleCollection();
+
+    /**
+     * destructor, waits for event loops started by start_event_loops
+     */
+    ~SampleCollection();
+
+    SampleCollection(const SampleCollection&) = delete;
+    SampleCollection& operator=(const SampleCollection&) = delete;
     
     /**
      * method to add a sample to the collection
      */
     SampleCollection* add(SampleWrapper* sample);
     
+    /**
+     * method to process all samples in a single event loop over their chained files, see MergedSampleLoop
+     * defines and filters are then built once, with flag-specific ones resolved by a sample_idx column, and
+     * 1d/2d histograms, efficiencies, and cutflow yields are filled per sample by single actions
+     * should be called after adding samples and before weights, defines, filters, and booking; all samples must be
+     * read from trees named tree_name with the same branches (names and types, compared on the first file of each
+     * sample or its dataset manifest), otherwise an error is printed and samples are processed separately.
+     * Other bookings (ex. variations) use per-sample filters of the merged loop.
+     * Not supported with normalize_at_fill, adaptive filter order, sharding, or work distribution
+     */
+    SampleCollection* set_merged_event_loop(const char* tree_name="tree");
+
     /**
      * method to define data frame columns, see RInterface::Define
      * flags argument can be used to only define colums for certain samples
@@ -62,6 +189,13 @@ class SampleCollection {
      */
     SampleCollection* filter(std::string expression, std::string filter_description="", std::vector<std::string> flags={});
 
+    /**
+     * method to run subsequent filters in the order minimizing expected cost per event, see SampleWrapper::set_adaptive_filter_order
+     * flags argument can be used to only reorder filters of certain samples
+     */
+    SampleCollection* set_adaptive_filter_order(unsigned int warmup_events=10000, unsigned int cutflow_period=100,
+                                                std::vector<std::string> flags={});
+
     /**
      * method to set luminosity
      */
@@ -73,12 +207,214 @@ class SampleCollection {
      * full_weight_column_name is the name of the column to use when weighting event; if unspecified, lumi_weight_column_name will be used
      */
     SampleCollection* set_weight_branches(std::string lumi_weight_column_name, std::string full_weight_column_name="", std::vector<std::string> flags={});
+
+    /**
+     * method to read sum of lumi weights from a small metadata tree (ex. NanoAOD Runs/genEventSumw) for normalize_at_fill
+     */
+    SampleCollection* set_sum_of_weights_from_tree(std::string metadata_tree_name="Runs", std::string sum_of_weights_column="genEventSumw", std::vector<std::string> flags={});
+
+    /**
+     * method to fold cross section * luminosity / sum of weights into the weights of MC samples so that histograms
+     * and tables booked afterwards need no rescaling. Should be called after set_luminosity and set_weight_branches
+     * and before any filters. Samples without a sum of weights from set_sum_of_weights_from_tree (or the result
+     * cache) run an extra event loop to compute it, see SampleWrapper::normalize_at_fill
+     */
+    SampleCollection* normalize_at_fill(std::vector<std::string> flags={});
+
+    /**
+     * method to set a single output file shared by all subsequently booked plots
+     * the sink is not owned by the SampleCollection and should be closed by the caller once drawing is done
+     * without it, plots saved with PlotCollection::set_save_root_file share one default file (ntuples/output.root),
+     * opened on the first save and closed when the SampleCollection is deleted
+     */
+    SampleCollection* set_output_sink(OutputSink* i_output_sink);
+
+    /**
+     * method to read columns of all samples from memory-mapped column caches of their input files, see
+     * SampleWrapper::use_column_cache. Must be called before set_weight_branches, define, and filter
+     */
+    SampleCollection* use_column_cache(std::vector<std::string> columns, std::string cache_directory="column_cache", bool compress=false);
+
+    /**
+     * method to build the chains of input files of all samples from dataset manifests stored in manifest_directory,
+     * so startup reads one small file per sample instead of opening every input file, see SampleWrapper::use_dataset_manifest
+     * should be called after adding samples and before weights, defines, and filters
+     */
+    SampleCollection* use_dataset_manifest(std::string manifest_directory="manifest_cache", unsigned int num_threads=0);
+
+    /**
+     * method to materialize columns of all samples defined afterwards with compiled functions as friend trees of
+     * their input files, reused by later runs of any executable, see SampleWrapper::cache_defined_columns
+     * should be called after adding samples and before define; cached columns must be defined before weights and filters
+     */
+    SampleCollection* cache_defined_columns(std::vector<std::string> columns, std::string version="", std::string cache_directory="friend_cache");
+
+    /**
+     * method to print progress of event loops every interval_seconds, see ProgressMonitor
+     * if json_filename is not empty, records are also appended to it as JSON lines. Counters of each slot are
+     * updated every update_entries entries; only the first event loop of each sample is followed
+     * should be called after adding samples and before the event loops run
+     */
+    SampleCollection* set_progress_monitor(double interval_seconds=10., std::string json_filename="", ULong64_t update_entries=1000);
+
+    /**
+     * method to process only about fraction of the entries of each sample for quick looks, see
+     * SampleWrapper::set_sampled_fraction; yields, cutflows, and histograms are extrapolated to all entries
+     * should be called after adding samples and before weights, filters, and booking
+     */
+    SampleCollection* set_sampled_fraction(double fraction);
+
+    /**
+     * method to print the fraction of entries processed by each sample, the resulting increase of statistical
+     * uncertainties, and wall time and bytes read so far extrapolated to a run over all entries
+     * should be called after the event loops have run; only time processing entries is extrapolated, which is
+     * measured with PhaseReport if it is enabled, otherwise all time is extrapolated as an upper bound
+     */
+    void print_sampled_run_report();
+
+    /**
+     * method to start the event loops of all samples on background threads, at most num_concurrent at a time (all if 0),
+     * so that results of finished samples can be used while the others are still processed
+     * should be called after booking; loops are only run for samples with results booked since the last call (see
+     * SampleWrapper::get_num_booked_results), so samples whose results were all loaded from a ResultCache finish at
+     * once; calling it again waits for the previous loops and starts loops for results booked since
+     * merged event loops are not supported since they process all samples together
+     */
+    SampleCollection* start_event_loops(unsigned int num_concurrent=0);
+
+    /**
+     * returns future that is ready once the event loop of sample sample_idx has finished (and holds its exception, if
+     * it failed); starts the event loops if needed
+     */
+    std::shared_future<void> get_sample_future(unsigned int sample_idx);
+
+    /**
+     * method calling callback(sample_idx) on the calling thread for each sample as soon as its event loop has finished,
+     * in order of completion, ex. to draw or archive its results (see PlotCollection::save_archive and
+     * TableCollection::save_archive) while the remaining samples are processed; results of samples that are still
+     * running may be read in callbacks but wait for their loop (see SampleWrapper::wait_for_event_loop)
+     * starts the event loops if needed and returns once all samples are done
+     */
+    SampleCollection* for_each_finished_sample(std::function<void(unsigned int)> callback);
+
+    /**
+     * method to memoize realized results of all samples in a ResultCache
+     * results are keyed by a hash of input files, defines, filters, and booked action, so unchanged plots,
+     * tables, and yields are loaded instead of rerunning the event loop
+     * should be called before set_weight_branches, filters, and booking for their results to be cached
+     */
+    SampleCollection* set_result_cache(ResultCache* i_result_cache);
+
+    /**
+     * method to book string defines, filters, region cuts, and untyped histograms of all samples with compiled code
+     * from a CompiledExpressionCache, expressions missing from the cache are jitted, and compiled for later runs by
+     * CompiledExpressionCache::compile
+     * should be called before define, filter, and booking
+     */
+    SampleCollection* set_expression_cache(CompiledExpressionCache* i_expression_cache);
+
+    /**
+     * method to set how subsequently booked 1d/2d histograms with at least min_cells bins (including under/overflow)
+     * are stored while filling, see HistogramStorage; smaller histograms keep the default per-slot copies
+     * integer_counts precision is only used for unweighted samples, weighted samples fall back to double precision
+     */
+    SampleCollection* set_histogram_storage(HistogramStorage i_histogram_storage, BinPrecision i_bin_precision=BinPrecision::double_precision, unsigned long min_cells=0);
+
+    /**
+     * method to set a limit (in MB) on projected histogram memory, a warning is printed when a booking exceeds it
+     */
+    SampleCollection* set_histogram_memory_limit(double limit_mb);
+
+    /**
+     * method to print projected histogram memory of all bookings so far, by storage mode
+     */
+    SampleCollection* print_histogram_memory();
+
+    /**
+     * returns projected histogram memory of all bookings so far in MB
+     */
+    double get_projected_histogram_memory();
     
+    /**
+     * method to run the event loops of all samples in num_shards forked local processes and merge their results
+     * should be called after booking and before drawing or printing; each shard processes a contiguous range of
+     * entries of every sample and stores its 1d/2d histograms, sums of weights, and cutflow reports under
+     * shard_directory, which are then summed into the collections already returned by the book_* methods
+     * for separately launched batch jobs, set the environment variable SHARD_INDEX to run only that shard and exit,
+     * then rerun with SHARD_MERGE_ONLY set to merge. Implicit multithreading should not be enabled when forking.
+     * Results of other actions (ex. variations, n-dimensional histograms) are computed by the merging process
+     */
+    SampleCollection* run_shards(unsigned int num_shards, std::string shard_directory="shards");
+
+    /**
+     * method to run the event loops of shard shard_idx of num_shards and store its results under shard_directory
+     */
+    void run_shard(unsigned int shard_idx, unsigned int num_shards, std::string shard_directory="shards");
+
+    /**
+     * method to replace booked results with the sum of the results stored by num_shards shards under shard_directory
+     */
+    SampleCollection* merge_shards(unsigned int num_shards, std::string shard_directory="shards");
+
+    /**
+     * method to run the event loops of all samples as work units (ranges of about entries_per_unit entries aligned to
+     * file clusters) served over TCP on port, merging results incrementally as workers return them
+     * should be called after booking and before drawing or printing; any number of workers may connect, including
+     * num_local_workers forked local processes (ex. to test on localhost). Units of workers that are killed or
+     * disconnect are reassigned. The coordinator listens on 127.0.0.1 unless the environment variable
+     * COORDINATOR_INTERFACE is set to the IPv4 address of another interface, which also requires COORDINATOR_TOKEN to
+     * be set to a shared secret. To run a worker on another node, run the same program with the environment variables
+     * COORDINATOR_ADDRESS set to host:port and COORDINATOR_TOKEN set to the same secret; it processes units until the
+     * coordinator is done, then exits.
+     * Each unit is processed in a fresh forked process whose input is restricted to the files and entries of the unit,
+     * see SampleWrapper::set_entry_range. Implicit multithreading should not be enabled.
+     * Completed units are saved for restarts if set_checkpoint was called.
+     */
+    SampleCollection* run_distributed(unsigned short port, unsigned int num_local_workers=0,
+        unsigned long entries_per_unit=1000000, std::string work_directory="work");
+
+    /**
+     * method to save completed work units and partial results (histograms, sums of weights, cutflow reports) of
+     * run_distributed under checkpoint_directory every i_checkpoint_seconds and once all units are done
+     * a restarted job with the same inputs, defines, filters, weights, bookings, and units resumes from the last
+     * checkpoint and only processes the remaining units; should be called before run_distributed
+     */
+    SampleCollection* set_checkpoint(std::string i_checkpoint_directory="checkpoint", unsigned int i_checkpoint_seconds=300);
+
+    /**
+     * method to request and process work units from the coordinator at host:port until it is done
+     * the token in the environment variable COORDINATOR_TOKEN is sent first, see run_distributed
+     */
+    void run_worker(std::string host, unsigned short port, std::string work_directory="work");
+
     /**
      * method to make 1d histograms of variable with weight weight in each region specified by regions, see RInterface::Histo1D
      */
     PlotCollection* book_1d_histogram(VariableAxis axis, RegionCollection* regions=nullptr);
     
+    /**
+     * method to make 1d histograms with several weight variations filled in a single pass, see MultiWeightHistogramHelper
+     * variation 0 is the nominal sample weight, variation i is filled with weight column weight_columns[i-1] (ex. trigger efficiency up/down)
+     * variable must be a scalar column; data samples fill all variations with the nominal weight
+     */
+    PlotCollection* book_1d_histogram_variations(VariableAxis axis, std::vector<std::string> weight_columns, RegionCollection* regions=nullptr);
+
+    /**
+     * method to make 1d histograms with weight variations from a vector column of relative weights (ex. LHEPdfWeight)
+     * variation 0 is the nominal sample weight, variation i is filled with nominal weight * weight_vector_column[i-1]
+     * variation_names gives names of the entries of weight_vector_column and sets the number of variations
+     */
+    PlotCollection* book_1d_histogram_vector_variations(VariableAxis axis, std::string weight_vector_column, std::vector<std::string> variation_names, RegionCollection* regions=nullptr);
+
+    /**
+     * method to make 1d histograms with num_replicas Poisson bootstrap replicas filled in a single pass, see BootstrapWeights
+     * variation 0 is the nominal histogram, variation i is filled with nominal weight * a Poisson(1) count drawn per
+     * event from (seed, event_key_columns, i), so replicas are reproducible and independent of the number of threads
+     * replicas of derived quantities (ratios, efficiencies) estimate their statistical uncertainties, see
+     * PlotCollection::get_replica_band; data samples are resampled as well
+     */
+    PlotCollection* book_1d_histogram_bootstrap(VariableAxis axis, unsigned int num_replicas, RegionCollection* regions=nullptr, ULong64_t seed=0, std::vector<std::string> event_key_columns={"run", "luminosityBlock", "event"});
+    
     /**
      * method to make 1d efficiency plots of variable with weight weight in each region specified by regions, see RInterface::Histo1D
      */
@@ -89,6 +425,13 @@ class SampleCollection {
      */
     PlotCollection* book_2d_histogram(VariableAxis x_axis, VariableAxis y_axis, RegionCollection* regions=nullptr);
     
+    /**
+     * method to make one n-dimensional histogram per sample and region filled with a single bin computation per event
+     * 1d/2d projections and slices can then be made with NdHistogramCollection without rerunning the event loop
+     * variables must be scalar columns; histograms with more than max_dense_cells cells are stored sparsely
+     */
+    NdHistogramCollection* book_nd_histogram(std::vector<VariableAxis> axes, RegionCollection* regions=nullptr, unsigned long max_dense_cells=1000000);
+    
     /**
      * method to make 2d efficiency plots of variable with weight weight in each region specified by regions, see RInterface::Histo2D
      */
@@ -98,6 +441,14 @@ class SampleCollection {
      * method to make cutflow table
      */
     TableCollection* book_cutflow_table();
+
+    /**
+     * method to make sequential, N-1, and first-failing-cut tables for cuts in every region in a single pass
+     * each cut and region selection is evaluated once per event and packed into bitmasks (at most 64 of each, further
+     * cuts and regions are dropped with an error), see CutMaskHelper; cuts are applied on top of existing filters, and
+     * are not added as filters; cut_descriptions default to the cut expressions
+     */
+    TableCollection* book_cut_mask_table(std::vector<std::string> cuts, std::vector<std::string> cut_descriptions={}, RegionCollection* regions=nullptr);
 };
 
 #include "../../src/core/sample_collection.tpp"
@@ -1,13 +1,30 @@
 #ifndef H_SAMPLE_WRAPPER
 #define H_SAMPLE_WRAPPER
 
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
+#include "TChain.h"
+#include "TEntryList.h"
+
 #include "ROOT/RDataFrame.hxx"
 #include "ROOT/RDF/RInterface.hxx"
 #include "ROOT/RResultPtr.hxx"
 
+#include "core/result_cache.hxx"
+#include "core/cut_mask.hxx"
+#include "core/compiled_expression_cache.hxx"
+#include "core/friend_column_cache.hxx"
+#include "core/dataset_manifest.hxx"
+
+class MergedSampleLoop;
+class ColumnCacheDataSource;
+
 /**
  * class representing a certain category of samples 
  * ex. ZJets, QCDMultijet, ttbar, GluGluHToGammaGamma
@@ -18,11 +35,140 @@ class SampleWrapper {
     std::vector<std::string> sample_filenames;
     std::vector<std::string> flags;
     std::string lumi_weight_column;
-    ROOT::RDF::RInterface<ROOT::Detail::RDF::RJittedFilter, void> sample_data_frame;
+    //chains and entry list are declared before the data frames reading them, so they are destroyed after them
+    std::vector<std::unique_ptr<TChain>> friend_chains;
+    std::unique_ptr<TEntryList> input_entry_list;
+    std::unique_ptr<TChain> input_chain;
+    ROOT::RDF::RNode sample_data_frame;
+    ROOT::RDF::RNode entry_data_frame;
     ROOT::RDF::RResultPtr<ROOT::Detail::RDF::SumReturnType_t<double>> total_yield;
     float cross_section;
     float normed_luminosity;
     float luminosity;
+    double sum_of_weights;
+    bool normalized_at_fill;
+    std::string graph_description;
+    ResultCache* result_cache;
+    CompiledExpressionCache* expression_cache;
+    std::string total_yield_key;
+    bool total_yield_realized;
+    double total_yield_value;
+    std::vector<std::string> cut_yield_keys;
+    std::vector<bool> cut_yields_realized;
+    std::vector<double> cut_yield_values;
+    std::string sample_tree_name;
+    std::vector<std::function<ROOT::RDF::RNode(ROOT::RDF::RNode)>> graph_replay;
+    bool adaptive_filter_order;
+    unsigned int adaptive_warmup_events;
+    unsigned int adaptive_cutflow_period;
+    std::vector<std::string> pending_filter_expressions;
+    std::vector<std::string> pending_filter_descriptions;
+    std::vector<std::vector<ROOT::RDF::RResultPtr<CutMaskYields>>> adaptive_batch_results;
+    std::vector<std::vector<ROOT::RDF::RResultPtr<CutMaskYields>>> adaptive_batch_sampled_results;
+    std::vector<std::vector<ROOT::RDF::RResultPtr<CutMaskYields>>> adaptive_batch_sampled_totals;
+    std::vector<std::shared_ptr<CutMaskYields>> adaptive_batch_yields;
+    std::vector<int> cut_adaptive_batch;
+    std::vector<unsigned int> cut_adaptive_index;
+    ULong64_t range_begin;
+    ULong64_t range_end;
+    MergedSampleLoop* merged_loop;
+    unsigned int merged_sample_idx;
+    unsigned int merged_loop_nodes;
+    std::vector<unsigned int> merged_cut_filters;
+    bool column_cache_used;
+    unsigned int num_booked_results;
+    std::shared_future<void> event_loop;
+    std::string friend_directory;
+    std::string friend_version;
+    std::vector<std::string> friend_columns;
+    std::map<std::string, std::string> column_definitions;
+    std::vector<std::pair<std::string, std::vector<std::string>>> attached_friends;
+    std::vector<std::function<ROOT::RDF::RResultPtr<ULong64_t>(ROOT::RDF::RNode)>> friend_writer_bookings;
+    std::vector<ROOT::RDF::RResultPtr<ULong64_t>> friend_writer_results;
+    std::shared_ptr<bool> friend_writers_enabled;
+    std::vector<std::pair<ULong64_t, ULong64_t>> sampled_ranges;
+    double sampled_fraction;
+    std::unique_ptr<DatasetManifest> manifest;
+    ColumnCacheDataSource* column_cache_source;
+    bool input_files_loaded;
+    std::vector<std::string> input_filenames;
+    std::vector<ULong64_t> input_file_entries;
+
+    /**
+     * internal function filling input_filenames and input_file_entries, the matched input files in chain order and
+     * their number of entries; files are opened once unless a dataset manifest is used
+     */
+    void load_input_files();
+
+    /**
+     * internal function returning sorted [begin, end) ranges of chain entries processed by this process, the
+     * intersection of its entry range and sampled clusters
+     */
+    std::vector<std::pair<ULong64_t, ULong64_t>> get_selected_ranges();
+
+    /**
+     * internal function restricting the input of the data frame to the selected ranges: only input files overlapping
+     * them are chained, with an entry list if files are partially selected, so skipped entries and files are never read
+     */
+    void restrict_input();
+
+    /**
+     * internal function returning number of entries in [begin, end) processed in sampled runs, see set_sampled_fraction
+     */
+    ULong64_t count_sampled_entries(ULong64_t begin, ULong64_t end);
+
+    /**
+     * internal function adding the input files to chain, with their number of entries if a dataset manifest is used
+     */
+    void add_input_files(TChain &chain);
+
+    /**
+     * internal functions applying a string define, filter, or sum to node, compiled if the expression cache has them
+     */
+    ROOT::RDF::RNode define_node(ROOT::RDF::RNode node, std::string name, std::string expression);
+    ROOT::RDF::RNode filter_node(ROOT::RDF::RNode node, std::string expression, std::string filter_name);
+    ROOT::RDF::RResultPtr<ROOT::Detail::RDF::SumReturnType_t<double>> sum_node(ROOT::RDF::RNode node, std::string column);
+
+    /**
+     * internal function to apply a filter in declared order and book its cut yield
+     */
+    void apply_filter(std::string expression, std::string internal_description);
+
+    /**
+     * internal function to apply filters deferred by adaptive ordering, see set_adaptive_filter_order
+     */
+    void apply_pending_filters();
+
+    /**
+     * internal function returning order (indices into expressions) minimizing expected cost per event
+     * cost and pass fraction of each filter are measured in one loop over warm-up entries of the first file
+     * the declared order is kept unless the expected gain, including the cost of recovering the declared-order
+     * cutflow, exceeds the timing noise
+     */
+    std::vector<unsigned int> measure_filter_order(std::vector<std::string> expressions);
+
+    /**
+     * internal function returning merged declared-order cutflow of an adaptive batch of filters
+     */
+    std::shared_ptr<CutMaskYields> get_adaptive_batch_yields(unsigned int batch_idx);
+
+    /**
+     * internal function returning true if column_name should be read from or written to friend trees, see
+     * cache_defined_columns
+     */
+    bool is_friend_column(std::string column_name);
+
+    /**
+     * internal function returning friend file of a column with definition for each input file, and setting
+     * file_entries to the number of entries of each input file
+     */
+    std::vector<std::string> get_friend_filenames(std::string definition, std::vector<ULong64_t> &file_entries);
+
+    /**
+     * internal function reading column_name from friend_filenames: the data frame is rebuilt on a chain of the input
+     * files with all attached friend trees, and defines and friend writers booked so far are replayed on it
+     */
+    void attach_friend_column(std::string column_name, std::vector<std::string> friend_filenames);
   
   public:
     short sample_color;
@@ -65,33 +211,289 @@ class SampleWrapper {
 
     /**
      * method for setting cross section of process in pb. Used for rescaling events appropriately for luminosity
+     * must be called before normalize_at_fill
      */
     SampleWrapper* set_cross_section(float i_cross_section);
 
     /**
-     * method for setting luminosity for rescaling
+     * method for setting luminosity for rescaling, must be called before normalize_at_fill
      */
     SampleWrapper* set_luminosity(float i_luminosity);
 
     /**
      * get scaling weight based on assigned luminosity and cross section
+     * returns 1 for samples normalized at fill time since their histograms are already scaled
      */
     float scale_weight();
 
+    /**
+     * method for setting sum of lumi weights from metadata, avoids a pre-pass when normalizing at fill time
+     */
+    SampleWrapper* set_sum_of_weights(double i_sum_of_weights);
+
+    /**
+     * method for setting sum of lumi weights from a small metadata tree, ex. the NanoAOD Runs tree
+     */
+    SampleWrapper* set_sum_of_weights_from_tree(std::string metadata_tree_name="Runs", std::string sum_of_weights_column="genEventSumw");
+
+    /**
+     * method that folds cross section * luminosity / sum of weights into the weight column so that
+     * histograms and yields booked afterwards are born normalized. Must be called after set_weight_branches,
+     * set_cross_section, and set_luminosity, and before any filters; cross section and luminosity cannot be changed
+     * afterwards. If no sum of weights was provided (see set_sum_of_weights_from_tree) and it is not in the result
+     * cache, it is computed with a pre-pass: an extra event loop over the lumi weight column before the main one
+     */
+    SampleWrapper* normalize_at_fill();
+
+    /**
+     * method for checking if sample weights are normalized at fill time
+     */
+    bool is_normalized_at_fill();
+
+    /**
+     * method to define data frame columns, see RInterface::Define
+     */
+    SampleWrapper* define(const char* name, const char* expression);
+
+    /**
+     * method to define data frame columns, see RInterface::Define
+     */
+    template<typename F>
+    SampleWrapper* define(const char* name, F expression, const std::vector<std::string> columns);
+
+    /**
+     * returns names of root files of this sample
+     */
+    std::vector<std::string> get_filenames();
+
+    /**
+     * returns name of the tree read from the files of this sample
+     */
+    std::string get_tree_name();
+
+    /**
+     * returns "name:type" of each branch of the tree of the first input file, from the dataset manifest if one is used
+     * returns an empty vector if the file cannot be read
+     */
+    std::vector<std::string> get_branches();
+
+    /**
+     * returns number of entries of each input file processed by this process (within its entry range)
+     */
+    std::vector<ULong64_t> get_file_entries();
+
+    /**
+     * returns data frame of all entries processed by this process, before defines and filters
+     */
+    ROOT::RDF::RNode & unfiltered_data_frame();
+
+    /**
+     * returns name of the column used when normalizing weights, see set_weight_branches
+     */
+    std::string get_lumi_weight_column();
+
     /**
      * method for filtering sample
      */
     SampleWrapper* filter(std::string expression, std::string filter_description="");
 
+    /**
+     * method to let subsequent consecutive filters run in the order minimizing expected cost per event
+     * cost and rejection of each filter are measured on warmup_events events of the first file before the
+     * filters are applied (on the next access to the data frame); cut yields and tables keep declared order
+     * if filters are reordered, the declared-order filters an event skipped are only evaluated for one in
+     * cutflow_period rejected events, so intermediate cut yields are estimates while the total and final yields
+     * stay exact; cutflow_period 1 gives an exact cutflow, which is never cheaper than the declared order
+     */
+    SampleWrapper* set_adaptive_filter_order(unsigned int warmup_events=10000, unsigned int cutflow_period=100);
+
+    /**
+     * returns true if cut cut_idx was applied with adaptive ordering
+     */
+    bool is_adaptive_cut(unsigned int cut_idx);
+
+    /**
+     * returns declared-order yield (weighted or not) after cut cut_idx, or entering it if before_cut is true
+     * only valid for cuts applied with adaptive ordering
+     */
+    double get_adaptive_cut_yield(unsigned int cut_idx, bool weighted, bool before_cut=false);
+
+    /**
+     * method to read columns from memory-mapped column caches of the input files instead of the ROOT files, see
+     * ColumnCacheDataSource. Caches are built under cache_directory on first use, one per input file, and rebuilt when
+     * an input file changes; compress stores blocks LZ4-compressed. Only columns are available afterwards, so they
+     * should include all branches read by defines, filters, weights, and plots. Must be called before
+     * set_weight_branches, define, and filter
+     */
+    SampleWrapper* use_column_cache(std::vector<std::string> columns, std::string cache_directory="column_cache", bool compress=false);
+
+    /**
+     * returns true if columns are read from column caches, see use_column_cache
+     */
+    bool uses_column_cache();
+
+    /**
+     * method to record that a result was booked on the event loop of this sample rather than loaded from a
+     * ResultCache, see get_num_booked_results
+     */
+    SampleWrapper* add_booked_result();
+
+    /**
+     * returns number of results booked on the event loop of this sample so far, only results booked by SampleWrapper
+     * and SampleCollection are counted, see SampleCollection::start_event_loops
+     */
+    unsigned int get_num_booked_results();
+
+    /**
+     * method to set the future of the event loop of this sample run on a background thread, see
+     * SampleCollection::start_event_loops
+     */
+    SampleWrapper* set_event_loop(std::shared_future<void> i_event_loop);
+
+    /**
+     * method to wait until the event loop set by set_event_loop has finished, rethrowing its exception if it failed
+     * booked results must not be read while the loop is running on another thread, so all accessors of booked
+     * results (ex. get_total_yield, PlotCollection and TableCollection results) call it first
+     */
+    void wait_for_event_loop();
+
+    /**
+     * method to build the chain of input files from a DatasetManifest (file list, entries, clusters, and schema) stored
+     * in manifest_directory, so that files are not opened one by one at startup to get entries and clusters; the
+     * manifest is built once with num_threads threads and updated when files change. Must be called before
+     * set_weight_branches, define, and filter
+     */
+    SampleWrapper* use_dataset_manifest(std::string manifest_directory="manifest_cache", unsigned int num_threads=0);
+
+    /**
+     * method to materialize columns defined afterwards with compiled functions as friend trees under cache_directory,
+     * one per input file, see FriendColumnCache. Friend trees are written by the first event loop processing all
+     * entries of an input file and read instead of evaluating the function in later runs of any executable with the
+     * same definition (name, callable and result types, input columns, version); version should be changed when a
+     * defining function changes. Columns defined by function pointers are only cached with a non-empty version, since
+     * their type does not identify the function. Columns must be defined before set_weight_branches and filter; friend trees are not written (with a
+     * warning) if only part of the entries is processed (ex. set_entry_range or set_sampled_fraction)
+     */
+    SampleWrapper* cache_defined_columns(std::vector<std::string> columns, std::string version="", std::string cache_directory="friend_cache");
+
+    /**
+     * method to process this sample as sample i_merged_sample_idx of a merged event loop, see MergedSampleLoop
+     * afterwards, defines and filters must be added through the merged loop and data_frame returns the entries
+     * of this sample in the merged data frame
+     */
+    SampleWrapper* set_merged_loop(MergedSampleLoop* i_merged_loop, unsigned int i_merged_sample_idx);
+
+    /**
+     * returns true if this sample is processed in a merged event loop
+     */
+    bool uses_merged_loop();
+
+    /**
+     * method to record filter filter_idx of the merged event loop as a cut of this sample
+     */
+    SampleWrapper* add_merged_cut(unsigned int filter_idx, std::string expression, std::string filter_description="");
+
+    /**
+     * returns yield (weighted or not) after cut cut_idx, or entering it if before_cut is true
+     * only valid for samples processed in a merged event loop
+     */
+    double get_merged_cut_yield(unsigned int cut_idx, bool weighted, bool before_cut=false);
+
     /**
      * method for getting formatted string of all cuts applied
      */
     std::string selection_string();
     
+    /**
+     * method to memoize sums of weights and cut yields in a ResultCache
+     * should be called before set_weight_branches and filter for their results to be cached
+     */
+    SampleWrapper* set_result_cache(ResultCache* i_result_cache);
+
+    /**
+     * method to book string defines, filters, and sums with compiled code from a CompiledExpressionCache
+     * should be called before define and filter
+     */
+    SampleWrapper* set_expression_cache(CompiledExpressionCache* i_expression_cache);
+
+    /**
+     * returns canonical description of everything defined, filtered, and weighted on this sample so far
+     */
+    std::string get_graph_description();
+
+    /**
+     * method to record a new node (ex. a define) in the graph description
+     */
+    SampleWrapper* append_graph_description(std::string node_description);
+
+    /**
+     * returns sum of lumi weights before any cuts, from cache if possible
+     */
+    double get_total_yield();
+
+    /**
+     * returns weighted yield after cut cut_idx, from cache if possible
+     */
+    double get_cut_yield(unsigned int cut_idx);
+
+    /**
+     * method to restrict the event loop of this process to shard i_shard_idx of i_num_shards contiguous entry ranges
+     * must be called before the event loop runs; only input files overlapping the shard are read, see set_entry_range
+     */
+    SampleWrapper* set_shard(unsigned int i_shard_idx, unsigned int i_num_shards);
+
+    /**
+     * method to restrict the event loop of this process to entries [i_range_begin, i_range_end) of the chained input files
+     * must be called before the event loop runs; the data frame input is replaced by a chain of only the input files
+     * overlapping the range, with an entry list for partially covered files. Friend trees of cache_defined_columns are
+     * not written in restricted runs
+     */
+    SampleWrapper* set_entry_range(ULong64_t i_range_begin, ULong64_t i_range_end);
+
+    /**
+     * method to process only about fraction of the entries of this sample, for quick looks during development
+     * whole clusters are selected deterministically and spread evenly over the chained input files, and only the selected
+     * clusters are read (see set_entry_range); the start of the selection depends on the sample name, so each cluster
+     * is selected with probability fraction, and yields, cut yields, and histograms are extrapolated to all entries
+     * by dividing by it (unbiased, while the fraction of entries selected varies with cluster sizes)
+     * must be called before set_weight_branches and filter, and is not supported with merged event loops
+     */
+    SampleWrapper* set_sampled_fraction(double fraction);
+
+    /**
+     * returns probability with which each cluster is processed, 1 unless set_sampled_fraction was called
+     */
+    double get_sampled_fraction();
+
+    /**
+     * returns number of entries of the chained input files within the entry range of this process, including entries
+     * skipped by set_sampled_fraction
+     */
+    ULong64_t get_num_entries();
+
+    /**
+     * returns [begin, end) entry ranges covering the chained input files, each within one file, aligned to
+     * cluster boundaries, and holding about entries_per_range entries (at least one cluster)
+     */
+    std::vector<std::pair<ULong64_t, ULong64_t>> get_cluster_ranges(ULong64_t entries_per_range);
+
+    /**
+     * method to realize booked sums of weights and cut yields and store them in shard_cache, used by shard processes
+     * results already loaded from the result cache are not stored, so they are not counted once per shard
+     */
+    void store_shard_results(ResultCache* shard_cache);
+
+    /**
+     * method to replace booked sums of weights and cut yields with the sum of the results of all shards
+     */
+    void merge_shard_results(std::vector<ResultCache*> shard_caches);
+
     /**
      * internal RDataFrame object
      */
-    ROOT::RDF::RInterface<ROOT::Detail::RDF::RJittedFilter, void> & data_frame();
+    ROOT::RDF::RNode & data_frame();
 };
 
+#include "../../src/core/sample_wrapper.tpp"
+
 #endif
@@ -10,9 +10,12 @@
 
 #include "core/sample_wrapper.hxx"
 #include "core/region_collection.hxx"
+#include "core/histogram_archive.hxx"
+#include "core/result_cache.hxx"
+#include "core/cut_mask.hxx"
 
 /**
- * class to hold a collection of booked CutFlowReports
+ * class to hold a collection of booked CutFlowReports or cut bitmask yields
  * equipped with methods for comparing them and writing results to .tex file
  */
 class TableCollection {
@@ -21,28 +24,146 @@ class TableCollection {
     std::vector<ROOT::RDF::RResultPtr<ROOT::RDF::RCutFlowReport>> cutflows;
     std::vector<SampleWrapper*> samples;
     float luminosity;
+    ResultCache* result_cache;
+    std::vector<std::string> report_keys;
+    std::vector<std::vector<double>> report_values;
+    std::vector<ROOT::RDF::RResultPtr<CutMaskYields>> cut_mask_yields;
+    std::vector<std::shared_ptr<CutMaskYields>> loaded_cut_mask_yields;
+    std::vector<std::string> mask_cut_names;
+    RegionCollection* regions;
+    CutflowView cutflow_view;
+
+    /**
+     * internal function returning true if the unweighted report of a sample has been realized
+     */
+    bool report_realized(unsigned int sample_idx);
+
+    /**
+     * internal function returning true if the report of a sample is booked, false if it was loaded or merged
+     */
+    bool report_booked(unsigned int sample_idx);
+
+    /**
+     * internal function returning number of values in the report of a sample
+     */
+    unsigned int report_size(unsigned int sample_idx);
+
+    /**
+     * internal function to realize the unweighted report of a sample as (pass, all) per cut
+     * for bitmask tables, the report holds the values of the cut bitmask yields, see CutMaskYields::get_values
+     */
+    void realize_report(unsigned int sample_idx);
+
+    /**
+     * internal function returning the (booked or loaded) cut bitmask yields of a sample
+     */
+    const CutMaskYields& get_cut_mask_yields(unsigned int sample_idx);
+
+    /**
+     * internal function returning number of unweighted events passing cut cut_idx
+     */
+    double cut_pass(unsigned int sample_idx, unsigned int cut_idx);
+
+    /**
+     * internal function returning unweighted efficiency of cut cut_idx
+     */
+    double cut_eff(unsigned int sample_idx, unsigned int cut_idx);
+
+    /**
+     * internal function returning number of regions in bitmask tables, including the inclusive selection
+     */
+    unsigned int num_mask_regions();
+
+    /**
+     * internal function returning description of a region in bitmask tables
+     */
+    std::string mask_region_description(unsigned int region_idx);
+
+    /**
+     * internal function returning row names of the current view in bitmask tables
+     */
+    std::vector<std::string> mask_row_names();
+
+    /**
+     * internal function returning (scaled, if MC) yield of row row_idx of the current view in bitmask tables
+     */
+    double mask_yield(unsigned int sample_idx, unsigned int region_idx, unsigned int row_idx);
+
+    /**
+     * internal function returning efficiency of row row_idx of the current view in bitmask tables
+     * relative to the previous cut for sequential, the fraction of N-1 events passing the cut for n_minus_one,
+     * and the fraction of all events for first_failing
+     */
+    double mask_eff(unsigned int sample_idx, unsigned int region_idx, unsigned int row_idx);
+
+    /**
+     * internal functions to print/save bitmask tables, if only_sample is not null only its yields are printed
+     */
+    void print_mask_tables(SampleWrapper* only_sample=nullptr);
+    void save_mask_tables(std::string filename);
   
   public:
     /**
      * constructor to generate collection from a vector of vectors
      */
     TableCollection(std::vector<ROOT::RDF::RResultPtr<ROOT::RDF::RCutFlowReport>> i_cutflows, std::vector<SampleWrapper*> i_samples);
+
+    /**
+     * constructor to generate collection from cut bitmask yields, one per sample, see CutMaskHelper
+     * regions may be nullptr, in which case only the inclusive table is made
+     */
+    TableCollection(std::vector<ROOT::RDF::RResultPtr<CutMaskYields>> i_cut_mask_yields, std::vector<std::string> i_cut_names, std::vector<SampleWrapper*> i_samples, RegionCollection* i_regions);
     
+    /**
+     * function to memoize unweighted cutflow reports, report_values[sample] holds (pass, all) per cut if loaded from cache
+     * for bitmask tables, report_values[sample] holds CutMaskYields::get_values if loaded from cache
+     */
+    TableCollection* set_result_cache(ResultCache* i_result_cache, std::vector<std::string> i_report_keys, std::vector<std::vector<double>> i_report_values);
+
     /**
      * function to set luminosity
      * FIXME: use sample lumis?
      */
     TableCollection* set_luminosity(float i_luminosity);
+
+    /**
+     * function to set view (sequential, N-1, or first failing cut) printed and saved by bitmask tables
+     */
+    TableCollection* set_cutflow_view(CutflowView i_cutflow_view);
     
     /**
      * function to print table to terminal
+     * if only_sample is not null, only its table is printed, ex. as soon as its event loop has finished (see
+     * SampleCollection::for_each_finished_sample) without waiting for the other samples
      */
-    void print();
+    void print(SampleWrapper* only_sample=nullptr);
 
     /**
      * function to save table to tex file
      */
     void save(std::string filename);
+
+    /**
+     * function returning keys under which unweighted reports (or bitmask yields) are stored, see set_result_cache
+     */
+    std::vector<std::string> get_result_keys();
+
+    /**
+     * function to realize unweighted reports (or bitmask yields) and store them in shard_cache under their keys, used by shard processes
+     * if only_sample is not null, only the report of that sample is realized and stored
+     */
+    void store_shard_results(ResultCache* shard_cache, SampleWrapper* only_sample=nullptr);
+
+    /**
+     * function to replace booked unweighted reports (or bitmask yields) with the sum of the reports stored by all shards
+     */
+    void merge_shard_results(std::vector<ResultCache*> shard_caches);
+
+    /**
+     * function to write realized cutflow yields to an archive under (cutflow, sample, inclusive, cutflow)
+     * if only_sample is not null, only its yields are written
+     */
+    void save_archive(HistogramArchiveWriter* archive_writer, SampleWrapper* only_sample=nullptr);
   
 };
 
@@ -4,6 +4,18 @@
 #include <string>
 #include <vector>
 
+/**
+ * C++ types of columns that histograms can be booked on without jitting, automatic means detected from the data frame
+ */
+enum class ColumnType {automatic, float_value, double_value, int_value, unsigned_int_value, bool_value, unsigned_char_value,
+    long64_value, unsigned_long64_value, short_value, unsigned_short_value, char_value, float_vector, int_vector,
+    double_vector, unsigned_char_vector, bool_vector, short_vector};
+
+/**
+ * function returning ColumnType of a column type name as given by RInterface::GetColumnType, or automatic if unsupported
+ */
+ColumnType column_type_from_name(std::string type_name);
+
 /***
  * class to hold information used in construction an axis for a plot
  */
@@ -16,6 +28,7 @@ class VariableAxis {
     double low, high;
     const double* bins;
     bool uniform_bins;
+    ColumnType value_type, weight_type;
     
     /**
      * uniform bin constructor
@@ -27,6 +40,13 @@ class VariableAxis {
      */
     VariableAxis(std::string i_variable_name, std::string i_variable_description, int i_nbins, const double* i_bins, std::string i_units="");
 
+    /**
+     * method to set the C++ types of the variable column and of the weight column of weighted samples
+     * histograms are then booked with typed actions; types left automatic are detected from each sample's columns
+     * 2d histograms use the weight type of their x axis
+     */
+    VariableAxis& set_column_types(ColumnType i_value_type, ColumnType i_weight_type=ColumnType::automatic);
+
     /**
      * return string describing units as it should be applied to axes
      */
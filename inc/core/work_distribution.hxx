@@ -0,0 +1,170 @@
+#ifndef H_WORK_DISTRIBUTION
+#define H_WORK_DISTRIBUTION
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Rtypes.h"
+
+#include "core/result_cache.hxx"
+#include "core/checkpoint.hxx"
+
+/**
+ * unit of work served by a WorkCoordinator: a [begin_entry, end_entry) range of the chained files of one sample
+ */
+struct WorkUnit {
+  unsigned int sample_idx;
+  ULong64_t begin_entry;
+  ULong64_t end_entry;
+};
+
+/**
+ * class wrapping a TCP connection between a coordinator and a worker
+ * messages are single text lines, result files are sent as a "FILE <name> <size>" line followed by the file contents
+ */
+class WorkConnection {
+  private:
+    int socket_fd;
+    std::string read_buffer;
+
+    /**
+     * internal function to read more data into the buffer, returns false if the connection is closed
+     */
+    bool fill_buffer();
+
+  public:
+    /**
+     * constructor, takes ownership of a connected socket
+     */
+    WorkConnection(int i_socket_fd);
+
+    /**
+     * destructor, closes the socket
+     */
+    ~WorkConnection();
+
+    WorkConnection(const WorkConnection &) = delete;
+    WorkConnection& operator=(const WorkConnection &) = delete;
+
+    /**
+     * returns a new connection to host:port, or nullptr if the connection fails; caller owns connection
+     */
+    static WorkConnection* connect_to(std::string host, unsigned short port);
+
+    /**
+     * returns underlying socket, used to poll several connections
+     */
+    int get_socket() const;
+
+    /**
+     * returns true if a complete line has already been received and can be read without blocking
+     */
+    bool has_buffered_line() const;
+
+    /**
+     * methods to send and receive one line (without the newline), return false if the connection is closed
+     */
+    bool send_line(std::string line);
+    bool receive_line(std::string &line);
+
+    /**
+     * method to send the file filename under name, the file is read and sent in chunks
+     */
+    bool send_file(std::string filename, std::string name);
+
+    /**
+     * method to receive one file of at most max_file_size bytes into directory, name is set to the name it was sent under
+     * the file is written in chunks to a temporary name and renamed, so readers never see partial files
+     */
+    bool receive_file(std::string directory, std::string &name, size_t max_file_size);
+};
+
+/**
+ * class serving work units over TCP to any number of workers and merging their results as they arrive
+ * units of workers that disconnect (ex. are killed) or report a failure before finishing are reassigned, up to
+ * max_unit_failures times per unit; serving fails if a unit fails more often or no worker is connected for
+ * worker_timeout_seconds
+ * workers must first send the token the coordinator was started with, see serve
+ * protocol (worker -> coordinator / coordinator -> worker):
+ *   HELLO <token> / no reply, the connection is closed if the token does not match
+ *   REQUEST / UNIT <unit> <sample> <begin> <end>, WAIT (all units assigned, ask again later), or DONE
+ *   RESULT <unit> <number of files> followed by the files / no reply
+ *   FAILED <unit> / no reply
+ */
+class WorkCoordinator {
+  private:
+    std::vector<WorkUnit> units;
+    std::string work_directory;
+    std::unique_ptr<ResultCache> merged_cache;
+    std::vector<std::unique_ptr<WorkConnection>> connections;
+    std::vector<bool> connections_authenticated;
+    std::string token;
+    std::vector<int> unit_owners;
+    std::vector<bool> units_done;
+    std::vector<unsigned int> unit_failures;
+    unsigned int num_units_done;
+    unsigned int max_unit_failures;
+    unsigned int worker_timeout_seconds;
+    bool units_failed;
+    Checkpoint* checkpoint;
+    unsigned int checkpoint_seconds;
+    std::chrono::steady_clock::time_point last_checkpoint;
+
+    /**
+     * internal function to save completed units and merged results to the checkpoint, if set
+     */
+    void save_checkpoint();
+
+    /**
+     * internal function to handle one message from connection connection_idx, returns false if it disconnected
+     */
+    bool handle_message(unsigned int connection_idx);
+
+    /**
+     * internal function to reassign unit unit_idx after a failure, or to stop serving if it failed too often
+     */
+    void reassign(unsigned int unit_idx);
+
+    /**
+     * internal function to close connection connection_idx and reassign its unfinished units
+     */
+    void disconnect(unsigned int connection_idx);
+
+  public:
+    /**
+     * constructor
+     * i_work_directory - directory in which received and merged results are stored
+     * i_max_unit_failures - number of failures or lost workers after which a unit is not reassigned
+     * i_worker_timeout_seconds - time without any connected worker after which serving stops
+     */
+    WorkCoordinator(std::vector<WorkUnit> i_units, std::string i_work_directory="work", unsigned int i_max_unit_failures=3,
+        unsigned int i_worker_timeout_seconds=300);
+
+    /**
+     * method to resume from i_checkpoint, marking its units as done, and to save a checkpoint every
+     * i_checkpoint_seconds while serving and once all units are done; must be called before serve
+     */
+    WorkCoordinator* set_checkpoint(Checkpoint* i_checkpoint, unsigned int i_checkpoint_seconds=300);
+
+    /**
+     * returns true if all units are done (ex. all were loaded from a checkpoint)
+     */
+    bool is_done();
+
+    /**
+     * method to serve units on port until all are done, returns false if the port cannot be opened, a unit failed
+     * too often, or no worker was connected for the worker timeout
+     * i_interface - IPv4 address of the interface to listen on, other interfaces than loopback require a token
+     * i_token - shared secret that workers must send before any other message
+     */
+    bool serve(unsigned short port, std::string i_interface="127.0.0.1", std::string i_token="");
+
+    /**
+     * returns cache holding the sum of the results of all units
+     */
+    ResultCache* get_merged_cache();
+};
+
+#endif
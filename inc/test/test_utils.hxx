@@ -0,0 +1,110 @@
+#ifndef H_TEST_UTILS
+#define H_TEST_UTILS
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+#include <unistd.h>
+
+#include "TFile.h"
+#include "TTree.h"
+
+/**
+ * class to count the checks of a test executable (see src/test), failed checks are printed as they happen
+ * the exit code returned by report is the number of failed checks, so make test stops at the first failing test
+ */
+class TestCounter {
+  private:
+    std::string test_name;
+    unsigned int num_checks;
+    unsigned int num_failures;
+
+  public:
+    /**
+     * constructor
+     */
+    TestCounter(std::string i_test_name) : test_name(i_test_name), num_checks(0), num_failures(0) {}
+
+    /**
+     * method to record a check, description is printed if condition is false
+     */
+    TestCounter* check(bool condition, std::string description) {
+      num_checks++;
+      if (!condition) {
+        num_failures++;
+        std::cout << "ERROR: " << test_name << ": " << description << std::endl;
+      }
+      return this;
+    }
+
+    /**
+     * method to record a check that value is within tolerance of expected
+     */
+    TestCounter* check_close(double value, double expected, double tolerance, std::string description) {
+      return check(std::fabs(value-expected) <= tolerance, description+" (got "+std::to_string(value)+", expected "
+          +std::to_string(expected)+")");
+    }
+
+    /**
+     * method to print a summary, returns exit code of the test
+     */
+    int report() {
+      std::cout << test_name << ": " << num_checks-num_failures << " of " << num_checks << " checks passed" << std::endl;
+      return static_cast<int>(num_failures);
+    }
+};
+
+/**
+ * returns path of a scratch file or directory named name, unique to this process
+ */
+inline std::string test_path(std::string name) {
+  return "/tmp/"+name+"_"+std::to_string(getpid());
+}
+
+/**
+ * returns content of filename, empty if it cannot be read
+ */
+inline std::string read_test_file(std::string filename) {
+  std::ifstream input_file(filename, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(input_file), std::istreambuf_iterator<char>());
+}
+
+/**
+ * method to replace the content of filename with content
+ */
+inline void write_test_file(std::string filename, std::string content) {
+  std::ofstream output_file(filename, std::ios::binary | std::ios::trunc);
+  output_file.write(content.data(), static_cast<std::streamsize>(content.size()));
+}
+
+/**
+ * method to write tree "tree" with num_entries entries to filename: float x = entry*scale, int n = entry%4, and
+ * float array v of n elements v[i] = x+i
+ */
+inline void write_test_tree(std::string filename, unsigned int num_entries, float scale=1.f) {
+  TFile* output_file = TFile::Open(filename.c_str(), "RECREATE");
+  //the tree belongs to the file and is deleted with it
+  TTree* tree = new TTree("tree", "tree");
+  float x = 0.f;
+  int n = 0;
+  float v[4];
+  tree->Branch("x", &x, "x/F");
+  tree->Branch("n", &n, "n/I");
+  tree->Branch("v", v, "v[n]/F");
+  for (unsigned int entry = 0; entry < num_entries; entry++) {
+    x = static_cast<float>(entry)*scale;
+    n = static_cast<int>(entry%4u);
+    for (int element_idx = 0; element_idx < n; element_idx++)
+      v[element_idx] = x+static_cast<float>(element_idx);
+    tree->Fill();
+  }
+  tree->Write();
+  output_file->Close();
+  delete output_file;
+}
+
+#endif
@@ -0,0 +1,55 @@
+#include <cmath>
+
+#include "Rtypes.h"
+#include "ROOT/RVec.hxx"
+
+#include "core/bootstrap_weights.hxx"
+
+/**
+ * constructor
+ */
+BootstrapWeights::BootstrapWeights(unsigned int i_num_replicas, ULong64_t i_seed) {
+  num_replicas = i_num_replicas;
+  seed = i_seed;
+}
+
+/**
+ * returns nominal weight followed by the weights of all replicas
+ */
+ROOT::RVec<double> BootstrapWeights::operator()(const ROOT::RVec<ULong64_t> &event_key, double nominal_weight) const {
+  //the key of the event is mixed once, each replica then only mixes its own counter
+  ULong64_t event_state = mix(seed);
+  for (ULong64_t key_value : event_key)
+    event_state = mix(event_state^key_value);
+  ROOT::RVec<double> weights(num_replicas+1);
+  weights[0] = nominal_weight;
+  for (unsigned int replica_idx = 1; replica_idx <= num_replicas; replica_idx++)
+    weights[replica_idx] = nominal_weight*poisson_count(mix(event_state+replica_idx*0x9e3779b97f4a7c15ull));
+  return weights;
+}
+
+/**
+ * returns 64 random bits for counter, a bijective mix (SplitMix64 finalizer) of its argument
+ */
+ULong64_t BootstrapWeights::mix(ULong64_t counter) {
+  counter = (counter^(counter >> 30))*0xbf58476d1ce4e5b9ull;
+  counter = (counter^(counter >> 27))*0x94d049bb133111ebull;
+  return counter^(counter >> 31);
+}
+
+/**
+ * returns count drawn from a Poisson distribution of mean 1 by inverting its cumulative distribution at random_bits
+ */
+unsigned int BootstrapWeights::poisson_count(ULong64_t random_bits) {
+  //uniform in [0, 1) from the top 53 bits
+  double uniform = static_cast<double>(random_bits >> 11)*(1.0/9007199254740992.0);
+  double probability = std::exp(-1.0);
+  double cumulative = probability;
+  unsigned int count = 0;
+  while (uniform >= cumulative && count < 20) {
+    count++;
+    probability /= count;
+    cumulative += probability;
+  }
+  return count;
+}
@@ -0,0 +1,227 @@
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "TH1.h"
+#include "TH2.h"
+#include "TTreeReader.h"
+
+#include "core/bounded_histogram.hxx"
+
+/**
+ * internal function to atomically add to a floating point bin (atomic fetch_add on floating point types requires c++20)
+ */
+template <typename T>
+static void atomic_add(std::atomic<T> &bin, T value) {
+  T current = bin.load(std::memory_order_relaxed);
+  while (!bin.compare_exchange_weak(current, current+value, std::memory_order_relaxed)) {}
+}
+
+/**
+ * constructor
+ */
+BoundedBinStorage::BoundedBinStorage(HistogramStorage i_storage, BinPrecision i_precision, uint64_t i_num_cells, unsigned int num_slots) {
+  storage = i_storage;
+  precision = i_precision;
+  num_cells = i_num_cells;
+  if (storage == HistogramStorage::sparse_slots) {
+    slot_sparse_cells.resize(num_slots);
+  }
+  else if (precision == BinPrecision::integer_counts) {
+    integer_contents.reset(new std::atomic<int64_t>[num_cells]);
+    integer_sumw2.reset(new std::atomic<int64_t>[num_cells]);
+    for (uint64_t cell = 0; cell < num_cells; cell++) {
+      integer_contents[cell] = 0;
+      integer_sumw2[cell] = 0;
+    }
+  }
+  else if (precision == BinPrecision::float_precision) {
+    float_contents.reset(new std::atomic<float>[num_cells]);
+    float_sumw2.reset(new std::atomic<float>[num_cells]);
+    for (uint64_t cell = 0; cell < num_cells; cell++) {
+      float_contents[cell] = 0;
+      float_sumw2[cell] = 0;
+    }
+  }
+  else {
+    double_contents.reset(new std::atomic<double>[num_cells]);
+    double_sumw2.reset(new std::atomic<double>[num_cells]);
+    for (uint64_t cell = 0; cell < num_cells; cell++) {
+      double_contents[cell] = 0;
+      double_sumw2[cell] = 0;
+    }
+  }
+  slot_entries.resize(num_slots);
+  warned_non_integer_weight = false;
+}
+
+/**
+ * returns projected number of bytes used by this storage, excluding sparse buffers which grow with filled bins
+ */
+uint64_t BoundedBinStorage::projected_bytes(HistogramStorage storage, BinPrecision precision, uint64_t num_cells, unsigned int num_slots) {
+  //contents and sumw2 of the final histogram are always needed
+  uint64_t result_bytes = 2*sizeof(double)*num_cells;
+  switch (storage) {
+    case HistogramStorage::per_slot:
+      return result_bytes*num_slots;
+    case HistogramStorage::sparse_slots:
+      return result_bytes;
+    case HistogramStorage::shared_atomic:
+      if (precision == BinPrecision::integer_counts)
+        return result_bytes+2*sizeof(int64_t)*num_cells;
+      if (precision == BinPrecision::float_precision)
+        return result_bytes+2*sizeof(float)*num_cells;
+      return result_bytes+2*sizeof(double)*num_cells;
+    default:
+      return result_bytes;
+  }
+}
+
+/**
+ * method to add weight to bin cell from slot slot
+ */
+void BoundedBinStorage::fill(unsigned int slot, uint64_t cell, double weight) {
+  slot_entries[slot].entries += 1;
+  if (storage == HistogramStorage::sparse_slots) {
+    std::pair<double, double> &sparse_cell = slot_sparse_cells[slot][cell];
+    sparse_cell.first += weight;
+    sparse_cell.second += weight*weight;
+  }
+  else if (precision == BinPrecision::integer_counts) {
+    if (std::nearbyint(weight) < weight || std::nearbyint(weight) > weight) {
+      if (!warned_non_integer_weight.exchange(true, std::memory_order_relaxed))
+        std::cout << "WARNING: non-integer weight " << weight << " filled into integer_counts histogram, weights are rounded to the nearest integer" << std::endl;
+    }
+    int64_t integer_weight = static_cast<int64_t>(llround(weight));
+    integer_contents[cell].fetch_add(integer_weight, std::memory_order_relaxed);
+    integer_sumw2[cell].fetch_add(integer_weight*integer_weight, std::memory_order_relaxed);
+  }
+  else if (precision == BinPrecision::float_precision) {
+    atomic_add(float_contents[cell], static_cast<float>(weight));
+    atomic_add(float_sumw2[cell], static_cast<float>(weight*weight));
+  }
+  else {
+    atomic_add(double_contents[cell], weight);
+    atomic_add(double_sumw2[cell], weight*weight);
+  }
+}
+
+/**
+ * method to write merged bins into histogram
+ */
+void BoundedBinStorage::write_to(TH1* histogram) {
+  histogram->Sumw2();
+  if (storage == HistogramStorage::sparse_slots) {
+    std::unordered_map<uint64_t, std::pair<double, double>> merged_cells;
+    for (unsigned int slot = 0; slot < slot_sparse_cells.size(); slot++) {
+      for (std::pair<const uint64_t, std::pair<double, double>> sparse_cell : slot_sparse_cells[slot]) {
+        std::pair<double, double> &merged_cell = merged_cells[sparse_cell.first];
+        merged_cell.first += sparse_cell.second.first;
+        merged_cell.second += sparse_cell.second.second;
+      }
+      slot_sparse_cells[slot].clear();
+    }
+    for (std::pair<const uint64_t, std::pair<double, double>> merged_cell : merged_cells) {
+      histogram->SetBinContent(static_cast<int>(merged_cell.first), merged_cell.second.first);
+      histogram->SetBinError(static_cast<int>(merged_cell.first), sqrt(merged_cell.second.second));
+    }
+  }
+  else {
+    for (uint64_t cell = 0; cell < num_cells; cell++) {
+      double content = 0, sumw2 = 0;
+      if (precision == BinPrecision::integer_counts) {
+        content = static_cast<double>(integer_contents[cell].load());
+        sumw2 = static_cast<double>(integer_sumw2[cell].load());
+      }
+      else if (precision == BinPrecision::float_precision) {
+        content = static_cast<double>(float_contents[cell].load());
+        sumw2 = static_cast<double>(float_sumw2[cell].load());
+      }
+      else {
+        content = double_contents[cell].load();
+        sumw2 = double_sumw2[cell].load();
+      }
+      histogram->SetBinContent(static_cast<int>(cell), content);
+      histogram->SetBinError(static_cast<int>(cell), sqrt(sumw2));
+    }
+  }
+  double entries = 0;
+  for (SlotEntryCount slot_entry : slot_entries)
+    entries += slot_entry.entries;
+  histogram->SetEntries(entries);
+}
+
+/**
+ * constructor, result is initialized as an empty copy of model
+ */
+BoundedHistogram1DHelper::BoundedHistogram1DHelper(std::shared_ptr<TH1D> model, HistogramStorage storage, BinPrecision precision, unsigned int num_slots)
+  : result(model)
+{
+  result->SetDirectory(nullptr);
+  bin_storage.reset(new BoundedBinStorage(storage, precision, static_cast<uint64_t>(result->GetNcells()), num_slots));
+}
+
+/**
+ * methods required by RDataFrame for custom actions
+ */
+std::shared_ptr<TH1D> BoundedHistogram1DHelper::GetResultPtr() const {
+  return result;
+}
+
+void BoundedHistogram1DHelper::Initialize() {}
+
+void BoundedHistogram1DHelper::InitTask(TTreeReader *, unsigned int) {}
+
+void BoundedHistogram1DHelper::Exec(unsigned int slot, double value, double weight) {
+  //FindFixBin never extends the axes, so it is safe to call from all slots
+  bin_storage->fill(slot, static_cast<uint64_t>(result->FindFixBin(value)), weight);
+}
+
+void BoundedHistogram1DHelper::Finalize() {
+  bin_storage->write_to(result.get());
+  bin_storage.reset();
+}
+
+std::string BoundedHistogram1DHelper::GetActionName() {
+  return "BoundedHistogram1D";
+}
+
+/**
+ * constructor, result is initialized as an empty copy of model
+ */
+BoundedHistogram2DHelper::BoundedHistogram2DHelper(std::shared_ptr<TH2D> model, HistogramStorage storage, BinPrecision precision, unsigned int num_slots)
+  : result(model)
+{
+  result->SetDirectory(nullptr);
+  bin_storage.reset(new BoundedBinStorage(storage, precision, static_cast<uint64_t>(result->GetNcells()), num_slots));
+}
+
+/**
+ * methods required by RDataFrame for custom actions
+ */
+std::shared_ptr<TH2D> BoundedHistogram2DHelper::GetResultPtr() const {
+  return result;
+}
+
+void BoundedHistogram2DHelper::Initialize() {}
+
+void BoundedHistogram2DHelper::InitTask(TTreeReader *, unsigned int) {}
+
+void BoundedHistogram2DHelper::Exec(unsigned int slot, double x_value, double y_value, double weight) {
+  bin_storage->fill(slot, static_cast<uint64_t>(result->FindFixBin(x_value, y_value)), weight);
+}
+
+void BoundedHistogram2DHelper::Finalize() {
+  bin_storage->write_to(result.get());
+  bin_storage.reset();
+}
+
+std::string BoundedHistogram2DHelper::GetActionName() {
+  return "BoundedHistogram2D";
+}
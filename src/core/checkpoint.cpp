@@ -0,0 +1,83 @@
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "core/checkpoint.hxx"
+#include "core/result_cache.hxx"
+
+/**
+ * constructor
+ * i_checkpoint_directory - directory in which checkpoints are stored, created if it does not exist
+ * graph_hash - hash of everything determining the results of the units, see ResultCache::hash
+ */
+Checkpoint::Checkpoint(std::string i_checkpoint_directory, std::string graph_hash) {
+  mkdir(i_checkpoint_directory.c_str(), 0755);
+  checkpoint_directory = i_checkpoint_directory+"/"+graph_hash;
+  mkdir(checkpoint_directory.c_str(), 0755);
+  generation = 0;
+}
+
+/**
+ * internal function returning directory holding the results of generation i_generation
+ */
+std::string Checkpoint::generation_directory(unsigned int i_generation) {
+  return checkpoint_directory+"/generation_"+std::to_string(i_generation);
+}
+
+/**
+ * method to read the indices of completed units and add their results to results
+ * returns false if there is no checkpoint
+ */
+bool Checkpoint::load(std::vector<unsigned int> &completed_units, ResultCache* results) {
+  std::ifstream state_file(checkpoint_directory+"/state");
+  if (!state_file.is_open()) return false;
+  unsigned int num_units = 0;
+  if (!(state_file >> generation >> num_units)) {
+    std::cout << "ERROR: unable to read checkpoint state in " << checkpoint_directory << std::endl;
+    generation = 0;
+    return false;
+  }
+  completed_units.clear();
+  unsigned int unit_idx = 0;
+  while (completed_units.size() < num_units && state_file >> unit_idx)
+    completed_units.push_back(unit_idx);
+  ResultCache generation_cache(generation_directory(generation));
+  for (std::string key : generation_cache.list_keys())
+    results->accumulate(key, &generation_cache);
+  std::cout << "Resuming from checkpoint with " << completed_units.size() << " completed units" << std::endl;
+  return true;
+}
+
+/**
+ * method to replace the checkpoint with completed_units and the sum of their results held in results
+ */
+void Checkpoint::save(std::vector<unsigned int> completed_units, ResultCache* results) {
+  //results of a generation are complete before the state file points to it
+  unsigned int new_generation = generation+1;
+  ResultCache generation_cache(generation_directory(new_generation));
+  generation_cache.clear();
+  for (std::string key : results->list_keys())
+    generation_cache.accumulate(key, results);
+  std::string temporary_filename = checkpoint_directory+"/state.tmp";
+  {
+    std::ofstream state_file(temporary_filename);
+    state_file << new_generation << " " << completed_units.size() << "\n";
+    for (unsigned int unit_idx : completed_units)
+      state_file << unit_idx << "\n";
+  }
+  if (std::rename(temporary_filename.c_str(), (checkpoint_directory+"/state").c_str()) != 0) {
+    std::cout << "ERROR: unable to write checkpoint state in " << checkpoint_directory << std::endl;
+    return;
+  }
+  ResultCache previous_generation_cache(generation_directory(generation));
+  previous_generation_cache.clear();
+  rmdir(generation_directory(generation).c_str());
+  generation = new_generation;
+  std::cout << "Saved checkpoint with " << completed_units.size() << " completed units" << std::endl;
+}
@@ -0,0 +1,542 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Compression.h"
+#include "RZip.h"
+#include "TFile.h"
+#include "TTree.h"
+
+#include "core/column_cache.hxx"
+#include "core/result_cache.hxx"
+
+namespace {
+
+const char column_cache_magic[8] = {'R','D','F','C','O','L','C','1'};
+const uint32_t column_cache_version = 1;
+//largest buffer compressed by a single call of the ROOT compression routines
+const uint64_t max_zip_chunk = 0xffffff;
+
+/**
+ * returns size rounded up to a multiple of 8 bytes
+ */
+uint64_t padded_size(uint64_t size) {
+  return (size+7u)/8u*8u;
+}
+
+/**
+ * function to set type to the column type of a leaf type name, returns false for unsupported types
+ */
+bool get_column_type(std::string leaf_type_name, ColumnCacheType &type) {
+  const std::map<std::string, ColumnCacheType> leaf_types = {
+    {"Float_t", ColumnCacheType::float32}, {"Double_t", ColumnCacheType::float64},
+    {"Char_t", ColumnCacheType::int8}, {"UChar_t", ColumnCacheType::uint8}, {"Bool_t", ColumnCacheType::boolean},
+    {"Short_t", ColumnCacheType::int16}, {"UShort_t", ColumnCacheType::uint16},
+    {"Int_t", ColumnCacheType::int32}, {"UInt_t", ColumnCacheType::uint32},
+    {"Long64_t", ColumnCacheType::int64}, {"ULong64_t", ColumnCacheType::uint64}};
+  std::map<std::string, ColumnCacheType>::const_iterator leaf_type = leaf_types.find(leaf_type_name);
+  if (leaf_type == leaf_types.end()) return false;
+  type = leaf_type->second;
+  return true;
+}
+
+/**
+ * returns size in bytes of a value of a column type
+ */
+uint64_t get_type_size(ColumnCacheType type) {
+  switch (type) {
+    case ColumnCacheType::int8:
+    case ColumnCacheType::uint8:
+    case ColumnCacheType::boolean:
+      return 1;
+    case ColumnCacheType::int16:
+    case ColumnCacheType::uint16:
+      return 2;
+    case ColumnCacheType::float32:
+    case ColumnCacheType::int32:
+    case ColumnCacheType::uint32:
+      return 4;
+    case ColumnCacheType::float64:
+    case ColumnCacheType::int64:
+    case ColumnCacheType::uint64:
+      return 8;
+    default:
+      return 0;
+  }
+}
+
+/**
+ * returns C++ name of a column type, as used in jitted expressions
+ */
+std::string get_type_name(ColumnCacheType type) {
+  switch (type) {
+    case ColumnCacheType::float32: return "float";
+    case ColumnCacheType::float64: return "double";
+    case ColumnCacheType::int8: return "char";
+    case ColumnCacheType::uint8: return "unsigned char";
+    case ColumnCacheType::boolean: return "bool";
+    case ColumnCacheType::int16: return "short";
+    case ColumnCacheType::uint16: return "unsigned short";
+    case ColumnCacheType::int32: return "int";
+    case ColumnCacheType::uint32: return "unsigned int";
+    case ColumnCacheType::int64: return "Long64_t";
+    case ColumnCacheType::uint64: return "ULong64_t";
+    default: return "";
+  }
+}
+
+/**
+ * returns a new reader of a column of a given type
+ */
+ColumnCacheReaderBase* make_reader(ColumnCacheType type, unsigned int num_slots, bool is_jagged) {
+  switch (type) {
+    case ColumnCacheType::float32: return new ColumnCacheReader<Float_t>(num_slots, is_jagged);
+    case ColumnCacheType::float64: return new ColumnCacheReader<Double_t>(num_slots, is_jagged);
+    case ColumnCacheType::int8: return new ColumnCacheReader<Char_t>(num_slots, is_jagged);
+    case ColumnCacheType::uint8: return new ColumnCacheReader<UChar_t>(num_slots, is_jagged);
+    case ColumnCacheType::boolean: return new ColumnCacheReader<Bool_t>(num_slots, is_jagged);
+    case ColumnCacheType::int16: return new ColumnCacheReader<Short_t>(num_slots, is_jagged);
+    case ColumnCacheType::uint16: return new ColumnCacheReader<UShort_t>(num_slots, is_jagged);
+    case ColumnCacheType::int32: return new ColumnCacheReader<Int_t>(num_slots, is_jagged);
+    case ColumnCacheType::uint32: return new ColumnCacheReader<UInt_t>(num_slots, is_jagged);
+    case ColumnCacheType::int64: return new ColumnCacheReader<Long64_t>(num_slots, is_jagged);
+    case ColumnCacheType::uint64: return new ColumnCacheReader<ULong64_t>(num_slots, is_jagged);
+    default: return nullptr;
+  }
+}
+
+/**
+ * function to LZ4-compress raw into compressed with the ROOT compression routines
+ * returns false if the data do not compress, in which case the raw values should be stored
+ */
+bool compress_values(std::vector<char> &raw, std::vector<char> &compressed) {
+  compressed.assign(raw.size(), 0);
+  uint64_t compressed_size = 0;
+  for (uint64_t chunk_begin = 0; chunk_begin < raw.size(); chunk_begin += max_zip_chunk) {
+    int chunk_size = static_cast<int>(std::min(max_zip_chunk, raw.size()-chunk_begin));
+    int available_size = static_cast<int>(std::min(max_zip_chunk, raw.size()-compressed_size));
+    int stored_size = 0;
+    R__zipMultipleAlgorithm(4, &chunk_size, raw.data()+chunk_begin, &available_size, compressed.data()+compressed_size,
+        &stored_size, ROOT::RCompressionSetting::EAlgorithm::kLZ4);
+    if (stored_size <= 0) return false;
+    compressed_size += static_cast<uint64_t>(stored_size);
+  }
+  compressed.resize(compressed_size);
+  return compressed_size < raw.size();
+}
+
+/**
+ * function to decompress stored_size bytes at stored into raw_size bytes at raw, returns false on corrupt data
+ */
+bool decompress_values(char* stored, uint64_t stored_size, char* raw, uint64_t raw_size) {
+  uint64_t stored_position = 0, raw_position = 0;
+  while (raw_position < raw_size) {
+    int chunk_stored_size = 0, chunk_raw_size = 0;
+    unsigned char* chunk = reinterpret_cast<unsigned char*>(stored+stored_position);
+    if (stored_position >= stored_size || R__unzip_header(&chunk_stored_size, chunk, &chunk_raw_size) != 0
+        || chunk_raw_size <= 0 || raw_position+static_cast<uint64_t>(chunk_raw_size) > raw_size)
+      return false;
+    int decompressed_size = 0;
+    R__unzip(&chunk_stored_size, chunk, &chunk_raw_size, reinterpret_cast<unsigned char*>(raw+raw_position), &decompressed_size);
+    if (decompressed_size != chunk_raw_size) return false;
+    stored_position += static_cast<uint64_t>(chunk_stored_size);
+    raw_position += static_cast<uint64_t>(chunk_raw_size);
+  }
+  return true;
+}
+
+/**
+ * function to write raw bytes followed by zeros up to a multiple of 8 bytes and advance offset
+ */
+void write_padded(std::ofstream &output_file, uint64_t &offset, const void* data, uint64_t size) {
+  const char padding[8] = {0,0,0,0,0,0,0,0};
+  output_file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+  output_file.write(padding, static_cast<std::streamsize>(padded_size(size)-size));
+  offset += padded_size(size);
+}
+
+}
+
+/**
+ * returns path of the cache of columns of tree_name in root_filename under cache_directory
+ */
+std::string ColumnCacheWriter::get_cache_filename(std::string cache_directory, std::string root_filename, std::string tree_name, std::vector<std::string> columns, bool compress) {
+  std::string description = ResultCache::file_identity(root_filename)+"|tree:"+tree_name+"|lz4:"+(compress ? "1" : "0");
+  for (std::string column : columns)
+    description += "|"+column;
+  return cache_directory+"/"+ResultCache::hash(description)+".colc";
+}
+
+/**
+ * method to write columns of tree_name in root_filename to cache_filename, returns false on failure
+ */
+bool ColumnCacheWriter::build(std::string root_filename, std::string tree_name, std::vector<std::string> columns, std::string cache_filename, bool compress, uint64_t entries_per_block) {
+  std::unique_ptr<TFile> input_file(TFile::Open(root_filename.c_str()));
+  if (!input_file || input_file->IsZombie()) {
+    std::cout << "ERROR: unable to open " << root_filename << std::endl;
+    return false;
+  }
+  TTree* tree = input_file->Get<TTree>(tree_name.c_str());
+  if (tree == nullptr || columns.size() == 0 || entries_per_block == 0) {
+    std::cout << "ERROR: no tree " << tree_name << " or no columns to cache in " << root_filename << std::endl;
+    return false;
+  }
+  //only cached branches (and the counters of their lengths) are read, into buffers holding their longest entry
+  tree->SetBranchStatus("*", false);
+  std::vector<TLeaf*> leaves;
+  std::vector<ColumnCacheType> types;
+  std::map<std::string, std::vector<char>> branch_buffers;
+  for (std::string column : columns) {
+    TLeaf* leaf = tree->GetLeaf(column.c_str());
+    ColumnCacheType type = ColumnCacheType::float32;
+    if (leaf == nullptr || !get_column_type(leaf->GetTypeName(), type) || branch_buffers.count(column) > 0) {
+      std::cout << "ERROR: column " << column << " is missing, repeated, or not of a basic type in " << root_filename << std::endl;
+      return false;
+    }
+    TLeaf* count_leaf = leaf->GetLeafCount();
+    uint64_t max_length = static_cast<uint64_t>(std::max(leaf->GetLenStatic(), 1));
+    if (count_leaf != nullptr) {
+      max_length *= static_cast<uint64_t>(std::max(count_leaf->GetMaximum(), 1));
+      std::string count_branch_name = count_leaf->GetBranch()->GetName();
+      if (branch_buffers.count(count_branch_name) == 0) {
+        branch_buffers[count_branch_name].assign(8, 0);
+        tree->SetBranchStatus(count_branch_name.c_str(), true);
+        tree->SetBranchAddress(count_branch_name.c_str(), branch_buffers[count_branch_name].data());
+      }
+    }
+    branch_buffers[column].assign(max_length*get_type_size(type), 0);
+    tree->SetBranchStatus(column.c_str(), true);
+    tree->SetBranchAddress(column.c_str(), branch_buffers[column].data());
+    leaves.push_back(leaf);
+    types.push_back(type);
+  }
+  std::string temporary_filename = cache_filename+".tmp";
+  std::ofstream output_file(temporary_filename.c_str(), std::ios::binary | std::ios::trunc);
+  if (!output_file.is_open()) {
+    std::cout << "ERROR: unable to open column cache " << temporary_filename << std::endl;
+    return false;
+  }
+  //header is rewritten with final table locations at the end
+  ColumnCacheHeader header;
+  std::memset(&header, 0, sizeof(header));
+  uint64_t current_offset = 0;
+  write_padded(output_file, current_offset, &header, sizeof(header));
+  unsigned int num_columns = static_cast<unsigned int>(columns.size());
+  std::vector<std::vector<char>> block_values(num_columns);
+  std::vector<std::vector<uint64_t>> block_offsets(num_columns, std::vector<uint64_t>(1, 0));
+  std::vector<ColumnCacheBlock> block_table;
+  ULong64_t num_entries = static_cast<ULong64_t>(tree->GetEntries());
+  for (ULong64_t entry = 0; entry < num_entries; entry++) {
+    if (tree->GetEntry(static_cast<Long64_t>(entry)) < 0) {
+      std::cout << "ERROR: unable to read entry " << entry << " of " << root_filename << std::endl;
+      output_file.close();
+      std::remove(temporary_filename.c_str());
+      return false;
+    }
+    for (unsigned int column_idx = 0; column_idx < num_columns; column_idx++) {
+      uint64_t length = static_cast<uint64_t>(leaves[column_idx]->GetLen());
+      const char* values = branch_buffers[columns[column_idx]].data();
+      block_values[column_idx].insert(block_values[column_idx].end(), values, values+length*get_type_size(types[column_idx]));
+      block_offsets[column_idx].push_back(block_offsets[column_idx].back()+length);
+    }
+    if ((entry+1)%entries_per_block != 0 && entry+1 != num_entries) continue;
+    for (unsigned int column_idx = 0; column_idx < num_columns; column_idx++) {
+      ColumnCacheBlock block;
+      std::memset(&block, 0, sizeof(block));
+      if (leaves[column_idx]->GetLeafCount() != nullptr || leaves[column_idx]->GetLenStatic() > 1) {
+        block.offsets_offset = current_offset;
+        write_padded(output_file, current_offset, block_offsets[column_idx].data(), block_offsets[column_idx].size()*sizeof(uint64_t));
+      }
+      std::vector<char> compressed_values;
+      block.raw_size = block_values[column_idx].size();
+      block.is_compressed = (compress && compress_values(block_values[column_idx], compressed_values)) ? 1 : 0;
+      std::vector<char> &stored_values = block.is_compressed ? compressed_values : block_values[column_idx];
+      block.values_offset = current_offset;
+      block.stored_size = stored_values.size();
+      write_padded(output_file, current_offset, stored_values.data(), stored_values.size());
+      block_table.push_back(block);
+      block_values[column_idx].clear();
+      block_offsets[column_idx].assign(1, 0);
+    }
+  }
+  std::vector<ColumnCacheColumn> column_table;
+  for (unsigned int column_idx = 0; column_idx < num_columns; column_idx++) {
+    ColumnCacheColumn column;
+    std::memset(&column, 0, sizeof(column));
+    column.name_offset = current_offset;
+    column.name_length = columns[column_idx].size();
+    column.type = static_cast<uint32_t>(types[column_idx]);
+    column.is_jagged = (leaves[column_idx]->GetLeafCount() != nullptr || leaves[column_idx]->GetLenStatic() > 1) ? 1 : 0;
+    write_padded(output_file, current_offset, columns[column_idx].data(), columns[column_idx].size());
+    column_table.push_back(column);
+  }
+  std::memcpy(header.magic, column_cache_magic, sizeof(column_cache_magic));
+  header.version = column_cache_version;
+  header.num_columns = num_columns;
+  header.num_entries = num_entries;
+  header.entries_per_block = entries_per_block;
+  header.num_blocks = block_table.size()/num_columns;
+  header.column_table_offset = current_offset;
+  write_padded(output_file, current_offset, column_table.data(), column_table.size()*sizeof(ColumnCacheColumn));
+  header.block_table_offset = current_offset;
+  write_padded(output_file, current_offset, block_table.data(), block_table.size()*sizeof(ColumnCacheBlock));
+  output_file.seekp(0);
+  output_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  output_file.close();
+  if (!output_file || std::rename(temporary_filename.c_str(), cache_filename.c_str()) != 0) {
+    std::cout << "ERROR: unable to write column cache " << cache_filename << std::endl;
+    std::remove(temporary_filename.c_str());
+    return false;
+  }
+  return true;
+}
+
+/**
+ * constructor
+ */
+ColumnCacheReaderBase::ColumnCacheReaderBase(unsigned int num_slots)
+  : value_pointers(num_slots, nullptr)
+{}
+
+/**
+ * destructor
+ */
+ColumnCacheReaderBase::~ColumnCacheReaderBase() {}
+
+/**
+ * returns pointers to the value pointer of each slot, see RDataSource::GetColumnReadersImpl
+ */
+std::vector<void*> ColumnCacheReaderBase::get_readers() {
+  std::vector<void*> readers;
+  for (void* &value_pointer : value_pointers)
+    readers.push_back(&value_pointer);
+  return readers;
+}
+
+/**
+ * constructor, maps i_cache_filenames into memory; all files must hold the same columns
+ */
+ColumnCacheDataSource::ColumnCacheDataSource(std::vector<std::string> i_cache_filenames)
+  : cache_filenames(i_cache_filenames), num_slots(1), ranges_returned(false), entries_selected(false)
+{
+  ULong64_t first_entry = 0;
+  for (std::string cache_filename : cache_filenames) {
+    int file_descriptor = open(cache_filename.c_str(), O_RDONLY);
+    struct stat file_status;
+    if (file_descriptor < 0 || fstat(file_descriptor, &file_status) != 0
+        || static_cast<uint64_t>(file_status.st_size) < sizeof(ColumnCacheHeader)) {
+      std::cout << "ERROR: column cache " << cache_filename << " is missing or unreadable" << std::endl;
+      if (file_descriptor >= 0) close(file_descriptor);
+      return;
+    }
+    //mapped copy-on-write, so array columns handed out as views may be modified without touching the file
+    MappedCacheFile file;
+    file.mapped_size = static_cast<uint64_t>(file_status.st_size);
+    void* mapping = mmap(nullptr, file.mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file_descriptor, 0);
+    close(file_descriptor);
+    if (mapping == MAP_FAILED) {
+      std::cout << "ERROR: unable to map column cache " << cache_filename << std::endl;
+      return;
+    }
+    file.mapped_data = static_cast<char*>(mapping);
+    file.header = reinterpret_cast<const ColumnCacheHeader*>(file.mapped_data);
+    file.block_table = reinterpret_cast<const ColumnCacheBlock*>(file.mapped_data+file.header->block_table_offset);
+    file.first_entry = first_entry;
+    files.push_back(file);
+    const ColumnCacheHeader* header = file.header;
+    bool valid = std::memcmp(header->magic, column_cache_magic, sizeof(column_cache_magic)) == 0
+        && header->version == column_cache_version && header->entries_per_block > 0
+        && header->column_table_offset+header->num_columns*sizeof(ColumnCacheColumn) <= file.mapped_size
+        && header->block_table_offset+header->num_blocks*header->num_columns*sizeof(ColumnCacheBlock) <= file.mapped_size;
+    const ColumnCacheColumn* column_table = reinterpret_cast<const ColumnCacheColumn*>(file.mapped_data+header->column_table_offset);
+    if (valid && column_names.size() == 0) {
+      for (unsigned int column_idx = 0; column_idx < header->num_columns; column_idx++) {
+        column_names.push_back(std::string(file.mapped_data+column_table[column_idx].name_offset, column_table[column_idx].name_length));
+        column_types.push_back(static_cast<ColumnCacheType>(column_table[column_idx].type));
+        column_jagged.push_back(column_table[column_idx].is_jagged != 0);
+      }
+    }
+    valid = valid && header->num_columns == column_names.size();
+    for (unsigned int column_idx = 0; valid && column_idx < column_names.size(); column_idx++) {
+      valid = std::string(file.mapped_data+column_table[column_idx].name_offset, column_table[column_idx].name_length) == column_names[column_idx]
+          && static_cast<ColumnCacheType>(column_table[column_idx].type) == column_types[column_idx]
+          && (column_table[column_idx].is_jagged != 0) == column_jagged[column_idx];
+    }
+    if (!valid) {
+      std::cout << "ERROR: " << cache_filename << " is not a valid column cache or holds other columns than "
+          << cache_filenames[0] << std::endl;
+      munmap(file.mapped_data, file.mapped_size);
+      files.pop_back();
+      return;
+    }
+    first_entry += header->num_entries;
+  }
+}
+
+/**
+ * destructor, unmaps cache files
+ */
+ColumnCacheDataSource::~ColumnCacheDataSource() {
+  for (MappedCacheFile &file : files)
+    munmap(file.mapped_data, file.mapped_size);
+}
+
+/**
+ * returns true if all cache files were mapped successfully
+ */
+bool ColumnCacheDataSource::is_open() {
+  return files.size() == cache_filenames.size();
+}
+
+/**
+ * method to read only entries in i_selected_ranges, sorted [begin, end) ranges of chained entries, in the next
+ * event loops
+ */
+void ColumnCacheDataSource::set_entry_ranges(std::vector<std::pair<ULong64_t, ULong64_t>> i_selected_ranges) {
+  entries_selected = true;
+  selected_ranges = i_selected_ranges;
+}
+
+/**
+ * internal function returning index of column name, or -1 if absent
+ */
+int ColumnCacheDataSource::find_column(std::string_view name) const {
+  for (unsigned int column_idx = 0; column_idx < column_names.size(); column_idx++) {
+    if (column_names[column_idx] == name) return static_cast<int>(column_idx);
+  }
+  return -1;
+}
+
+/**
+ * internal function to make the block holding entry current for slot, decompressing it if needed
+ */
+void ColumnCacheDataSource::load_block(unsigned int slot, ULong64_t entry) {
+  SlotBlock &slot_block = slot_blocks[slot];
+  unsigned int file_idx = 0;
+  while (file_idx+1 < files.size() && files[file_idx+1].first_entry <= entry)
+    file_idx++;
+  const MappedCacheFile &file = files[file_idx];
+  slot_block.file_idx = static_cast<int>(file_idx);
+  slot_block.block_idx = (entry-file.first_entry)/file.header->entries_per_block;
+  slot_block.first_entry = file.first_entry+slot_block.block_idx*file.header->entries_per_block;
+  slot_block.end_entry = std::min(slot_block.first_entry+file.header->entries_per_block, file.first_entry+file.header->num_entries);
+  slot_block.buffers.resize(readers.size());
+  for (unsigned int reader_idx = 0; reader_idx < readers.size(); reader_idx++) {
+    const ColumnCacheBlock &block = file.block_table[slot_block.block_idx*file.header->num_columns+reader_columns[reader_idx]];
+    if (!block.is_compressed) continue;
+    slot_block.buffers[reader_idx].resize(block.raw_size);
+    if (!decompress_values(file.mapped_data+block.values_offset, block.stored_size, slot_block.buffers[reader_idx].data(), block.raw_size))
+      throw std::runtime_error("corrupt block in column cache "+cache_filenames[file_idx]);
+  }
+}
+
+/**
+ * methods required by RDataFrame for data sources
+ */
+ColumnCacheDataSource::Record_t ColumnCacheDataSource::GetColumnReadersImpl(std::string_view name, const std::type_info &type_info) {
+  int column_idx = find_column(name);
+  if (column_idx < 0)
+    throw std::runtime_error("column "+std::string(name)+" is not in the column cache");
+  unsigned int column = static_cast<unsigned int>(column_idx);
+  std::unique_ptr<ColumnCacheReaderBase> reader(make_reader(column_types[column], num_slots, column_jagged[column]));
+  if (!reader || reader->get_type() != type_info)
+    throw std::runtime_error("column "+std::string(name)+" is cached with type "+GetTypeName(name));
+  readers.push_back(std::move(reader));
+  reader_columns.push_back(column);
+  //slots reload their block so that buffers of the new reader are filled
+  for (SlotBlock &slot_block : slot_blocks)
+    slot_block.file_idx = -1;
+  return readers.back()->get_readers();
+}
+
+void ColumnCacheDataSource::SetNSlots(unsigned int i_num_slots) {
+  num_slots = i_num_slots;
+  slot_blocks.assign(num_slots, SlotBlock());
+  for (SlotBlock &slot_block : slot_blocks)
+    slot_block.file_idx = -1;
+}
+
+const std::vector<std::string> &ColumnCacheDataSource::GetColumnNames() const {
+  return column_names;
+}
+
+bool ColumnCacheDataSource::HasColumn(std::string_view name) const {
+  return find_column(name) >= 0;
+}
+
+std::string ColumnCacheDataSource::GetTypeName(std::string_view name) const {
+  int column_idx = find_column(name);
+  if (column_idx < 0) return "";
+  std::string type_name = get_type_name(column_types[static_cast<unsigned int>(column_idx)]);
+  if (column_jagged[static_cast<unsigned int>(column_idx)])
+    return "ROOT::VecOps::RVec<"+type_name+">";
+  return type_name;
+}
+
+std::vector<std::pair<ULong64_t, ULong64_t>> ColumnCacheDataSource::GetEntryRanges() {
+  //all blocks are handed out at once, one range per block
+  std::vector<std::pair<ULong64_t, ULong64_t>> entry_ranges;
+  if (ranges_returned) return entry_ranges;
+  ranges_returned = true;
+  for (const MappedCacheFile &file : files) {
+    for (uint64_t block_idx = 0; block_idx < file.header->num_blocks; block_idx++) {
+      ULong64_t block_begin = file.first_entry+block_idx*file.header->entries_per_block;
+      ULong64_t block_end = std::min(block_begin+file.header->entries_per_block, file.first_entry+file.header->num_entries);
+      if (!entries_selected) {
+        entry_ranges.push_back(std::make_pair(block_begin, block_end));
+        continue;
+      }
+      for (std::pair<ULong64_t, ULong64_t> selected_range : selected_ranges) {
+        ULong64_t overlap_begin = std::max(block_begin, selected_range.first);
+        ULong64_t overlap_end = std::min(block_end, selected_range.second);
+        if (overlap_end > overlap_begin) entry_ranges.push_back(std::make_pair(overlap_begin, overlap_end));
+      }
+    }
+  }
+  return entry_ranges;
+}
+
+bool ColumnCacheDataSource::SetEntry(unsigned int slot, ULong64_t entry) {
+  SlotBlock &slot_block = slot_blocks[slot];
+  if (slot_block.file_idx < 0 || entry < slot_block.first_entry || entry >= slot_block.end_entry)
+    load_block(slot, entry);
+  const MappedCacheFile &file = files[static_cast<unsigned int>(slot_block.file_idx)];
+  uint64_t block_entry = entry-slot_block.first_entry;
+  for (unsigned int reader_idx = 0; reader_idx < readers.size(); reader_idx++) {
+    unsigned int column = reader_columns[reader_idx];
+    const ColumnCacheBlock &block = file.block_table[slot_block.block_idx*file.header->num_columns+column];
+    char* values = block.is_compressed ? slot_block.buffers[reader_idx].data() : file.mapped_data+block.values_offset;
+    if (column_jagged[column]) {
+      const uint64_t* offsets = reinterpret_cast<const uint64_t*>(file.mapped_data+block.offsets_offset);
+      readers[reader_idx]->set_value(slot, values, offsets[block_entry], offsets[block_entry+1]);
+    }
+    else {
+      readers[reader_idx]->set_value(slot, values, block_entry, block_entry+1);
+    }
+  }
+  return true;
+}
+
+void ColumnCacheDataSource::Initialize() {
+  ranges_returned = false;
+}
+
+std::string ColumnCacheDataSource::GetLabel() {
+  return "ColumnCache";
+}
@@ -0,0 +1,38 @@
+//this gets included directly into column_cache.hxx in order to get general templates
+
+/**
+ * constructor
+ */
+template<typename T>
+ColumnCacheReader<T>::ColumnCacheReader(unsigned int num_slots, bool i_is_jagged)
+  : ColumnCacheReaderBase(num_slots), is_jagged(i_is_jagged), slot_views(num_slots)
+{
+  if (is_jagged) {
+    for (unsigned int slot = 0; slot < num_slots; slot++)
+      value_pointers[slot] = &slot_views[slot];
+  }
+}
+
+/**
+ * method to point the value of slot to elements [begin, end) of values
+ */
+template<typename T>
+void ColumnCacheReader<T>::set_value(unsigned int slot, char* values, uint64_t begin, uint64_t end) {
+  T* first_value = reinterpret_cast<T*>(values)+begin;
+  if (!is_jagged) {
+    value_pointers[slot] = first_value;
+    return;
+  }
+  //the adopted memory is not owned, so it is not freed when the view is replaced
+  ROOT::RVec<T> view(first_value, static_cast<std::size_t>(end-begin));
+  std::swap(slot_views[slot], view);
+}
+
+/**
+ * returns type of column values as read by RDataFrame
+ */
+template<typename T>
+const std::type_info& ColumnCacheReader<T>::get_type() {
+  if (is_jagged) return typeid(ROOT::RVec<T>);
+  return typeid(T);
+}
@@ -0,0 +1,437 @@
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "RVersion.h"
+#include "TH1.h"
+#include "TH2.h"
+
+#include "ROOT/RResultPtr.hxx"
+#include "ROOT/RDF/RInterface.hxx"
+#include "ROOT/RDF/HistoModels.hxx"
+
+#include "core/result_cache.hxx"
+#include "core/compiled_expression_cache.hxx"
+
+namespace {
+
+typedef void (*NodeFunction)(ROOT::RDF::RNode*, const char*);
+typedef void (*SumFunction)(ROOT::RDF::RNode*, ROOT::RDF::RResultPtr<double>*);
+typedef void (*Histo1DFunction)(ROOT::RDF::RNode*, const ROOT::RDF::TH1DModel*, ROOT::RDF::RResultPtr<TH1D>*);
+typedef void (*Histo2DFunction)(ROOT::RDF::RNode*, const ROOT::RDF::TH2DModel*, ROOT::RDF::RResultPtr<TH2D>*);
+
+/**
+ * returns function pointer of type F to symbol, dlsym returns object pointers
+ */
+template<typename F>
+F to_function(void* symbol) {
+  F function = nullptr;
+  std::memcpy(&function, &symbol, sizeof(function));
+  return function;
+}
+
+/**
+ * returns name of the compiled function for key
+ */
+std::string function_name(std::string key) {
+  return "compiled_expression_"+key;
+}
+
+/**
+ * returns columns as C++ string literals separated by commas
+ */
+std::string column_arguments(std::vector<std::string> columns) {
+  std::string arguments = "";
+  for (unsigned int column_idx = 0; column_idx < columns.size(); column_idx++)
+    arguments += (column_idx > 0 ? ", \"" : "\"")+columns[column_idx]+"\"";
+  return arguments;
+}
+
+/**
+ * returns columns as a C++ initializer list of strings
+ */
+std::string column_list(std::vector<std::string> columns) {
+  return "{"+column_arguments(columns)+"}";
+}
+
+/**
+ * returns items joined with ", "
+ */
+std::string join(std::vector<std::string> items) {
+  std::string joined = "";
+  for (unsigned int item_idx = 0; item_idx < items.size(); item_idx++)
+    joined += (item_idx > 0 ? ", " : "")+items[item_idx];
+  return joined;
+}
+
+/**
+ * returns words of text separated by whitespace
+ */
+std::vector<std::string> split_words(std::string text) {
+  std::vector<std::string> words;
+  std::istringstream text_stream(text);
+  std::string word;
+  while (text_stream >> word)
+    words.push_back(word);
+  return words;
+}
+
+/**
+ * runs program arguments[0] with arguments (looked up in PATH, without a shell so arguments are never reinterpreted)
+ * with stdout and stderr written to log_filename, returns true if it exited with status 0
+ */
+bool run_program(std::vector<std::string> arguments, std::string log_filename) {
+  std::vector<char*> argument_pointers;
+  for (std::string &argument : arguments)
+    argument_pointers.push_back(&argument[0]);
+  argument_pointers.push_back(nullptr);
+  pid_t program_pid = fork();
+  if (program_pid < 0) return false;
+  if (program_pid == 0) {
+    int log_fd = open(log_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (log_fd >= 0) {
+      dup2(log_fd, STDOUT_FILENO);
+      dup2(log_fd, STDERR_FILENO);
+      close(log_fd);
+    }
+    execvp(argument_pointers[0], argument_pointers.data());
+    _exit(127);
+  }
+  int program_status = 0;
+  if (waitpid(program_pid, &program_status, 0) != program_pid) return false;
+  return WIFEXITED(program_status) && WEXITSTATUS(program_status) == 0;
+}
+
+}
+
+/**
+ * constructor
+ * i_cache_directory - directory holding compiled libraries, a subdirectory is used for each ROOT version
+ * i_headers - headers included in compiled code, ex. declaring functions called by expressions
+ * i_compile_flags - additional g++ flags, ex. include directories of the headers
+ */
+CompiledExpressionCache::CompiledExpressionCache(std::string i_cache_directory, std::vector<std::string> i_headers,
+    std::string i_compile_flags) {
+  headers = i_headers;
+  compile_flags = split_words(i_compile_flags);
+  std::string root_version = ROOT_RELEASE;
+  for (char &version_char : root_version)
+    if (version_char == '/') version_char = '.';
+  mkdir(i_cache_directory.c_str(), 0755);
+  cache_directory = i_cache_directory+"/root_"+root_version;
+  mkdir(cache_directory.c_str(), 0755);
+  //compiled code depends on the g++ found at run time (not the one that compiled this file), on the flags, and on
+  //the headers, so they are part of every key
+  std::istringstream version_stream(get_program_output({"g++", "--version"}));
+  std::getline(version_stream, compiler_version);
+  if (compiler_version == "")
+    std::cout << "ERROR: unable to run g++ --version, expressions will not be compiled" << std::endl;
+  root_flags = split_words(get_program_output({"root-config", "--cflags"}));
+  key_context = compiler_version+"|"+join(root_flags)+"|"+join(compile_flags);
+  for (std::string header : headers)
+    key_context += "|"+ResultCache::file_identity(header);
+  //index lines are "key library", libraries are only loaded once one of their expressions is booked
+  std::ifstream index_file((cache_directory+"/index").c_str());
+  std::string index_key, index_library;
+  while (index_file >> index_key >> index_library)
+    library_filenames[index_key] = cache_directory+"/"+index_library;
+  std::ifstream failed_file((cache_directory+"/failed_expressions").c_str());
+  std::string failed_key;
+  while (failed_file >> failed_key)
+    failed_keys.insert(failed_key);
+}
+
+/**
+ * destructor, pending expressions are not compiled (see compile); libraries stay loaded since booked data frames
+ * run their code
+ */
+CompiledExpressionCache::~CompiledExpressionCache() {
+  if (pending_sources.size() > 0)
+    std::cout << "WARNING: " << pending_sources.size() << " jitted expressions were not compiled, see CompiledExpressionCache::compile" << std::endl;
+}
+
+/**
+ * internal function returning handle of a compiled library, loaded on first use, or nullptr if it cannot be loaded
+ */
+void* CompiledExpressionCache::load_library(std::string library_filename) {
+  std::map<std::string, void*>::iterator library_handle = library_handles.find(library_filename);
+  if (library_handle != library_handles.end()) return library_handle->second;
+  void* new_library_handle = dlopen(library_filename.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if (new_library_handle == nullptr)
+    std::cout << "ERROR: unable to load compiled expressions " << library_filename << ": " << dlerror() << std::endl;
+  //failures are also remembered so that they are reported once
+  library_handles[library_filename] = new_library_handle;
+  return new_library_handle;
+}
+
+/**
+ * internal function returning output (stdout and stderr) of running arguments, or an empty string if it fails
+ */
+std::string CompiledExpressionCache::get_program_output(std::vector<std::string> arguments) {
+  std::string output_filename = cache_directory+"/program_output."+std::to_string(getpid())+".tmp";
+  std::string output = "";
+  if (run_program(arguments, output_filename)) {
+    std::ifstream output_file(output_filename.c_str());
+    std::ostringstream output_stream;
+    output_stream << output_file.rdbuf();
+    output = output_stream.str();
+  }
+  std::remove(output_filename.c_str());
+  return output;
+}
+
+/**
+ * internal function returning names of columns of node used as identifiers in expression, in order of appearance
+ */
+std::vector<std::string> CompiledExpressionCache::get_expression_columns(ROOT::RDF::RNode &node, std::string expression) {
+  std::vector<std::string> columns;
+  std::set<std::string> seen_identifiers;
+  size_t position = 0;
+  while (position < expression.size()) {
+    char expression_char = expression[position];
+    if (expression_char == '"' || expression_char == '\'') {
+      //skip string and character literals
+      position++;
+      while (position < expression.size() && expression[position] != expression_char)
+        position += (expression[position] == '\\') ? 2u : 1u;
+      position++;
+      continue;
+    }
+    if (std::isdigit(static_cast<unsigned char>(expression_char))) {
+      //skip numbers including suffixes, ex. 1.5f or 0x1full
+      while (position < expression.size() && (std::isalnum(static_cast<unsigned char>(expression[position]))
+          || expression[position] == '_' || expression[position] == '.'))
+        position++;
+      continue;
+    }
+    if (!std::isalpha(static_cast<unsigned char>(expression_char)) && expression_char != '_') {
+      position++;
+      continue;
+    }
+    size_t identifier_begin = position;
+    while (position < expression.size() && (std::isalnum(static_cast<unsigned char>(expression[position]))
+        || expression[position] == '_'))
+      position++;
+    std::string identifier = expression.substr(identifier_begin, position-identifier_begin);
+    //members (a.b, a->b) and scoped names (a::b) are not columns
+    size_t previous = identifier_begin > 0 ? expression.find_last_not_of(" \t\n", identifier_begin-1) : std::string::npos;
+    if (previous != std::string::npos && (expression[previous] == '.'
+        || (previous > 0 && (expression.compare(previous-1, 2, "->") == 0 || expression.compare(previous-1, 2, "::") == 0))))
+      continue;
+    size_t next = expression.find_first_not_of(" \t\n", position);
+    if (next != std::string::npos && expression.compare(next, 2, "::") == 0)
+      continue;
+    if (seen_identifiers.insert(identifier).second && node.HasColumn(identifier))
+      columns.push_back(identifier);
+  }
+  return columns;
+}
+
+/**
+ * internal function returning the type of column as a parameter declaration, ex. "const Float_t &MET_pt"
+ */
+std::string CompiledExpressionCache::get_parameter(ROOT::RDF::RNode &node, std::string column) {
+  return "const "+node.GetColumnType(column)+" &"+column;
+}
+
+/**
+ * internal function returning key of an expression described by description
+ */
+std::string CompiledExpressionCache::get_key(std::string description) {
+  return ResultCache::hash(description+"|"+key_context);
+}
+
+/**
+ * internal function returning function compiled for key, or nullptr after adding source to pending expressions
+ */
+void* CompiledExpressionCache::get_function(std::string key, std::string source, std::string expression) {
+  std::map<std::string, void*>::iterator function = functions.find(key);
+  if (function != functions.end()) return function->second;
+  std::map<std::string, std::string>::iterator library_filename = library_filenames.find(key);
+  if (library_filename != library_filenames.end()) {
+    void* library_handle = load_library(library_filename->second);
+    void* symbol = library_handle != nullptr ? dlsym(library_handle, function_name(key).c_str()) : nullptr;
+    if (symbol != nullptr) {
+      functions[key] = symbol;
+      return symbol;
+    }
+  }
+  if (failed_keys.count(key) == 0) {
+    pending_sources[key] = source;
+    pending_expressions[key] = expression;
+  }
+  return nullptr;
+}
+
+/**
+ * methods to book compiled versions of RInterface::Define(name, expression) and RInterface::Filter(expression, name)
+ * on node, returns false (leaving node unchanged) if the expression is not compiled yet
+ */
+bool CompiledExpressionCache::define(ROOT::RDF::RNode &node, std::string name, std::string expression) {
+  std::vector<std::string> columns = get_expression_columns(node, expression);
+  std::vector<std::string> parameters;
+  for (std::string column : columns)
+    parameters.push_back(get_parameter(node, column));
+  std::string key = get_key("define|"+expression+"|"+join(parameters));
+  std::string source = "extern \"C\" void "+function_name(key)+"(ROOT::RDF::RNode *node, const char *name) {\n"
+      +"  *node = node->Define(name, []("+join(parameters)+") { return ("+expression+"); }, "+column_list(columns)+");\n}\n";
+  void* function = get_function(key, source, expression);
+  if (function == nullptr) return false;
+  to_function<NodeFunction>(function)(&node, name.c_str());
+  return true;
+}
+
+bool CompiledExpressionCache::filter(ROOT::RDF::RNode &node, std::string expression, std::string filter_name) {
+  std::vector<std::string> columns = get_expression_columns(node, expression);
+  std::vector<std::string> parameters;
+  for (std::string column : columns)
+    parameters.push_back(get_parameter(node, column));
+  std::string key = get_key("filter|"+expression+"|"+join(parameters));
+  std::string source = "extern \"C\" void "+function_name(key)+"(ROOT::RDF::RNode *node, const char *filter_name) {\n"
+      +"  *node = node->Filter([]("+join(parameters)+") -> bool { return ("+expression+"); }, "+column_list(columns)
+      +", filter_name);\n}\n";
+  void* function = get_function(key, source, expression);
+  if (function == nullptr) return false;
+  to_function<NodeFunction>(function)(&node, filter_name.c_str());
+  return true;
+}
+
+/**
+ * methods to book typed versions of RInterface::Sum, Histo1D and Histo2D on columns of node (weight_column may be
+ * empty), returns false if they are not compiled yet
+ */
+bool CompiledExpressionCache::sum(ROOT::RDF::RNode &node, std::string column, ROOT::RDF::RResultPtr<double> &result) {
+  if (!node.HasColumn(column)) return false;
+  std::string column_type = node.GetColumnType(column);
+  std::string key = get_key("sum|"+column+"|"+column_type);
+  std::string source = "extern \"C\" void "+function_name(key)+"(ROOT::RDF::RNode *node, ROOT::RDF::RResultPtr<double> *result) {\n"
+      +"  *result = node->Sum<"+column_type+">(\""+column+"\");\n}\n";
+  void* function = get_function(key, source, "Sum("+column+")");
+  if (function == nullptr) return false;
+  to_function<SumFunction>(function)(&node, &result);
+  return true;
+}
+
+bool CompiledExpressionCache::histo_1d(ROOT::RDF::RNode &node, const ROOT::RDF::TH1DModel &model, std::string column,
+    std::string weight_column, ROOT::RDF::RResultPtr<TH1D> &result) {
+  std::vector<std::string> columns = {column};
+  if (weight_column != "") columns.push_back(weight_column);
+  std::vector<std::string> column_types;
+  for (std::string histogram_column : columns) {
+    if (!node.HasColumn(histogram_column)) return false;
+    column_types.push_back(node.GetColumnType(histogram_column));
+  }
+  std::string key = get_key("histo_1d|"+join(columns)+"|"+join(column_types));
+  std::string source = "extern \"C\" void "+function_name(key)
+      +"(ROOT::RDF::RNode *node, const ROOT::RDF::TH1DModel *model, ROOT::RDF::RResultPtr<TH1D> *result) {\n"
+      +"  *result = node->Histo1D<"+join(column_types)+">(*model, "+column_arguments(columns)+");\n}\n";
+  void* function = get_function(key, source, "Histo1D("+join(columns)+")");
+  if (function == nullptr) return false;
+  to_function<Histo1DFunction>(function)(&node, &model, &result);
+  return true;
+}
+
+bool CompiledExpressionCache::histo_2d(ROOT::RDF::RNode &node, const ROOT::RDF::TH2DModel &model, std::string x_column,
+    std::string y_column, std::string weight_column, ROOT::RDF::RResultPtr<TH2D> &result) {
+  std::vector<std::string> columns = {x_column, y_column};
+  if (weight_column != "") columns.push_back(weight_column);
+  std::vector<std::string> column_types;
+  for (std::string histogram_column : columns) {
+    if (!node.HasColumn(histogram_column)) return false;
+    column_types.push_back(node.GetColumnType(histogram_column));
+  }
+  std::string key = get_key("histo_2d|"+join(columns)+"|"+join(column_types));
+  std::string source = "extern \"C\" void "+function_name(key)
+      +"(ROOT::RDF::RNode *node, const ROOT::RDF::TH2DModel *model, ROOT::RDF::RResultPtr<TH2D> *result) {\n"
+      +"  *result = node->Histo2D<"+join(column_types)+">(*model, "+column_arguments(columns)+");\n}\n";
+  void* function = get_function(key, source, "Histo2D("+join(columns)+")");
+  if (function == nullptr) return false;
+  to_function<Histo2DFunction>(function)(&node, &model, &result);
+  return true;
+}
+
+/**
+ * method to compile pending expressions into a new library of the cache
+ */
+void CompiledExpressionCache::compile() {
+  if (pending_sources.size() == 0) return;
+  if (compiler_version == "") {
+    std::cout << "ERROR: g++ is not available, " << pending_sources.size() << " expressions stay jitted" << std::endl;
+    pending_sources.clear();
+    pending_expressions.clear();
+    return;
+  }
+  std::vector<std::string> keys;
+  for (std::pair<const std::string, std::string> &pending_source : pending_sources)
+    keys.push_back(pending_source.first);
+  compile_batch(keys);
+  pending_sources.clear();
+  pending_expressions.clear();
+}
+
+/**
+ * internal function compiling keys of pending expressions into one library, splitting batches that fail
+ */
+void CompiledExpressionCache::compile_batch(std::vector<std::string> keys) {
+  std::string batch_name = "expressions_"+ResultCache::hash(join(keys));
+  std::string source_filename = cache_directory+"/"+batch_name+".cxx";
+  std::string log_filename = cache_directory+"/"+batch_name+".log";
+  std::string library_filename = cache_directory+"/"+batch_name+".so";
+  //libraries are written under a temporary name so that concurrent runs never load a partial library
+  std::string temporary_filename = library_filename+"."+std::to_string(getpid())+".tmp";
+  {
+    std::ofstream source_file(source_filename.c_str());
+    source_file << "#include <cmath>\n#include \"TMath.h\"\n#include \"ROOT/RVec.hxx\"\n#include \"ROOT/RDataFrame.hxx\"\n";
+    for (std::string header : headers)
+      source_file << "#include \"" << header << "\"\n";
+    source_file << "using namespace ROOT::VecOps;\n\n";
+    for (std::string key : keys)
+      source_file << pending_sources[key] << "\n";
+  }
+  std::cout << "Compiling " << keys.size() << " expressions into " << library_filename << std::endl;
+  std::vector<std::string> arguments = {"g++", "-O2", "-shared", "-fPIC"};
+  arguments.insert(arguments.end(), root_flags.begin(), root_flags.end());
+  arguments.insert(arguments.end(), compile_flags.begin(), compile_flags.end());
+  arguments.insert(arguments.end(), {"-o", temporary_filename, source_filename});
+  if (run_program(arguments, log_filename) && std::rename(temporary_filename.c_str(), library_filename.c_str()) == 0) {
+    std::remove(source_filename.c_str());
+    std::remove(log_filename.c_str());
+    //the library is complete before it is indexed, so concurrent runs only load finished libraries
+    std::string index_lines = "";
+    for (std::string key : keys) {
+      index_lines += key+" "+batch_name+".so\n";
+      library_filenames[key] = library_filename;
+    }
+    std::ofstream index_file((cache_directory+"/index").c_str(), std::ios::app);
+    index_file << index_lines << std::flush;
+    return;
+  }
+  std::remove(temporary_filename.c_str());
+  if (keys.size() == 1) {
+    //source and log are kept to show why the expression stays jitted
+    std::cout << "WARNING: unable to compile " << pending_expressions[keys[0]] << ", see " << log_filename << std::endl;
+    failed_keys.insert(keys[0]);
+    std::ofstream failed_file((cache_directory+"/failed_expressions").c_str(), std::ios::app);
+    failed_file << keys[0] << std::endl;
+    return;
+  }
+  std::remove(source_filename.c_str());
+  std::remove(log_filename.c_str());
+  compile_batch(std::vector<std::string>(keys.begin(), keys.begin()+static_cast<long>(keys.size()/2)));
+  compile_batch(std::vector<std::string>(keys.begin()+static_cast<long>(keys.size()/2), keys.end()));
+}
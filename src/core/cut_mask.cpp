@@ -0,0 +1,218 @@
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Rtypes.h"
+#include "TTreeReader.h"
+
+#include "core/cut_mask.hxx"
+
+/**
+ * returns weighted (or unweighted, if weighted is false) yield of view for cut cut_idx in region region_idx
+ * for the sequential and n_minus_one views, cut_idx num_cuts gives events passing all cuts
+ * for first_failing, cut_idx num_cuts gives events passing all cuts as well
+ */
+double CutMaskYields::get_yield(CutflowView view, unsigned int region_idx, unsigned int cut_idx, bool weighted) const {
+  const std::vector<double> &first_failing = weighted ? first_failing_yields : first_failing_counts;
+  const std::vector<double> &only_failing = weighted ? only_failing_yields : only_failing_counts;
+  unsigned int first_offset = region_idx*(num_cuts+1);
+  double all_pass = first_failing[first_offset+num_cuts];
+  switch (view) {
+    case CutflowView::sequential: {
+      //events pass cuts 0..cut_idx if their first failing cut is after cut_idx
+      double yield = 0.;
+      for (unsigned int failing_idx = cut_idx+1; failing_idx <= num_cuts; failing_idx++)
+        yield += first_failing[first_offset+failing_idx];
+      return cut_idx >= num_cuts ? all_pass : yield;
+    }
+    case CutflowView::n_minus_one:
+      if (cut_idx >= num_cuts) return all_pass;
+      return all_pass+only_failing[region_idx*num_cuts+cut_idx];
+    case CutflowView::first_failing:
+      return first_failing[first_offset+(cut_idx >= num_cuts ? num_cuts : cut_idx)];
+    default:
+      return 0.;
+  }
+}
+
+/**
+ * returns statistical uncertainty of get_yield
+ */
+double CutMaskYields::get_uncertainty(CutflowView view, unsigned int region_idx, unsigned int cut_idx, bool weighted) const {
+  if (!weighted)
+    return sqrt(get_yield(view, region_idx, cut_idx, false));
+  //sumw2 adds in the same way as the yields, so reuse get_yield on a copy holding sumw2
+  CutMaskYields sumw2_yields;
+  sumw2_yields.num_cuts = num_cuts;
+  sumw2_yields.num_regions = num_regions;
+  sumw2_yields.first_failing_yields = first_failing_sumw2;
+  sumw2_yields.only_failing_yields = only_failing_sumw2;
+  return sqrt(sumw2_yields.get_yield(view, region_idx, cut_idx, true));
+}
+
+/**
+ * returns yield of events entering the cutflow in region region_idx
+ */
+double CutMaskYields::get_total(unsigned int region_idx, bool weighted) const {
+  const std::vector<double> &first_failing = weighted ? first_failing_yields : first_failing_counts;
+  double total = 0.;
+  for (unsigned int failing_idx = 0; failing_idx <= num_cuts; failing_idx++)
+    total += first_failing[region_idx*(num_cuts+1)+failing_idx];
+  return total;
+}
+
+/**
+ * method to add yields of another result with the same cuts and regions (ex. from another branch of the graph)
+ */
+void CutMaskYields::add(const CutMaskYields &other) {
+  add_scaled(other, 1., 1., 1.);
+}
+
+/**
+ * method to add yields of another result scaled by yield_scale, its sums of squared weights scaled by sumw2_scale,
+ * and its counts scaled by count_scale
+ */
+void CutMaskYields::add_scaled(const CutMaskYields &other, double yield_scale, double sumw2_scale, double count_scale) {
+  std::vector<double> scales = {yield_scale, sumw2_scale, count_scale, yield_scale, sumw2_scale, count_scale};
+  std::vector<std::vector<double>*> arrays = {&first_failing_yields, &first_failing_sumw2, &first_failing_counts,
+      &only_failing_yields, &only_failing_sumw2, &only_failing_counts};
+  std::vector<const std::vector<double>*> other_arrays = {&other.first_failing_yields, &other.first_failing_sumw2,
+      &other.first_failing_counts, &other.only_failing_yields, &other.only_failing_sumw2, &other.only_failing_counts};
+  for (unsigned int array_idx = 0; array_idx < arrays.size(); array_idx++) {
+    if (arrays[array_idx]->size() < other_arrays[array_idx]->size())
+      arrays[array_idx]->resize(other_arrays[array_idx]->size(), 0.);
+    for (unsigned int cell = 0; cell < other_arrays[array_idx]->size(); cell++)
+      (*arrays[array_idx])[cell] += scales[array_idx]*(*other_arrays[array_idx])[cell];
+  }
+}
+
+/**
+ * returns number of values in get_values for num_cuts cuts and num_regions regions
+ * region num_regions is the inclusive selection
+ */
+unsigned int CutMaskYields::num_values(unsigned int num_cuts, unsigned int num_regions) {
+  return 3*(num_regions+1)*(num_cuts+1)+3*(num_regions+1)*num_cuts;
+}
+
+/**
+ * returns all yields as one list, used to store results in a ResultCache; lists add elementwise
+ */
+std::vector<double> CutMaskYields::get_values() const {
+  std::vector<double> values;
+  for (const std::vector<double>* array : {&first_failing_yields, &first_failing_sumw2, &first_failing_counts,
+      &only_failing_yields, &only_failing_sumw2, &only_failing_counts})
+    values.insert(values.end(), array->begin(), array->end());
+  return values;
+}
+
+/**
+ * method to set yields from get_values of a result with the same num_cuts and num_regions
+ * returns false if the number of values does not match
+ */
+bool CutMaskYields::set_values(std::vector<double> values) {
+  if (values.size() != num_values(num_cuts, num_regions)) return false;
+  std::vector<std::vector<double>*> arrays = {&first_failing_yields, &first_failing_sumw2, &first_failing_counts,
+      &only_failing_yields, &only_failing_sumw2, &only_failing_counts};
+  size_t first_failing_size = static_cast<size_t>(num_regions+1)*(num_cuts+1);
+  size_t only_failing_size = static_cast<size_t>(num_regions+1)*num_cuts;
+  size_t offset = 0;
+  for (unsigned int array_idx = 0; array_idx < arrays.size(); array_idx++) {
+    size_t array_size = (array_idx < 3) ? first_failing_size : only_failing_size;
+    arrays[array_idx]->assign(values.begin()+static_cast<long>(offset), values.begin()+static_cast<long>(offset+array_size));
+    offset += array_size;
+  }
+  return true;
+}
+
+/**
+ * constructor
+ */
+CutMaskHelper::CutMaskHelper(unsigned int num_cuts, unsigned int num_regions, unsigned int num_slots) {
+  result = std::make_shared<CutMaskYields>();
+  result->num_cuts = num_cuts;
+  result->num_regions = num_regions;
+  all_cuts_mask = (num_cuts >= 64) ? ~0ull : (1ull << num_cuts)-1ull;
+  //region num_regions is the inclusive selection
+  std::vector<double> first_failing_zeros((num_regions+1)*(num_cuts+1), 0.);
+  std::vector<double> only_failing_zeros((num_regions+1)*num_cuts, 0.);
+  slot_first_failing_yields.assign(num_slots, first_failing_zeros);
+  slot_first_failing_sumw2.assign(num_slots, first_failing_zeros);
+  slot_first_failing_counts.assign(num_slots, first_failing_zeros);
+  slot_only_failing_yields.assign(num_slots, only_failing_zeros);
+  slot_only_failing_sumw2.assign(num_slots, only_failing_zeros);
+  slot_only_failing_counts.assign(num_slots, only_failing_zeros);
+}
+
+/**
+ * internal function to add an event with given cut mask to region region_idx
+ */
+void CutMaskHelper::fill_region(unsigned int slot, unsigned int region_idx, ULong64_t failed_cuts, double weight) {
+  unsigned int num_cuts = result->num_cuts;
+  unsigned int first_failing_idx = num_cuts;
+  if (failed_cuts != 0)
+    first_failing_idx = static_cast<unsigned int>(__builtin_ctzll(failed_cuts));
+  unsigned int first_failing_cell = region_idx*(num_cuts+1)+first_failing_idx;
+  slot_first_failing_yields[slot][first_failing_cell] += weight;
+  slot_first_failing_sumw2[slot][first_failing_cell] += weight*weight;
+  slot_first_failing_counts[slot][first_failing_cell] += 1.;
+  //exactly one failed cut
+  if (failed_cuts != 0 && (failed_cuts & (failed_cuts-1ull)) == 0) {
+    unsigned int only_failing_cell = region_idx*num_cuts+first_failing_idx;
+    slot_only_failing_yields[slot][only_failing_cell] += weight;
+    slot_only_failing_sumw2[slot][only_failing_cell] += weight*weight;
+    slot_only_failing_counts[slot][only_failing_cell] += 1.;
+  }
+}
+
+/**
+ * methods required by RDataFrame for custom actions
+ */
+std::shared_ptr<CutMaskYields> CutMaskHelper::GetResultPtr() const {
+  return result;
+}
+
+void CutMaskHelper::Initialize() {}
+
+void CutMaskHelper::InitTask(TTreeReader *, unsigned int) {}
+
+void CutMaskHelper::Exec(unsigned int slot, ULong64_t cut_mask, ULong64_t region_mask, double weight) {
+  //every cut was evaluated once for the mask, so all views are filled from the failed bits alone
+  ULong64_t failed_cuts = ~cut_mask & all_cuts_mask;
+  fill_region(slot, result->num_regions, failed_cuts, weight);
+  for (unsigned int region_idx = 0; region_idx < result->num_regions; region_idx++) {
+    if ((region_mask >> region_idx) & 1ull)
+      fill_region(slot, region_idx, failed_cuts, weight);
+  }
+}
+
+void CutMaskHelper::Finalize() {
+  std::vector<std::vector<std::vector<double>>*> all_slot_arrays = {&slot_first_failing_yields, &slot_first_failing_sumw2,
+      &slot_first_failing_counts, &slot_only_failing_yields, &slot_only_failing_sumw2, &slot_only_failing_counts};
+  std::vector<std::vector<double>*> result_arrays = {&result->first_failing_yields, &result->first_failing_sumw2,
+      &result->first_failing_counts, &result->only_failing_yields, &result->only_failing_sumw2, &result->only_failing_counts};
+  for (unsigned int array_idx = 0; array_idx < result_arrays.size(); array_idx++) {
+    std::vector<std::vector<double>> &slots = *all_slot_arrays[array_idx];
+    std::vector<double> &merged = *result_arrays[array_idx];
+    merged.assign(slots.size() > 0 ? slots[0].size() : 0, 0.);
+    for (unsigned int slot = 0; slot < slots.size(); slot++) {
+      for (unsigned int cell = 0; cell < merged.size(); cell++)
+        merged[cell] += slots[slot][cell];
+    }
+    slots.clear();
+  }
+}
+
+std::string CutMaskHelper::GetActionName() {
+  return "CutMask";
+}
+
+/**
+ * returns jitted expression packing the results of cuts into a ULong64_t bitmask, bit i set if cuts[i] passes
+ */
+std::string get_cut_mask_expression(std::vector<std::string> cuts) {
+  std::string expression = "static_cast<ULong64_t>(0ull";
+  for (unsigned int cut_idx = 0; cut_idx < cuts.size() && cut_idx < 64; cut_idx++)
+    expression += "|(("+cuts[cut_idx]+") ? "+std::to_string(1ull << cut_idx)+"ull : 0ull)";
+  return expression+")";
+}
@@ -0,0 +1,250 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <glob.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "TBranch.h"
+#include "TChain.h"
+#include "TFile.h"
+#include "TLeaf.h"
+#include "TROOT.h"
+#include "TTree.h"
+
+#include "core/result_cache.hxx"
+#include "core/dataset_manifest.hxx"
+
+/**
+ * constructor, loads the manifest and updates it if any matched file changed
+ */
+DatasetManifest::DatasetManifest(std::vector<std::string> i_filename_patterns, std::string i_tree_name,
+    std::string manifest_directory, unsigned int num_threads) {
+  tree_name = i_tree_name;
+  valid = true;
+  mkdir(manifest_directory.c_str(), 0755);
+  std::string description = "tree:"+tree_name;
+  for (std::string filename_pattern : i_filename_patterns)
+    description += "|"+filename_pattern;
+  manifest_filename = manifest_directory+"/"+ResultCache::hash(description)+".manifest";
+  //listing and stat-ing files is cheap compared to opening them, so matches are always refreshed
+  for (std::string filename_pattern : i_filename_patterns) {
+    std::vector<std::string> matched_filenames;
+    glob_t glob_result;
+    if (glob(filename_pattern.c_str(), 0, nullptr, &glob_result) == 0) {
+      for (size_t match_idx = 0; match_idx < glob_result.gl_pathc; match_idx++)
+        matched_filenames.push_back(glob_result.gl_pathv[match_idx]);
+    }
+    globfree(&glob_result);
+    //patterns matching no local file (ex. remote URLs) are used as file names and always opened
+    if (matched_filenames.size() == 0)
+      matched_filenames.push_back(filename_pattern);
+    for (std::string matched_filename : matched_filenames) {
+      ManifestFile file;
+      file.filename = matched_filename;
+      file.size = -1;
+      file.inode = 0;
+      file.modification_time = -1;
+      file.entries = 0;
+      struct stat file_status;
+      if (stat(matched_filename.c_str(), &file_status) == 0) {
+        file.size = static_cast<long long>(file_status.st_size);
+        file.inode = static_cast<unsigned long long>(file_status.st_ino);
+        file.modification_time = static_cast<long long>(file_status.st_mtim.tv_sec)*1000000000ll
+            +static_cast<long long>(file_status.st_mtim.tv_nsec);
+      }
+      files.push_back(file);
+    }
+  }
+  std::vector<ManifestFile> stored_files = load();
+  //datasets can have tens of thousands of files, so stored files are looked up by name instead of scanned
+  std::unordered_map<std::string, unsigned int> stored_file_indices;
+  for (unsigned int stored_idx = 0; stored_idx < stored_files.size(); stored_idx++)
+    stored_file_indices.emplace(stored_files[stored_idx].filename, stored_idx);
+  std::vector<unsigned int> changed_files;
+  for (unsigned int file_idx = 0; file_idx < files.size(); file_idx++) {
+    std::unordered_map<std::string, unsigned int>::const_iterator stored_index = stored_file_indices.find(files[file_idx].filename);
+    //a file replaced by another one (ex. moved over it) gets a new inode even if size and time match
+    if (stored_index != stored_file_indices.end() && files[file_idx].size >= 0
+        && stored_files[stored_index->second].size == files[file_idx].size
+        && stored_files[stored_index->second].inode == files[file_idx].inode
+        && stored_files[stored_index->second].modification_time == files[file_idx].modification_time)
+      files[file_idx] = stored_files[stored_index->second];
+    else
+      changed_files.push_back(file_idx);
+  }
+  if (changed_files.size() == 0) return;
+  std::cout << "Updating dataset manifest " << manifest_filename << " with " << changed_files.size() << " files" << std::endl;
+  if (num_threads == 0)
+    num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+  num_threads = std::min(num_threads, static_cast<unsigned int>(changed_files.size()));
+  ROOT::EnableThreadSafety();
+  std::atomic<unsigned int> next_file(0);
+  std::atomic<bool> scans_succeeded(true);
+  std::vector<std::thread> scan_threads;
+  for (unsigned int thread_idx = 0; thread_idx < num_threads; thread_idx++) {
+    scan_threads.emplace_back([this, &changed_files, &next_file, &scans_succeeded]() {
+      for (unsigned int change_idx = next_file++; change_idx < changed_files.size(); change_idx = next_file++) {
+        if (!scan_file(files[changed_files[change_idx]]))
+          scans_succeeded = false;
+      }
+    });
+  }
+  for (std::thread &scan_thread : scan_threads)
+    scan_thread.join();
+  if (!scans_succeeded) {
+    valid = false;
+    return;
+  }
+  store();
+}
+
+/**
+ * internal function opening file.filename to fill its entries, clusters, and branches, returns false on failure
+ */
+bool DatasetManifest::scan_file(ManifestFile &file) {
+  std::unique_ptr<TFile> input_file(TFile::Open(file.filename.c_str(), "READ"));
+  if (!input_file || input_file->IsZombie()) {
+    std::cout << "ERROR: unable to open " << file.filename << std::endl;
+    return false;
+  }
+  TTree* tree = input_file->Get<TTree>(tree_name.c_str());
+  if (tree == nullptr) {
+    std::cout << "ERROR: unable to read tree " << tree_name << " from " << file.filename << std::endl;
+    return false;
+  }
+  file.entries = static_cast<ULong64_t>(tree->GetEntries());
+  file.cluster_starts.clear();
+  TTree::ClusterIterator cluster_iterator = tree->GetClusterIterator(0);
+  Long64_t cluster_start = 0;
+  while ((cluster_start = cluster_iterator.Next()) < tree->GetEntries())
+    file.cluster_starts.push_back(static_cast<ULong64_t>(cluster_start));
+  file.branches.clear();
+  TObjArray* branch_list = tree->GetListOfBranches();
+  for (int branch_idx = 0; branch_idx < branch_list->GetEntries(); branch_idx++) {
+    TBranch* branch = static_cast<TBranch*>(branch_list->At(branch_idx));
+    std::string branch_type = "";
+    if (branch->GetListOfLeaves()->GetEntries() > 0)
+      branch_type = static_cast<TLeaf*>(branch->GetListOfLeaves()->At(0))->GetTypeName();
+    file.branches.push_back(std::string(branch->GetName())+":"+branch_type);
+  }
+  return true;
+}
+
+/**
+ * internal function returning files stored in the manifest file, empty if there is none
+ */
+std::vector<ManifestFile> DatasetManifest::load() {
+  std::vector<ManifestFile> stored_files;
+  std::ifstream manifest_file(manifest_filename.c_str());
+  std::string line;
+  //manifests of older versions are rebuilt
+  if (!std::getline(manifest_file, line) || line != "manifest 2 "+tree_name) return stored_files;
+  while (std::getline(manifest_file, line)) {
+    //file lines are "file size inode modification_time entries num_clusters num_branches filename"
+    std::istringstream line_stream(line);
+    std::string line_type;
+    ManifestFile file;
+    unsigned int num_clusters = 0, num_branches = 0;
+    if (!(line_stream >> line_type >> file.size >> file.inode >> file.modification_time >> file.entries >> num_clusters >> num_branches)
+        || line_type != "file") return std::vector<ManifestFile>();
+    line_stream.get();
+    std::getline(line_stream, file.filename);
+    std::getline(manifest_file, line);
+    std::istringstream cluster_stream(line);
+    file.cluster_starts.resize(num_clusters);
+    for (unsigned int cluster_idx = 0; cluster_idx < num_clusters; cluster_idx++)
+      cluster_stream >> file.cluster_starts[cluster_idx];
+    file.branches.resize(num_branches);
+    for (unsigned int branch_idx = 0; branch_idx < num_branches; branch_idx++)
+      std::getline(manifest_file, file.branches[branch_idx]);
+    if (!manifest_file) return std::vector<ManifestFile>();
+    stored_files.push_back(file);
+  }
+  return stored_files;
+}
+
+/**
+ * internal function writing the manifest file
+ * the manifest is written to a temporary file and renamed so that concurrent jobs never read a partial one
+ */
+void DatasetManifest::store() {
+  std::string temporary_filename = manifest_filename+".tmp";
+  {
+    std::ofstream manifest_file(temporary_filename.c_str());
+    if (!manifest_file.is_open()) {
+      std::cout << "WARNING: unable to write dataset manifest " << manifest_filename << std::endl;
+      return;
+    }
+    manifest_file << "manifest 2 " << tree_name << "\n";
+    for (ManifestFile &file : files) {
+      manifest_file << "file " << file.size << " " << file.inode << " " << file.modification_time << " " << file.entries << " "
+          << file.cluster_starts.size() << " " << file.branches.size() << " " << file.filename << "\n";
+      for (unsigned int cluster_idx = 0; cluster_idx < file.cluster_starts.size(); cluster_idx++)
+        manifest_file << (cluster_idx > 0 ? " " : "") << file.cluster_starts[cluster_idx];
+      manifest_file << "\n";
+      for (std::string branch : file.branches)
+        manifest_file << branch << "\n";
+    }
+  }
+  std::rename(temporary_filename.c_str(), manifest_filename.c_str());
+}
+
+/**
+ * returns false if any matched file could not be read
+ */
+bool DatasetManifest::is_valid() {
+  return valid;
+}
+
+/**
+ * returns names of all matched files, in chain order
+ */
+std::vector<std::string> DatasetManifest::get_filenames() {
+  std::vector<std::string> filenames;
+  for (ManifestFile &file : files)
+    filenames.push_back(file.filename);
+  return filenames;
+}
+
+/**
+ * returns number of entries of each matched file
+ */
+std::vector<ULong64_t> DatasetManifest::get_file_entries() {
+  std::vector<ULong64_t> file_entries;
+  for (ManifestFile &file : files)
+    file_entries.push_back(file.entries);
+  return file_entries;
+}
+
+/**
+ * returns (file-local) first entry of each cluster of file file_idx
+ */
+std::vector<ULong64_t> DatasetManifest::get_cluster_starts(unsigned int file_idx) {
+  return files[file_idx].cluster_starts;
+}
+
+/**
+ * returns "name:type" of each branch of the tree of the first file
+ */
+std::vector<std::string> DatasetManifest::get_branches() {
+  if (files.size() == 0) return std::vector<std::string>();
+  return files[0].branches;
+}
+
+/**
+ * method to add all files to chain with their known number of entries, so that they are not opened
+ */
+void DatasetManifest::add_to_chain(TChain &chain) {
+  for (ManifestFile &file : files)
+    chain.Add(file.filename.c_str(), static_cast<Long64_t>(file.entries));
+}
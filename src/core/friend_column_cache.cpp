@@ -0,0 +1,33 @@
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "core/result_cache.hxx"
+#include "core/friend_column_cache.hxx"
+
+/**
+ * returns name of the friend tree holding column_name
+ */
+std::string FriendColumnCache::get_tree_name(std::string column_name) {
+  return "friend_"+column_name;
+}
+
+/**
+ * returns name of the friend file holding a column with definition for tree tree_name of root_filename
+ */
+std::string FriendColumnCache::get_filename(std::string cache_directory, std::string root_filename, std::string tree_name, std::string definition) {
+  std::string description = ResultCache::file_identity(root_filename)+"|tree:"+tree_name+"|definition:"+definition;
+  return cache_directory+"/"+ResultCache::hash(description)+".root";
+}
+
+/**
+ * returns true if all friend_filenames exist
+ */
+bool FriendColumnCache::all_exist(std::vector<std::string> friend_filenames) {
+  for (std::string friend_filename : friend_filenames) {
+    struct stat file_status;
+    if (stat(friend_filename.c_str(), &file_status) != 0) return false;
+  }
+  return true;
+}
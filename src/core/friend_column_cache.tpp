@@ -0,0 +1,157 @@
+//this gets included directly into friend_column_cache.hxx in order to get general templates
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+
+#include "TFile.h"
+#include "TTree.h"
+
+//number of consecutive entries a slot collects before writing them
+static const size_t friend_chunk_entries = 65536;
+
+/**
+ * returns mutex serializing writes of friend files, which are written by event loop threads
+ */
+inline std::mutex& get_friend_write_mutex() {
+  static std::mutex write_mutex;
+  return write_mutex;
+}
+
+/**
+ * constructor
+ * i_friend_filenames - friend file of each input file
+ * file_entries - number of entries of each input file
+ * i_enabled - flag read when the event loop starts, nothing is written if it is false
+ */
+template<typename T>
+FriendColumnHelper<T>::FriendColumnHelper(std::string i_column_name, std::vector<std::string> i_friend_filenames,
+    std::vector<ULong64_t> file_entries, unsigned int num_slots, std::shared_ptr<bool> i_enabled)
+  : column_name(i_column_name), friend_filenames(i_friend_filenames), slot_chunks(num_slots),
+    slot_chunk_begins(num_slots, 0), slot_files(num_slots, 0), enabled(i_enabled), active(false),
+    result(new ULong64_t(0))
+{
+  file_begin_entries.push_back(0);
+  for (unsigned int file_idx = 0; file_idx < file_entries.size(); file_idx++) {
+    file_begin_entries.push_back(file_begin_entries.back()+file_entries[file_idx]);
+    friend_files.emplace_back(new FriendFile());
+  }
+}
+
+/**
+ * methods required by RDataFrame for custom actions
+ */
+template<typename T>
+std::shared_ptr<ULong64_t> FriendColumnHelper<T>::GetResultPtr() const {
+  return result;
+}
+
+template<typename T>
+void FriendColumnHelper<T>::Initialize() {
+  active = *enabled;
+}
+
+template<typename T>
+void FriendColumnHelper<T>::InitTask(TTreeReader *, unsigned int slot) {
+  //entries of a new task do not follow those of the previous one
+  if (active) flush_chunk(slot);
+}
+
+template<typename T>
+void FriendColumnHelper<T>::Exec(unsigned int slot, const T &value, ULong64_t entry) {
+  if (!active) return;
+  unsigned int file_idx = slot_files[slot];
+  if (entry < file_begin_entries[file_idx] || entry >= file_begin_entries[file_idx+1]) {
+    flush_chunk(slot);
+    file_idx = static_cast<unsigned int>(std::upper_bound(file_begin_entries.begin(), file_begin_entries.end(), entry)
+        -file_begin_entries.begin()-1);
+    if (file_idx+1 >= file_begin_entries.size()) return;
+    slot_files[slot] = file_idx;
+  }
+  std::vector<T> &chunk = slot_chunks[slot];
+  if (chunk.size() > 0 && (entry != slot_chunk_begins[slot]+chunk.size() || chunk.size() >= friend_chunk_entries))
+    flush_chunk(slot);
+  if (chunk.size() == 0) slot_chunk_begins[slot] = entry;
+  chunk.push_back(value);
+}
+
+template<typename T>
+void FriendColumnHelper<T>::Finalize() {
+  if (!active) return;
+  for (unsigned int slot = 0; slot < slot_chunks.size(); slot++)
+    flush_chunk(slot);
+  //files missing entries (ex. a loop stopped early) are dropped, so they are never attached
+  for (unsigned int file_idx = 0; file_idx < friend_files.size(); file_idx++) {
+    FriendFile &friend_file = *friend_files[file_idx];
+    if (!friend_file.file) continue;
+    friend_file.tree->SetDirectory(nullptr);
+    friend_file.tree.reset();
+    friend_file.file->Close();
+    friend_file.file.reset();
+    std::remove((friend_filenames[file_idx]+".tmp").c_str());
+    std::cout << "WARNING: friend column file " << friend_filenames[file_idx] << " is incomplete and was not written" << std::endl;
+  }
+}
+
+template<typename T>
+std::string FriendColumnHelper<T>::GetActionName() {
+  return "FriendColumn";
+}
+
+/**
+ * internal function handing the chunk of slot to its friend file and writing the chunks that are ready
+ */
+template<typename T>
+void FriendColumnHelper<T>::flush_chunk(unsigned int slot) {
+  if (slot_chunks[slot].size() == 0) return;
+  std::lock_guard<std::mutex> lock(get_friend_write_mutex());
+  unsigned int file_idx = slot_files[slot];
+  friend_files[file_idx]->pending_chunks[slot_chunk_begins[slot]-file_begin_entries[file_idx]] = std::move(slot_chunks[slot]);
+  slot_chunks[slot] = std::vector<T>();
+  write_chunks(file_idx);
+}
+
+/**
+ * internal function writing chunks of input file file_idx that follow the entries already written, and closing
+ * its friend file once complete; the write mutex must be held
+ */
+template<typename T>
+void FriendColumnHelper<T>::write_chunks(unsigned int file_idx) {
+  FriendFile &friend_file = *friend_files[file_idx];
+  //files are written under a temporary name so that other processes never attach a partial file
+  std::string temporary_filename = friend_filenames[file_idx]+".tmp";
+  while (friend_file.pending_chunks.size() > 0 && friend_file.pending_chunks.begin()->first == friend_file.num_written) {
+    std::vector<T> chunk = std::move(friend_file.pending_chunks.begin()->second);
+    friend_file.pending_chunks.erase(friend_file.pending_chunks.begin());
+    friend_file.num_written += chunk.size();
+    if (friend_file.failed) continue;
+    if (!friend_file.file) {
+      friend_file.file.reset(TFile::Open(temporary_filename.c_str(), "RECREATE"));
+      if (!friend_file.file || friend_file.file->IsZombie()) {
+        std::cout << "ERROR: unable to write friend column file " << temporary_filename << std::endl;
+        friend_file.file.reset();
+        friend_file.failed = true;
+        continue;
+      }
+      friend_file.tree.reset(new TTree(FriendColumnCache::get_tree_name(column_name).c_str(), column_name.c_str()));
+      friend_file.tree->SetDirectory(friend_file.file.get());
+      friend_file.tree->Branch(column_name.c_str(), &friend_file.value);
+    }
+    for (T &chunk_value : chunk) {
+      friend_file.value = chunk_value;
+      friend_file.tree->Fill();
+    }
+  }
+  if (!friend_file.file || friend_file.num_written < file_begin_entries[file_idx+1]-file_begin_entries[file_idx]) return;
+  friend_file.tree->Write();
+  friend_file.tree->SetDirectory(nullptr);
+  friend_file.tree.reset();
+  friend_file.file->Close();
+  friend_file.file.reset();
+  if (std::rename(temporary_filename.c_str(), friend_filenames[file_idx].c_str()) != 0) {
+    std::cout << "ERROR: unable to write friend column file " << friend_filenames[file_idx] << std::endl;
+    return;
+  }
+  *result += friend_file.num_written;
+}
@@ -0,0 +1,408 @@
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "TH1.h"
+#include "TH2.h"
+
+#include "core/histogram_archive.hxx"
+
+namespace {
+
+const char archive_magic[8] = {'R','D','F','H','A','R','C','1'};
+const uint32_t archive_version = 1;
+
+/**
+ * 64-bit FNV-1a hash used to index archive entries
+ */
+uint64_t archive_hash(std::string key) {
+  uint64_t hash = 14695981039346656037ull;
+  for (char key_char : key) {
+    hash ^= static_cast<uint64_t>(static_cast<unsigned char>(key_char));
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+/**
+ * returns size rounded up to a multiple of 8 bytes
+ */
+uint64_t padded_size(uint64_t size) {
+  return (size+7u)/8u*8u;
+}
+
+/**
+ * returns bin edges of an axis, including upper edge of last bin
+ */
+std::vector<double> axis_edges(TAxis* axis) {
+  std::vector<double> edges;
+  for (int bin_idx = 1; bin_idx <= axis->GetNbins()+1; bin_idx++)
+    edges.push_back(axis->GetBinLowEdge(bin_idx));
+  return edges;
+}
+
+}
+
+/**
+ * function returning the archive key for a (variable, sample, region, kind) tuple
+ */
+std::string histogram_archive_key(std::string variable, std::string sample, std::string region, std::string kind) {
+  //unit separator cannot appear in names used in plots
+  return variable+"\x1f"+sample+"\x1f"+region+"\x1f"+kind;
+}
+
+/**
+ * constructor, opens archive file for writing
+ */
+HistogramArchiveWriter::HistogramArchiveWriter(std::string i_filename)
+  : filename(i_filename), current_offset(0), is_closed(false)
+{
+  output_file.open(filename.c_str(), std::ios::binary | std::ios::trunc);
+  if (!output_file.is_open()) {
+    std::cout << "ERROR: unable to open archive " << filename << std::endl;
+    is_closed = true;
+    return;
+  }
+  //header is rewritten with final index location on close
+  ArchiveHeader header;
+  std::memset(&header, 0, sizeof(header));
+  write_bytes(&header, sizeof(header));
+}
+
+/**
+ * destructor, closes archive if not already closed
+ */
+HistogramArchiveWriter::~HistogramArchiveWriter() {
+  close();
+}
+
+/**
+ * internal function to write raw bytes and advance current offset
+ */
+void HistogramArchiveWriter::write_bytes(const void* data, uint64_t size) {
+  output_file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+  current_offset += size;
+}
+
+/**
+ * internal function to append a single entry with given bin edges and bin arrays
+ */
+void HistogramArchiveWriter::add_entry(std::string key, std::string name, std::string title, uint32_t num_dimensions, std::vector<double> x_edges, std::vector<double> y_edges, const double* contents, const double* sumw2, uint32_t num_cells, double entries) {
+  if (is_closed) {
+    std::cout << "ERROR: attempt to write to closed archive " << filename << std::endl;
+    return;
+  }
+  ArchiveEntryHeader entry_header;
+  std::memset(&entry_header, 0, sizeof(entry_header));
+  entry_header.num_dimensions = num_dimensions;
+  entry_header.nbins_x = static_cast<uint32_t>(x_edges.size()-1);
+  entry_header.nbins_y = num_dimensions > 1 ? static_cast<uint32_t>(y_edges.size()-1) : 0;
+  entry_header.num_cells = num_cells;
+  entry_header.name_length = name.size();
+  entry_header.title_length = title.size();
+  entry_header.key_length = key.size();
+  entry_header.entries = entries;
+  ArchiveSlot slot;
+  slot.key_hash = archive_hash(key);
+  slot.entry_offset = current_offset;
+  write_bytes(&entry_header, sizeof(entry_header));
+  const char padding[8] = {0,0,0,0,0,0,0,0};
+  for (std::string text : {name, title, key}) {
+    write_bytes(text.data(), text.size());
+    write_bytes(padding, padded_size(text.size())-text.size());
+  }
+  write_bytes(x_edges.data(), x_edges.size()*sizeof(double));
+  if (num_dimensions > 1)
+    write_bytes(y_edges.data(), y_edges.size()*sizeof(double));
+  write_bytes(contents, num_cells*sizeof(double));
+  write_bytes(sumw2, num_cells*sizeof(double));
+  entry_index.push_back(slot);
+}
+
+/**
+ * method to add a 1d histogram under key (variable, sample, region, kind)
+ */
+HistogramArchiveWriter* HistogramArchiveWriter::add(TH1D* histogram, std::string variable, std::string sample, std::string region, std::string kind) {
+  uint32_t num_cells = static_cast<uint32_t>(histogram->GetNcells());
+  const double* contents = histogram->GetArray();
+  //histograms filled without weights have no sumw2 array, errors are then sqrt(content)
+  const double* sumw2 = histogram->GetSumw2N() > 0 ? histogram->GetSumw2()->GetArray() : contents;
+  add_entry(histogram_archive_key(variable, sample, region, kind), histogram->GetName(), histogram->GetTitle(),
+      1, axis_edges(histogram->GetXaxis()), {}, contents, sumw2, num_cells, histogram->GetEntries());
+  return this;
+}
+
+/**
+ * method to add a 2d histogram under key (variable, sample, region, kind)
+ */
+HistogramArchiveWriter* HistogramArchiveWriter::add(TH2D* histogram, std::string variable, std::string sample, std::string region, std::string kind) {
+  uint32_t num_cells = static_cast<uint32_t>(histogram->GetNcells());
+  const double* contents = histogram->GetArray();
+  const double* sumw2 = histogram->GetSumw2N() > 0 ? histogram->GetSumw2()->GetArray() : contents;
+  add_entry(histogram_archive_key(variable, sample, region, kind), histogram->GetName(), histogram->GetTitle(),
+      2, axis_edges(histogram->GetXaxis()), axis_edges(histogram->GetYaxis()), contents, sumw2, num_cells, histogram->GetEntries());
+  return this;
+}
+
+/**
+ * method to add a list of named values (ex. cutflow yields) under key (variable, sample, region, kind)
+ */
+HistogramArchiveWriter* HistogramArchiveWriter::add(std::vector<std::string> labels, std::vector<double> values, std::string variable, std::string sample, std::string region, std::string kind) {
+  //stored as a 1d histogram with one bin per value and labels joined in the title
+  std::string joined_labels;
+  std::vector<double> edges;
+  std::vector<double> contents = {0.};
+  for (unsigned int value_idx = 0; value_idx < values.size(); value_idx++) {
+    if (value_idx != 0) joined_labels += "\n";
+    if (value_idx < labels.size()) joined_labels += labels[value_idx];
+    edges.push_back(static_cast<double>(value_idx));
+    contents.push_back(values[value_idx]);
+  }
+  edges.push_back(static_cast<double>(values.size()));
+  contents.push_back(0.);
+  add_entry(histogram_archive_key(variable, sample, region, kind), variable+"_"+sample, joined_labels,
+      1, edges, {}, contents.data(), contents.data(), static_cast<uint32_t>(contents.size()), static_cast<double>(values.size()));
+  return this;
+}
+
+/**
+ * method to write index and close file
+ */
+void HistogramArchiveWriter::close() {
+  if (is_closed) return;
+  //open addressing hash table with at most 50% occupancy
+  uint64_t num_slots = 1;
+  while (num_slots < 2*entry_index.size()) num_slots *= 2;
+  std::vector<ArchiveSlot> slot_table(num_slots, ArchiveSlot{0, 0});
+  for (ArchiveSlot slot : entry_index) {
+    uint64_t slot_idx = slot.key_hash & (num_slots-1);
+    //later entries with the same key replace earlier ones
+    while (slot_table[slot_idx].entry_offset != 0 && slot_table[slot_idx].key_hash != slot.key_hash)
+      slot_idx = (slot_idx+1) & (num_slots-1);
+    slot_table[slot_idx] = slot;
+  }
+  ArchiveHeader header;
+  std::memcpy(header.magic, archive_magic, sizeof(header.magic));
+  header.version = archive_version;
+  header.num_entries = static_cast<uint32_t>(entry_index.size());
+  header.num_slots = num_slots;
+  header.slot_table_offset = current_offset;
+  write_bytes(slot_table.data(), num_slots*sizeof(ArchiveSlot));
+  output_file.seekp(0);
+  output_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  output_file.close();
+  is_closed = true;
+}
+
+/**
+ * constructor, maps archive file into memory
+ */
+HistogramArchive::HistogramArchive(std::string i_filename)
+  : filename(i_filename), mapped_data(nullptr), mapped_size(0), header(nullptr), slot_table(nullptr)
+{
+  int file_descriptor = open(filename.c_str(), O_RDONLY);
+  if (file_descriptor < 0) {
+    std::cout << "ERROR: unable to open archive " << filename << std::endl;
+    return;
+  }
+  struct stat file_status;
+  if (fstat(file_descriptor, &file_status) != 0 || static_cast<uint64_t>(file_status.st_size) < sizeof(ArchiveHeader)) {
+    std::cout << "ERROR: archive " << filename << " is empty or unreadable" << std::endl;
+    ::close(file_descriptor);
+    return;
+  }
+  mapped_size = static_cast<uint64_t>(file_status.st_size);
+  void* mapping = mmap(nullptr, mapped_size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+  ::close(file_descriptor);
+  if (mapping == MAP_FAILED) {
+    std::cout << "ERROR: unable to map archive " << filename << std::endl;
+    mapped_size = 0;
+    return;
+  }
+  mapped_data = static_cast<const char*>(mapping);
+  header = reinterpret_cast<const ArchiveHeader*>(mapped_data);
+  //sizes are compared by division so that corrupt values cannot overflow the checks
+  bool is_valid = std::memcmp(header->magic, archive_magic, sizeof(archive_magic)) == 0 && header->version == archive_version
+      && header->num_slots != 0 && (header->num_slots & (header->num_slots-1)) == 0
+      && header->num_slots <= mapped_size/sizeof(ArchiveSlot)
+      && header->slot_table_offset <= mapped_size-header->num_slots*sizeof(ArchiveSlot);
+  if (is_valid) {
+    slot_table = reinterpret_cast<const ArchiveSlot*>(mapped_data+header->slot_table_offset);
+    //every entry is checked once here, so lookups never read outside the mapping
+    for (uint64_t slot_idx = 0; slot_idx < header->num_slots && is_valid; slot_idx++) {
+      if (slot_table[slot_idx].entry_offset != 0 && !is_valid_entry(slot_table[slot_idx].entry_offset))
+        is_valid = false;
+    }
+  }
+  if (!is_valid) {
+    std::cout << "ERROR: " << filename << " is not a valid histogram archive or is truncated" << std::endl;
+    munmap(const_cast<char*>(mapped_data), mapped_size);
+    mapped_data = nullptr;
+    mapped_size = 0;
+    header = nullptr;
+    slot_table = nullptr;
+    return;
+  }
+}
+
+/**
+ * internal function returning true if the entry at entry_offset, including its strings and arrays, lies within the
+ * mapping and its number of cells matches its binning
+ */
+bool HistogramArchive::is_valid_entry(uint64_t entry_offset) {
+  if (entry_offset < sizeof(ArchiveHeader) || entry_offset%8u != 0 || mapped_size < sizeof(ArchiveEntryHeader)
+      || entry_offset > mapped_size-sizeof(ArchiveEntryHeader))
+    return false;
+  const ArchiveEntryHeader* entry_header = reinterpret_cast<const ArchiveEntryHeader*>(mapped_data+entry_offset);
+  uint64_t available_size = mapped_size-entry_offset-sizeof(ArchiveEntryHeader);
+  for (uint64_t text_length : {entry_header->name_length, entry_header->title_length, entry_header->key_length}) {
+    if (text_length > available_size || padded_size(text_length) > available_size) return false;
+    available_size -= padded_size(text_length);
+  }
+  if (entry_header->num_dimensions != 1 && entry_header->num_dimensions != 2) return false;
+  uint64_t num_x_cells = entry_header->nbins_x+2ull;
+  uint64_t num_y_cells = entry_header->num_dimensions > 1 ? entry_header->nbins_y+2ull : 1ull;
+  if (entry_header->num_cells%num_y_cells != 0 || entry_header->num_cells/num_y_cells != num_x_cells) return false;
+  uint64_t num_edges = entry_header->nbins_x+1ull;
+  if (entry_header->num_dimensions > 1) num_edges += entry_header->nbins_y+1ull;
+  return num_edges+2ull*entry_header->num_cells <= available_size/sizeof(double);
+}
+
+/**
+ * destructor, unmaps archive
+ */
+HistogramArchive::~HistogramArchive() {
+  if (mapped_data != nullptr)
+    munmap(const_cast<char*>(mapped_data), mapped_size);
+}
+
+/**
+ * returns true if archive was mapped successfully
+ */
+bool HistogramArchive::is_open() {
+  return header != nullptr;
+}
+
+/**
+ * internal function returning entry header for a key, or nullptr if absent
+ */
+const ArchiveEntryHeader* HistogramArchive::find(std::string key) {
+  if (header == nullptr || header->num_slots == 0) return nullptr;
+  uint64_t key_hash = archive_hash(key);
+  uint64_t slot_idx = key_hash & (header->num_slots-1);
+  //probes are bounded so that a table without empty slots cannot loop forever
+  for (uint64_t probe_idx = 0; probe_idx < header->num_slots && slot_table[slot_idx].entry_offset != 0; probe_idx++) {
+    if (slot_table[slot_idx].key_hash == key_hash) {
+      const char* entry_data = mapped_data+slot_table[slot_idx].entry_offset;
+      const ArchiveEntryHeader* entry_header = reinterpret_cast<const ArchiveEntryHeader*>(entry_data);
+      //verify full key in case of a hash collision
+      const char* entry_key = entry_data+sizeof(ArchiveEntryHeader)+padded_size(entry_header->name_length)+padded_size(entry_header->title_length);
+      if (entry_header->key_length == key.size() && std::memcmp(entry_key, key.data(), key.size()) == 0)
+        return entry_header;
+    }
+    slot_idx = (slot_idx+1) & (header->num_slots-1);
+  }
+  return nullptr;
+}
+
+/**
+ * returns true if archive contains key (variable, sample, region, kind)
+ */
+bool HistogramArchive::contains(std::string variable, std::string sample, std::string region, std::string kind) {
+  return find(histogram_archive_key(variable, sample, region, kind)) != nullptr;
+}
+
+/**
+ * returns pointer to the contiguous bin contents (including under/overflow) for a key without copying, or nullptr
+ */
+const double* HistogramArchive::get_contents(std::string variable, std::string sample, std::string region, std::string kind, unsigned int &num_cells) {
+  const ArchiveEntryHeader* entry_header = find(histogram_archive_key(variable, sample, region, kind));
+  if (entry_header == nullptr) return nullptr;
+  const char* entry_data = reinterpret_cast<const char*>(entry_header)+sizeof(ArchiveEntryHeader)
+      +padded_size(entry_header->name_length)+padded_size(entry_header->title_length)+padded_size(entry_header->key_length);
+  uint64_t num_edges = entry_header->nbins_x+1u;
+  if (entry_header->num_dimensions > 1) num_edges += entry_header->nbins_y+1u;
+  num_cells = entry_header->num_cells;
+  return reinterpret_cast<const double*>(entry_data)+num_edges;
+}
+
+/**
+ * returns a new 1d histogram for a key, or nullptr if absent; caller owns histogram
+ */
+TH1D* HistogramArchive::get_1d_histogram(std::string variable, std::string sample, std::string region, std::string kind) {
+  const ArchiveEntryHeader* entry_header = find(histogram_archive_key(variable, sample, region, kind));
+  if (entry_header == nullptr || entry_header->num_dimensions != 1) return nullptr;
+  const char* entry_data = reinterpret_cast<const char*>(entry_header)+sizeof(ArchiveEntryHeader);
+  std::string name(entry_data, entry_header->name_length);
+  entry_data += padded_size(entry_header->name_length);
+  std::string title(entry_data, entry_header->title_length);
+  entry_data += padded_size(entry_header->title_length)+padded_size(entry_header->key_length);
+  const double* x_edges = reinterpret_cast<const double*>(entry_data);
+  const double* contents = x_edges+entry_header->nbins_x+1;
+  const double* sumw2 = contents+entry_header->num_cells;
+  TH1D* histogram = new TH1D(name.c_str(), title.c_str(), static_cast<int>(entry_header->nbins_x), x_edges);
+  histogram->SetDirectory(nullptr);
+  histogram->Sumw2();
+  std::memcpy(histogram->GetArray(), contents, entry_header->num_cells*sizeof(double));
+  std::memcpy(histogram->GetSumw2()->GetArray(), sumw2, entry_header->num_cells*sizeof(double));
+  histogram->ResetStats();
+  histogram->SetEntries(entry_header->entries);
+  return histogram;
+}
+
+/**
+ * returns a new 2d histogram for a key, or nullptr if absent; caller owns histogram
+ */
+TH2D* HistogramArchive::get_2d_histogram(std::string variable, std::string sample, std::string region, std::string kind) {
+  const ArchiveEntryHeader* entry_header = find(histogram_archive_key(variable, sample, region, kind));
+  if (entry_header == nullptr || entry_header->num_dimensions != 2) return nullptr;
+  const char* entry_data = reinterpret_cast<const char*>(entry_header)+sizeof(ArchiveEntryHeader);
+  std::string name(entry_data, entry_header->name_length);
+  entry_data += padded_size(entry_header->name_length);
+  std::string title(entry_data, entry_header->title_length);
+  entry_data += padded_size(entry_header->title_length)+padded_size(entry_header->key_length);
+  const double* x_edges = reinterpret_cast<const double*>(entry_data);
+  const double* y_edges = x_edges+entry_header->nbins_x+1;
+  const double* contents = y_edges+entry_header->nbins_y+1;
+  const double* sumw2 = contents+entry_header->num_cells;
+  TH2D* histogram = new TH2D(name.c_str(), title.c_str(), static_cast<int>(entry_header->nbins_x), x_edges,
+      static_cast<int>(entry_header->nbins_y), y_edges);
+  histogram->SetDirectory(nullptr);
+  histogram->Sumw2();
+  std::memcpy(histogram->GetArray(), contents, entry_header->num_cells*sizeof(double));
+  std::memcpy(histogram->GetSumw2()->GetArray(), sumw2, entry_header->num_cells*sizeof(double));
+  histogram->ResetStats();
+  histogram->SetEntries(entry_header->entries);
+  return histogram;
+}
+
+/**
+ * returns labels and values stored with add(labels, values, ...), false if absent
+ */
+bool HistogramArchive::get_values(std::string variable, std::string sample, std::string region, std::string kind, std::vector<std::string> &labels, std::vector<double> &values) {
+  const ArchiveEntryHeader* entry_header = find(histogram_archive_key(variable, sample, region, kind));
+  if (entry_header == nullptr || entry_header->num_dimensions != 1) return false;
+  const char* entry_data = reinterpret_cast<const char*>(entry_header)+sizeof(ArchiveEntryHeader)+padded_size(entry_header->name_length);
+  std::string joined_labels(entry_data, entry_header->title_length);
+  entry_data += padded_size(entry_header->title_length)+padded_size(entry_header->key_length);
+  const double* contents = reinterpret_cast<const double*>(entry_data)+entry_header->nbins_x+1;
+  labels.clear();
+  values.clear();
+  size_t label_start = 0;
+  for (unsigned int value_idx = 0; value_idx < entry_header->nbins_x; value_idx++) {
+    size_t label_end = joined_labels.find('\n', label_start);
+    labels.push_back(joined_labels.substr(label_start, label_end == std::string::npos ? std::string::npos : label_end-label_start));
+    label_start = label_end == std::string::npos ? joined_labels.size() : label_end+1;
+    //skip underflow bin
+    values.push_back(contents[value_idx+1]);
+  }
+  return true;
+}
@@ -0,0 +1,371 @@
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "TChain.h"
+#include "TH1.h"
+#include "TH2.h"
+#include "TTreeReader.h"
+
+#include "ROOT/RDataFrame.hxx"
+#include "ROOT/RResultPtr.hxx"
+#include "ROOT/RDF/RInterface.hxx"
+
+#include "core/sample_wrapper.hxx"
+#include "core/merged_sample_loop.hxx"
+#include "core/phase_report.hxx"
+
+/**
+ * constructor
+ */
+SampleSumHelper::SampleSumHelper(unsigned int num_samples, unsigned int num_slots) {
+  result = std::make_shared<SampleSums>();
+  slot_yields.assign(num_slots, std::vector<double>(num_samples, 0.));
+  slot_counts.assign(num_slots, std::vector<double>(num_samples, 0.));
+}
+
+/**
+ * methods required by RDataFrame for custom actions
+ */
+std::shared_ptr<SampleSums> SampleSumHelper::GetResultPtr() const {
+  return result;
+}
+
+void SampleSumHelper::Initialize() {}
+
+void SampleSumHelper::InitTask(TTreeReader *, unsigned int) {}
+
+void SampleSumHelper::Exec(unsigned int slot, double weight, unsigned int sample_idx) {
+  if (sample_idx >= slot_yields[slot].size()) return;
+  slot_yields[slot][sample_idx] += weight;
+  slot_counts[slot][sample_idx] += 1.;
+}
+
+void SampleSumHelper::Finalize() {
+  result->yields.assign(slot_yields[0].size(), 0.);
+  result->counts.assign(slot_counts[0].size(), 0.);
+  for (unsigned int slot = 0; slot < slot_yields.size(); slot++) {
+    for (unsigned int sample_idx = 0; sample_idx < result->yields.size(); sample_idx++) {
+      result->yields[sample_idx] += slot_yields[slot][sample_idx];
+      result->counts[sample_idx] += slot_counts[slot][sample_idx];
+    }
+  }
+  slot_yields.clear();
+  slot_counts.clear();
+}
+
+std::string SampleSumHelper::GetActionName() {
+  return "SampleSum";
+}
+
+/**
+ * internal function returning the histogram of a slot for a sample, cloned from the (empty) model on first use
+ */
+template <typename H>
+static H* get_slot_histogram(std::unique_ptr<H> &slot_histogram, const std::shared_ptr<H> &model) {
+  if (!slot_histogram) {
+    slot_histogram.reset(static_cast<H*>(model->Clone()));
+    slot_histogram->SetDirectory(nullptr);
+  }
+  return slot_histogram.get();
+}
+
+/**
+ * internal function to add the histograms of all slots into the result histograms
+ */
+template <typename H>
+static void merge_slot_histograms(std::vector<std::shared_ptr<H>> &histograms, std::vector<std::vector<std::unique_ptr<H>>> &slot_histograms) {
+  for (unsigned int slot = 0; slot < slot_histograms.size(); slot++) {
+    for (unsigned int sample_idx = 0; sample_idx < histograms.size(); sample_idx++) {
+      if (slot_histograms[slot][sample_idx])
+        histograms[sample_idx]->Add(slot_histograms[slot][sample_idx].get());
+    }
+  }
+  slot_histograms.clear();
+}
+
+/**
+ * constructor, models[sample] gives the (empty) histogram of each sample, null to skip a sample
+ */
+SampleHistogram1DHelper::SampleHistogram1DHelper(std::vector<std::shared_ptr<TH1D>> models, unsigned int num_slots) {
+  result = std::make_shared<SampleHistograms>();
+  result->histograms = models;
+  for (std::shared_ptr<TH1D> model : models) {
+    if (!model) continue;
+    model->SetDirectory(nullptr);
+    model->Sumw2();
+  }
+  slot_histograms.resize(num_slots);
+  for (unsigned int slot = 0; slot < num_slots; slot++)
+    slot_histograms[slot].resize(models.size());
+}
+
+/**
+ * methods required by RDataFrame for custom actions
+ */
+std::shared_ptr<SampleHistograms> SampleHistogram1DHelper::GetResultPtr() const {
+  return result;
+}
+
+void SampleHistogram1DHelper::Initialize() {}
+
+void SampleHistogram1DHelper::InitTask(TTreeReader *, unsigned int) {}
+
+void SampleHistogram1DHelper::Exec(unsigned int slot, double value, double weight, unsigned int sample_idx) {
+  if (sample_idx >= result->histograms.size() || !result->histograms[sample_idx]) return;
+  get_slot_histogram(slot_histograms[slot][sample_idx], result->histograms[sample_idx])->Fill(value, weight);
+}
+
+void SampleHistogram1DHelper::Finalize() {
+  merge_slot_histograms(result->histograms, slot_histograms);
+}
+
+std::string SampleHistogram1DHelper::GetActionName() {
+  return "SampleHistogram1D";
+}
+
+/**
+ * constructor, models[sample] gives the (empty) histogram of each sample, null to skip a sample
+ */
+SampleHistogram2DHelper::SampleHistogram2DHelper(std::vector<std::shared_ptr<TH2D>> models, unsigned int num_slots) {
+  result = std::make_shared<SampleHistograms>();
+  result->twodim_histograms = models;
+  for (std::shared_ptr<TH2D> model : models) {
+    if (!model) continue;
+    model->SetDirectory(nullptr);
+    model->Sumw2();
+  }
+  slot_histograms.resize(num_slots);
+  for (unsigned int slot = 0; slot < num_slots; slot++)
+    slot_histograms[slot].resize(models.size());
+}
+
+/**
+ * methods required by RDataFrame for custom actions
+ */
+std::shared_ptr<SampleHistograms> SampleHistogram2DHelper::GetResultPtr() const {
+  return result;
+}
+
+void SampleHistogram2DHelper::Initialize() {}
+
+void SampleHistogram2DHelper::InitTask(TTreeReader *, unsigned int) {}
+
+void SampleHistogram2DHelper::Exec(unsigned int slot, double x_value, double y_value, double weight, unsigned int sample_idx) {
+  if (sample_idx >= result->twodim_histograms.size() || !result->twodim_histograms[sample_idx]) return;
+  get_slot_histogram(slot_histograms[slot][sample_idx], result->twodim_histograms[sample_idx])->Fill(x_value, y_value, weight);
+}
+
+void SampleHistogram2DHelper::Finalize() {
+  merge_slot_histograms(result->twodim_histograms, slot_histograms);
+}
+
+std::string SampleHistogram2DHelper::GetActionName() {
+  return "SampleHistogram2D";
+}
+
+/**
+ * internal function returning the first entry of the chained files after each sample
+ */
+std::vector<ULong64_t> MergedSampleLoop::get_sample_end_entries(std::vector<SampleWrapper*> samples) {
+  std::vector<ULong64_t> sample_end_entries;
+  ULong64_t num_entries = 0;
+  //entries are taken from the dataset manifest of samples that use one, so their files are not opened
+  for (SampleWrapper* sample : samples) {
+    for (ULong64_t file_entries : sample->get_file_entries())
+      num_entries += file_entries;
+    sample_end_entries.push_back(num_entries);
+  }
+  return sample_end_entries;
+}
+
+/**
+ * internal function returning chained files of all samples
+ */
+static std::vector<std::string> get_merged_filenames(std::vector<SampleWrapper*> samples) {
+  std::vector<std::string> merged_filenames;
+  for (SampleWrapper* sample : samples) {
+    std::vector<std::string> sample_filenames = sample->get_filenames();
+    merged_filenames.insert(merged_filenames.end(), sample_filenames.begin(), sample_filenames.end());
+  }
+  return merged_filenames;
+}
+
+/**
+ * constructor
+ * i_samples - samples to chain, the sample_idx column gives the index of an entry's sample in this vector
+ * tree_name - name of TTree to read from files of all samples
+ */
+MergedSampleLoop::MergedSampleLoop(std::vector<SampleWrapper*> i_samples, const char* tree_name)
+  : samples(i_samples), merged_data_frame(ROOT::RDataFrame(tree_name, get_merged_filenames(i_samples))
+      .Define("sample_idx", [sample_end_entries = get_sample_end_entries(i_samples)](ULong64_t entry) {
+        //entries are numbered over the whole chain, so the sample is found from the cumulative entry counts
+        return static_cast<unsigned int>(std::upper_bound(sample_end_entries.begin(), sample_end_entries.end(), entry)
+            -sample_end_entries.begin());
+      }, {"rdfentry_"}))
+{
+  num_nodes = 0;
+  num_weight_columns = 0;
+  weight_column = "merged_unit_weight";
+  merged_data_frame = merged_data_frame.Define(weight_column, []() { return 1.0; }, {});
+  entry_sums = book_sums(weight_column);
+}
+
+/**
+ * internal function to book per-sample sums of column weight on the current data frame
+ */
+ROOT::RDF::RResultPtr<SampleSums> MergedSampleLoop::book_sums(std::string weight) {
+  return merged_data_frame.Book<double, unsigned int>(SampleSumHelper(static_cast<unsigned int>(samples.size()),
+      merged_data_frame.GetNSlots()), {weight, "sample_idx"});
+}
+
+/**
+ * returns jitted expression true for entries of samples sample_indices
+ */
+std::string MergedSampleLoop::get_sample_selection(std::vector<unsigned int> sample_indices) {
+  if (sample_indices.size() == 0) return "false";
+  std::string selection;
+  for (unsigned int sample_idx : sample_indices) {
+    if (selection != "") selection += "||";
+    selection += "sample_idx=="+std::to_string(sample_idx);
+  }
+  return "("+selection+")";
+}
+
+/**
+ * returns jitted expression evaluating sample_expressions[sample_idx] for each entry
+ */
+std::string MergedSampleLoop::get_sample_expression(std::vector<std::string> sample_expressions) {
+  if (sample_expressions.size() == 0) return "";
+  bool all_equal = true;
+  for (std::string sample_expression : sample_expressions) {
+    if (sample_expression != sample_expressions[0]) all_equal = false;
+  }
+  if (all_equal) return sample_expressions[0];
+  std::string expression = "("+sample_expressions.back()+")";
+  for (unsigned int sample_idx = static_cast<unsigned int>(sample_expressions.size()-1); sample_idx-- > 0;)
+    expression = "(sample_idx=="+std::to_string(sample_idx)+" ? ("+sample_expressions[sample_idx]+") : "+expression+")";
+  return expression;
+}
+
+/**
+ * method to define a column for samples sample_indices (all samples if empty), see RInterface::Define
+ */
+void MergedSampleLoop::define(std::string name, std::string expression, std::vector<unsigned int> sample_indices) {
+  num_nodes++;
+  if (sample_indices.size() == 0 || sample_indices.size() == samples.size()) {
+    merged_data_frame = PhaseReport::jitted_define(merged_data_frame, name, expression);
+    num_column_definitions[name]++;
+    return;
+  }
+  std::string selection = get_sample_selection(sample_indices);
+  unsigned int num_definitions = num_column_definitions[name]++;
+  if (num_definitions == 0) {
+    merged_data_frame = PhaseReport::jitted_define(merged_data_frame, name, selection+" ? ("+expression+") : std::decay_t<decltype("+expression+")>{}");
+    return;
+  }
+  //keep the previous definition for other samples, it is only evaluated for them
+  std::string previous_name = "merged_previous_"+std::to_string(num_definitions)+"_"+name;
+  merged_data_frame = PhaseReport::jitted_redefine(PhaseReport::jitted_define(merged_data_frame, previous_name, name),
+      name, selection+" ? ("+expression+") : "+previous_name);
+}
+
+/**
+ * method to filter samples sample_indices (all samples if empty), see RInterface::Filter
+ */
+unsigned int MergedSampleLoop::filter(std::string expression, std::string filter_description, std::vector<unsigned int> sample_indices) {
+  num_nodes++;
+  if (sample_indices.size() == 0 || sample_indices.size() == samples.size())
+    merged_data_frame = PhaseReport::jitted_filter(merged_data_frame, expression, filter_description);
+  else
+    merged_data_frame = PhaseReport::jitted_filter(merged_data_frame, "!"+get_sample_selection(sample_indices)+"||("+expression+")", filter_description);
+  filter_sums.push_back(book_sums(weight_column));
+  return static_cast<unsigned int>(filter_sums.size()-1);
+}
+
+/**
+ * method to rebuild the merged weight column from the weight branches of all samples and book sums of lumi weights
+ */
+void MergedSampleLoop::update_weights() {
+  std::vector<std::string> sample_weights, sample_lumi_weights;
+  for (SampleWrapper* sample : samples) {
+    sample_weights.push_back(sample->weighted_sample ? "static_cast<double>("+sample->weight_column+")" : "1.0");
+    sample_lumi_weights.push_back(sample->weighted_sample ? "static_cast<double>("+sample->get_lumi_weight_column()+")" : "1.0");
+  }
+  num_nodes++;
+  num_weight_columns++;
+  weight_column = "merged_weight_"+std::to_string(num_weight_columns);
+  std::string lumi_weight_column = "merged_lumi_weight_"+std::to_string(num_weight_columns);
+  merged_data_frame = PhaseReport::jitted_define(merged_data_frame, weight_column, get_sample_expression(sample_weights));
+  merged_data_frame = PhaseReport::jitted_define(merged_data_frame, lumi_weight_column, get_sample_expression(sample_lumi_weights));
+  if (filter_sums.size() > 0)
+    std::cout << "ERROR: weights of a merged event loop changed after filtering, sums of weights include previous filters" << std::endl;
+  entry_sums = book_sums(weight_column);
+  total_sums = book_sums(lumi_weight_column);
+}
+
+/**
+ * returns name of the column holding the weight of each entry (1 for unweighted samples)
+ */
+std::string MergedSampleLoop::get_weight_column() {
+  return weight_column;
+}
+
+/**
+ * returns weighted (or unweighted) yield of sample sample_idx before any filter
+ */
+double MergedSampleLoop::get_entry_yield(unsigned int sample_idx, bool weighted) {
+  return weighted ? entry_sums->yields[sample_idx] : entry_sums->counts[sample_idx];
+}
+
+/**
+ * returns sum of lumi weights of sample sample_idx, see SampleWrapper::get_total_yield
+ */
+double MergedSampleLoop::get_total_yield(unsigned int sample_idx) {
+  if (!total_sums) return get_entry_yield(sample_idx, false);
+  return total_sums->yields[sample_idx];
+}
+
+/**
+ * returns weighted (or unweighted) yield of sample sample_idx after filter filter_idx
+ */
+double MergedSampleLoop::get_filter_yield(unsigned int filter_idx, unsigned int sample_idx, bool weighted) {
+  return weighted ? filter_sums[filter_idx]->yields[sample_idx] : filter_sums[filter_idx]->counts[sample_idx];
+}
+
+/**
+ * returns number of defines and filters added so far, used to notice changes of the data frame
+ */
+unsigned int MergedSampleLoop::get_num_nodes() {
+  return num_nodes;
+}
+
+/**
+ * returns data frame of the entries of sample sample_idx, selected without jitting
+ */
+ROOT::RDF::RNode MergedSampleLoop::get_sample_data_frame(unsigned int sample_idx) {
+  return merged_data_frame.Filter([sample_idx](unsigned int entry_sample_idx) {
+    return entry_sample_idx == sample_idx;
+  }, {"sample_idx"});
+}
+
+/**
+ * returns data frame of entries of all samples selected by sample_cuts[sample_idx] (no cut if empty)
+ */
+ROOT::RDF::RNode MergedSampleLoop::get_selected_data_frame(std::vector<std::string> sample_cuts) {
+  std::vector<std::string> sample_selections;
+  for (std::string sample_cut : sample_cuts)
+    sample_selections.push_back(sample_cut == "" ? "true" : sample_cut);
+  std::string selection = get_sample_expression(sample_selections);
+  if (selection == "" || selection == "true") return merged_data_frame;
+  return PhaseReport::jitted_filter(merged_data_frame, selection);
+}
+
+/**
+ * internal RDataFrame object
+ */
+ROOT::RDF::RNode &MergedSampleLoop::data_frame() {
+  return merged_data_frame;
+}
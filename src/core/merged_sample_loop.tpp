@@ -0,0 +1,16 @@
+//this gets included directly into merged_sample_loop.hxx in order to get general templates
+
+/**
+ * method to define a column for all samples, see RInterface::Define
+ */
+template<typename F>
+void MergedSampleLoop::define(std::string name, F expression, const std::vector<std::string> columns) {
+  if (num_column_definitions[name] > 0) {
+    //compiled functions cannot be wrapped in a jitted selection, so they cannot be combined per sample
+    std::cout << "ERROR: compiled column " << name << " is already defined in the merged event loop" << std::endl;
+    return;
+  }
+  merged_data_frame = merged_data_frame.Define(name, expression, columns);
+  num_column_definitions[name]++;
+  num_nodes++;
+}
@@ -0,0 +1,138 @@
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "TH1.h"
+#include "TTreeReader.h"
+#include "ROOT/RVec.hxx"
+
+#include "core/variable_axis.hxx"
+#include "core/multi_weight_histogram.hxx"
+
+/**
+ * returns number of bins per variation, including under/overflow
+ */
+unsigned int MultiWeightHistogram::num_cells() const {
+  return static_cast<unsigned int>(bin_edges.size()+1);
+}
+
+/**
+ * returns a new histogram for variation variation_idx; caller owns histogram
+ */
+TH1D* MultiWeightHistogram::make_histogram(unsigned int variation_idx, std::string name, std::string title) const {
+  TH1D* histogram = new TH1D(name.c_str(), title.c_str(), static_cast<int>(bin_edges.size()-1), bin_edges.data());
+  histogram->SetDirectory(nullptr);
+  histogram->Sumw2();
+  unsigned int offset = variation_idx*num_cells();
+  for (unsigned int bin_idx = 0; bin_idx < num_cells(); bin_idx++) {
+    histogram->SetBinContent(static_cast<int>(bin_idx), contents[offset+bin_idx]);
+    histogram->SetBinError(static_cast<int>(bin_idx), sqrt(sumw2[offset+bin_idx]));
+  }
+  histogram->SetEntries(entries);
+  return histogram;
+}
+
+/**
+ * returns entries, contents, and sumw2 as one list, used to store results in a ResultCache; lists add elementwise
+ */
+std::vector<double> MultiWeightHistogram::get_values() const {
+  std::vector<double> values = {entries};
+  values.insert(values.end(), contents.begin(), contents.end());
+  values.insert(values.end(), sumw2.begin(), sumw2.end());
+  return values;
+}
+
+/**
+ * method to set entries, contents, and sumw2 from get_values of a result with the same binning and variations
+ * returns false if the number of values does not match
+ */
+bool MultiWeightHistogram::set_values(std::vector<double> values) {
+  size_t array_size = static_cast<size_t>(num_variations)*num_cells();
+  if (values.size() != 2*array_size+1) return false;
+  entries = values[0];
+  contents.assign(values.begin()+1, values.begin()+1+static_cast<long>(array_size));
+  sumw2.assign(values.begin()+1+static_cast<long>(array_size), values.end());
+  return true;
+}
+
+/**
+ * constructor
+ */
+MultiWeightHistogramHelper::MultiWeightHistogramHelper(VariableAxis axis, unsigned int num_variations, unsigned int num_slots) {
+  result = std::make_shared<MultiWeightHistogram>();
+  uniform_bins = axis.uniform_bins;
+  low = axis.low;
+  high = axis.high;
+  nbins = static_cast<unsigned int>(axis.nbins);
+  for (unsigned int bin_idx = 0; bin_idx <= nbins; bin_idx++) {
+    if (uniform_bins)
+      result->bin_edges.push_back(low+(high-low)*bin_idx/nbins);
+    else
+      result->bin_edges.push_back(axis.bins[bin_idx]);
+  }
+  result->num_variations = num_variations;
+  result->entries = 0;
+  //each slot fills its own array so no locking is needed in Exec
+  unsigned int array_size = num_variations*result->num_cells();
+  slot_contents.assign(num_slots, std::vector<double>(array_size, 0.));
+  slot_sumw2.assign(num_slots, std::vector<double>(array_size, 0.));
+  slot_entries.assign(num_slots, 0.);
+}
+
+/**
+ * internal function returning the bin (0 = underflow, nbins+1 = overflow) of value
+ */
+unsigned int MultiWeightHistogramHelper::find_bin(double value) const {
+  if (value < result->bin_edges.front()) return 0;
+  if (value >= result->bin_edges.back()) return nbins+1;
+  if (uniform_bins)
+    return 1+std::min(nbins-1, static_cast<unsigned int>((value-low)/(high-low)*nbins));
+  return static_cast<unsigned int>(std::upper_bound(result->bin_edges.begin(), result->bin_edges.end(), value)-result->bin_edges.begin());
+}
+
+/**
+ * methods required by RDataFrame for custom actions
+ */
+std::shared_ptr<MultiWeightHistogram> MultiWeightHistogramHelper::GetResultPtr() const {
+  return result;
+}
+
+void MultiWeightHistogramHelper::Initialize() {}
+
+void MultiWeightHistogramHelper::InitTask(TTreeReader *, unsigned int) {}
+
+void MultiWeightHistogramHelper::Exec(unsigned int slot, double value, const ROOT::RVec<double> &weights) {
+  if (std::isnan(value)) return;
+  //bin index is computed once and shared by all variations
+  unsigned int bin_idx = find_bin(value);
+  unsigned int num_cells = result->num_cells();
+  unsigned int num_variations = std::min(result->num_variations, static_cast<unsigned int>(weights.size()));
+  double* contents = slot_contents[slot].data();
+  double* sumw2 = slot_sumw2[slot].data();
+  for (unsigned int variation_idx = 0; variation_idx < num_variations; variation_idx++) {
+    double weight = weights[variation_idx];
+    contents[variation_idx*num_cells+bin_idx] += weight;
+    sumw2[variation_idx*num_cells+bin_idx] += weight*weight;
+  }
+  slot_entries[slot] += 1;
+}
+
+void MultiWeightHistogramHelper::Finalize() {
+  result->contents.assign(slot_contents[0].size(), 0.);
+  result->sumw2.assign(slot_sumw2[0].size(), 0.);
+  for (unsigned int slot = 0; slot < slot_contents.size(); slot++) {
+    for (unsigned int cell_idx = 0; cell_idx < result->contents.size(); cell_idx++) {
+      result->contents[cell_idx] += slot_contents[slot][cell_idx];
+      result->sumw2[cell_idx] += slot_sumw2[slot][cell_idx];
+    }
+    result->entries += slot_entries[slot];
+  }
+  slot_contents.clear();
+  slot_sumw2.clear();
+}
+
+std::string MultiWeightHistogramHelper::GetActionName() {
+  return "MultiWeightHistogram";
+}
@@ -0,0 +1,292 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "TH1.h"
+#include "TH2.h"
+#include "TTreeReader.h"
+#include "ROOT/RVec.hxx"
+
+#include "core/variable_axis.hxx"
+#include "core/nd_histogram.hxx"
+
+/**
+ * returns number of cells, including under/overflow on every axis
+ */
+uint64_t NdHistogram::num_cells() const {
+  uint64_t cells = 1;
+  for (std::vector<double> axis_edges : bin_edges)
+    cells *= axis_edges.size()+1;
+  return cells;
+}
+
+/**
+ * returns index of axis for variable_name, or number of axes if absent
+ */
+unsigned int NdHistogram::axis_index(std::string variable_name) const {
+  for (unsigned int axis_idx = 0; axis_idx < variable_names.size(); axis_idx++) {
+    if (variable_names[axis_idx] == variable_name) return axis_idx;
+  }
+  return static_cast<unsigned int>(variable_names.size());
+}
+
+/**
+ * internal function to loop over filled cells passing cuts, calling fill(bins, content, sumw2)
+ */
+template <typename F>
+void NdHistogram::for_each_cell(std::vector<NdAxisCut> cuts, F fill) const {
+  //precompute which bins of each axis pass the cuts
+  std::vector<std::vector<bool>> bin_passes;
+  for (std::vector<double> axis_edges : bin_edges)
+    bin_passes.push_back(std::vector<bool>(axis_edges.size()+1, true));
+  for (NdAxisCut cut : cuts) {
+    unsigned int axis_idx = axis_index(cut.variable_name);
+    if (axis_idx == variable_names.size()) continue;
+    const std::vector<double> &axis_edges = bin_edges[axis_idx];
+    for (unsigned int bin_idx = 0; bin_idx < bin_passes[axis_idx].size(); bin_idx++) {
+      double bin_center = -std::numeric_limits<double>::infinity();
+      if (bin_idx == axis_edges.size())
+        bin_center = std::numeric_limits<double>::infinity();
+      else if (bin_idx > 0)
+        bin_center = (axis_edges[bin_idx-1]+axis_edges[bin_idx])/2.;
+      if (bin_center < cut.low || bin_center >= cut.high)
+        bin_passes[axis_idx][bin_idx] = false;
+    }
+  }
+  std::vector<unsigned int> bins(bin_edges.size(), 0);
+  auto visit = [&](uint64_t cell, double content, double sumw2) {
+    for (unsigned int axis_idx = 0; axis_idx < bin_edges.size(); axis_idx++) {
+      uint64_t axis_cells = bin_edges[axis_idx].size()+1;
+      bins[axis_idx] = static_cast<unsigned int>(cell % axis_cells);
+      if (!bin_passes[axis_idx][bins[axis_idx]]) return;
+      cell /= axis_cells;
+    }
+    fill(bins, content, sumw2);
+  };
+  if (is_sparse) {
+    for (std::pair<const uint64_t, std::pair<double, double>> sparse_cell : sparse_cells)
+      visit(sparse_cell.first, sparse_cell.second.first, sparse_cell.second.second);
+  }
+  else {
+    for (uint64_t cell = 0; cell < dense_contents.size(); cell++) {
+      if (dense_sumw2[cell] > 0.)
+        visit(cell, dense_contents[cell], dense_sumw2[cell]);
+    }
+  }
+}
+
+/**
+ * returns a new 1d projection on axis axis_idx of the cells passing cuts; caller owns histogram
+ */
+TH1D* NdHistogram::project_1d(unsigned int axis_idx, std::vector<NdAxisCut> cuts, std::string name, std::string title) const {
+  const std::vector<double> &axis_edges = bin_edges[axis_idx];
+  TH1D* histogram = new TH1D(name.c_str(), title.c_str(), static_cast<int>(axis_edges.size()-1), axis_edges.data());
+  histogram->SetDirectory(nullptr);
+  std::vector<double> contents(axis_edges.size()+1, 0.), sumw2(axis_edges.size()+1, 0.);
+  for_each_cell(cuts, [&](const std::vector<unsigned int> &bins, double content, double cell_sumw2) {
+    contents[bins[axis_idx]] += content;
+    sumw2[bins[axis_idx]] += cell_sumw2;
+  });
+  for (unsigned int bin_idx = 0; bin_idx < contents.size(); bin_idx++) {
+    histogram->SetBinContent(static_cast<int>(bin_idx), contents[bin_idx]);
+    histogram->SetBinError(static_cast<int>(bin_idx), sqrt(sumw2[bin_idx]));
+  }
+  histogram->SetEntries(entries);
+  return histogram;
+}
+
+/**
+ * returns a new 2d projection on axes x_axis_idx, y_axis_idx of the cells passing cuts; caller owns histogram
+ */
+TH2D* NdHistogram::project_2d(unsigned int x_axis_idx, unsigned int y_axis_idx, std::vector<NdAxisCut> cuts, std::string name, std::string title) const {
+  const std::vector<double> &x_edges = bin_edges[x_axis_idx];
+  const std::vector<double> &y_edges = bin_edges[y_axis_idx];
+  TH2D* histogram = new TH2D(name.c_str(), title.c_str(), static_cast<int>(x_edges.size()-1), x_edges.data(),
+      static_cast<int>(y_edges.size()-1), y_edges.data());
+  histogram->SetDirectory(nullptr);
+  unsigned int x_cells = static_cast<unsigned int>(x_edges.size()+1);
+  std::vector<double> contents(x_cells*(y_edges.size()+1), 0.), sumw2(x_cells*(y_edges.size()+1), 0.);
+  for_each_cell(cuts, [&](const std::vector<unsigned int> &bins, double content, double cell_sumw2) {
+    contents[bins[y_axis_idx]*x_cells+bins[x_axis_idx]] += content;
+    sumw2[bins[y_axis_idx]*x_cells+bins[x_axis_idx]] += cell_sumw2;
+  });
+  for (unsigned int cell_idx = 0; cell_idx < contents.size(); cell_idx++) {
+    int x_bin = static_cast<int>(cell_idx % x_cells);
+    int y_bin = static_cast<int>(cell_idx / x_cells);
+    histogram->SetBinContent(x_bin, y_bin, contents[cell_idx]);
+    histogram->SetBinError(x_bin, y_bin, sqrt(sumw2[cell_idx]));
+  }
+  histogram->SetEntries(entries);
+  return histogram;
+}
+
+/**
+ * returns filled cells as (cell, content, sumw2) triples followed by (-1, entries, 0), used to store results in a ResultCache
+ * lists of histograms with the same binning are merged by concatenation, see ResultCache::store_values
+ */
+std::vector<double> NdHistogram::get_cell_values() const {
+  std::vector<double> values;
+  if (is_sparse) {
+    for (std::pair<const uint64_t, std::pair<double, double>> sparse_cell : sparse_cells)
+      values.insert(values.end(), {static_cast<double>(sparse_cell.first), sparse_cell.second.first, sparse_cell.second.second});
+  }
+  else {
+    for (uint64_t cell = 0; cell < dense_contents.size(); cell++) {
+      //sumw2 is only zero for cells without nonzero weights
+      if (dense_sumw2[cell] <= 0.) continue;
+      values.insert(values.end(), {static_cast<double>(cell), dense_contents[cell], dense_sumw2[cell]});
+    }
+  }
+  values.insert(values.end(), {-1., entries, 0.});
+  return values;
+}
+
+/**
+ * method to set contents from (concatenated) get_cell_values of histograms with the same binning, duplicate cells are added
+ * returns false if the values are not triples of cells in range
+ */
+bool NdHistogram::set_cell_values(std::vector<double> values) {
+  if (values.size() % 3 != 0) return false;
+  //cell indices are below 2^53, so they are exact as doubles
+  double max_cell = static_cast<double>(num_cells());
+  for (size_t value_idx = 0; value_idx < values.size(); value_idx += 3) {
+    if (values[value_idx] < -1. || values[value_idx] >= max_cell) return false;
+  }
+  entries = 0;
+  sparse_cells.clear();
+  if (!is_sparse) {
+    dense_contents.assign(num_cells(), 0.);
+    dense_sumw2.assign(num_cells(), 0.);
+  }
+  for (size_t value_idx = 0; value_idx < values.size(); value_idx += 3) {
+    if (values[value_idx] < 0.) {
+      entries += values[value_idx+1];
+      continue;
+    }
+    uint64_t cell = static_cast<uint64_t>(values[value_idx]);
+    if (is_sparse) {
+      std::pair<double, double> &sparse_cell = sparse_cells[cell];
+      sparse_cell.first += values[value_idx+1];
+      sparse_cell.second += values[value_idx+2];
+    }
+    else {
+      dense_contents[cell] += values[value_idx+1];
+      dense_sumw2[cell] += values[value_idx+2];
+    }
+  }
+  return true;
+}
+
+/**
+ * constructor
+ */
+NdHistogramHelper::NdHistogramHelper(std::vector<VariableAxis> i_axes, unsigned int num_slots, uint64_t max_dense_cells)
+  : axes(i_axes)
+{
+  result = std::make_shared<NdHistogram>();
+  uint64_t stride = 1;
+  for (VariableAxis axis : axes) {
+    std::vector<double> axis_edges;
+    for (int bin_idx = 0; bin_idx <= axis.nbins; bin_idx++) {
+      if (axis.uniform_bins)
+        axis_edges.push_back(axis.low+(axis.high-axis.low)*bin_idx/axis.nbins);
+      else
+        axis_edges.push_back(axis.bins[bin_idx]);
+    }
+    result->variable_names.push_back(axis.variable_name);
+    result->bin_edges.push_back(axis_edges);
+    strides.push_back(stride);
+    stride *= static_cast<uint64_t>(axis.nbins+2);
+  }
+  result->entries = 0;
+  result->is_sparse = (result->num_cells() > max_dense_cells);
+  //each slot fills its own storage so no locking is needed in Exec
+  if (result->is_sparse) {
+    slot_sparse_cells.resize(num_slots);
+  }
+  else {
+    slot_dense_contents.assign(num_slots, std::vector<double>(result->num_cells(), 0.));
+    slot_dense_sumw2.assign(num_slots, std::vector<double>(result->num_cells(), 0.));
+  }
+  slot_entries.assign(num_slots, 0.);
+}
+
+/**
+ * internal function returning the bin (0 = underflow, nbins+1 = overflow) of value on axis axis_idx
+ */
+uint64_t NdHistogramHelper::find_bin(unsigned int axis_idx, double value) const {
+  const VariableAxis &axis = axes[axis_idx];
+  const std::vector<double> &axis_edges = result->bin_edges[axis_idx];
+  if (value < axis_edges.front()) return 0;
+  if (value >= axis_edges.back()) return static_cast<uint64_t>(axis.nbins+1);
+  if (axis.uniform_bins)
+    return 1+std::min(static_cast<uint64_t>(axis.nbins-1), static_cast<uint64_t>((value-axis.low)/(axis.high-axis.low)*axis.nbins));
+  return static_cast<uint64_t>(std::upper_bound(axis_edges.begin(), axis_edges.end(), value)-axis_edges.begin());
+}
+
+/**
+ * methods required by RDataFrame for custom actions
+ */
+std::shared_ptr<NdHistogram> NdHistogramHelper::GetResultPtr() const {
+  return result;
+}
+
+void NdHistogramHelper::Initialize() {}
+
+void NdHistogramHelper::InitTask(TTreeReader *, unsigned int) {}
+
+void NdHistogramHelper::Exec(unsigned int slot, const ROOT::RVec<double> &values, double weight) {
+  //a single cell index over all axes replaces one fill per booked 1d/2d histogram
+  uint64_t cell = 0;
+  for (unsigned int axis_idx = 0; axis_idx < axes.size() && axis_idx < values.size(); axis_idx++) {
+    if (std::isnan(values[axis_idx])) return;
+    cell += find_bin(axis_idx, values[axis_idx])*strides[axis_idx];
+  }
+  if (result->is_sparse) {
+    std::pair<double, double> &sparse_cell = slot_sparse_cells[slot][cell];
+    sparse_cell.first += weight;
+    sparse_cell.second += weight*weight;
+  }
+  else {
+    slot_dense_contents[slot][cell] += weight;
+    slot_dense_sumw2[slot][cell] += weight*weight;
+  }
+  slot_entries[slot] += 1;
+}
+
+void NdHistogramHelper::Finalize() {
+  if (result->is_sparse) {
+    for (unsigned int slot = 0; slot < slot_sparse_cells.size(); slot++) {
+      for (std::pair<const uint64_t, std::pair<double, double>> sparse_cell : slot_sparse_cells[slot]) {
+        std::pair<double, double> &merged_cell = result->sparse_cells[sparse_cell.first];
+        merged_cell.first += sparse_cell.second.first;
+        merged_cell.second += sparse_cell.second.second;
+      }
+    }
+    slot_sparse_cells.clear();
+  }
+  else {
+    result->dense_contents.assign(result->num_cells(), 0.);
+    result->dense_sumw2.assign(result->num_cells(), 0.);
+    for (unsigned int slot = 0; slot < slot_dense_contents.size(); slot++) {
+      for (uint64_t cell = 0; cell < result->dense_contents.size(); cell++) {
+        result->dense_contents[cell] += slot_dense_contents[slot][cell];
+        result->dense_sumw2[cell] += slot_dense_sumw2[slot][cell];
+      }
+    }
+    slot_dense_contents.clear();
+    slot_dense_sumw2.clear();
+  }
+  for (double entries : slot_entries)
+    result->entries += entries;
+}
+
+std::string NdHistogramHelper::GetActionName() {
+  return "NdHistogram";
+}
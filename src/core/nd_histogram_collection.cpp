@@ -0,0 +1,239 @@
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "TH1.h"
+#include "TH2.h"
+#include "ROOT/RResultPtr.hxx"
+
+#include "core/sample_wrapper.hxx"
+#include "core/variable_axis.hxx"
+#include "core/region_collection.hxx"
+#include "core/plot_collection.hxx"
+#include "core/output_sink.hxx"
+#include "core/result_cache.hxx"
+#include "core/nd_histogram.hxx"
+#include "core/nd_histogram_collection.hxx"
+
+/**
+ * constructor, n-dimensional histograms are indexed [sample][region]
+ * max_dense_cells must match the booked histograms, see NdHistogramHelper
+ */
+NdHistogramCollection::NdHistogramCollection(std::vector<VariableAxis> i_axes, std::vector<std::vector<ROOT::RDF::RResultPtr<NdHistogram>>> i_nd_histograms, std::vector<SampleWrapper*> i_samples, RegionCollection* i_regions, uint64_t max_dense_cells)
+  : axes(i_axes), nd_histograms(i_nd_histograms), samples(i_samples)
+{
+  regions = i_regions;
+  output_sink = nullptr;
+  default_output_sink = nullptr;
+  result_cache = nullptr;
+  //binning and storage of histograms loaded from the result cache or merged from shards
+  empty_nd_histogram = NdHistogramHelper(axes, 0, max_dense_cells).GetResultPtr();
+}
+
+/**
+ * function to use results memoized in a ResultCache; entries of loaded histograms that are not null replace booked results
+ */
+NdHistogramCollection* NdHistogramCollection::set_cached_results(ResultCache* i_result_cache, std::vector<std::vector<std::shared_ptr<NdHistogram>>> i_loaded_nd_histograms, std::vector<std::vector<std::string>> i_result_keys) {
+  result_cache = i_result_cache;
+  loaded_nd_histograms = i_loaded_nd_histograms;
+  result_keys = i_result_keys;
+  return this;
+}
+
+/**
+ * internal function returning the (booked or loaded) n-dimensional histogram for a sample and region
+ * booked histograms are stored in the result cache once realized
+ */
+const NdHistogram& NdHistogramCollection::get_nd_histogram(unsigned int sample_idx, unsigned int region_idx) {
+  if (loaded_nd_histograms.size() > sample_idx && loaded_nd_histograms[sample_idx][region_idx])
+    return *loaded_nd_histograms[sample_idx][region_idx];
+  samples[sample_idx]->wait_for_event_loop();
+  if (result_cache != nullptr && result_keys.size() > sample_idx) {
+    if (results_stored.size() != samples.size())
+      results_stored.assign(samples.size(), std::vector<bool>(num_regions(), false));
+    if (!results_stored[sample_idx][region_idx]) {
+      result_cache->store_values(result_keys[sample_idx][region_idx], nd_histograms[sample_idx][region_idx]->get_cell_values(), true);
+      results_stored[sample_idx][region_idx] = true;
+    }
+  }
+  return *nd_histograms[sample_idx][region_idx];
+}
+
+/**
+ * function returning keys under which booked histograms are stored, see set_cached_results
+ */
+std::vector<std::string> NdHistogramCollection::get_result_keys() {
+  std::vector<std::string> keys;
+  for (std::vector<std::string> sample_keys : result_keys)
+    keys.insert(keys.end(), sample_keys.begin(), sample_keys.end());
+  return keys;
+}
+
+/**
+ * function to realize booked histograms and store them in shard_cache under their keys, used by shard processes
+ * if only_sample is not null, only histograms of that sample are realized and stored
+ */
+void NdHistogramCollection::store_shard_results(ResultCache* shard_cache, SampleWrapper* only_sample) {
+  //shard processes never write their partial histograms to the shared cache
+  result_cache = nullptr;
+  for (unsigned int sample_idx = 0; sample_idx < samples.size() && sample_idx < result_keys.size(); sample_idx++) {
+    if (only_sample != nullptr && samples[sample_idx] != only_sample) continue;
+    for (unsigned int region_idx = 0; region_idx < num_regions(); region_idx++) {
+      if (loaded_nd_histograms.size() > sample_idx && loaded_nd_histograms[sample_idx][region_idx]) continue;
+      //filled cells of each shard are concatenated, see NdHistogram::set_cell_values
+      shard_cache->store_values(result_keys[sample_idx][region_idx], get_nd_histogram(sample_idx, region_idx).get_cell_values(), true);
+    }
+  }
+}
+
+/**
+ * function to replace booked histograms with the sum of the histograms stored by all shards
+ * entries missing from any shard keep their booked result
+ */
+void NdHistogramCollection::merge_shard_results(std::vector<ResultCache*> shard_caches) {
+  if (loaded_nd_histograms.size() < samples.size())
+    loaded_nd_histograms.resize(samples.size(), std::vector<std::shared_ptr<NdHistogram>>(num_regions()));
+  for (unsigned int sample_idx = 0; sample_idx < samples.size() && sample_idx < result_keys.size(); sample_idx++) {
+    for (unsigned int region_idx = 0; region_idx < num_regions(); region_idx++) {
+      if (loaded_nd_histograms[sample_idx][region_idx]) continue;
+      std::vector<double> merged_values;
+      bool all_shards_found = true;
+      for (ResultCache* shard_cache : shard_caches) {
+        std::vector<double> shard_values;
+        if (!shard_cache->load_values(result_keys[sample_idx][region_idx], shard_values)) {
+          all_shards_found = false;
+          break;
+        }
+        merged_values.insert(merged_values.end(), shard_values.begin(), shard_values.end());
+      }
+      if (!all_shards_found) continue;
+      std::shared_ptr<NdHistogram> merged_histogram = std::make_shared<NdHistogram>(*empty_nd_histogram);
+      if (merged_histogram->set_cell_values(merged_values))
+        loaded_nd_histograms[sample_idx][region_idx] = merged_histogram;
+    }
+  }
+}
+
+/**
+ * method to set a shared output file used by all projections
+ */
+NdHistogramCollection* NdHistogramCollection::set_output_sink(OutputSink* i_output_sink) {
+  output_sink = i_output_sink;
+  return this;
+}
+
+/**
+ * method to set the default output file of all projections, see PlotCollection::set_default_output_sink
+ */
+NdHistogramCollection* NdHistogramCollection::set_default_output_sink(OutputSink* i_default_output_sink) {
+  default_output_sink = i_default_output_sink;
+  return this;
+}
+
+/**
+ * internal function returning number of regions (1 if there is no RegionCollection)
+ */
+unsigned int NdHistogramCollection::num_regions() {
+  if (regions != nullptr) return regions->size();
+  return 1;
+}
+
+/**
+ * internal function returning index of axis for variable_name, or number of axes if absent
+ */
+unsigned int NdHistogramCollection::axis_index(std::string variable_name) {
+  for (unsigned int axis_idx = 0; axis_idx < axes.size(); axis_idx++) {
+    if (axes[axis_idx].variable_name == variable_name) return axis_idx;
+  }
+  return static_cast<unsigned int>(axes.size());
+}
+
+/**
+ * internal function returning formatted description of slice cuts, used in histogram titles
+ */
+std::string NdHistogramCollection::cuts_description(std::vector<NdAxisCut> cuts) {
+  std::ostringstream description_stream;
+  for (NdAxisCut cut : cuts) {
+    unsigned int axis_idx = axis_index(cut.variable_name);
+    std::string variable_description = (axis_idx < axes.size()) ? axes[axis_idx].variable_description : cut.variable_name;
+    description_stream << ", ";
+    if (!std::isinf(cut.low)) description_stream << cut.low << "#leq";
+    description_stream << variable_description;
+    if (!std::isinf(cut.high)) description_stream << "<" << cut.high;
+  }
+  return description_stream.str();
+}
+
+/**
+ * internal function returning the common part of projection titles for a sample and region
+ */
+std::string NdHistogramCollection::selection_description(unsigned int sample_idx, unsigned int region_idx, std::vector<NdAxisCut> cuts) {
+  std::string description = samples[sample_idx]->selection_string();
+  if (regions != nullptr)
+    description += ", "+regions->get_description(region_idx);
+  return description+cuts_description(cuts);
+}
+
+/**
+ * method returning 1d projections on variable_name, keeping only bins passing cuts on the other axes
+ */
+PlotCollection* NdHistogramCollection::project_1d(std::string variable_name, std::vector<NdAxisCut> cuts) {
+  unsigned int axis_idx = axis_index(variable_name);
+  if (axis_idx == axes.size()) {
+    std::cout << "ERROR: " << variable_name << " is not an axis of the booked histograms" << std::endl;
+    return nullptr;
+  }
+  VariableAxis axis = axes[axis_idx];
+  std::vector<std::vector<std::shared_ptr<TH1D>>> histograms;
+  for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
+    histograms.push_back(std::vector<std::shared_ptr<TH1D>>());
+    for (unsigned int region_idx = 0; region_idx < num_regions(); region_idx++) {
+      std::string hist_name = "hist_"+axis.variable_name+"_"+samples[sample_idx]->sample_name;
+      if (regions != nullptr) hist_name += "_"+regions->get_name(region_idx);
+      std::string hist_title = axis.variable_description+" "+selection_description(sample_idx, region_idx, cuts)
+          +"; "+axis.variable_description+" "+axis.formatted_units();
+      histograms[sample_idx].push_back(std::shared_ptr<TH1D>(
+          get_nd_histogram(sample_idx, region_idx).project_1d(axis_idx, cuts, hist_name, hist_title)));
+    }
+  }
+  PlotCollection* plot_collection = new PlotCollection(axis, histograms, samples, regions);
+  plot_collection->set_default_output_sink(default_output_sink);
+  if (output_sink != nullptr)
+    plot_collection->set_output_sink(output_sink);
+  return plot_collection;
+}
+
+/**
+ * method returning 2d projections on (x_variable_name, y_variable_name), keeping only bins passing cuts on the other axes
+ */
+PlotCollection* NdHistogramCollection::project_2d(std::string x_variable_name, std::string y_variable_name, std::vector<NdAxisCut> cuts) {
+  unsigned int x_axis_idx = axis_index(x_variable_name);
+  unsigned int y_axis_idx = axis_index(y_variable_name);
+  if (x_axis_idx == axes.size() || y_axis_idx == axes.size() || x_axis_idx == y_axis_idx) {
+    std::cout << "ERROR: " << x_variable_name << " and " << y_variable_name << " are not two axes of the booked histograms" << std::endl;
+    return nullptr;
+  }
+  VariableAxis x_axis = axes[x_axis_idx];
+  VariableAxis y_axis = axes[y_axis_idx];
+  std::vector<std::vector<std::shared_ptr<TH2D>>> histograms;
+  for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
+    histograms.push_back(std::vector<std::shared_ptr<TH2D>>());
+    for (unsigned int region_idx = 0; region_idx < num_regions(); region_idx++) {
+      std::string hist_name = "hist_"+y_axis.variable_name+"_"+x_axis.variable_name+"_"+samples[sample_idx]->sample_name;
+      if (regions != nullptr) hist_name += "_"+regions->get_name(region_idx);
+      std::string hist_title = y_axis.variable_description+" vs "+x_axis.variable_description+", "
+          +selection_description(sample_idx, region_idx, cuts)+"; "+x_axis.variable_description+" "+x_axis.formatted_units()
+          +"; "+y_axis.variable_description+" "+y_axis.formatted_units()+"; Events/"+x_axis.bin_size()+"/"+y_axis.bin_size();
+      histograms[sample_idx].push_back(std::shared_ptr<TH2D>(
+          get_nd_histogram(sample_idx, region_idx).project_2d(x_axis_idx, y_axis_idx, cuts, hist_name, hist_title)));
+    }
+  }
+  PlotCollection* plot_collection = new PlotCollection(x_axis, y_axis, histograms, samples, regions);
+  plot_collection->set_default_output_sink(default_output_sink);
+  if (output_sink != nullptr)
+    plot_collection->set_output_sink(output_sink);
+  return plot_collection;
+}
@@ -0,0 +1,162 @@
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include "TDirectory.h"
+#include "TFile.h"
+#include "TH1.h"
+#include "TObject.h"
+#include "TROOT.h"
+
+#include "core/output_sink.hxx"
+
+/**
+ * constructor
+ * i_filename - name of output root file
+ * option - TFile option, ex. RECREATE or UPDATE
+ * i_use_writer_thread - if true, objects are written from a background thread, ROOT thread safety is then enabled
+ */
+OutputSink::OutputSink(std::string i_filename, std::string option, bool i_use_writer_thread)
+  : filename(i_filename), file_option(option), output_file(nullptr), use_writer_thread(i_use_writer_thread), is_closed(false), open_failed(false),
+    stop_writer(false)
+{
+  if (use_writer_thread) {
+    //the writer thread does file I/O while the main thread creates and draws objects
+    ROOT::EnableThreadSafety();
+    writer_thread = std::thread(&OutputSink::writer_loop, this);
+  }
+}
+
+/**
+ * destructor, closes file if not already closed
+ */
+OutputSink::~OutputSink() {
+  close();
+}
+
+/**
+ * internal function to open the output file, returns false if it cannot be opened
+ */
+bool OutputSink::open_file() {
+  if (output_file != nullptr) return true;
+  if (open_failed) return false;
+  //the current directory is restored so objects created afterwards are never attached to the output file
+  TDirectory::TContext directory_context;
+  output_file = TFile::Open(filename.c_str(), file_option.c_str());
+  if (output_file == nullptr || output_file->IsZombie()) {
+    std::cout << "ERROR: unable to open output file " << filename << std::endl;
+    delete output_file;
+    output_file = nullptr;
+    open_failed = true;
+    return false;
+  }
+  return true;
+}
+
+/**
+ * internal function to write a single object to a (possibly new) directory and free it
+ */
+void OutputSink::write_object(std::string directory, TObject* object) {
+  TDirectory* target_directory = output_file;
+  //walk/create directory hierarchy one level at a time
+  std::string remaining_path = directory;
+  while (remaining_path != "") {
+    size_t slash_position = remaining_path.find('/');
+    std::string subdirectory_name = remaining_path.substr(0, slash_position);
+    if (slash_position == std::string::npos)
+      remaining_path = "";
+    else
+      remaining_path = remaining_path.substr(slash_position+1);
+    if (subdirectory_name == "") continue;
+    TDirectory* subdirectory = target_directory->GetDirectory(subdirectory_name.c_str());
+    if (subdirectory == nullptr)
+      subdirectory = target_directory->mkdir(subdirectory_name.c_str());
+    if (subdirectory == nullptr) {
+      std::cout << "ERROR: unable to make directory " << directory << " in output file " << filename << std::endl;
+      delete object;
+      return;
+    }
+    target_directory = subdirectory;
+  }
+  //key list is only written when the file is closed
+  target_directory->WriteTObject(object);
+  delete object;
+}
+
+/**
+ * internal function run by background writer thread
+ */
+void OutputSink::writer_loop() {
+  //with thread safety enabled the current directory is per thread, so writes never change it for the main thread
+  TDirectory::TContext directory_context(nullptr);
+  while (true) {
+    std::pair<std::string, TObject*> next_item;
+    {
+      std::unique_lock<std::mutex> queue_lock(queue_mutex);
+      queue_condition.wait(queue_lock, [this]{ return stop_writer || !write_queue.empty(); });
+      if (write_queue.empty()) return;
+      next_item = write_queue.front();
+      write_queue.pop_front();
+    }
+    write_object(next_item.first, next_item.second);
+  }
+}
+
+/**
+ * method to write an object to the file in directory (ex. "region/sample")
+ * the sink takes ownership of object, so callers should pass a clone
+ */
+OutputSink* OutputSink::write(TObject* object, std::string directory) {
+  if (object == nullptr) return this;
+  if (is_closed || !open_file()) {
+    if (is_closed)
+      std::cout << "ERROR: attempt to write to closed output file " << filename << std::endl;
+    delete object;
+    return this;
+  }
+  //detach histograms from gDirectory so the sink is the only owner
+  if (object->InheritsFrom(TH1::Class()))
+    static_cast<TH1*>(object)->SetDirectory(nullptr);
+  if (use_writer_thread) {
+    {
+      std::lock_guard<std::mutex> queue_lock(queue_mutex);
+      write_queue.push_back(std::make_pair(directory, object));
+    }
+    queue_condition.notify_one();
+  }
+  else {
+    write_object(directory, object);
+  }
+  return this;
+}
+
+/**
+ * method to finish all pending writes and close the file
+ */
+void OutputSink::close() {
+  if (is_closed) return;
+  if (use_writer_thread) {
+    {
+      std::lock_guard<std::mutex> queue_lock(queue_mutex);
+      stop_writer = true;
+    }
+    queue_condition.notify_one();
+    writer_thread.join();
+  }
+  is_closed = true;
+  if (output_file == nullptr) return;
+  output_file->Close();
+  delete output_file;
+  output_file = nullptr;
+}
+
+/**
+ * returns name of output file
+ */
+std::string OutputSink::get_filename() {
+  return filename;
+}
@@ -0,0 +1,454 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "ROOT/RLogger.hxx"
+#include "ROOT/RDF/RInterface.hxx"
+#include "ROOT/RDF/Utils.hxx"
+
+#include "core/phase_report.hxx"
+
+namespace {
+
+/**
+ * wall time, peak resident memory, and jitted expressions of one phase
+ */
+struct Phase {
+  std::string name;
+  double seconds;
+  long peak_rss_kb;
+  unsigned int num_jitted;
+  unsigned int count;
+};
+
+/**
+ * jit, loop, and merge time of one event loop, and the phase it ran in
+ */
+struct LoopTiming {
+  std::string phase_name;
+  double jit_seconds = 0.;
+  double loop_seconds = 0.;
+  double merge_seconds = 0.;
+  std::chrono::steady_clock::time_point start;
+};
+
+/**
+ * state of the report; phases are recorded from the main thread, but RDataFrame may log from others
+ * resident memory is sampled by a separate thread that only touches the atomic sampled_peak_rss_kb, so the mutex
+ * is never held by it (ex. when the process forks)
+ */
+struct PhaseState {
+  bool enabled = false;
+  bool printed = false;
+  std::string json_filename;
+  std::vector<Phase> phases;
+  std::vector<std::size_t> open_phases;
+  std::chrono::steady_clock::time_point segment_start;
+  double deducted_seconds = 0.;
+  unsigned int pending_jitted = 0;
+  std::map<std::thread::id, LoopTiming> running_loops;
+  std::vector<LoopTiming> loops;
+  ROOT::Experimental::RLogHandler* log_handler = nullptr;
+  ROOT::Experimental::ELogLevel previous_verbosity = ROOT::Experimental::ELogLevel::kUnset;
+  std::atomic<long> sampled_peak_rss_kb{0};
+  std::atomic<bool> sampling{false};
+  std::thread sampler;
+  pid_t sampler_pid = 0;
+  std::mutex state_mutex;
+};
+
+PhaseState& get_state() {
+  static PhaseState state;
+  return state;
+}
+
+/**
+ * returns current resident memory in kB from /proc/self/statm, or 0 if unavailable
+ */
+long read_rss_kb() {
+  std::ifstream statm_file("/proc/self/statm");
+  long size_pages = 0, resident_pages = 0;
+  if (!(statm_file >> size_pages >> resident_pages)) return 0;
+  return resident_pages*(sysconf(_SC_PAGESIZE)/1024);
+}
+
+/**
+ * raises peak_rss_kb to rss_kb if it is larger
+ */
+void raise_peak_rss(std::atomic<long>& peak_rss_kb, long rss_kb) {
+  long peak = peak_rss_kb.load();
+  while (rss_kb > peak && !peak_rss_kb.compare_exchange_weak(peak, rss_kb)) {}
+}
+
+/**
+ * samples resident memory every 20 ms into the peak of the running phase until sampling is stopped
+ */
+void sample_rss(PhaseState* state) {
+  while (state->sampling.load()) {
+    raise_peak_rss(state->sampled_peak_rss_kb, read_rss_kb());
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+}
+
+/**
+ * stops the memory sampler; forked processes do not have the thread, so it is only joined by the process that
+ * started it
+ */
+void stop_sampler(PhaseState& state) {
+  state.sampling.store(false);
+  if (!state.sampler.joinable()) return;
+  if (getpid() == state.sampler_pid)
+    state.sampler.join();
+  else
+    state.sampler.detach();
+}
+
+/**
+ * returns seconds since this process was started, or 0 if unavailable
+ */
+double process_age_seconds() {
+  std::ifstream uptime_file("/proc/uptime");
+  double uptime = 0.;
+  if (!(uptime_file >> uptime)) return 0.;
+  std::ifstream stat_file("/proc/self/stat");
+  std::string stat;
+  std::getline(stat_file, stat);
+  //the command name may contain spaces, fields are counted after its closing parenthesis
+  std::size_t fields_begin = stat.rfind(')');
+  if (fields_begin == std::string::npos) return 0.;
+  std::istringstream stat_stream(stat.substr(fields_begin+1));
+  std::string field;
+  for (unsigned int field_idx = 3; field_idx < 22; field_idx++)
+    stat_stream >> field;
+  double start_ticks = 0.;
+  if (!(stat_stream >> start_ticks)) return 0.;
+  return std::max(uptime-start_ticks/static_cast<double>(sysconf(_SC_CLK_TCK)), 0.);
+}
+
+/**
+ * returns index of phase phase_name, adding it if needed
+ */
+std::size_t get_phase(PhaseState& state, std::string phase_name) {
+  for (std::size_t phase_idx = 0; phase_idx < state.phases.size(); phase_idx++)
+    if (state.phases[phase_idx].name == phase_name) return phase_idx;
+  state.phases.push_back({phase_name, 0., 0, 0, 0});
+  return state.phases.size()-1;
+}
+
+/**
+ * updates peak memory of phase phase_idx with the peak sampled since the last update, which restarts from current
+ * resident memory
+ */
+void update_peak_rss(PhaseState& state, std::size_t phase_idx) {
+  long rss_kb = read_rss_kb();
+  raise_peak_rss(state.sampled_peak_rss_kb, rss_kb);
+  state.phases[phase_idx].peak_rss_kb = std::max(state.phases[phase_idx].peak_rss_kb, state.sampled_peak_rss_kb.exchange(rss_kb));
+}
+
+/**
+ * attributes time since the start of the current segment (minus time recorded in jit, loop, and merge phases) to
+ * the innermost open phase, and starts a new segment
+ */
+void close_segment(PhaseState& state) {
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  if (state.open_phases.size() > 0) {
+    std::size_t phase_idx = state.open_phases.back();
+    state.phases[phase_idx].seconds += std::max(
+        std::chrono::duration<double>(now-state.segment_start).count()-state.deducted_seconds, 0.);
+    update_peak_rss(state, phase_idx);
+  }
+  state.segment_start = now;
+  state.deducted_seconds = 0.;
+}
+
+/**
+ * adds seconds to phase phase_name and deducts them from the enclosing phase
+ */
+void record_nested_time(PhaseState& state, std::string phase_name, double seconds, unsigned int num_jitted) {
+  std::size_t phase_idx = get_phase(state, phase_name);
+  state.phases[phase_idx].seconds += seconds;
+  state.phases[phase_idx].num_jitted += num_jitted;
+  state.phases[phase_idx].count++;
+  update_peak_rss(state, phase_idx);
+  state.deducted_seconds += seconds;
+}
+
+/**
+ * returns the number following prefix in message, or -1 if message does not start with prefix
+ */
+double parse_after(const std::string& message, std::string prefix) {
+  if (message.compare(0, prefix.size(), prefix) != 0) return -1.;
+  return std::atof(message.c_str()+prefix.size());
+}
+
+/**
+ * log handler recording jit and event loop times from messages of the RDataFrame log channel
+ * a data frame jits, loops, and merges on the thread that runs it, so loops running concurrently (ex. one thread per
+ * sample) are told apart by thread
+ */
+class PhaseLogHandler : public ROOT::Experimental::RLogHandler {
+  public:
+    bool Emit(const ROOT::Experimental::RLogEntry &entry) override {
+      if (entry.fChannel != &ROOT::Detail::RDF::RDFLogChannel()
+          || entry.fLevel != ROOT::Experimental::ELogLevel::kInfo) return true;
+      PhaseState& state = get_state();
+      std::lock_guard<std::mutex> lock(state.state_mutex);
+      const std::string& message = entry.fMessage;
+      std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+      std::thread::id thread_id = std::this_thread::get_id();
+      if (message.compare(0, 36, "Just-in-time compilation phase compl") == 0
+          || message.compare(0, 26, "Nothing to jit and execute") == 0) {
+        double jit_seconds = std::max(parse_after(message, "Just-in-time compilation phase completed in "), 0.);
+        record_nested_time(state, "jit", jit_seconds, state.pending_jitted);
+        state.pending_jitted = 0;
+        state.running_loops[thread_id].jit_seconds += jit_seconds;
+      }
+      else if (message.compare(0, 26, "Starting event loop number") == 0) {
+        LoopTiming& loop = state.running_loops[thread_id];
+        loop.start = now;
+        loop.phase_name = state.open_phases.size() > 0 ? state.phases[state.open_phases.back()].name : "";
+      }
+      else if (message.compare(0, 26, "Finished event loop number") == 0) {
+        //message is "Finished event loop number N (Xs CPU, Ys elapsed).", results are merged after the loop
+        LoopTiming& loop = state.running_loops[thread_id];
+        std::size_t elapsed_end = message.find("s elapsed");
+        std::size_t elapsed_begin = message.rfind(' ', elapsed_end);
+        if (elapsed_end != std::string::npos && elapsed_begin != std::string::npos)
+          loop.loop_seconds = std::atof(message.substr(elapsed_begin+1, elapsed_end-elapsed_begin-1).c_str());
+        loop.merge_seconds = std::max(std::chrono::duration<double>(now-loop.start).count()-loop.loop_seconds, 0.);
+        record_nested_time(state, "loop", loop.loop_seconds, 0);
+        record_nested_time(state, "merge", loop.merge_seconds, 0);
+        state.loops.push_back(loop);
+        state.running_loops.erase(thread_id);
+      }
+      else {
+        //other info messages are only shown if RDataFrame logging was enabled before the report
+        return state.previous_verbosity >= ROOT::Experimental::ELogLevel::kInfo;
+      }
+      return false;
+    }
+};
+
+/**
+ * returns text quoted as a JSON string
+ */
+std::string json_string(std::string text) {
+  std::string quoted = "\"";
+  for (char text_char : text) {
+    if (text_char == '"' || text_char == '\\') quoted += '\\';
+    quoted += text_char;
+  }
+  return quoted+"\"";
+}
+
+void print_at_exit() {
+  PhaseReport::print();
+  stop_sampler(get_state());
+}
+
+}
+
+/**
+ * method to start recording phases, should be called at the start of main
+ * a summary is printed at exit, and written to json_filename as JSON if it is not empty
+ */
+void PhaseReport::enable(std::string json_filename) {
+  PhaseState& state = get_state();
+  {
+    std::lock_guard<std::mutex> lock(state.state_mutex);
+    if (state.enabled) return;
+    state.enabled = true;
+    state.json_filename = json_filename;
+    std::size_t startup_idx = get_phase(state, "startup");
+    state.phases[startup_idx].seconds = process_age_seconds();
+    state.phases[startup_idx].count = 1;
+    update_peak_rss(state, startup_idx);
+    state.open_phases.push_back(get_phase(state, "graph"));
+    state.phases[state.open_phases.back()].count = 1;
+    state.segment_start = std::chrono::steady_clock::now();
+    state.log_handler = new PhaseLogHandler();
+    state.previous_verbosity = ROOT::Detail::RDF::RDFLogChannel().GetVerbosity();
+    state.sampling.store(true);
+    state.sampler_pid = getpid();
+    state.sampler = std::thread(sample_rss, &state);
+  }
+  ROOT::Experimental::RLogManager::Get().PushFront(std::unique_ptr<ROOT::Experimental::RLogHandler>(state.log_handler));
+  ROOT::Detail::RDF::RDFLogChannel().SetVerbosity(ROOT::Experimental::ELogLevel::kInfo);
+  static bool print_registered = false;
+  if (!print_registered) std::atexit(print_at_exit);
+  print_registered = true;
+}
+
+/**
+ * method to stop recording phases: the summary is printed, and the RDataFrame log verbosity and handlers are restored
+ */
+void PhaseReport::disable() {
+  PhaseState& state = get_state();
+  if (!state.enabled) return;
+  print();
+  std::lock_guard<std::mutex> lock(state.state_mutex);
+  stop_sampler(state);
+  ROOT::Experimental::RLogManager::Get().Remove(state.log_handler);
+  state.log_handler = nullptr;
+  ROOT::Detail::RDF::RDFLogChannel().SetVerbosity(state.previous_verbosity);
+  //a later enable starts a new report
+  state.enabled = false;
+  state.printed = false;
+  state.phases.clear();
+  state.open_phases.clear();
+  state.running_loops.clear();
+  state.loops.clear();
+  state.pending_jitted = 0;
+}
+
+/**
+ * returns true if phases are being recorded
+ */
+bool PhaseReport::is_enabled() {
+  return get_state().enabled;
+}
+
+/**
+ * methods to open a phase (nested in the current one) and close the current phase, see PhaseScope
+ */
+void PhaseReport::begin(std::string phase_name) {
+  PhaseState& state = get_state();
+  std::lock_guard<std::mutex> lock(state.state_mutex);
+  if (!state.enabled) return;
+  close_segment(state);
+  state.open_phases.push_back(get_phase(state, phase_name));
+  state.phases[state.open_phases.back()].count++;
+}
+
+void PhaseReport::end() {
+  PhaseState& state = get_state();
+  std::lock_guard<std::mutex> lock(state.state_mutex);
+  //the outermost (graph) phase stays open
+  if (!state.enabled || state.open_phases.size() <= 1) return;
+  close_segment(state);
+  state.open_phases.pop_back();
+}
+
+/**
+ * method to count jitted expressions (string defines, filters, and actions) declared in the current phase
+ */
+void PhaseReport::add_jitted_expressions(unsigned int num_expressions) {
+  PhaseState& state = get_state();
+  std::lock_guard<std::mutex> lock(state.state_mutex);
+  if (!state.enabled) return;
+  state.phases[state.open_phases.back()].num_jitted += num_expressions;
+  state.pending_jitted += num_expressions;
+}
+
+/**
+ * methods applying a string define, redefine, or filter to node and counting it with add_jitted_expressions
+ */
+ROOT::RDF::RNode PhaseReport::jitted_define(ROOT::RDF::RNode node, std::string name, std::string expression) {
+  add_jitted_expressions();
+  return node.Define(name, expression);
+}
+
+ROOT::RDF::RNode PhaseReport::jitted_redefine(ROOT::RDF::RNode node, std::string name, std::string expression) {
+  add_jitted_expressions();
+  return node.Redefine(name, expression);
+}
+
+ROOT::RDF::RNode PhaseReport::jitted_filter(ROOT::RDF::RNode node, std::string expression, std::string filter_name) {
+  add_jitted_expressions();
+  return node.Filter(expression, filter_name);
+}
+
+/**
+ * returns seconds recorded so far in phase phase_name, 0 if phases are not recorded
+ */
+double PhaseReport::get_seconds(std::string phase_name) {
+  PhaseState& state = get_state();
+  std::lock_guard<std::mutex> lock(state.state_mutex);
+  for (const Phase& phase : state.phases)
+    if (phase.name == phase_name) return phase.seconds;
+  return 0.;
+}
+
+/**
+ * method to print the summary (and write it to JSON if set)
+ */
+void PhaseReport::print() {
+  PhaseState& state = get_state();
+  std::lock_guard<std::mutex> lock(state.state_mutex);
+  if (!state.enabled || state.printed) return;
+  state.printed = true;
+  close_segment(state);
+  double total_seconds = 0.;
+  for (const Phase& phase : state.phases)
+    total_seconds += phase.seconds;
+  std::cout << "Phase report:" << std::endl;
+  std::cout << std::left << std::setw(12) << "phase" << std::right << std::setw(12) << "seconds" << std::setw(10) << "fraction"
+      << std::setw(14) << "peak RSS [MB]" << std::setw(10) << "jitted" << std::setw(8) << "count" << std::endl;
+  for (const Phase& phase : state.phases) {
+    std::cout << std::left << std::setw(12) << phase.name << std::right << std::fixed << std::setprecision(3)
+        << std::setw(12) << phase.seconds << std::setprecision(1) << std::setw(9)
+        << (total_seconds > 0. ? 100.*phase.seconds/total_seconds : 0.) << "%" << std::setw(14)
+        << static_cast<double>(phase.peak_rss_kb)/1024. << std::setw(10) << phase.num_jitted << std::setw(8) << phase.count
+        << std::defaultfloat << std::setprecision(6) << std::endl;
+  }
+  std::cout << std::left << std::setw(12) << "total" << std::right << std::fixed << std::setprecision(3)
+      << std::setw(12) << total_seconds << std::defaultfloat << std::setprecision(6) << std::endl;
+  if (state.loops.size() > 0) {
+    std::cout << "Event loops:" << std::endl;
+    std::cout << std::left << std::setw(12) << "loop" << std::right << std::setw(12) << "jit [s]" << std::setw(12) << "loop [s]"
+        << std::setw(12) << "merge [s]" << "  phase" << std::endl;
+    for (std::size_t loop_idx = 0; loop_idx < state.loops.size(); loop_idx++) {
+      const LoopTiming& loop = state.loops[loop_idx];
+      std::cout << std::left << std::setw(12) << loop_idx << std::right << std::fixed << std::setprecision(3)
+          << std::setw(12) << loop.jit_seconds << std::setw(12) << loop.loop_seconds << std::setw(12) << loop.merge_seconds
+          << "  " << loop.phase_name << std::defaultfloat << std::setprecision(6) << std::endl;
+    }
+  }
+  if (state.json_filename == "") return;
+  std::ofstream json_file(state.json_filename.c_str());
+  if (!json_file.is_open()) {
+    std::cout << "ERROR: unable to open phase report file " << state.json_filename << std::endl;
+    return;
+  }
+  json_file << "{\"phases\": [";
+  for (std::size_t phase_idx = 0; phase_idx < state.phases.size(); phase_idx++) {
+    const Phase& phase = state.phases[phase_idx];
+    json_file << (phase_idx > 0 ? ", " : "") << "{\"name\": " << json_string(phase.name) << ", \"seconds\": " << phase.seconds
+        << ", \"peak_rss_mb\": " << static_cast<double>(phase.peak_rss_kb)/1024. << ", \"jitted_expressions\": "
+        << phase.num_jitted << ", \"count\": " << phase.count << "}";
+  }
+  json_file << "], \"loops\": [";
+  for (std::size_t loop_idx = 0; loop_idx < state.loops.size(); loop_idx++) {
+    const LoopTiming& loop = state.loops[loop_idx];
+    json_file << (loop_idx > 0 ? ", " : "") << "{\"phase\": " << json_string(loop.phase_name) << ", \"jit_seconds\": "
+        << loop.jit_seconds << ", \"loop_seconds\": " << loop.loop_seconds << ", \"merge_seconds\": " << loop.merge_seconds << "}";
+  }
+  json_file << "], \"total_seconds\": " << total_seconds << "}" << std::endl;
+}
+
+/**
+ * constructor, opens phase phase_name
+ */
+PhaseScope::PhaseScope(std::string phase_name) {
+  PhaseReport::begin(phase_name);
+}
+
+/**
+ * destructor, closes the phase
+ */
+PhaseScope::~PhaseScope() {
+  PhaseReport::end();
+}
@@ -1,11 +1,16 @@
+#include <cmath>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <memory>
 
 #include "TStyle.h"
 #include "TLegend.h"
 #include "TCanvas.h"
+#include "TPad.h"
 #include "TH1.h"
 #include "THStack.h"
 #include "TGraphAsymmErrors.h"
@@ -14,7 +19,12 @@
 
 #include "core/sample_wrapper.hxx"
 #include "core/region_collection.hxx"
+#include "core/output_sink.hxx"
+#include "core/histogram_archive.hxx"
+#include "core/result_cache.hxx"
+#include "core/multi_weight_histogram.hxx"
 #include "core/plot_collection.hxx"
+#include "core/phase_report.hxx"
 
 /**
  * sorting function to sort histograms by integrated area
@@ -35,25 +45,39 @@ bool sort_by_maximum(HistogramAndStyle hist_a, HistogramAndStyle hist_b) {
 }
 
 /**
- * constructor to generate collection from a vector of vectors for 1d histograms
+ * internal function to set the axis, regions, and default options shared by all constructors
  */
-PlotCollection::PlotCollection(VariableAxis axis, std::vector<std::vector<ROOT::RDF::RResultPtr<TH1D>>> i_histograms, std::vector<SampleWrapper*> i_samples, RegionCollection* i_regions)
-  : samples(i_samples)
-{
+void PlotCollection::init(VariableAxis axis, RegionCollection* i_regions) {
   regions = i_regions;
   name = axis.variable_name;
   description = axis.variable_description;
-  histograms = i_histograms;
   luminosity = 1.0;
   x_log = false;
   y_log = false;
   z_log = false;
   is_efficiency = false;
   is_2d = false;
+  is_loaded = false;
   save_as_root = false;
+  output_sink = nullptr;
+  default_output_sink = nullptr;
   file_extension = "png";
   plot_combine_style = PlotCombineStyle::overlay;
   bottom_style = BottomStyle::none;
+  signal_flag = "signal";
+  significance_style = SignificanceStyle::s_over_sqrt_b;
+  result_cache = nullptr;
+  results_stored = false;
+}
+
+/**
+ * constructor to generate collection from a vector of vectors for 1d histograms
+ */
+PlotCollection::PlotCollection(VariableAxis axis, std::vector<std::vector<ROOT::RDF::RResultPtr<TH1D>>> i_histograms, std::vector<SampleWrapper*> i_samples, RegionCollection* i_regions)
+  : samples(i_samples)
+{
+  init(axis, i_regions);
+  histograms = i_histograms;
 }
 
 /**
@@ -63,21 +87,10 @@ PlotCollection::PlotCollection(VariableAxis axis, std::vector<std::vector<ROOT::
   : samples(i_samples)
 {
   std::string temp = numerator_description; //temp to avoid unused variable
-  regions = i_regions;
-  name = axis.variable_name;
-  description = axis.variable_description;
+  init(axis, i_regions);
   histograms = i_histograms;
   denominator_histograms = i_denominator_histograms;
-  luminosity = 1.0;
-  x_log = false;
-  y_log = false;
-  z_log = false;
   is_efficiency = true;
-  is_2d = false;
-  save_as_root = false;
-  file_extension = "png";
-  plot_combine_style = PlotCombineStyle::overlay;
-  bottom_style = BottomStyle::none;
 }
 
 /**
@@ -86,22 +99,11 @@ PlotCollection::PlotCollection(VariableAxis axis, std::vector<std::vector<ROOT::
 PlotCollection::PlotCollection(VariableAxis x_axis, VariableAxis y_axis, std::vector<std::vector<ROOT::RDF::RResultPtr<TH2D>>> i_twodim_histograms, std::vector<SampleWrapper*> i_samples, RegionCollection* i_regions)
   : samples(i_samples)
 {
-  regions = i_regions;
-  name = x_axis.variable_name;
-  description = x_axis.variable_description;
+  init(x_axis, i_regions);
   yname = y_axis.variable_name;
   ydescription = y_axis.variable_description;
   twodim_histograms = i_twodim_histograms;
-  luminosity = 1.0;
-  x_log = false;
-  y_log = false;
-  z_log = false;
-  is_efficiency = false;
   is_2d = true;
-  save_as_root = false;
-  file_extension = "png";
-  plot_combine_style = PlotCombineStyle::overlay;
-  bottom_style = BottomStyle::none;
 }
 
 /**
@@ -111,23 +113,530 @@ PlotCollection::PlotCollection(VariableAxis x_axis, VariableAxis y_axis, std::ve
   : samples(i_samples)
 {
   std::string temp = numerator_description; //temp to avoid unused variable
-  regions = i_regions;
-  name = x_axis.variable_name;
-  description = x_axis.variable_description;
+  init(x_axis, i_regions);
   yname = y_axis.variable_name;
   ydescription = y_axis.variable_description;
   twodim_histograms = i_twodim_histograms;
   twodim_denominator_histograms = i_twodim_denominator_histograms;
-  luminosity = 1.0;
-  x_log = false;
-  y_log = false;
-  z_log = false;
   is_efficiency = true;
   is_2d = true;
-  save_as_root = false;
-  file_extension = "png";
-  plot_combine_style = PlotCombineStyle::overlay;
-  bottom_style = BottomStyle::none;
+}
+
+/**
+ * constructor to generate collection of 1d histograms with weight variations from multi-weight results
+ */
+PlotCollection::PlotCollection(VariableAxis axis, std::vector<std::vector<ROOT::RDF::RResultPtr<MultiWeightHistogram>>> i_variation_results, std::vector<std::string> i_variation_names, std::vector<SampleWrapper*> i_samples, RegionCollection* i_regions)
+  : samples(i_samples)
+{
+  init(axis, i_regions);
+  variation_results = i_variation_results;
+  variation_names = i_variation_names;
+  variation_histograms.assign(samples.size(), std::vector<std::vector<std::shared_ptr<TH1D>>>(num_regions()));
+  //binning of variation results loaded from the result cache or merged from shards
+  empty_variation_result = MultiWeightHistogramHelper(axis, static_cast<unsigned int>(variation_names.size()), 0).GetResultPtr();
+}
+
+/**
+ * constructor to generate collection from already realized 1d histograms (ex. projections), indexed [sample][region]
+ */
+PlotCollection::PlotCollection(VariableAxis axis, std::vector<std::vector<std::shared_ptr<TH1D>>> i_histograms, std::vector<SampleWrapper*> i_samples, RegionCollection* i_regions)
+  : samples(i_samples)
+{
+  init(axis, i_regions);
+  loaded_histograms = i_histograms;
+  is_loaded = true;
+}
+
+/**
+ * constructor to generate collection from already realized 2d histograms (ex. projections), indexed [sample][region]
+ */
+PlotCollection::PlotCollection(VariableAxis x_axis, VariableAxis y_axis, std::vector<std::vector<std::shared_ptr<TH2D>>> i_twodim_histograms, std::vector<SampleWrapper*> i_samples, RegionCollection* i_regions)
+  : samples(i_samples)
+{
+  init(x_axis, i_regions);
+  yname = y_axis.variable_name;
+  ydescription = y_axis.variable_description;
+  loaded_twodim_histograms = i_twodim_histograms;
+  is_2d = true;
+  is_loaded = true;
+}
+
+/**
+ * constructor to rebuild a 1d histogram or efficiency collection from an archive written by save_archive
+ * no input data is read; samples are only used for names and styles
+ */
+PlotCollection::PlotCollection(HistogramArchive* archive, VariableAxis axis, std::vector<SampleWrapper*> i_samples, RegionCollection* i_regions)
+  : samples(i_samples)
+{
+  init(axis, i_regions);
+  is_loaded = true;
+  //archived histograms are already normalized
+  histograms_normalized.assign(samples.size(), true);
+  is_efficiency = samples.size() > 0 && archive->contains(archive_variable_name(), samples[0]->sample_name, archive_region_name(0), "denominator");
+  std::string kind = is_efficiency ? "numerator" : "histogram";
+  for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
+    loaded_histograms.push_back(std::vector<std::shared_ptr<TH1D>>());
+    loaded_denominator_histograms.push_back(std::vector<std::shared_ptr<TH1D>>());
+    for (unsigned int region_idx = 0; region_idx < num_regions(); region_idx++) {
+      std::shared_ptr<TH1D> histogram(archive->get_1d_histogram(archive_variable_name(), samples[sample_idx]->sample_name, archive_region_name(region_idx), kind));
+      std::shared_ptr<TH1D> denominator_histogram;
+      if (is_efficiency)
+        denominator_histogram.reset(archive->get_1d_histogram(archive_variable_name(), samples[sample_idx]->sample_name, archive_region_name(region_idx), "denominator"));
+      if (!histogram || (is_efficiency && !denominator_histogram)) {
+        std::cout << "ERROR: " << name << " for sample " << samples[sample_idx]->sample_name << " in region " << archive_region_name(region_idx) << " not found in archive" << std::endl;
+        loaded_histograms.clear();
+        loaded_denominator_histograms.clear();
+        return;
+      }
+      loaded_histograms[sample_idx].push_back(histogram);
+      loaded_denominator_histograms[sample_idx].push_back(denominator_histogram);
+    }
+  }
+}
+
+/**
+ * constructor to rebuild a 2d histogram or efficiency collection from an archive written by save_archive
+ */
+PlotCollection::PlotCollection(HistogramArchive* archive, VariableAxis x_axis, VariableAxis y_axis, std::vector<SampleWrapper*> i_samples, RegionCollection* i_regions)
+  : samples(i_samples)
+{
+  init(x_axis, i_regions);
+  yname = y_axis.variable_name;
+  ydescription = y_axis.variable_description;
+  is_2d = true;
+  is_loaded = true;
+  //archived histograms are already normalized
+  histograms_normalized.assign(samples.size(), true);
+  is_efficiency = samples.size() > 0 && archive->contains(archive_variable_name(), samples[0]->sample_name, archive_region_name(0), "denominator");
+  std::string kind = is_efficiency ? "numerator" : "histogram";
+  for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
+    loaded_twodim_histograms.push_back(std::vector<std::shared_ptr<TH2D>>());
+    loaded_twodim_denominator_histograms.push_back(std::vector<std::shared_ptr<TH2D>>());
+    for (unsigned int region_idx = 0; region_idx < num_regions(); region_idx++) {
+      std::shared_ptr<TH2D> histogram(archive->get_2d_histogram(archive_variable_name(), samples[sample_idx]->sample_name, archive_region_name(region_idx), kind));
+      std::shared_ptr<TH2D> denominator_histogram;
+      if (is_efficiency)
+        denominator_histogram.reset(archive->get_2d_histogram(archive_variable_name(), samples[sample_idx]->sample_name, archive_region_name(region_idx), "denominator"));
+      if (!histogram || (is_efficiency && !denominator_histogram)) {
+        std::cout << "ERROR: " << yname << " vs " << name << " for sample " << samples[sample_idx]->sample_name << " in region " << archive_region_name(region_idx) << " not found in archive" << std::endl;
+        loaded_twodim_histograms.clear();
+        loaded_twodim_denominator_histograms.clear();
+        return;
+      }
+      loaded_twodim_histograms[sample_idx].push_back(histogram);
+      loaded_twodim_denominator_histograms[sample_idx].push_back(denominator_histogram);
+    }
+  }
+}
+
+/**
+ * internal functions returning the (booked or loaded) histogram for a sample and region
+ * histograms are loaded per entry, so collections may mix cached and booked results
+ */
+TH1D* PlotCollection::get_histogram(unsigned int sample_idx, unsigned int region_idx) {
+  if (loaded_histograms.size() > sample_idx && loaded_histograms[sample_idx][region_idx])
+    return loaded_histograms[sample_idx][region_idx].get();
+  if (variation_results.size() > 0) {
+    realize_variations(sample_idx, region_idx);
+    return variation_histograms[sample_idx][region_idx][0].get();
+  }
+  if (merged_results.size() > region_idx && merged_results[region_idx])
+    return merged_results[region_idx]->histograms[sample_idx].get();
+  samples[sample_idx]->wait_for_event_loop();
+  return histograms[sample_idx][region_idx].GetPtr();
+}
+
+TH1D* PlotCollection::get_denominator_histogram(unsigned int sample_idx, unsigned int region_idx) {
+  if (loaded_denominator_histograms.size() > sample_idx && loaded_denominator_histograms[sample_idx][region_idx])
+    return loaded_denominator_histograms[sample_idx][region_idx].get();
+  if (merged_denominator_results.size() > region_idx && merged_denominator_results[region_idx])
+    return merged_denominator_results[region_idx]->histograms[sample_idx].get();
+  samples[sample_idx]->wait_for_event_loop();
+  return denominator_histograms[sample_idx][region_idx].GetPtr();
+}
+
+TH2D* PlotCollection::get_twodim_histogram(unsigned int sample_idx, unsigned int region_idx) {
+  if (loaded_twodim_histograms.size() > sample_idx && loaded_twodim_histograms[sample_idx][region_idx])
+    return loaded_twodim_histograms[sample_idx][region_idx].get();
+  if (merged_results.size() > region_idx && merged_results[region_idx])
+    return merged_results[region_idx]->twodim_histograms[sample_idx].get();
+  samples[sample_idx]->wait_for_event_loop();
+  return twodim_histograms[sample_idx][region_idx].GetPtr();
+}
+
+TH2D* PlotCollection::get_twodim_denominator_histogram(unsigned int sample_idx, unsigned int region_idx) {
+  if (loaded_twodim_denominator_histograms.size() > sample_idx && loaded_twodim_denominator_histograms[sample_idx][region_idx])
+    return loaded_twodim_denominator_histograms[sample_idx][region_idx].get();
+  if (merged_denominator_results.size() > region_idx && merged_denominator_results[region_idx])
+    return merged_denominator_results[region_idx]->twodim_histograms[sample_idx].get();
+  samples[sample_idx]->wait_for_event_loop();
+  return twodim_denominator_histograms[sample_idx][region_idx].GetPtr();
+}
+
+/**
+ * function to use results memoized in a ResultCache; entries of loaded histograms that are not null replace booked results
+ * results that were booked are stored under their key once realized, before any scaling is applied
+ */
+PlotCollection* PlotCollection::set_cached_results(ResultCache* i_result_cache, std::vector<std::vector<std::shared_ptr<TH1D>>> i_loaded_histograms, std::vector<std::vector<std::shared_ptr<TH1D>>> i_loaded_denominator_histograms, std::vector<std::vector<std::string>> i_result_keys, std::vector<std::vector<std::string>> i_denominator_result_keys) {
+  result_cache = i_result_cache;
+  loaded_histograms = i_loaded_histograms;
+  loaded_denominator_histograms = i_loaded_denominator_histograms;
+  result_keys = i_result_keys;
+  denominator_result_keys = i_denominator_result_keys;
+  return this;
+}
+
+PlotCollection* PlotCollection::set_cached_results(ResultCache* i_result_cache, std::vector<std::vector<std::shared_ptr<TH2D>>> i_loaded_histograms, std::vector<std::vector<std::shared_ptr<TH2D>>> i_loaded_denominator_histograms, std::vector<std::vector<std::string>> i_result_keys, std::vector<std::vector<std::string>> i_denominator_result_keys) {
+  result_cache = i_result_cache;
+  loaded_twodim_histograms = i_loaded_histograms;
+  loaded_twodim_denominator_histograms = i_loaded_denominator_histograms;
+  result_keys = i_result_keys;
+  denominator_result_keys = i_denominator_result_keys;
+  return this;
+}
+
+PlotCollection* PlotCollection::set_cached_results(ResultCache* i_result_cache, std::vector<std::vector<std::shared_ptr<MultiWeightHistogram>>> i_loaded_variation_results, std::vector<std::vector<std::string>> i_result_keys) {
+  result_cache = i_result_cache;
+  loaded_variation_results = i_loaded_variation_results;
+  result_keys = i_result_keys;
+  return this;
+}
+
+/**
+ * function to use per-sample histograms filled by a merged event loop, indexed by region, see MergedSampleLoop
+ * samples loaded from the result cache keep their loaded histograms
+ */
+PlotCollection* PlotCollection::set_merged_results(std::vector<ROOT::RDF::RResultPtr<SampleHistograms>> i_merged_results, std::vector<ROOT::RDF::RResultPtr<SampleHistograms>> i_merged_denominator_results) {
+  merged_results = i_merged_results;
+  merged_denominator_results = i_merged_denominator_results;
+  return this;
+}
+
+/**
+ * function returning keys under which booked histograms (and denominators) are stored, see set_cached_results
+ */
+std::vector<std::string> PlotCollection::get_result_keys() {
+  std::vector<std::string> keys;
+  for (std::vector<std::string> sample_keys : result_keys)
+    keys.insert(keys.end(), sample_keys.begin(), sample_keys.end());
+  for (std::vector<std::string> sample_keys : denominator_result_keys)
+    keys.insert(keys.end(), sample_keys.begin(), sample_keys.end());
+  return keys;
+}
+
+/**
+ * function to realize booked histograms and store them in shard_cache under their keys, used by shard processes
+ * histograms loaded from the result cache are not stored, so they are not counted once per shard
+ * if only_sample is not null, only histograms of that sample are realized and stored
+ */
+void PlotCollection::store_shard_results(ResultCache* shard_cache, SampleWrapper* only_sample) {
+  if (result_keys.size() == 0) return;
+  for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
+    if (only_sample != nullptr && samples[sample_idx] != only_sample) continue;
+    for (unsigned int region_idx = 0; region_idx < num_regions(); region_idx++) {
+      if (variation_results.size() > 0) {
+        //multi-weight results are stored unscaled, with all variations in one list
+        if (!(loaded_variation_results.size() > sample_idx && loaded_variation_results[sample_idx][region_idx]))
+          shard_cache->store_values(result_keys[sample_idx][region_idx], get_variation_result(sample_idx, region_idx).get_values());
+      }
+      else if (is_2d) {
+        if (!(loaded_twodim_histograms.size() > sample_idx && loaded_twodim_histograms[sample_idx][region_idx]))
+          shard_cache->store(result_keys[sample_idx][region_idx], get_twodim_histogram(sample_idx, region_idx));
+        if (is_efficiency && !(loaded_twodim_denominator_histograms.size() > sample_idx && loaded_twodim_denominator_histograms[sample_idx][region_idx]))
+          shard_cache->store(denominator_result_keys[sample_idx][region_idx], get_twodim_denominator_histogram(sample_idx, region_idx));
+      }
+      else {
+        if (!(loaded_histograms.size() > sample_idx && loaded_histograms[sample_idx][region_idx]))
+          shard_cache->store(result_keys[sample_idx][region_idx], get_histogram(sample_idx, region_idx));
+        if (is_efficiency && !(loaded_denominator_histograms.size() > sample_idx && loaded_denominator_histograms[sample_idx][region_idx]))
+          shard_cache->store(denominator_result_keys[sample_idx][region_idx], get_denominator_histogram(sample_idx, region_idx));
+      }
+    }
+  }
+}
+
+/**
+ * internal function returning sum of histograms stored under key by all shards, or nullptr if a shard is missing it
+ */
+template <typename H>
+static std::shared_ptr<H> merge_shard_histogram(std::vector<ResultCache*> shard_caches, std::string key, H* (ResultCache::*load_histogram)(std::string)) {
+  std::shared_ptr<H> merged_histogram;
+  for (ResultCache* shard_cache : shard_caches) {
+    std::unique_ptr<H> shard_histogram((shard_cache->*load_histogram)(key));
+    if (!shard_histogram) return nullptr;
+    if (!merged_histogram)
+      merged_histogram.reset(shard_histogram.release());
+    else
+      merged_histogram->Add(shard_histogram.get());
+  }
+  return merged_histogram;
+}
+
+/**
+ * internal function to set entry (sample_idx, region_idx) of loaded histograms if merged is not null
+ */
+template <typename H>
+static void set_merged_histogram(std::vector<std::vector<std::shared_ptr<H>>> &loaded, unsigned int num_samples, unsigned int num_regions, unsigned int sample_idx, unsigned int region_idx, std::shared_ptr<H> merged) {
+  if (!merged) return;
+  if (loaded.size() < num_samples) loaded.resize(num_samples);
+  if (loaded[sample_idx].size() < num_regions) loaded[sample_idx].resize(num_regions);
+  loaded[sample_idx][region_idx] = merged;
+}
+
+/**
+ * internal function returning sum of multi-weight results stored under key by all shards, or nullptr if a shard is missing it
+ */
+static std::shared_ptr<MultiWeightHistogram> merge_shard_variation_result(std::vector<ResultCache*> shard_caches, std::string key, const MultiWeightHistogram &empty_result) {
+  std::vector<double> merged_values;
+  for (ResultCache* shard_cache : shard_caches) {
+    std::vector<double> shard_values;
+    if (!shard_cache->load_values(key, shard_values)) return nullptr;
+    if (merged_values.size() == 0) {
+      merged_values = shard_values;
+      continue;
+    }
+    if (merged_values.size() != shard_values.size()) return nullptr;
+    for (unsigned int value_idx = 0; value_idx < merged_values.size(); value_idx++)
+      merged_values[value_idx] += shard_values[value_idx];
+  }
+  std::shared_ptr<MultiWeightHistogram> merged_result = std::make_shared<MultiWeightHistogram>(empty_result);
+  if (!merged_result->set_values(merged_values)) return nullptr;
+  return merged_result;
+}
+
+/**
+ * function to replace booked histograms with the sum of the histograms stored by all shards
+ * entries missing from any shard keep their booked result
+ */
+void PlotCollection::merge_shard_results(std::vector<ResultCache*> shard_caches) {
+  if (result_keys.size() == 0) return;
+  unsigned int num_samples = static_cast<unsigned int>(samples.size());
+  for (unsigned int sample_idx = 0; sample_idx < num_samples; sample_idx++) {
+    for (unsigned int region_idx = 0; region_idx < num_regions(); region_idx++) {
+      if (variation_results.size() > 0) {
+        if (!(loaded_variation_results.size() > sample_idx && loaded_variation_results[sample_idx][region_idx])) {
+          set_merged_histogram(loaded_variation_results, num_samples, num_regions(), sample_idx, region_idx,
+              merge_shard_variation_result(shard_caches, result_keys[sample_idx][region_idx], *empty_variation_result));
+          variation_histograms[sample_idx][region_idx].clear();
+        }
+      }
+      else if (is_2d) {
+        if (!(loaded_twodim_histograms.size() > sample_idx && loaded_twodim_histograms[sample_idx][region_idx]))
+          set_merged_histogram(loaded_twodim_histograms, num_samples, num_regions(), sample_idx, region_idx,
+              merge_shard_histogram(shard_caches, result_keys[sample_idx][region_idx], &ResultCache::load_2d_histogram));
+        if (is_efficiency && !(loaded_twodim_denominator_histograms.size() > sample_idx && loaded_twodim_denominator_histograms[sample_idx][region_idx]))
+          set_merged_histogram(loaded_twodim_denominator_histograms, num_samples, num_regions(), sample_idx, region_idx,
+              merge_shard_histogram(shard_caches, denominator_result_keys[sample_idx][region_idx], &ResultCache::load_2d_histogram));
+      }
+      else {
+        if (!(loaded_histograms.size() > sample_idx && loaded_histograms[sample_idx][region_idx]))
+          set_merged_histogram(loaded_histograms, num_samples, num_regions(), sample_idx, region_idx,
+              merge_shard_histogram(shard_caches, result_keys[sample_idx][region_idx], &ResultCache::load_1d_histogram));
+        if (is_efficiency && !(loaded_denominator_histograms.size() > sample_idx && loaded_denominator_histograms[sample_idx][region_idx]))
+          set_merged_histogram(loaded_denominator_histograms, num_samples, num_regions(), sample_idx, region_idx,
+              merge_shard_histogram(shard_caches, denominator_result_keys[sample_idx][region_idx], &ResultCache::load_1d_histogram));
+      }
+    }
+  }
+}
+
+/**
+ * internal function returning the (booked or loaded) multi-weight result for a sample and region
+ */
+const MultiWeightHistogram& PlotCollection::get_variation_result(unsigned int sample_idx, unsigned int region_idx) {
+  if (loaded_variation_results.size() > sample_idx && loaded_variation_results[sample_idx][region_idx])
+    return *loaded_variation_results[sample_idx][region_idx];
+  samples[sample_idx]->wait_for_event_loop();
+  return *(variation_results[sample_idx][region_idx]);
+}
+
+/**
+ * internal function to build (unscaled) per-variation histograms of a sample and region from a multi-weight result
+ */
+void PlotCollection::realize_variations(unsigned int sample_idx, unsigned int region_idx) {
+  if (variation_histograms[sample_idx][region_idx].size() > 0) return;
+  const MultiWeightHistogram& variation_result = get_variation_result(sample_idx, region_idx);
+  std::string hist_name = "hist_"+name+"_"+samples[sample_idx]->sample_name+"_"+archive_region_name(region_idx);
+  std::string hist_title = description+" "+samples[sample_idx]->selection_string();
+  if (regions != nullptr)
+    hist_title += ", "+regions->get_description(region_idx);
+  hist_title += "; "+description;
+  for (unsigned int variation_idx = 0; variation_idx < variation_result.num_variations; variation_idx++) {
+    std::string variation_suffix = (variation_idx == 0) ? "" : "_"+variation_names[variation_idx];
+    variation_histograms[sample_idx][region_idx].push_back(std::shared_ptr<TH1D>(
+      variation_result.make_histogram(variation_idx, hist_name+variation_suffix, hist_title)));
+  }
+}
+
+/**
+ * internal function to scale the non-nominal variations of a sample and region, the nominal is scaled as a regular histogram
+ */
+void PlotCollection::scale_variations(unsigned int sample_idx, unsigned int region_idx, double scale) {
+  if (variation_results.size() == 0) return;
+  realize_variations(sample_idx, region_idx);
+  for (unsigned int variation_idx = 1; variation_idx < variation_histograms[sample_idx][region_idx].size(); variation_idx++)
+    variation_histograms[sample_idx][region_idx][variation_idx]->Scale(scale);
+}
+
+/**
+ * function returning names of weight variations, empty if collection was not booked with variations
+ */
+std::vector<std::string> PlotCollection::get_variation_names() {
+  return variation_names;
+}
+
+/**
+ * function returning (normalized) histogram of a weight variation; histogram is owned by the collection
+ */
+TH1D* PlotCollection::get_variation_histogram(unsigned int sample_idx, unsigned int region_idx, unsigned int variation_idx) {
+  if (variation_idx >= variation_names.size()) {
+    std::cout << "ERROR: variation " << variation_idx << " not booked for " << name << std::endl;
+    return nullptr;
+  }
+  normalize_histograms();
+  realize_variations(sample_idx, region_idx);
+  return variation_histograms[sample_idx][region_idx][variation_idx].get();
+}
+
+/**
+ * function returning band around the nominal histogram spanning the minimum and maximum of all variations in each bin
+ * caller owns graph
+ */
+TGraphAsymmErrors* PlotCollection::get_envelope(unsigned int sample_idx, unsigned int region_idx) {
+  if (variation_names.size() == 0) {
+    std::cout << "ERROR: envelope requested for " << name << " which was not booked with variations" << std::endl;
+    return nullptr;
+  }
+  TH1D* nominal = get_variation_histogram(sample_idx, region_idx, 0);
+  TGraphAsymmErrors* envelope = new TGraphAsymmErrors(nominal->GetNbinsX());
+  for (int bin_idx = 1; bin_idx <= nominal->GetNbinsX(); bin_idx++) {
+    double nominal_content = nominal->GetBinContent(bin_idx);
+    double envelope_low = nominal_content;
+    double envelope_high = nominal_content;
+    for (unsigned int variation_idx = 1; variation_idx < variation_names.size(); variation_idx++) {
+      double variation_content = variation_histograms[sample_idx][region_idx][variation_idx]->GetBinContent(bin_idx);
+      envelope_low = std::min(envelope_low, variation_content);
+      envelope_high = std::max(envelope_high, variation_content);
+    }
+    double bin_center = nominal->GetXaxis()->GetBinCenter(bin_idx);
+    double bin_half_width = (nominal->GetXaxis()->GetBinUpEdge(bin_idx)-nominal->GetXaxis()->GetBinLowEdge(bin_idx))/2.;
+    envelope->SetPoint(bin_idx-1, bin_center, nominal_content);
+    envelope->SetPointError(bin_idx-1, bin_half_width, bin_half_width, nominal_content-envelope_low, envelope_high-nominal_content);
+  }
+  envelope->SetName((std::string(nominal->GetName())+"_envelope").c_str());
+  return envelope;
+}
+
+/**
+ * function returning band around the nominal histogram with the standard deviation of the variations in each bin
+ */
+TGraphAsymmErrors* PlotCollection::get_replica_band(unsigned int sample_idx, unsigned int region_idx) {
+  if (variation_names.size() < 3) {
+    std::cout << "ERROR: replica band requested for " << name << " which was not booked with at least two replicas" << std::endl;
+    return nullptr;
+  }
+  TH1D* nominal = get_variation_histogram(sample_idx, region_idx, 0);
+  TGraphAsymmErrors* band = new TGraphAsymmErrors(nominal->GetNbinsX());
+  double num_replicas = static_cast<double>(variation_names.size()-1);
+  for (int bin_idx = 1; bin_idx <= nominal->GetNbinsX(); bin_idx++) {
+    double replica_sum = 0.;
+    double replica_sum2 = 0.;
+    for (unsigned int variation_idx = 1; variation_idx < variation_names.size(); variation_idx++) {
+      double replica_content = variation_histograms[sample_idx][region_idx][variation_idx]->GetBinContent(bin_idx);
+      replica_sum += replica_content;
+      replica_sum2 += replica_content*replica_content;
+    }
+    double replica_mean = replica_sum/num_replicas;
+    double replica_deviation = sqrt(std::max((replica_sum2-num_replicas*replica_mean*replica_mean)/(num_replicas-1.), 0.));
+    double nominal_content = nominal->GetBinContent(bin_idx);
+    double bin_center = nominal->GetXaxis()->GetBinCenter(bin_idx);
+    double bin_half_width = (nominal->GetXaxis()->GetBinUpEdge(bin_idx)-nominal->GetXaxis()->GetBinLowEdge(bin_idx))/2.;
+    band->SetPoint(bin_idx-1, bin_center, nominal_content);
+    band->SetPointError(bin_idx-1, bin_half_width, bin_half_width, replica_deviation, replica_deviation);
+  }
+  band->SetName((std::string(nominal->GetName())+"_replica_band").c_str());
+  return band;
+}
+
+/**
+ * internal function to store realized results that were not loaded from the result cache
+ * must be called before histograms are scaled in place; if only_sample is not null, only its results are stored
+ */
+void PlotCollection::store_cached_results(SampleWrapper* only_sample) {
+  if (result_cache == nullptr || results_stored) return;
+  if (samples_stored.size() != samples.size())
+    samples_stored.assign(samples.size(), false);
+  for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
+    if (samples_stored[sample_idx] || (only_sample != nullptr && samples[sample_idx] != only_sample)) continue;
+    store_shard_results(result_cache, samples[sample_idx]);
+    samples_stored[sample_idx] = true;
+  }
+  if (only_sample == nullptr)
+    results_stored = true;
+}
+
+/**
+ * internal function returning number of regions (1 if there is no RegionCollection)
+ */
+unsigned int PlotCollection::num_regions() {
+  if (regions != nullptr) return regions->size();
+  return 1;
+}
+
+/**
+ * internal function returning true if any histograms are booked or loaded
+ */
+bool PlotCollection::is_booked() {
+  if (is_loaded)
+    return is_2d ? (loaded_twodim_histograms.size() > 0) : (loaded_histograms.size() > 0);
+  return is_2d ? (twodim_histograms.size() > 0) : (histograms.size() > 0 || variation_results.size() > 0);
+}
+
+/**
+ * internal function returning name used for this collection in archives
+ */
+std::string PlotCollection::archive_variable_name() {
+  if (is_2d) return name+"__"+yname;
+  return name;
+}
+
+/**
+ * internal function returning name used for a region in archives and output files
+ */
+std::string PlotCollection::archive_region_name(unsigned int region_idx) {
+  if (regions != nullptr) return regions->get_name(region_idx);
+  return "inclusive";
+}
+
+/**
+ * function to write realized (normalized) histograms to an archive, keyed by (variable, sample, region, kind)
+ * if only_sample is not null, only its histograms are written
+ */
+void PlotCollection::save_archive(HistogramArchiveWriter* archive_writer, SampleWrapper* only_sample) {
+  if (!is_booked()) {
+    std::cout << "ERROR: save before histograms are booked" << std::endl;
+    return;
+  }
+  //archive stores histograms as they are drawn so loading needs no scale weights
+  normalize_histograms(only_sample);
+  std::string kind = is_efficiency ? "numerator" : "histogram";
+  for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
+    if (only_sample != nullptr && samples[sample_idx] != only_sample) continue;
+    for (unsigned int region_idx = 0; region_idx < num_regions(); region_idx++) {
+      std::string sample_name = samples[sample_idx]->sample_name;
+      std::string region_name = archive_region_name(region_idx);
+      if (is_2d) {
+        archive_writer->add(get_twodim_histogram(sample_idx, region_idx), archive_variable_name(), sample_name, region_name, kind);
+        if (is_efficiency)
+          archive_writer->add(get_twodim_denominator_histogram(sample_idx, region_idx), archive_variable_name(), sample_name, region_name, "denominator");
+      }
+      else {
+        archive_writer->add(get_histogram(sample_idx, region_idx), archive_variable_name(), sample_name, region_name, kind);
+        if (is_efficiency)
+          archive_writer->add(get_denominator_histogram(sample_idx, region_idx), archive_variable_name(), sample_name, region_name, "denominator");
+      }
+    }
+  }
 }
 
 /**
@@ -135,26 +644,27 @@ PlotCollection::PlotCollection(VariableAxis x_axis, VariableAxis y_axis, std::ve
  */
 void PlotCollection::set_luminosity(float i_luminosity) {
 	luminosity = i_luminosity;
-	if (histograms.size() < 1) {
+	if (!is_booked()) {
 		std::cout << "ERROR: draw before histograms are booked" << std::endl;
 		return;
 	}
+	store_cached_results();
 	//scaling will cancel off in ratios, so don't scale efficiencies
+	//samples normalized at fill time already include luminosity, so don't scale them a second time
 	if (!is_2d && !is_efficiency) {
-		for (unsigned int region_idx = 0; region_idx < regions->size(); region_idx++) {
-			for (unsigned int sample_idx = 0; sample_idx < histograms.size(); sample_idx++) {
-				if (!samples[sample_idx]->is_data) {
-					histograms[sample_idx][region_idx]->Scale(luminosity);
-				}
+		for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
+			if (samples[sample_idx]->is_data || samples[sample_idx]->is_normalized_at_fill()) continue;
+			for (unsigned int region_idx = 0; region_idx < num_regions(); region_idx++) {
+				get_histogram(sample_idx, region_idx)->Scale(luminosity);
+				scale_variations(sample_idx, region_idx, luminosity);
 			}
 		}
 	}
 	if (is_2d && !is_efficiency) {
-		for (unsigned int region_idx = 0; region_idx < regions->size(); region_idx++) {
-			for (unsigned int sample_idx = 0; sample_idx < twodim_histograms.size(); sample_idx++) {
-				if (!samples[sample_idx]->is_data) {
-					twodim_histograms[sample_idx][region_idx]->Scale(luminosity);
-				}
+		for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
+			if (samples[sample_idx]->is_data || samples[sample_idx]->is_normalized_at_fill()) continue;
+			for (unsigned int region_idx = 0; region_idx < num_regions(); region_idx++) {
+				get_twodim_histogram(sample_idx, region_idx)->Scale(luminosity);
 			}
 		}
 	}
@@ -168,6 +678,42 @@ PlotCollection* PlotCollection::set_save_root_file(bool i_set_save_root_file) {
   return this;
 }
 
+/**
+ * function to set a shared output file; implies set_save_root_file(true)
+ * the sink is not owned by the PlotCollection and should be closed by the caller
+ */
+PlotCollection* PlotCollection::set_output_sink(OutputSink* i_output_sink) {
+  output_sink = i_output_sink;
+  save_as_root = (i_output_sink != nullptr);
+  return this;
+}
+
+/**
+ * function to set the output file used by set_save_root_file(true) if no sink is set by set_output_sink
+ */
+PlotCollection* PlotCollection::set_default_output_sink(OutputSink* i_default_output_sink) {
+  default_output_sink = i_default_output_sink;
+  return this;
+}
+
+/**
+ * internal function returning the output file set by set_output_sink, or else the default one
+ * prints an error and returns nullptr if saving root files is requested without any output file
+ */
+OutputSink* PlotCollection::get_output_sink() {
+  if (output_sink != nullptr) return output_sink;
+  if (default_output_sink == nullptr)
+    std::cout << "ERROR: no output file to save " << name << " in, see set_output_sink" << std::endl;
+  return default_output_sink;
+}
+
+/**
+ * internal function returning directory (region/sample) in output file for a given plot
+ */
+std::string PlotCollection::output_directory(unsigned int sample_idx, unsigned int region_idx) {
+  return archive_region_name(region_idx)+"/"+samples[sample_idx]->sample_name;
+}
+
 /**
  * function to set log options
  */
@@ -202,24 +748,190 @@ PlotCollection* PlotCollection::set_bottom_style(BottomStyle i_bottom_style) {
   return this;
 }
 
+/**
+ * function to set options for cut significance bottom styles
+ */
+PlotCollection* PlotCollection::set_cut_significance(std::string i_signal_flag, SignificanceStyle i_significance_style) {
+  signal_flag = i_signal_flag;
+  significance_style = i_significance_style;
+  return this;
+}
+
+/**
+ * function returning optimal cuts found by cut significance bottom panels in previous draws
+ */
+std::vector<CutScanResult> PlotCollection::get_optimal_cuts() {
+  return optimal_cuts;
+}
+
+/**
+ * internal function returning a histogram of cut significance vs threshold for a single region
+ * each bin holds the significance of cutting at its upper edge (upper cut) or lower edge (lower cut), so the
+ * whole scan costs O(nbins) on histograms that are already filled instead of one event loop per threshold
+ */
+TH1D* PlotCollection::make_cut_significance(bool is_region, unsigned int region_idx) {
+  bool is_upper_cut = (bottom_style == BottomStyle::upper_cut_significance);
+  TH1D* signal_hist = nullptr;
+  std::vector<double> signal_yields, background_yields;
+  for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
+    if (samples[sample_idx]->is_data) continue;
+    TH1D* sample_hist = get_histogram(sample_idx, region_idx);
+    if (signal_yields.size() == 0) {
+      signal_yields.assign(static_cast<size_t>(sample_hist->GetNbinsX()+2), 0.);
+      background_yields.assign(static_cast<size_t>(sample_hist->GetNbinsX()+2), 0.);
+    }
+    bool is_signal = samples[sample_idx]->check_flag(signal_flag);
+    if (is_signal && signal_hist == nullptr) signal_hist = sample_hist;
+    for (unsigned int bin_idx = 0; bin_idx < signal_yields.size(); bin_idx++) {
+      if (is_signal)
+        signal_yields[bin_idx] += sample_hist->GetBinContent(static_cast<int>(bin_idx));
+      else
+        background_yields[bin_idx] += sample_hist->GetBinContent(static_cast<int>(bin_idx));
+    }
+  }
+  if (signal_hist == nullptr) {
+    std::cout << "ERROR: no samples with flag " << signal_flag << " for cut significance" << std::endl;
+    return nullptr;
+  }
+  //cumulative sums: upper cuts keep bins up to and including bin, lower cuts keep bins from bin onward (with under/overflow)
+  unsigned int num_bins = static_cast<unsigned int>(signal_yields.size());
+  if (is_upper_cut) {
+    for (unsigned int bin_idx = 1; bin_idx < num_bins; bin_idx++) {
+      signal_yields[bin_idx] += signal_yields[bin_idx-1];
+      background_yields[bin_idx] += background_yields[bin_idx-1];
+    }
+  }
+  else {
+    for (unsigned int bin_idx = num_bins-1; bin_idx > 0; bin_idx--) {
+      signal_yields[bin_idx-1] += signal_yields[bin_idx];
+      background_yields[bin_idx-1] += background_yields[bin_idx];
+    }
+  }
+  TH1D* significance_hist = static_cast<TH1D*>(signal_hist->Clone("hist_significance"));
+  significance_hist->SetDirectory(nullptr);
+  significance_hist->Reset();
+  std::string significance_name = (significance_style == SignificanceStyle::asimov) ? "Z_{A}" : "S/#sqrt{B}";
+  significance_hist->SetTitle((";"+std::string(signal_hist->GetXaxis()->GetTitle())+";"+significance_name).c_str());
+  CutScanResult optimal_cut = {name, archive_region_name(region_idx), is_upper_cut, 0., -1., 0., 0.};
+  for (int bin_idx = 1; bin_idx <= significance_hist->GetNbinsX(); bin_idx++) {
+    double signal_yield = signal_yields[static_cast<unsigned int>(bin_idx)];
+    double background_yield = background_yields[static_cast<unsigned int>(bin_idx)];
+    double significance = 0.;
+    if (background_yield > 0 && signal_yield > 0) {
+      if (significance_style == SignificanceStyle::asimov)
+        significance = sqrt(2.*((signal_yield+background_yield)*log(1.+signal_yield/background_yield)-signal_yield));
+      else
+        significance = signal_yield/sqrt(background_yield);
+    }
+    significance_hist->SetBinContent(bin_idx, significance);
+    if (significance > optimal_cut.significance) {
+      optimal_cut.significance = significance;
+      optimal_cut.threshold = is_upper_cut ? significance_hist->GetXaxis()->GetBinUpEdge(bin_idx) : significance_hist->GetXaxis()->GetBinLowEdge(bin_idx);
+      optimal_cut.signal_yield = signal_yield;
+      optimal_cut.background_yield = background_yield;
+    }
+  }
+  optimal_cuts.push_back(optimal_cut);
+  //report optimal cut for use by scripts
+  std::string scan_filename = "plots/"+name+"_cut_scan";
+  if (is_region) scan_filename += "_"+regions->get_name(region_idx);
+  std::ofstream scan_file(scan_filename+".json");
+  scan_file << std::setprecision(10) << "{\"variable\": \"" << optimal_cut.variable << "\", \"region\": \"" << optimal_cut.region
+      << "\", \"cut\": \"" << (is_upper_cut ? "upper" : "lower") << "\", \"significance_style\": \""
+      << ((significance_style == SignificanceStyle::asimov) ? "asimov" : "s_over_sqrt_b") << "\", \"threshold\": " << optimal_cut.threshold
+      << ", \"significance\": " << optimal_cut.significance << ", \"signal\": " << optimal_cut.signal_yield
+      << ", \"background\": " << optimal_cut.background_yield << "}\n";
+  scan_file.close();
+  std::cout << "Optimal cut " << name << (is_upper_cut ? " < " : " > ") << optimal_cut.threshold << " in " << optimal_cut.region
+      << ": " << optimal_cut.significance << std::endl;
+  return significance_hist;
+}
+
+/**
+ * internal function to draw cut significance in the bottom pad, returns the drawn histogram
+ */
+TH1D* PlotCollection::draw_cut_significance(TPad* bottom_pad, bool is_region, unsigned int region_idx) {
+  TH1D* significance_hist = make_cut_significance(is_region, region_idx);
+  if (significance_hist == nullptr) return nullptr;
+  bottom_pad->cd();
+  gPad->SetTopMargin(0);
+  gPad->SetBottomMargin(0.22);
+  significance_hist->SetMinimum(0);
+  significance_hist->SetTitleSize(0.1,"X");
+  significance_hist->SetTitleSize(0.1,"Y");
+  significance_hist->SetTitleOffset(1.0,"X");
+  significance_hist->SetTitleOffset(0.4,"Y");
+  significance_hist->SetLabelSize(0.1,"X");
+  significance_hist->SetLabelSize(0.1,"Y");
+  significance_hist->SetLineColor(kBlack);
+  significance_hist->SetFillStyle(0);
+  significance_hist->Draw("hist");
+  bottom_pad->Modified();
+  return significance_hist;
+}
+
 
 /**
- * internal function for plotting several plots together for a single region
+ * internal function to scale MC histograms in place by their sample scale weight
+ * scaling is only ever applied once per histogram, so repeated draws do not require clones
+ * if only_sample is not null, only its histograms are realized and scaled
  */
-void PlotCollection::draw_together_single_region(bool sort_histograms, bool is_region, unsigned int region_idx) {
-  std::string canvas_name = name+"_canvas";
-  if (is_region) canvas_name = name+"_"+regions->get_name(region_idx)+"_canvas";
-  TCanvas* c = new TCanvas(canvas_name.c_str());
-  c->cd();
-  TPad *main_pad, *bottom_pad;
+void PlotCollection::normalize_histograms(SampleWrapper* only_sample) {
+  //cache holds raw results, so store them before they are scaled
+  store_cached_results(only_sample);
+  //scaling will cancel off in ratios, so don't scale efficiencies
+  if (is_efficiency) return;
+  if (histograms_normalized.size() != samples.size())
+    histograms_normalized.assign(samples.size(), false);
+  for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
+    if (histograms_normalized[sample_idx] || (only_sample != nullptr && samples[sample_idx] != only_sample)) continue;
+    //samples normalized at fill time are born scaled and data is not scaled, except to extrapolate sampled runs
+    float scale_weight = static_cast<float>(1./samples[sample_idx]->get_sampled_fraction());
+    if (!samples[sample_idx]->is_data && !samples[sample_idx]->is_normalized_at_fill())
+      scale_weight *= samples[sample_idx]->scale_weight();
+    if (is_2d) {
+      for (unsigned int region_idx = 0; region_idx < num_regions(); region_idx++)
+        get_twodim_histogram(sample_idx, region_idx)->Scale(scale_weight);
+    }
+    else {
+      for (unsigned int region_idx = 0; region_idx < num_regions(); region_idx++) {
+        get_histogram(sample_idx, region_idx)->Scale(scale_weight);
+        scale_variations(sample_idx, region_idx, scale_weight);
+      }
+    }
+    histograms_normalized[sample_idx] = true;
+  }
+}
+
+/**
+ * internal function returning the canvas shared by all draws of this collection
+ */
+TCanvas* PlotCollection::get_canvas() {
+  if (!canvas)
+    canvas.reset(new TCanvas((name+"_canvas").c_str()));
+  canvas->Clear();
+  canvas->SetLogx(false);
+  canvas->SetLogy(false);
+  canvas->SetLogz(false);
+  canvas->cd();
+  return canvas.get();
+}
+
+/**
+ * internal function for plotting several plots together for a single region, histograms are also written to sink
+ * unless it is nullptr
+ */
+void PlotCollection::draw_together_single_region(bool sort_histograms, bool is_region, unsigned int region_idx, OutputSink* sink) {
+  //all objects drawn for this region are owned here and freed once the plot is saved
+  TCanvas* c = get_canvas();
+  std::unique_ptr<TPad> main_pad, bottom_pad;
   if (bottom_style == BottomStyle::none) {
-    main_pad = new TPad("main_pad","",0.0,0.0,1.0,1.0);
+    main_pad.reset(new TPad("main_pad","",0.0,0.0,1.0,1.0));
     main_pad->Draw();
   }
   else {
-    //TODO: implement other bottom types, currently just ratio
-    main_pad = new TPad("main_pad","",0.0,0.2,1.0,1.0);
-    bottom_pad = new TPad("bottom_pad","",0.0,0.0,1.0,0.2);
+    main_pad.reset(new TPad("main_pad","",0.0,0.2,1.0,1.0));
+    bottom_pad.reset(new TPad("bottom_pad","",0.0,0.0,1.0,0.2));
     main_pad->Draw();
     bottom_pad->Draw();
   }
@@ -229,21 +941,26 @@ void PlotCollection::draw_together_single_region(bool sort_histograms, bool is_r
   if (bottom_style != BottomStyle::none) {
     gPad->SetBottomMargin(0);
   }
-  TLegend* legend = new TLegend(0.75,0.75,0.9,0.9);
+  std::unique_ptr<TLegend> legend(new TLegend(0.75,0.75,0.9,0.9));
+  std::unique_ptr<TH1D> significance_hist;
+  bool is_cut_significance = (bottom_style == BottomStyle::upper_cut_significance || bottom_style == BottomStyle::lower_cut_significance);
   std::vector<HistogramAndStyle> ordered_histograms;
-  for (unsigned int sample_idx = 0; sample_idx < histograms.size(); sample_idx++) {
+  TH1D* data_hist = nullptr;
+  for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
     if (plot_combine_style == PlotCombineStyle::stack && samples[sample_idx]->is_data) {
       //for stacks, treat data separately from MC
+      data_hist = get_histogram(sample_idx, region_idx);
+      data_hist->SetLineColor(samples[sample_idx]->sample_color);
+      legend->AddEntry(data_hist,(samples[sample_idx]->sample_description).c_str());
     }
     else {
-      ordered_histograms.push_back(HistogramAndStyle());
-      ordered_histograms[sample_idx].histogram = static_cast<TH1D*>((histograms[sample_idx][region_idx])->Clone());
-      //scale MC by lumi
-      if (!samples[sample_idx]->is_data)
-        ordered_histograms[sample_idx].histogram->Scale(samples[sample_idx]->scale_weight());
-      ordered_histograms[sample_idx].color = samples[sample_idx]->sample_color;
-      ordered_histograms[sample_idx].description = samples[sample_idx]->sample_description;
-      ordered_histograms[sample_idx].is_data = samples[sample_idx]->is_data;
+      //histograms are already scaled by normalize_histograms, so no copies are needed
+      HistogramAndStyle histogram_and_style;
+      histogram_and_style.histogram = get_histogram(sample_idx, region_idx);
+      histogram_and_style.color = samples[sample_idx]->sample_color;
+      histogram_and_style.description = samples[sample_idx]->sample_description;
+      histogram_and_style.is_data = samples[sample_idx]->is_data;
+      ordered_histograms.push_back(histogram_and_style);
     }
   }
   if (plot_combine_style == PlotCombineStyle::overlay) {
@@ -257,18 +974,21 @@ void PlotCollection::draw_together_single_region(bool sort_histograms, bool is_r
   }
   if (plot_combine_style == PlotCombineStyle::overlay) {
     //draw overlayed histograms
-    for (unsigned int sample_idx = 0; sample_idx < histograms.size(); sample_idx++) {
+    for (unsigned int sample_idx = 0; sample_idx < ordered_histograms.size(); sample_idx++) {
       ordered_histograms[sample_idx].histogram->SetLineColor(ordered_histograms[sample_idx].color);
+      ordered_histograms[sample_idx].histogram->SetFillStyle(0);
       if (sample_idx == 0) {
-        ordered_histograms[sample_idx].histogram->DrawClone("e0");
+        ordered_histograms[sample_idx].histogram->Draw("e0");
       }
       else {
-        ordered_histograms[sample_idx].histogram->DrawClone("e0 same");
+        ordered_histograms[sample_idx].histogram->Draw("e0 same");
       }
-      legend->AddEntry(ordered_histograms[sample_idx].histogram->GetName(),ordered_histograms[sample_idx].description.c_str());
+      legend->AddEntry(ordered_histograms[sample_idx].histogram,ordered_histograms[sample_idx].description.c_str());
     }
     legend->Draw();
     main_pad->Modified();
+    if (is_cut_significance)
+      significance_hist.reset(draw_cut_significance(bottom_pad.get(), is_region, region_idx));
     c->Update();
     if (is_region) {
       c->SaveAs(("plots/"+name+"_overlay_"+regions->get_name(region_idx)+"."+file_extension).c_str());
@@ -276,55 +996,64 @@ void PlotCollection::draw_together_single_region(bool sort_histograms, bool is_r
     else {
       c->SaveAs(("plots/"+name+"_overlay."+file_extension).c_str());
     }
+    if (sink != nullptr) {
+      for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++)
+        sink->write(get_histogram(sample_idx, region_idx)->Clone(), output_directory(sample_idx, region_idx));
+    }
   }
   else {
-    //draw stacked histograms
-    THStack* hist_stack = new THStack((regions->get_name(region_idx)+"_hist_stack").c_str(),histograms[0][region_idx]->GetTitle());
+    if (ordered_histograms.size() == 0) {
+      std::cout << "ERROR: no MC histograms to stack" << std::endl;
+      return;
+    }
+    //draw stacked histograms, the stack does not take ownership of its histograms
+    std::string stack_name = name+"_hist_stack";
+    if (is_region) stack_name = regions->get_name(region_idx)+"_hist_stack";
+    std::unique_ptr<THStack> hist_stack(new THStack(stack_name.c_str(),ordered_histograms[0].histogram->GetTitle()));
     for (unsigned int mc_sample_idx = 0; mc_sample_idx < ordered_histograms.size(); mc_sample_idx++) {
       ordered_histograms[mc_sample_idx].histogram->SetLineColor(ordered_histograms[mc_sample_idx].color);
       ordered_histograms[mc_sample_idx].histogram->SetFillColor(ordered_histograms[mc_sample_idx].color);
-      TH1D* draw_mc_hist = static_cast<TH1D*>(ordered_histograms[mc_sample_idx].histogram->Clone()); 
-      hist_stack->Add(draw_mc_hist,"hist");
-      legend->AddEntry(draw_mc_hist,ordered_histograms[mc_sample_idx].description.c_str(),"f");
-    }
-    TH1D* data_hist;
-    bool has_data = false;
-    for (unsigned int sample_idx = 0; sample_idx < histograms.size(); sample_idx++) {
-      if (samples[sample_idx]->is_data) {
-        has_data = true;
-        data_hist = static_cast<TH1D*>(histograms[sample_idx][region_idx]->Clone());
-        data_hist->SetLineColor(samples[sample_idx]->sample_color);
-        legend->AddEntry(histograms[sample_idx][region_idx]->GetName(),(samples[sample_idx]->sample_description).c_str());
-      }
+      ordered_histograms[mc_sample_idx].histogram->SetFillStyle(1001);
+      hist_stack->Add(ordered_histograms[mc_sample_idx].histogram,"hist");
+      legend->AddEntry(ordered_histograms[mc_sample_idx].histogram,ordered_histograms[mc_sample_idx].description.c_str(),"f");
     }
-    //set Y axis based on tallest bin
-    //make TH1D that is the sum of the MC histograms
-    TH1D* hist_ratio = new TH1D("hist_ratio",(";"+std::string(ordered_histograms[0].histogram->GetXaxis()->GetTitle())+";data/MC").c_str(),data_hist->GetNbinsX(),data_hist->GetXaxis()->GetXmin(),data_hist->GetXaxis()->GetXmax());
-    for (unsigned int mc_sample_idx = 0; mc_sample_idx < ordered_histograms.size(); mc_sample_idx++) {
-      hist_ratio->Add(static_cast<TH1D*>(ordered_histograms[mc_sample_idx].histogram->Clone()));
+    //make TH1D that is the sum of the MC histograms, the only new histogram in this plot
+    std::unique_ptr<TH1D> hist_ratio(static_cast<TH1D*>(ordered_histograms[0].histogram->Clone("hist_ratio")));
+    hist_ratio->SetDirectory(nullptr);
+    hist_ratio->SetTitle((";"+std::string(ordered_histograms[0].histogram->GetXaxis()->GetTitle())+";data/MC").c_str());
+    for (unsigned int mc_sample_idx = 1; mc_sample_idx < ordered_histograms.size(); mc_sample_idx++) {
+      hist_ratio->Add(ordered_histograms[mc_sample_idx].histogram);
     }
+    //set Y axis based on tallest bin
     float mc_max = hist_ratio->GetBinContent(hist_ratio->GetMaximumBin());
     float y_axis_max = mc_max;
-    if (has_data) {
+    if (data_hist != nullptr) {
       float data_max = data_hist->GetBinContent(data_hist->GetMaximumBin());
       y_axis_max = mc_max > data_max ? mc_max : data_max;
     }
     y_axis_max = y_axis_max * 1.15;
-    //draw any data
-    data_hist->Draw();
-    //is title already okay?
-    data_hist->GetYaxis()->SetRangeUser(0,y_axis_max);
-    data_hist->Draw("e0");
-    hist_stack->Draw("same");
-    data_hist->Draw("e0 same");
+    if (data_hist != nullptr) {
+      //draw any data
+      data_hist->GetYaxis()->SetRangeUser(0,y_axis_max);
+      data_hist->Draw("e0");
+      hist_stack->Draw("same");
+      data_hist->Draw("e0 same");
+    }
+    else {
+      hist_stack->SetMaximum(y_axis_max);
+      hist_stack->Draw();
+    }
     legend->Draw();
     main_pad->Modified();
-    if (bottom_style != BottomStyle::none) {
+    if (is_cut_significance) {
+      significance_hist.reset(draw_cut_significance(bottom_pad.get(), is_region, region_idx));
+    }
+    else if (bottom_style != BottomStyle::none && data_hist != nullptr) {
       //draw ratio plot
       bottom_pad->cd();
       gPad->SetTopMargin(0);
       gPad->SetBottomMargin(0.22);
-      hist_ratio->Divide(data_hist,hist_ratio);
+      hist_ratio->Divide(data_hist,hist_ratio.get());
       hist_ratio->GetYaxis()->SetRangeUser(0.4,1.6);
       hist_ratio->SetTitleSize(0.1,"X");
       hist_ratio->SetTitleSize(0.1,"Y");
@@ -333,6 +1062,7 @@ void PlotCollection::draw_together_single_region(bool sort_histograms, bool is_r
       hist_ratio->SetLabelSize(0.1,"X");
       hist_ratio->SetLabelSize(0.1,"Y");
       hist_ratio->SetLineColor(kBlack);
+      hist_ratio->SetFillStyle(0);
       hist_ratio->Draw("e0");
       bottom_pad->Modified();
     }
@@ -343,18 +1073,23 @@ void PlotCollection::draw_together_single_region(bool sort_histograms, bool is_r
     else {
       c->SaveAs(("plots/"+name+"_stack."+file_extension).c_str());
     }
+    if (sink != nullptr) {
+      for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++)
+        sink->write(get_histogram(sample_idx, region_idx)->Clone(), output_directory(sample_idx, region_idx));
+      sink->write(hist_stack->Clone(), archive_region_name(region_idx));
+    }
   }
 }
 
-
 /**
  * function to draw several 1d plots together (stacked/overlayed)
  * for stacks, samples marked as 'data' will be drawn over the stack rather than in it
  * sort_histograms - organize non-data histograms so largest non-data histograms are on top of stack
  */
 void PlotCollection::draw_together(bool sort_histograms) {
+  PhaseScope draw_phase("draw");
   //do checks
-  if (histograms.size() < 1) {
+  if (!is_booked()) {
     std::cout << "ERROR: draw before histograms are booked" << std::endl;
     return;
   }
@@ -367,15 +1102,18 @@ void PlotCollection::draw_together(bool sort_histograms) {
     plot_combine_style = PlotCombineStyle::overlay;
   }
   gStyle->SetOptStat(0);
+  normalize_histograms();
+  //the output file is looked up once, plots are still drawn if it is missing
+  OutputSink* sink = save_as_root ? get_output_sink() : nullptr;
   //regions
   if (regions != nullptr) {
     for (unsigned int region_idx = 0; region_idx < regions->size(); region_idx++) {
-      draw_together_single_region(sort_histograms, true, region_idx);
+      draw_together_single_region(sort_histograms, true, region_idx, sink);
     }
   }
   //no regions
   else {
-    draw_together_single_region(sort_histograms, false, 0);
+    draw_together_single_region(sort_histograms, false, 0, sink);
   }
 }
 
@@ -383,165 +1121,168 @@ void PlotCollection::draw_together(bool sort_histograms) {
  * function to draw several plots separately
  */
 void PlotCollection::draw_separate() {
+  PhaseScope draw_phase("draw");
   //TODO: allow draweach'ing 1d histograms
-  if (histograms.size() < 1) {
+  if (!is_booked()) {
     std::cout << "ERROR: draw before histograms are booked" << std::endl;
     return;
   }
   gStyle->SetOptStat(0);
+  normalize_histograms();
+  //the output file is looked up once, plots are still drawn if it is missing
+  OutputSink* sink = save_as_root ? get_output_sink() : nullptr;
   //loop over regions
   if (!is_efficiency) {
     if (regions != nullptr) {
       for (unsigned int region_idx = 0; region_idx < regions->size(); region_idx++) {
 	if (is_2d)
-          draw_2d_histogram_single_region(region_idx);
+          draw_2d_histogram_single_region(region_idx, sink);
 	else
-          draw_histogram_single_region(region_idx);
+          draw_histogram_single_region(region_idx, sink);
       }
     }
     else {
       if (is_2d)
-        draw_2d_histogram_single_region(0);
+        draw_2d_histogram_single_region(0, sink);
       else
-        draw_histogram_single_region(0);
+        draw_histogram_single_region(0, sink);
     }
   }
   else {
     if (regions != nullptr) {
       for (unsigned int region_idx = 0; region_idx < regions->size(); region_idx++) {
 	if (is_2d) 
-	  draw_2d_efficiency_plot_single_region(region_idx);
+	  draw_2d_efficiency_plot_single_region(region_idx, sink);
 	else
-	  draw_efficiency_plot_single_region(region_idx);
+	  draw_efficiency_plot_single_region(region_idx, sink);
       }
     }
     else {
       if (is_2d)
-        draw_2d_efficiency_plot_single_region(0);
+        draw_2d_efficiency_plot_single_region(0, sink);
       else
-        draw_efficiency_plot_single_region(0);
+        draw_efficiency_plot_single_region(0, sink);
     }
   }
 }
 
 /**
- * function to draw a histogram for a single region
+ * function to draw a histogram for a single region, drawn objects are also written to sink unless it is nullptr
  */
-void PlotCollection::draw_histogram_single_region(unsigned int region_idx) {
-  for (unsigned int sample_idx = 0; sample_idx < histograms.size(); sample_idx++) {
-    std::string canvas_name = name+"_"+samples[sample_idx]->sample_name+"_canvas";
-    if (regions != nullptr) canvas_name = name+"_"+regions->get_name(region_idx)+"_"+samples[sample_idx]->sample_name+"_canvas";
-    TCanvas* c = new TCanvas(canvas_name.c_str());
+void PlotCollection::draw_histogram_single_region(unsigned int region_idx, OutputSink* sink) {
+  for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
+    TCanvas* c = get_canvas();
     if (y_log) {
       c->SetLogy(true);
     }
-    c->cd();
-    TH1D* cloned_hist = static_cast<TH1D*>(histograms[sample_idx][region_idx]->Clone());
-    //scale MC by lumi
-    if (!samples[sample_idx]->is_data)
-      cloned_hist->Scale(samples[sample_idx]->scale_weight());
-    cloned_hist->SetTitle((samples[sample_idx]->sample_description+" "+cloned_hist->GetTitle()).c_str());
-    cloned_hist->Draw("e0");
+    //histograms are already scaled by normalize_histograms; title is restored after saving
+    TH1D* hist = get_histogram(sample_idx, region_idx);
+    std::string original_title = hist->GetTitle();
+    hist->SetTitle((samples[sample_idx]->sample_description+" "+original_title).c_str());
+    hist->SetFillStyle(0);
+    hist->Draw("e0");
+    std::unique_ptr<TGraphAsymmErrors> envelope;
+    if (variation_names.size() > 1) {
+      //draw band spanned by weight variations under the nominal histogram
+      envelope.reset(get_envelope(sample_idx, region_idx));
+      envelope->SetFillColor(samples[sample_idx]->sample_color);
+      envelope->SetFillStyle(3004);
+      envelope->Draw("2 same");
+      hist->Draw("e0 same");
+    }
     std::string file_name = "plots/"+name+"_"+samples[sample_idx]->sample_name+"."+file_extension;
     if (regions != nullptr) file_name = "plots/"+name+"_"+samples[sample_idx]->sample_name+"_"+regions->get_name(region_idx)+"."+file_extension;
     c->SaveAs(file_name.c_str());
-    if (save_as_root) {
-      TFile *out_file = TFile::Open("ntuples/output.root","UPDATE");
-      cloned_hist->Write();
-      out_file->Close();
+    if (sink != nullptr) {
+      sink->write(hist->Clone(), output_directory(sample_idx, region_idx));
+      for (unsigned int variation_idx = 1; variation_idx < variation_names.size(); variation_idx++)
+        sink->write(get_variation_histogram(sample_idx, region_idx, variation_idx)->Clone(), output_directory(sample_idx, region_idx));
     }
+    hist->SetTitle(original_title.c_str());
   }
 }
 
 /**
- * function to draw an efficiency plot for a single region
+ * function to draw an efficiency plot for a single region, drawn objects are also written to sink unless it is nullptr
  */
-void PlotCollection::draw_efficiency_plot_single_region(unsigned int region_idx) {
-  for (unsigned int sample_idx = 0; sample_idx < histograms.size(); sample_idx++) {
-    std::string canvas_name = name+"_"+samples[sample_idx]->sample_name+"_canvas";
-    if (regions != nullptr) canvas_name = name+"_"+regions->get_name(region_idx)+"_"+samples[sample_idx]->sample_name+"_canvas";
-    TCanvas* c = new TCanvas(canvas_name.c_str());
+void PlotCollection::draw_efficiency_plot_single_region(unsigned int region_idx, OutputSink* sink) {
+  for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
+    TCanvas* c = get_canvas();
     if (x_log)
       c->SetLogx(true);	
     if (y_log) 
       c->SetLogy(true);
-    c->cd();
-    TH1D* cloned_numerator = static_cast<TH1D*>(histograms[sample_idx][region_idx]->Clone());
-    TH1D* cloned_denominator = static_cast<TH1D*>(denominator_histograms[sample_idx][region_idx]->Clone());
-    TGraphAsymmErrors* hist_ratio = new TGraphAsymmErrors(cloned_numerator,cloned_denominator,"cp");
-    hist_ratio->SetTitle((samples[sample_idx]->sample_description+" "+cloned_numerator->GetTitle()).c_str());
-    hist_ratio->GetXaxis()->SetTitle(cloned_numerator->GetXaxis()->GetTitle());
-    hist_ratio->GetYaxis()->SetTitle(cloned_numerator->GetYaxis()->GetTitle());
+    TH1D* numerator = get_histogram(sample_idx, region_idx);
+    TH1D* denominator = get_denominator_histogram(sample_idx, region_idx);
+    std::unique_ptr<TGraphAsymmErrors> hist_ratio(new TGraphAsymmErrors(numerator,denominator,"cp"));
+    hist_ratio->SetName(("eff_"+std::string(numerator->GetName())).c_str());
+    hist_ratio->SetTitle((samples[sample_idx]->sample_description+" "+numerator->GetTitle()).c_str());
+    hist_ratio->GetXaxis()->SetTitle(numerator->GetXaxis()->GetTitle());
+    hist_ratio->GetYaxis()->SetTitle(numerator->GetYaxis()->GetTitle());
     hist_ratio->Draw("AP");
     std::string file_name = "plots/eff_"+name+"_"+samples[sample_idx]->sample_name+"."+file_extension;
     if (regions != nullptr) file_name = "plots/eff_"+name+"_"+samples[sample_idx]->sample_name+"_"+regions->get_name(region_idx)+"."+file_extension;
     c->SaveAs(file_name.c_str());
-    if (save_as_root) {
-      TFile *out_file = TFile::Open("ntuples/output.root","UPDATE");
-      cloned_numerator->Write();
-      cloned_denominator->Write();
-      hist_ratio->Write();
-      out_file->Close();
+    if (sink != nullptr) {
+      std::string directory = output_directory(sample_idx, region_idx);
+      sink->write(numerator->Clone(), directory);
+      sink->write(denominator->Clone((std::string(denominator->GetName())+"_denominator").c_str()), directory);
+      sink->write(hist_ratio->Clone(), directory);
     }
   }
 }
 
 /**
- * function to draw a 2d histogram for a single region
+ * function to draw a 2d histogram for a single region, drawn objects are also written to sink unless it is nullptr
  */
-void PlotCollection::draw_2d_histogram_single_region(unsigned int region_idx) {
-  for (unsigned int sample_idx = 0; sample_idx < twodim_histograms.size(); sample_idx++) {
-    std::string canvas_name = name+"_"+yname+"_"+samples[sample_idx]->sample_name+"_canvas";
-    if (regions != nullptr) canvas_name = name+"_"+yname+"_"+regions->get_name(region_idx)+"_"+samples[sample_idx]->sample_name+"_canvas";
-    TCanvas* c = new TCanvas(canvas_name.c_str());
+void PlotCollection::draw_2d_histogram_single_region(unsigned int region_idx, OutputSink* sink) {
+  for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
+    TCanvas* c = get_canvas();
     if (z_log) {
       c->SetLogz(true);
     }
-    c->cd();
-    TH2D* cloned_hist = static_cast<TH2D*>(twodim_histograms[sample_idx][region_idx]->Clone());
-    //scale MC by lumi
-    if (!samples[sample_idx]->is_data)
-      cloned_hist->Scale(samples[sample_idx]->scale_weight());
-    cloned_hist->SetTitle((samples[sample_idx]->sample_description+" "+cloned_hist->GetTitle()).c_str());
-    cloned_hist->Draw("colz");
+    //histograms are already scaled by normalize_histograms; title is restored after saving
+    TH2D* hist = get_twodim_histogram(sample_idx, region_idx);
+    std::string original_title = hist->GetTitle();
+    hist->SetTitle((samples[sample_idx]->sample_description+" "+original_title).c_str());
+    hist->Draw("colz");
     std::string file_name = "plots/"+name+"_"+yname+"_"+samples[sample_idx]->sample_name+"."+file_extension;
     if (regions != nullptr) file_name = "plots/"+name+"_"+yname+"_"+samples[sample_idx]->sample_name+"_"+regions->get_name(region_idx)+"."+file_extension;
     c->SaveAs(file_name.c_str());
-    if (save_as_root) {
-      TFile *out_file = TFile::Open("ntuples/output.root","UPDATE");
-      cloned_hist->Write();
-      out_file->Close();
+    if (sink != nullptr) {
+      sink->write(hist->Clone(), output_directory(sample_idx, region_idx));
+      for (unsigned int variation_idx = 1; variation_idx < variation_names.size(); variation_idx++)
+        sink->write(get_variation_histogram(sample_idx, region_idx, variation_idx)->Clone(), output_directory(sample_idx, region_idx));
     }
+    hist->SetTitle(original_title.c_str());
   }
 }
 
 /**
- * function to draw a 2d efficiency plot for a single region
+ * function to draw a 2d efficiency plot for a single region, drawn objects are also written to sink unless it is nullptr
  */
-void PlotCollection::draw_2d_efficiency_plot_single_region(unsigned int region_idx) {
-  for (unsigned int sample_idx = 0; sample_idx < twodim_histograms.size(); sample_idx++) {
-    std::string canvas_name = name+"_"+yname+"_"+samples[sample_idx]->sample_name+"_canvas";
-    if (regions != nullptr) canvas_name = name+"_"+yname+"_"+regions->get_name(region_idx)+"_"+samples[sample_idx]->sample_name+"_canvas";
-    TCanvas* c = new TCanvas(canvas_name.c_str());
+void PlotCollection::draw_2d_efficiency_plot_single_region(unsigned int region_idx, OutputSink* sink) {
+  for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
+    TCanvas* c = get_canvas();
     if (z_log) {
       c->SetLogz(true);
     }
-    c->cd();
-    TH2D* cloned_hist = static_cast<TH2D*>(twodim_histograms[sample_idx][region_idx]->Clone());
-    TH2D* cloned_denominator = static_cast<TH2D*>(twodim_denominator_histograms[sample_idx][region_idx]->Clone());
-    cloned_hist->Divide(cloned_denominator);
-    cloned_hist->SetTitle((samples[sample_idx]->sample_description+" "+cloned_hist->GetTitle()).c_str());
-    cloned_hist->Draw("colz");
+    TH2D* numerator = get_twodim_histogram(sample_idx, region_idx);
+    TH2D* denominator = get_twodim_denominator_histogram(sample_idx, region_idx);
+    //efficiency is the only new histogram, freed once the plot is saved
+    std::unique_ptr<TH2D> efficiency_hist(static_cast<TH2D*>(numerator->Clone(("eff_"+std::string(numerator->GetName())).c_str())));
+    efficiency_hist->SetDirectory(nullptr);
+    efficiency_hist->Divide(denominator);
+    efficiency_hist->SetTitle((samples[sample_idx]->sample_description+" "+numerator->GetTitle()).c_str());
+    efficiency_hist->Draw("colz");
     std::string file_name = "plots/eff_"+name+"_"+yname+"_"+samples[sample_idx]->sample_name+"."+file_extension;
     if (regions != nullptr) file_name = "plots/eff_"+name+"_"+yname+"_"+samples[sample_idx]->sample_name+"_"+regions->get_name(region_idx)+"."+file_extension;
     c->SaveAs(file_name.c_str());
-    if (save_as_root) {
-      TFile *out_file = TFile::Open("ntuples/output.root","UPDATE");
-      TH2D* cloned_numerator = static_cast<TH2D*>(twodim_histograms[sample_idx][region_idx]->Clone());
-      cloned_numerator->Write();
-      cloned_denominator->Write();
-      cloned_hist->Write();
-      out_file->Close();
+    if (sink != nullptr) {
+      std::string directory = output_directory(sample_idx, region_idx);
+      sink->write(numerator->Clone(), directory);
+      sink->write(denominator->Clone((std::string(denominator->GetName())+"_denominator").c_str()), directory);
+      sink->write(efficiency_hist->Clone(), directory);
     }
   }
 }
@@ -0,0 +1,194 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/time.h>
+
+#include "TFile.h"
+
+#include "core/progress_monitor.hxx"
+
+namespace {
+
+/**
+ * returns CPU time (user and system) used so far by all threads of this process in seconds
+ */
+double process_cpu_seconds() {
+  rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) return 0.;
+  return static_cast<double>(usage.ru_utime.tv_sec+usage.ru_stime.tv_sec)
+      +static_cast<double>(usage.ru_utime.tv_usec+usage.ru_stime.tv_usec)*1.0e-6;
+}
+
+/**
+ * returns text quoted as a JSON string
+ */
+std::string json_string(std::string text) {
+  std::string quoted = "\"";
+  for (char text_char : text) {
+    if (text_char == '"' || text_char == '\\') quoted += '\\';
+    quoted += text_char;
+  }
+  return quoted+"\"";
+}
+
+}
+
+/**
+ * constructor
+ * i_interval_seconds - time between progress records
+ * json_filename - if not empty, records are also appended to this file as JSON lines
+ */
+ProgressMonitor::ProgressMonitor(double i_interval_seconds, std::string json_filename) {
+  interval_seconds = i_interval_seconds;
+  num_threads = 1;
+  stop_requested = false;
+  last_entries = 0;
+  last_bytes_read = 0;
+  last_cpu_seconds = 0.;
+  start_time = std::chrono::steady_clock::now();
+  last_report_time = start_time;
+  if (json_filename != "") {
+    json_file.open(json_filename.c_str(), std::ios::app);
+    if (!json_file.is_open())
+      std::cout << "ERROR: unable to open progress file " << json_filename << std::endl;
+  }
+}
+
+/**
+ * destructor, emits a last record and stops the background thread
+ */
+ProgressMonitor::~ProgressMonitor() {
+  {
+    std::lock_guard<std::mutex> lock(report_mutex);
+    stop_requested = true;
+  }
+  stop_condition.notify_all();
+  if (report_thread.joinable())
+    report_thread.join();
+  report();
+}
+
+/**
+ * method to register a sample processed by num_slots slots with i_file_entries entries per input file
+ */
+unsigned int ProgressMonitor::add_sample(std::string sample_name, std::vector<ULong64_t> i_file_entries, unsigned int num_slots) {
+  num_slots = std::max(num_slots, 1u);
+  sample_names.push_back(sample_name);
+  file_entries.push_back(i_file_entries);
+  slot_counters.emplace_back(new SlotCounter[num_slots]);
+  for (unsigned int slot = 0; slot < num_slots; slot++)
+    slot_counters.back()[slot].entries.store(0, std::memory_order_relaxed);
+  num_sample_slots.push_back(num_slots);
+  num_threads = std::max(num_threads, num_slots);
+  return static_cast<unsigned int>(sample_names.size()-1);
+}
+
+/**
+ * method to set entries processed so far by slot of sample sample_idx, safe to call from event loop threads
+ */
+void ProgressMonitor::set_slot_entries(unsigned int sample_idx, unsigned int slot, ULong64_t entries) {
+  if (sample_idx >= slot_counters.size() || slot >= num_sample_slots[sample_idx]) return;
+  slot_counters[sample_idx][slot].entries.store(entries, std::memory_order_relaxed);
+}
+
+/**
+ * internal function returning entries processed so far by sample sample_idx
+ */
+ULong64_t ProgressMonitor::get_sample_entries(unsigned int sample_idx) {
+  ULong64_t entries = 0;
+  for (unsigned int slot = 0; slot < num_sample_slots[sample_idx]; slot++)
+    entries += slot_counters[sample_idx][slot].entries.load(std::memory_order_relaxed);
+  return entries;
+}
+
+/**
+ * method to start the background thread emitting records
+ */
+void ProgressMonitor::start() {
+  if (report_thread.joinable()) return;
+  start_time = std::chrono::steady_clock::now();
+  last_report_time = start_time;
+  last_bytes_read = TFile::GetFileBytesRead();
+  last_cpu_seconds = process_cpu_seconds();
+  report_thread = std::thread(&ProgressMonitor::run, this);
+}
+
+/**
+ * internal function run by the background thread
+ */
+void ProgressMonitor::run() {
+  std::unique_lock<std::mutex> lock(report_mutex);
+  while (!stop_requested) {
+    stop_condition.wait_for(lock, std::chrono::duration<double>(interval_seconds));
+    if (stop_requested) break;
+    lock.unlock();
+    report();
+    lock.lock();
+  }
+}
+
+/**
+ * method to emit one progress record to the terminal (and JSON file) if entries were processed since the last one
+ */
+void ProgressMonitor::report() {
+  ULong64_t total_entries = 0, processed_entries = 0;
+  unsigned int num_files = 0, num_files_completed = 0;
+  std::vector<ULong64_t> sample_entries;
+  for (unsigned int sample_idx = 0; sample_idx < sample_names.size(); sample_idx++) {
+    sample_entries.push_back(get_sample_entries(sample_idx));
+    processed_entries += sample_entries.back();
+    //files are assumed to be completed in order, which is approximate when slots read several files at once
+    ULong64_t file_end_entry = 0;
+    for (ULong64_t entries : file_entries[sample_idx]) {
+      file_end_entry += entries;
+      num_files++;
+      if (file_end_entry <= sample_entries.back()) num_files_completed++;
+    }
+    total_entries += file_end_entry;
+  }
+  if (processed_entries == last_entries) return;
+  std::chrono::steady_clock::time_point report_time = std::chrono::steady_clock::now();
+  double elapsed_seconds = std::chrono::duration<double>(report_time-last_report_time).count();
+  double total_seconds = std::chrono::duration<double>(report_time-start_time).count();
+  long long bytes_read = TFile::GetFileBytesRead();
+  double cpu_seconds = process_cpu_seconds();
+  double entries_per_second = elapsed_seconds > 0. ? static_cast<double>(processed_entries-last_entries)/elapsed_seconds : 0.;
+  double megabytes_per_second = elapsed_seconds > 0. ? static_cast<double>(bytes_read-last_bytes_read)/1.0e6/elapsed_seconds : 0.;
+  double thread_utilization = elapsed_seconds > 0. ? (cpu_seconds-last_cpu_seconds)/elapsed_seconds/num_threads : 0.;
+  double average_entries_per_second = total_seconds > 0. ? static_cast<double>(processed_entries)/total_seconds : 0.;
+  double eta_seconds = (average_entries_per_second > 0. && total_entries > processed_entries)
+      ? static_cast<double>(total_entries-processed_entries)/average_entries_per_second : 0.;
+  last_report_time = report_time;
+  last_entries = processed_entries;
+  last_bytes_read = bytes_read;
+  last_cpu_seconds = cpu_seconds;
+  long eta_minutes = static_cast<long>(eta_seconds/60.+0.5);
+  std::cout << "Progress: " << processed_entries << "/" << total_entries << " events ("
+      << std::fixed << std::setprecision(1) << (total_entries > 0 ? 100.*static_cast<double>(processed_entries)/static_cast<double>(total_entries) : 0.)
+      << "%), " << entries_per_second/1000. << " kevents/s, " << megabytes_per_second << " MB/s, files "
+      << num_files_completed << "/" << num_files << ", ETA " << eta_minutes/60 << "h" << std::setw(2) << std::setfill('0')
+      << eta_minutes%60 << "m, threads " << std::setfill(' ') << std::setprecision(0) << 100.*thread_utilization << "% busy"
+      << std::defaultfloat << std::setprecision(6) << std::endl;
+  if (!json_file.is_open()) return;
+  std::ostringstream record;
+  record << "{\"time\": " << total_seconds << ", \"events\": " << processed_entries << ", \"total_events\": " << total_entries
+      << ", \"events_per_second\": " << entries_per_second << ", \"mb_per_second\": " << megabytes_per_second
+      << ", \"files_completed\": " << num_files_completed << ", \"files\": " << num_files << ", \"eta_seconds\": " << eta_seconds
+      << ", \"thread_utilization\": " << thread_utilization << ", \"samples\": {";
+  for (unsigned int sample_idx = 0; sample_idx < sample_names.size(); sample_idx++)
+    record << (sample_idx > 0 ? ", " : "") << json_string(sample_names[sample_idx]) << ": " << sample_entries[sample_idx];
+  record << "}}";
+  json_file << record.str() << std::endl;
+}
@@ -85,6 +85,20 @@ unsigned int RegionCollection::size() {
   return region_names.size();
 }
 
+/**
+ * returns new collection holding the first num_regions regions (including flag cuts), caller owns it
+ */
+RegionCollection* RegionCollection::get_first_regions(unsigned int num_regions) {
+  RegionCollection* first_regions = new RegionCollection();
+  for (unsigned int region_idx = 0; region_idx < num_regions && region_idx < region_names.size(); region_idx++) {
+    first_regions->region_names.push_back(region_names[region_idx]);
+    first_regions->region_descriptions.push_back(region_descriptions[region_idx]);
+    first_regions->region_cuts_default.push_back(region_cuts_default[region_idx]);
+    first_regions->region_cuts_by_flag.push_back(region_cuts_by_flag[region_idx]);
+  }
+  return first_regions;
+}
+
 /**
  * get the cuts for an appropriate flag type in an appropriate region
  */
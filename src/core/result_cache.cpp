@@ -0,0 +1,227 @@
+#include <cstdint>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <glob.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "TH1.h"
+#include "TH2.h"
+
+#include "core/histogram_archive.hxx"
+#include "core/result_cache.hxx"
+
+/**
+ * constructor
+ * i_cache_directory - local directory in which results are stored, created if it does not exist
+ */
+ResultCache::ResultCache(std::string i_cache_directory, bool i_verbose) {
+  cache_directory = i_cache_directory;
+  verbose = i_verbose;
+  mkdir(cache_directory.c_str(), 0755);
+}
+
+/**
+ * returns hexadecimal 64-bit hash of text, used to build cache keys
+ */
+std::string ResultCache::hash(std::string text) {
+  uint64_t text_hash = 14695981039346656037ull;
+  for (char text_char : text) {
+    text_hash ^= static_cast<uint64_t>(static_cast<unsigned char>(text_char));
+    text_hash *= 1099511628211ull;
+  }
+  std::ostringstream hash_stream;
+  hash_stream << std::hex << std::setw(16) << std::setfill('0') << text_hash;
+  return hash_stream.str();
+}
+
+/**
+ * returns canonical description of input files matching filename_pattern, including size and modification time
+ */
+std::string ResultCache::file_identity(std::string filename_pattern) {
+  std::string identity = "files:"+filename_pattern;
+  glob_t glob_result;
+  if (glob(filename_pattern.c_str(), 0, nullptr, &glob_result) == 0) {
+    //glob returns matches sorted, so the description is canonical
+    for (size_t match_idx = 0; match_idx < glob_result.gl_pathc; match_idx++) {
+      struct stat file_status;
+      std::string matched_filename = glob_result.gl_pathv[match_idx];
+      identity += ";"+matched_filename;
+      if (stat(matched_filename.c_str(), &file_status) == 0)
+        identity += ":"+std::to_string(file_status.st_size)+":"+std::to_string(file_status.st_mtime);
+    }
+  }
+  globfree(&glob_result);
+  return identity;
+}
+
+/**
+ * returns description of the running executable (size and modification time), used as identity of compiled functions
+ */
+std::string ResultCache::executable_identity() {
+  static std::string identity = "";
+  if (identity == "") {
+    struct stat file_status;
+    if (stat("/proc/self/exe", &file_status) == 0)
+      identity = "exe:"+std::to_string(file_status.st_size)+":"+std::to_string(file_status.st_mtime);
+    else
+      identity = "exe:unknown";
+  }
+  return identity;
+}
+
+/**
+ * internal function returning path of cache file for a key
+ */
+std::string ResultCache::key_filename(std::string key) {
+  return cache_directory+"/"+key+".harc";
+}
+
+/**
+ * methods returning a new histogram for key, or nullptr on a cache miss; caller owns histogram
+ */
+TH1D* ResultCache::load_1d_histogram(std::string key) {
+  struct stat file_status;
+  if (stat(key_filename(key).c_str(), &file_status) != 0) return nullptr;
+  HistogramArchive archive(key_filename(key));
+  if (!archive.is_open()) return nullptr;
+  TH1D* histogram = archive.get_1d_histogram("result", "", "", "histogram");
+  if (verbose && histogram != nullptr)
+    std::cout << "Loaded " << histogram->GetName() << " from cache" << std::endl;
+  return histogram;
+}
+
+TH2D* ResultCache::load_2d_histogram(std::string key) {
+  struct stat file_status;
+  if (stat(key_filename(key).c_str(), &file_status) != 0) return nullptr;
+  HistogramArchive archive(key_filename(key));
+  if (!archive.is_open()) return nullptr;
+  TH2D* histogram = archive.get_2d_histogram("result", "", "", "histogram");
+  if (verbose && histogram != nullptr)
+    std::cout << "Loaded " << histogram->GetName() << " from cache" << std::endl;
+  return histogram;
+}
+
+/**
+ * method to load a list of values for key, returns false on a cache miss
+ */
+bool ResultCache::load_values(std::string key, std::vector<double> &values) {
+  return load_values(key, "values", values) || load_values(key, "concatenated_values", values);
+}
+
+/**
+ * internal function to load values stored under key with archive kind kind, returns false on a cache miss
+ */
+bool ResultCache::load_values(std::string key, std::string kind, std::vector<double> &values) {
+  struct stat file_status;
+  if (stat(key_filename(key).c_str(), &file_status) != 0) return false;
+  HistogramArchive archive(key_filename(key));
+  if (!archive.is_open()) return false;
+  std::vector<std::string> labels;
+  return archive.get_values("result", "", "", kind, labels, values);
+}
+
+/**
+ * methods to store realized results under key
+ * results are written to a temporary file and renamed so that concurrent jobs never read partial entries
+ */
+void ResultCache::store(std::string key, TH1D* histogram) {
+  std::string temporary_filename = key_filename(key)+".tmp";
+  {
+    HistogramArchiveWriter archive_writer(temporary_filename);
+    archive_writer.add(histogram, "result", "", "", "histogram");
+  }
+  std::rename(temporary_filename.c_str(), key_filename(key).c_str());
+}
+
+void ResultCache::store(std::string key, TH2D* histogram) {
+  std::string temporary_filename = key_filename(key)+".tmp";
+  {
+    HistogramArchiveWriter archive_writer(temporary_filename);
+    archive_writer.add(histogram, "result", "", "", "histogram");
+  }
+  std::rename(temporary_filename.c_str(), key_filename(key).c_str());
+}
+
+void ResultCache::store_values(std::string key, std::vector<double> values, bool concatenate) {
+  std::string temporary_filename = key_filename(key)+".tmp";
+  {
+    HistogramArchiveWriter archive_writer(temporary_filename);
+    archive_writer.add(std::vector<std::string>(), values, "result", "", "", concatenate ? "concatenated_values" : "values");
+  }
+  std::rename(temporary_filename.c_str(), key_filename(key).c_str());
+}
+
+/**
+ * returns keys of all results stored in the cache directory
+ */
+std::vector<std::string> ResultCache::list_keys() {
+  std::vector<std::string> keys;
+  glob_t glob_result;
+  std::string suffix = ".harc";
+  if (glob((cache_directory+"/*"+suffix).c_str(), 0, nullptr, &glob_result) == 0) {
+    for (size_t match_idx = 0; match_idx < glob_result.gl_pathc; match_idx++) {
+      std::string matched_filename = glob_result.gl_pathv[match_idx];
+      std::string key = matched_filename.substr(cache_directory.size()+1);
+      keys.push_back(key.substr(0, key.size()-suffix.size()));
+    }
+  }
+  globfree(&glob_result);
+  return keys;
+}
+
+/**
+ * returns path of the file holding the result stored under key
+ */
+std::string ResultCache::get_filename(std::string key) {
+  return key_filename(key);
+}
+
+/**
+ * method to remove all results stored in the cache directory
+ */
+void ResultCache::clear() {
+  for (std::string key : list_keys())
+    std::remove(key_filename(key).c_str());
+}
+
+/**
+ * method to add the result stored under key in source to the result stored under key here, or copy it if absent
+ * used to merge partial results (ex. from shards or work units); values are added elementwise or concatenated
+ */
+void ResultCache::accumulate(std::string key, ResultCache* source) {
+  //archive entries record their dimension, so at most one of the loads succeeds
+  std::unique_ptr<TH1D> source_1d_histogram(source->load_1d_histogram(key));
+  if (source_1d_histogram) {
+    std::unique_ptr<TH1D> histogram(load_1d_histogram(key));
+    if (histogram) histogram->Add(source_1d_histogram.get());
+    store(key, histogram ? histogram.get() : source_1d_histogram.get());
+    return;
+  }
+  std::unique_ptr<TH2D> source_2d_histogram(source->load_2d_histogram(key));
+  if (source_2d_histogram) {
+    std::unique_ptr<TH2D> histogram(load_2d_histogram(key));
+    if (histogram) histogram->Add(source_2d_histogram.get());
+    store(key, histogram ? histogram.get() : source_2d_histogram.get());
+    return;
+  }
+  std::vector<double> source_values, values;
+  if (source->load_values(key, "concatenated_values", source_values)) {
+    if (load_values(key, "concatenated_values", values))
+      source_values.insert(source_values.begin(), values.begin(), values.end());
+    store_values(key, source_values, true);
+    return;
+  }
+  if (!source->load_values(key, "values", source_values)) return;
+  if (load_values(key, values) && values.size() == source_values.size()) {
+    for (unsigned int value_idx = 0; value_idx < values.size(); value_idx++)
+      source_values[value_idx] += values[value_idx];
+  }
+  store_values(key, source_values);
+}
@@ -1,9 +1,34 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iomanip>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <future>
 #include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
 #include <string_view>
 #include <string>
 #include <set>
+#include <thread>
+#include <utility>
 #include <vector>
 
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "TFile.h"
+#include "TROOT.h"
+
 #include "ROOT/RDF/RInterface.hxx"
 #include "ROOT/RDF/HistoModels.hxx"
 #include "ROOT/RDF/InterfaceUtils.hxx"
@@ -14,12 +39,267 @@
 #include "core/sample_collection.hxx"
 #include "core/plot_collection.hxx"
 #include "core/table_collection.hxx"
+#include "core/output_sink.hxx"
+#include "core/result_cache.hxx"
+#include "core/multi_weight_histogram.hxx"
+#include "core/bootstrap_weights.hxx"
+#include "core/nd_histogram.hxx"
+#include "core/nd_histogram_collection.hxx"
+#include "core/bounded_histogram.hxx"
+#include "core/work_distribution.hxx"
+#include "core/merged_sample_loop.hxx"
+#include "core/phase_report.hxx"
+
+/**
+ * internal function returning name of a storage mode used in memory reports
+ */
+static std::string storage_name(HistogramStorage storage) {
+  switch (storage) {
+    case HistogramStorage::per_slot:
+      return "per_slot";
+    case HistogramStorage::shared_atomic:
+      return "shared_atomic";
+    case HistogramStorage::sparse_slots:
+      return "sparse_slots";
+    default:
+      return "unknown";
+  }
+}
+
+/**
+ * internal function returning type of column of data_frame, given_type unless it is automatic
+ */
+static ColumnType get_column_type(ROOT::RDF::RNode &data_frame, std::string column, ColumnType given_type) {
+  if (given_type != ColumnType::automatic || !data_frame.HasColumn(column)) return given_type;
+  return column_type_from_name(data_frame.GetColumnType(column));
+}
+
+/**
+ * internal function to book a typed 1d histogram of a column of type T, returns false if the weight type is unsupported
+ */
+template<typename T>
+static bool book_typed_1d_histogram(ROOT::RDF::RNode &data_frame, const ROOT::RDF::TH1DModel &model, std::string column,
+    std::string weight_column, ColumnType weight_type, ROOT::RDF::RResultPtr<TH1D> &histogram) {
+  if (weight_column == "") {
+    histogram = data_frame.Histo1D<T>(model, column);
+    return true;
+  }
+  switch (weight_type) {
+    case ColumnType::float_value:
+      histogram = data_frame.Histo1D<T, float>(model, column, weight_column);
+      return true;
+    case ColumnType::double_value:
+      histogram = data_frame.Histo1D<T, double>(model, column, weight_column);
+      return true;
+    case ColumnType::automatic:
+    case ColumnType::int_value:
+    case ColumnType::unsigned_int_value:
+    case ColumnType::bool_value:
+    case ColumnType::unsigned_char_value:
+    case ColumnType::long64_value:
+    case ColumnType::unsigned_long64_value:
+    case ColumnType::short_value:
+    case ColumnType::unsigned_short_value:
+    case ColumnType::char_value:
+    case ColumnType::float_vector:
+    case ColumnType::int_vector:
+    case ColumnType::double_vector:
+    case ColumnType::unsigned_char_vector:
+    case ColumnType::bool_vector:
+    case ColumnType::short_vector:
+    default:
+      return false;
+  }
+}
+
+/**
+ * internal function to book a typed 1d histogram, dispatching on the column type, returns false if a type is unsupported
+ */
+static bool book_typed_1d_histogram(ROOT::RDF::RNode &data_frame, const ROOT::RDF::TH1DModel &model, std::string column,
+    ColumnType column_type, std::string weight_column, ColumnType weight_type, ROOT::RDF::RResultPtr<TH1D> &histogram) {
+  switch (column_type) {
+    case ColumnType::float_value:
+      return book_typed_1d_histogram<float>(data_frame, model, column, weight_column, weight_type, histogram);
+    case ColumnType::double_value:
+      return book_typed_1d_histogram<double>(data_frame, model, column, weight_column, weight_type, histogram);
+    case ColumnType::int_value:
+      return book_typed_1d_histogram<int>(data_frame, model, column, weight_column, weight_type, histogram);
+    case ColumnType::unsigned_int_value:
+      return book_typed_1d_histogram<unsigned int>(data_frame, model, column, weight_column, weight_type, histogram);
+    case ColumnType::bool_value:
+      return book_typed_1d_histogram<bool>(data_frame, model, column, weight_column, weight_type, histogram);
+    case ColumnType::unsigned_char_value:
+      return book_typed_1d_histogram<unsigned char>(data_frame, model, column, weight_column, weight_type, histogram);
+    case ColumnType::long64_value:
+      return book_typed_1d_histogram<Long64_t>(data_frame, model, column, weight_column, weight_type, histogram);
+    case ColumnType::unsigned_long64_value:
+      return book_typed_1d_histogram<ULong64_t>(data_frame, model, column, weight_column, weight_type, histogram);
+    case ColumnType::short_value:
+      return book_typed_1d_histogram<Short_t>(data_frame, model, column, weight_column, weight_type, histogram);
+    case ColumnType::unsigned_short_value:
+      return book_typed_1d_histogram<UShort_t>(data_frame, model, column, weight_column, weight_type, histogram);
+    case ColumnType::char_value:
+      return book_typed_1d_histogram<Char_t>(data_frame, model, column, weight_column, weight_type, histogram);
+    case ColumnType::float_vector:
+      return book_typed_1d_histogram<ROOT::RVec<float>>(data_frame, model, column, weight_column, weight_type, histogram);
+    case ColumnType::int_vector:
+      return book_typed_1d_histogram<ROOT::RVec<int>>(data_frame, model, column, weight_column, weight_type, histogram);
+    case ColumnType::double_vector:
+      return book_typed_1d_histogram<ROOT::RVec<double>>(data_frame, model, column, weight_column, weight_type, histogram);
+    case ColumnType::unsigned_char_vector:
+      return book_typed_1d_histogram<ROOT::RVec<UChar_t>>(data_frame, model, column, weight_column, weight_type, histogram);
+    case ColumnType::bool_vector:
+      return book_typed_1d_histogram<ROOT::RVec<bool>>(data_frame, model, column, weight_column, weight_type, histogram);
+    case ColumnType::short_vector:
+      return book_typed_1d_histogram<ROOT::RVec<Short_t>>(data_frame, model, column, weight_column, weight_type, histogram);
+    case ColumnType::automatic:
+    default:
+      return false;
+  }
+}
+
+/**
+ * internal function to define name as a column of type T converted to Target
+ */
+template<typename Target, typename T>
+static ROOT::RDF::RNode define_converted_column(ROOT::RDF::RNode &data_frame, std::string name, std::string column) {
+  return data_frame.Define(name, [](const T &value) { return static_cast<Target>(value); }, {column});
+}
+
+/**
+ * internal function to define name as a scalar column converted to Target without jitting, dispatching on the column
+ * type, returns false (leaving data_frame unchanged) if the type is unsupported
+ */
+template<typename Target>
+static bool define_converted_column(ROOT::RDF::RNode &data_frame, std::string name, std::string column, ColumnType column_type) {
+  switch (column_type) {
+    case ColumnType::float_value:
+      data_frame = define_converted_column<Target, float>(data_frame, name, column);
+      return true;
+    case ColumnType::double_value:
+      data_frame = define_converted_column<Target, double>(data_frame, name, column);
+      return true;
+    case ColumnType::int_value:
+      data_frame = define_converted_column<Target, int>(data_frame, name, column);
+      return true;
+    case ColumnType::unsigned_int_value:
+      data_frame = define_converted_column<Target, unsigned int>(data_frame, name, column);
+      return true;
+    case ColumnType::bool_value:
+      data_frame = define_converted_column<Target, bool>(data_frame, name, column);
+      return true;
+    case ColumnType::unsigned_char_value:
+      data_frame = define_converted_column<Target, unsigned char>(data_frame, name, column);
+      return true;
+    case ColumnType::long64_value:
+      data_frame = define_converted_column<Target, Long64_t>(data_frame, name, column);
+      return true;
+    case ColumnType::unsigned_long64_value:
+      data_frame = define_converted_column<Target, ULong64_t>(data_frame, name, column);
+      return true;
+    case ColumnType::short_value:
+      data_frame = define_converted_column<Target, Short_t>(data_frame, name, column);
+      return true;
+    case ColumnType::unsigned_short_value:
+      data_frame = define_converted_column<Target, UShort_t>(data_frame, name, column);
+      return true;
+    case ColumnType::char_value:
+      data_frame = define_converted_column<Target, Char_t>(data_frame, name, column);
+      return true;
+    case ColumnType::automatic:
+    case ColumnType::float_vector:
+    case ColumnType::int_vector:
+    case ColumnType::double_vector:
+    case ColumnType::unsigned_char_vector:
+    case ColumnType::bool_vector:
+    case ColumnType::short_vector:
+    default:
+      return false;
+  }
+}
+
+/**
+ * internal function to define name as a scalar column converted to double without jitting, see define_converted_column
+ * converting both axes of 2d histograms to double needs one typed Histo2D per weight type instead of one per type combination
+ */
+static bool define_double_column(ROOT::RDF::RNode &data_frame, std::string name, std::string column, ColumnType column_type) {
+  return define_converted_column<double>(data_frame, name, column, column_type);
+}
+
+/**
+ * internal function returning data_frame with name defined as column (or expression) converted to Target, typed if
+ * the type of column is given or can be detected and jitted otherwise; target_name is used in the jitted conversion
+ */
+template<typename Target>
+static ROOT::RDF::RNode define_converted_column(ROOT::RDF::RNode data_frame, std::string name, std::string column,
+    ColumnType column_type, std::string target_name) {
+  if (define_converted_column<Target>(data_frame, name, column, get_column_type(data_frame, column, column_type)))
+    return data_frame;
+  return PhaseReport::jitted_define(data_frame, name, "static_cast<"+target_name+">("+column+")");
+}
+
+/**
+ * internal function returning data_frame with name defined as the RVec<Target> of columns (or expressions) converted to
+ * Target, see define_converted_column; column_types may be empty to detect all types
+ * elements are appended by one typed define per column, so only columns of unsupported types are jitted
+ */
+template<typename Target>
+static ROOT::RDF::RNode define_vector_column(ROOT::RDF::RNode data_frame, std::string name, std::vector<std::string> columns,
+    std::vector<ColumnType> column_types, std::string target_name) {
+  std::string vector_column = name+"_part_0";
+  data_frame = data_frame.Define(columns.size() == 0 ? name : vector_column, []() { return ROOT::RVec<Target>(); }, {});
+  for (unsigned int column_idx = 0; column_idx < columns.size(); column_idx++) {
+    std::string element_column = name+"_element_"+std::to_string(column_idx);
+    ColumnType column_type = column_idx < column_types.size() ? column_types[column_idx] : ColumnType::automatic;
+    data_frame = define_converted_column<Target>(data_frame, element_column, columns[column_idx], column_type, target_name);
+    std::string next_column = (column_idx+1 == columns.size()) ? name : name+"_part_"+std::to_string(column_idx+1);
+    data_frame = data_frame.Define(next_column, [](const ROOT::RVec<Target> &elements, Target element) {
+      ROOT::RVec<Target> extended_elements(elements);
+      extended_elements.push_back(element);
+      return extended_elements;
+    }, {vector_column, element_column});
+    vector_column = next_column;
+  }
+  return data_frame;
+}
+
+/**
+ * internal function returning data_frame with name defined as weight_column converted to double, 1 if weight_column
+ * is empty
+ */
+static ROOT::RDF::RNode define_weight_column(ROOT::RDF::RNode data_frame, std::string name, std::string weight_column,
+    ColumnType weight_type=ColumnType::automatic) {
+  if (weight_column == "")
+    return data_frame.Define(name, []() { return 1.0; }, {});
+  return define_converted_column<double>(data_frame, name, weight_column, weight_type, "double");
+}
 
 /**
  * default constructor
  */
 SampleCollection::SampleCollection() {
-  //do nothing
+  output_sink = nullptr;
+  //the file is only opened if a plot is saved to it
+  default_output_sink.reset(new OutputSink("ntuples/output.root", "UPDATE"));
+  result_cache = nullptr;
+  expression_cache = nullptr;
+  histogram_storage = HistogramStorage::per_slot;
+  bin_precision = BinPrecision::double_precision;
+  bounded_min_cells = 0;
+  histogram_memory_limit = -1;
+  checkpoint_directory = "";
+  checkpoint_seconds = 300;
+  sampled_run_start = std::chrono::steady_clock::now();
+  sampled_run_start_bytes = 0;
+  sampled_run_start_loop_seconds = 0.;
+}
+
+/**
+ * destructor, waits for event loops started by start_event_loops
+ */
+SampleCollection::~SampleCollection() {
+  for (std::thread &loop_thread : loop_threads)
+    loop_thread.join();
 }
 
 
@@ -27,21 +307,104 @@ SampleCollection::SampleCollection() {
  * method to add a sample to the collection
  */
 SampleCollection* SampleCollection::add(SampleWrapper* sample) {
+  if (merged_loop) {
+    std::cout << "ERROR: samples must be added before setting a merged event loop" << std::endl;
+    return this;
+  }
+  if (result_cache != nullptr)
+    sample->set_result_cache(result_cache);
+  if (expression_cache != nullptr)
+    sample->set_expression_cache(expression_cache);
   samples.push_back(sample);
   return this;
 }
 
+/**
+ * internal function returning indices of samples with any of flags, or of all samples if flags is empty
+ */
+std::vector<unsigned int> SampleCollection::get_flagged_samples(std::vector<std::string> flags) {
+  std::vector<unsigned int> flagged_samples;
+  for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
+    bool has_flag = (flags.size() == 0);
+    for (std::string flag : flags) {
+      if (samples[sample_idx]->check_flag(flag)) has_flag = true;
+    }
+    if (has_flag) flagged_samples.push_back(sample_idx);
+  }
+  return flagged_samples;
+}
+
+/**
+ * method to process all samples in a single event loop over their chained files, see MergedSampleLoop
+ * should be called after adding samples and before weights, defines, filters, and booking
+ */
+SampleCollection* SampleCollection::set_merged_event_loop(const char* tree_name) {
+  if (merged_loop) return this;
+  bool weighted = false;
+  for (SampleWrapper* sample : samples) {
+    if (sample->cuts.size() > 0 || sample->uses_column_cache() || sample->get_sampled_fraction() < 1.) {
+      std::cout << "ERROR: merged event loop must be set before filtering and does not read column caches or sampled entries, samples are processed separately" << std::endl;
+      return this;
+    }
+    if (sample->weighted_sample) weighted = true;
+  }
+  //entries of all samples go through the same defines and filters, so all trees must have the same branches
+  std::vector<std::string> merged_branches;
+  for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
+    if (samples[sample_idx]->get_tree_name() != tree_name) {
+      std::cout << "ERROR: " << samples[sample_idx]->sample_name << " is read from tree " << samples[sample_idx]->get_tree_name()
+                << " instead of " << tree_name << ", samples are processed separately" << std::endl;
+      return this;
+    }
+    std::vector<std::string> branches = samples[sample_idx]->get_branches();
+    std::sort(branches.begin(), branches.end());
+    if (branches.size() == 0) {
+      std::cout << "ERROR: unable to read branches of " << samples[sample_idx]->sample_name << ", samples are processed separately" << std::endl;
+      return this;
+    }
+    if (sample_idx == 0) {
+      merged_branches = branches;
+      continue;
+    }
+    std::vector<std::string> missing_branches, extra_branches;
+    std::set_difference(merged_branches.begin(), merged_branches.end(), branches.begin(), branches.end(), std::back_inserter(missing_branches));
+    std::set_difference(branches.begin(), branches.end(), merged_branches.begin(), merged_branches.end(), std::back_inserter(extra_branches));
+    if (missing_branches.size() > 0 || extra_branches.size() > 0) {
+      std::string branch = missing_branches.size() > 0 ? missing_branches[0] : extra_branches[0];
+      std::cout << "ERROR: branch (name:type) " << branch << " of " << (missing_branches.size() > 0 ? samples[0] : samples[sample_idx])->sample_name
+                << " is not in " << (missing_branches.size() > 0 ? samples[sample_idx] : samples[0])->sample_name
+                << ", merged event loops need the same branches in all samples, samples are processed separately" << std::endl;
+      return this;
+    }
+  }
+  merged_loop.reset(new MergedSampleLoop(samples, tree_name));
+  for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++)
+    samples[sample_idx]->set_merged_loop(merged_loop.get(), sample_idx);
+  if (weighted) merged_loop->update_weights();
+  return this;
+}
+
 /**
  * method to define data frame columns, see RInterface::Define
  * flags argument can be used to only define colums for certain samples
  */
 SampleCollection* SampleCollection::define(const char* name, const char* expression, std::vector<std::string> flags) {
+  if (merged_loop) {
+    //defined once for all samples, flags are resolved by sample index
+    std::vector<unsigned int> flagged_samples = get_flagged_samples(flags);
+    if (flagged_samples.size() == 0) return this;
+    merged_loop->define(name, expression, flagged_samples);
+    for (unsigned int sample_idx : flagged_samples)
+      samples[sample_idx]->append_graph_description("define:"+std::string(name)+"="+std::string(expression));
+    return this;
+  }
   if (flags.size() > 0) {
     //if flags provided, define only for samples matching flag
     for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
       for (std::string flag : flags) {
         if (samples[sample_idx]->check_flag(flag)) {
-          samples[sample_idx]->data_frame() = samples[sample_idx]->data_frame().Define(name, expression);
+          samples[sample_idx]->define(name, expression);
+          samples[sample_idx]->append_graph_description("define:"+std::string(name)+"="+std::string(expression));
           break;
         }
       }
@@ -50,7 +413,8 @@ SampleCollection* SampleCollection::define(const char* name, const char* express
   else {
     //if no flags provided, define for all samples
     for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
-      samples[sample_idx]->data_frame() = samples[sample_idx]->data_frame().Define(name, expression);
+      samples[sample_idx]->define(name, expression);
+      samples[sample_idx]->append_graph_description("define:"+std::string(name)+"="+std::string(expression));
     }
   }
   return this;
@@ -61,6 +425,15 @@ SampleCollection* SampleCollection::define(const char* name, const char* express
  * flags argument can be used to only filter certain samples
  */
 SampleCollection* SampleCollection::filter(std::string expression, std::string filter_description, std::vector<std::string> flags) {
+  if (merged_loop) {
+    //filtered once for all samples, entries of samples without flags pass
+    std::vector<unsigned int> flagged_samples = get_flagged_samples(flags);
+    if (flagged_samples.size() == 0) return this;
+    unsigned int filter_idx = merged_loop->filter(expression, filter_description == "" ? expression : filter_description, flagged_samples);
+    for (unsigned int sample_idx : flagged_samples)
+      samples[sample_idx]->add_merged_cut(filter_idx, expression, filter_description);
+    return this;
+  }
   if (flags.size() > 0) {
     //if flags provided, filter only samples matching flag
     for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
@@ -82,6 +455,22 @@ SampleCollection* SampleCollection::filter(std::string expression, std::string f
 }
 
 
+/**
+ * method to run subsequent filters in the order minimizing expected cost per event, see SampleWrapper::set_adaptive_filter_order
+ * flags argument can be used to only reorder filters of certain samples
+ */
+SampleCollection* SampleCollection::set_adaptive_filter_order(unsigned int warmup_events, unsigned int cutflow_period,
+                                                               std::vector<std::string> flags) {
+  for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
+    bool has_flag = (flags.size() == 0);
+    for (std::string flag : flags) {
+      if (samples[sample_idx]->check_flag(flag)) has_flag = true;
+    }
+    if (has_flag) samples[sample_idx]->set_adaptive_filter_order(warmup_events, cutflow_period);
+  }
+  return this;
+}
+
 /**
  * method to set luminosity
  */
@@ -132,6 +521,547 @@ SampleCollection* SampleCollection::set_weight_branches(std::string lumi_weight_
       samples[sample_idx]->set_weight_branches(lumi_weight_column_name,full_weight_column_name);
     }
   }
+  if (merged_loop)
+    merged_loop->update_weights();
+  return this;
+}
+
+
+
+/**
+ * method to read sum of lumi weights from a small metadata tree (ex. NanoAOD Runs/genEventSumw) for normalize_at_fill
+ */
+SampleCollection* SampleCollection::set_sum_of_weights_from_tree(std::string metadata_tree_name, std::string sum_of_weights_column, std::vector<std::string> flags) {
+  if (flags.size() > 0) {
+    //if flags provided, set only for samples matching flag
+    for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
+      for (std::string flag : flags) {
+        if (samples[sample_idx]->check_flag(flag)) {
+          if (!samples[sample_idx]->is_data)
+            samples[sample_idx]->set_sum_of_weights_from_tree(metadata_tree_name,sum_of_weights_column);
+          break;
+        }
+      }
+    }
+  }
+  else {
+    //if no flags provided, set for all samples
+    for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
+      if (!samples[sample_idx]->is_data)
+        samples[sample_idx]->set_sum_of_weights_from_tree(metadata_tree_name,sum_of_weights_column);
+    }
+  }
+  return this;
+}
+
+
+/**
+ * method to fold cross section * luminosity / sum of weights into the weights of MC samples so that histograms
+ * and tables booked afterwards need no rescaling
+ */
+SampleCollection* SampleCollection::normalize_at_fill(std::vector<std::string> flags) {
+  if (flags.size() > 0) {
+    //if flags provided, normalize only samples matching flag
+    for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
+      for (std::string flag : flags) {
+        if (samples[sample_idx]->check_flag(flag)) {
+          samples[sample_idx]->normalize_at_fill();
+          break;
+        }
+      }
+    }
+  }
+  else {
+    //if no flags provided, normalize all samples (data samples are left unchanged)
+    for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
+      samples[sample_idx]->normalize_at_fill();
+    }
+  }
+  return this;
+}
+
+/**
+ * method to set a single output file shared by all subsequently booked plots
+ * the sink is not owned by the SampleCollection and should be closed by the caller once drawing is done
+ */
+SampleCollection* SampleCollection::set_output_sink(OutputSink* i_output_sink) {
+  output_sink = i_output_sink;
+  return this;
+}
+
+/**
+ * internal function to set the output files of a booked plot collection
+ */
+void SampleCollection::set_plot_output(PlotCollection* plot_collection) {
+  plot_collection->set_default_output_sink(default_output_sink.get());
+  if (output_sink != nullptr)
+    plot_collection->set_output_sink(output_sink);
+}
+
+/**
+ * method to read columns of all samples from memory-mapped column caches of their input files
+ */
+SampleCollection* SampleCollection::use_column_cache(std::vector<std::string> columns, std::string cache_directory, bool compress) {
+  for (SampleWrapper* sample : samples)
+    sample->use_column_cache(columns, cache_directory, compress);
+  return this;
+}
+
+/**
+ * method to build the chains of input files of all samples from dataset manifests, see SampleWrapper::use_dataset_manifest
+ */
+SampleCollection* SampleCollection::use_dataset_manifest(std::string manifest_directory, unsigned int num_threads) {
+  for (SampleWrapper* sample : samples)
+    sample->use_dataset_manifest(manifest_directory, num_threads);
+  return this;
+}
+
+/**
+ * method to materialize columns of all samples defined afterwards with compiled functions as friend trees, see
+ * SampleWrapper::cache_defined_columns
+ */
+SampleCollection* SampleCollection::cache_defined_columns(std::vector<std::string> columns, std::string version, std::string cache_directory) {
+  for (SampleWrapper* sample : samples)
+    sample->cache_defined_columns(columns, version, cache_directory);
+  return this;
+}
+
+/**
+ * method to process only about fraction of the entries of each sample for quick looks
+ */
+SampleCollection* SampleCollection::set_sampled_fraction(double fraction) {
+  for (SampleWrapper* sample : samples)
+    sample->set_sampled_fraction(fraction);
+  sampled_run_start = std::chrono::steady_clock::now();
+  sampled_run_start_bytes = TFile::GetFileBytesRead();
+  sampled_run_start_loop_seconds = PhaseReport::get_seconds("loop");
+  return this;
+}
+
+/**
+ * method to print the fraction of entries processed by each sample, the resulting increase of statistical
+ * uncertainties, and wall time and bytes read so far extrapolated to a run over all entries
+ */
+void SampleCollection::print_sampled_run_report() {
+  double num_entries = 0.;
+  double num_sampled_entries = 0.;
+  std::cout << "Sampled run report:" << std::endl;
+  for (SampleWrapper* sample : samples) {
+    double sample_entries = 0.;
+    for (ULong64_t file_entries : sample->get_file_entries())
+      sample_entries += static_cast<double>(file_entries);
+    //the number of entries of the full run is known, so it is not extrapolated
+    double sample_total_entries = static_cast<double>(sample->get_num_entries());
+    num_sampled_entries += sample_entries;
+    num_entries += sample_total_entries;
+    if (sample_total_entries <= 0.) continue;
+    //extrapolated yields have statistical uncertainties 1/sqrt(fraction of entries) times those of the full run
+    double entry_fraction = sample_entries/sample_total_entries;
+    std::cout << sample->sample_name << ": " << sample_entries << " of " << sample_total_entries << " entries ("
+        << 100.*entry_fraction << "%), yields scaled by " << 1./sample->get_sampled_fraction()
+        << ", statistical uncertainties x" << (entry_fraction > 0. ? 1./std::sqrt(entry_fraction) : 0.) << std::endl;
+  }
+  if (num_sampled_entries <= 0. || num_entries <= 0.) return;
+  double entry_fraction = num_sampled_entries/num_entries;
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-sampled_run_start).count();
+  double megabytes = static_cast<double>(TFile::GetFileBytesRead()-sampled_run_start_bytes)/1.0e6;
+  //only processing entries scales with their number, jitting and merging results do not
+  if (!PhaseReport::is_enabled()) {
+    std::cout << "Processed " << 100.*entry_fraction << "% of entries in " << seconds << " s, reading " << megabytes << " MB" << std::endl;
+    std::cout << "Extrapolated full run: at most " << seconds/entry_fraction << " s (enable PhaseReport to separate event loop time), reading "
+        << megabytes/entry_fraction << " MB" << std::endl;
+    return;
+  }
+  double loop_seconds = std::min(PhaseReport::get_seconds("loop")-sampled_run_start_loop_seconds, seconds);
+  std::cout << "Processed " << 100.*entry_fraction << "% of entries in " << seconds << " s (" << loop_seconds
+      << " s processing entries), reading " << megabytes << " MB" << std::endl;
+  std::cout << "Extrapolated full run: " << seconds-loop_seconds+loop_seconds/entry_fraction << " s, reading "
+      << megabytes/entry_fraction << " MB" << std::endl;
+}
+
+/**
+ * method to start the event loops of all samples on background threads, at most num_concurrent at a time (all if 0)
+ */
+SampleCollection* SampleCollection::start_event_loops(unsigned int num_concurrent) {
+  if (merged_loop) {
+    std::cout << "ERROR: event loops of samples in a merged event loop cannot be started separately" << std::endl;
+    return this;
+  }
+  //futures of a previous call are kept by callers, so its loops are finished rather than abandoned
+  for (std::thread &loop_thread : loop_threads)
+    loop_thread.join();
+  loop_threads.clear();
+  sample_loops.clear();
+  {
+    std::lock_guard<std::mutex> lock(finished_mutex);
+    finished_samples.clear();
+  }
+  started_booked_results.resize(samples.size(), 0);
+  //loops read files and write outputs on background threads while the calling thread draws
+  ROOT::EnableThreadSafety();
+  //the count is booked on the loop of each sample, so getting it runs all actions booked on the sample
+  std::vector<ROOT::RDF::RResultPtr<ULong64_t>> loop_counts;
+  std::vector<unsigned int> loop_samples;
+  std::shared_ptr<std::vector<std::promise<void>>> loop_promises(new std::vector<std::promise<void>>(samples.size()));
+  for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
+    sample_loops.push_back((*loop_promises)[sample_idx].get_future().share());
+    //accessors of booked results wait for the loop, so results of running samples are never read concurrently
+    samples[sample_idx]->set_event_loop(sample_loops.back());
+    unsigned int num_booked_results = samples[sample_idx]->get_num_booked_results();
+    if (num_booked_results > started_booked_results[sample_idx]) {
+      started_booked_results[sample_idx] = num_booked_results;
+      loop_counts.push_back(samples[sample_idx]->unfiltered_data_frame().Count());
+      loop_samples.push_back(sample_idx);
+      continue;
+    }
+    //results of samples without booked results were loaded from the cache, so running their loop would only reread them
+    (*loop_promises)[sample_idx].set_value();
+    std::lock_guard<std::mutex> lock(finished_mutex);
+    finished_samples.push_back(sample_idx);
+  }
+  finished_condition.notify_all();
+  if (num_concurrent == 0 || num_concurrent > loop_samples.size())
+    num_concurrent = static_cast<unsigned int>(loop_samples.size());
+  std::shared_ptr<std::atomic<unsigned int>> next_loop(new std::atomic<unsigned int>(0));
+  for (unsigned int thread_idx = 0; thread_idx < num_concurrent; thread_idx++) {
+    loop_threads.emplace_back([this, loop_counts, loop_samples, loop_promises, next_loop]() mutable {
+      for (unsigned int loop_idx = (*next_loop)++; loop_idx < loop_counts.size(); loop_idx = (*next_loop)++) {
+        unsigned int sample_idx = loop_samples[loop_idx];
+        try {
+          loop_counts[loop_idx].GetValue();
+          (*loop_promises)[sample_idx].set_value();
+        }
+        catch (...) {
+          (*loop_promises)[sample_idx].set_exception(std::current_exception());
+        }
+        {
+          std::lock_guard<std::mutex> lock(finished_mutex);
+          finished_samples.push_back(sample_idx);
+        }
+        finished_condition.notify_all();
+      }
+    });
+  }
+  return this;
+}
+
+/**
+ * returns future that is ready once the event loop of sample sample_idx has finished
+ */
+std::shared_future<void> SampleCollection::get_sample_future(unsigned int sample_idx) {
+  if (sample_loops.size() == 0)
+    start_event_loops();
+  if (sample_idx >= sample_loops.size()) {
+    std::cout << "ERROR: no event loop for sample " << sample_idx << std::endl;
+    return std::shared_future<void>();
+  }
+  return sample_loops[sample_idx];
+}
+
+/**
+ * method calling callback(sample_idx) on the calling thread for each sample as soon as its event loop has finished
+ */
+SampleCollection* SampleCollection::for_each_finished_sample(std::function<void(unsigned int)> callback) {
+  if (sample_loops.size() == 0)
+    start_event_loops();
+  for (unsigned int finished_idx = 0; finished_idx < sample_loops.size(); finished_idx++) {
+    unsigned int sample_idx = 0;
+    {
+      std::unique_lock<std::mutex> lock(finished_mutex);
+      finished_condition.wait(lock, [this, finished_idx]() { return finished_samples.size() > finished_idx; });
+      sample_idx = finished_samples[finished_idx];
+    }
+    //rethrows the exception of a failed event loop
+    sample_loops[sample_idx].get();
+    callback(sample_idx);
+  }
+  for (std::thread &loop_thread : loop_threads)
+    loop_thread.join();
+  loop_threads.clear();
+  return this;
+}
+
+/**
+ * method to print progress of event loops every interval_seconds, see ProgressMonitor
+ */
+SampleCollection* SampleCollection::set_progress_monitor(double interval_seconds, std::string json_filename, ULong64_t update_entries) {
+  if (progress_monitor) return this;
+  progress_monitor.reset(new ProgressMonitor(interval_seconds, json_filename));
+  ProgressMonitor* monitor = progress_monitor.get();
+  for (SampleWrapper* sample : samples) {
+    ROOT::RDF::RNode entry_data_frame = sample->unfiltered_data_frame();
+    unsigned int monitor_sample_idx = monitor->add_sample(sample->sample_name, sample->get_file_entries(), entry_data_frame.GetNSlots());
+    //partial counts of a slot are cumulative, so they are stored rather than added
+    progress_counts.push_back(entry_data_frame.Count());
+    progress_counts.back().OnPartialResultSlot(update_entries, [monitor, monitor_sample_idx](unsigned int slot, ULong64_t &entries) {
+      monitor->set_slot_entries(monitor_sample_idx, slot, entries);
+    });
+  }
+  monitor->start();
+  return this;
+}
+
+/**
+ * method to memoize realized results of all samples in a ResultCache
+ * should be called before set_weight_branches, filters, and booking for their results to be cached
+ */
+SampleCollection* SampleCollection::set_result_cache(ResultCache* i_result_cache) {
+  result_cache = i_result_cache;
+  for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
+    samples[sample_idx]->set_result_cache(result_cache);
+  }
+  return this;
+}
+
+/**
+ * method to book string defines, filters, region cuts, and untyped histograms of all samples with compiled code
+ */
+SampleCollection* SampleCollection::set_expression_cache(CompiledExpressionCache* i_expression_cache) {
+  expression_cache = i_expression_cache;
+  for (SampleWrapper* sample : samples)
+    sample->set_expression_cache(expression_cache);
+  return this;
+}
+
+/**
+ * internal function returning data frame of a sample filtered to a region (unfiltered if regions is nullptr)
+ */
+ROOT::RDF::RNode SampleCollection::get_region_data_frame(unsigned int sample_idx, RegionCollection* regions, unsigned int region_idx) {
+  if (regions == nullptr) return samples[sample_idx]->data_frame();
+  ROOT::RDF::RNode region_data_frame = samples[sample_idx]->data_frame();
+  std::string region_cuts = regions->get_cuts(region_idx, samples[sample_idx]);
+  if (expression_cache != nullptr && expression_cache->filter(region_data_frame, region_cuts))
+    return region_data_frame;
+  return PhaseReport::jitted_filter(region_data_frame, region_cuts);
+}
+
+/**
+ * internal function returning canonical description of an axis (name, labels, and binning) for cache keys
+ */
+std::string SampleCollection::axis_description(VariableAxis axis) {
+  std::ostringstream axis_stream;
+  axis_stream << std::setprecision(17) << axis.variable_name << ";" << axis.variable_description << ";" << axis.units << ";" << axis.nbins;
+  if (axis.uniform_bins) {
+    axis_stream << ";" << axis.low << ";" << axis.high;
+  }
+  else {
+    for (int bin_idx = 0; bin_idx <= axis.nbins; bin_idx++)
+      axis_stream << ";" << axis.bins[bin_idx];
+  }
+  return axis_stream.str();
+}
+
+/**
+ * internal function returning cache key of a result booked on a sample in a region
+ */
+std::string SampleCollection::get_result_key(unsigned int sample_idx, RegionCollection* regions, unsigned int region_idx, std::string action_description) {
+  std::string result_description = samples[sample_idx]->get_graph_description()+"|selection:"+samples[sample_idx]->selection_string();
+  if (regions != nullptr)
+    result_description += "|region:"+regions->get_name(region_idx)+":"+regions->get_description(region_idx)+":"+regions->get_cuts(region_idx, samples[sample_idx]);
+  result_description += "|"+action_description;
+  if (samples[sample_idx]->weighted_sample)
+    result_description += "|weight:"+samples[sample_idx]->weight_column;
+  return ResultCache::hash(result_description);
+}
+
+/**
+ * internal functions to book a (weighted, if the sample is weighted) histogram on a data frame
+ * histograms with at least bounded_min_cells bins are filled with the storage mode set by set_histogram_storage
+ */
+ROOT::RDF::RResultPtr<TH1D> SampleCollection::book_1d_result(ROOT::RDF::RNode data_frame, ROOT::RDF::TH1DModel model, VariableAxis axis, unsigned int sample_idx) {
+  samples[sample_idx]->add_booked_result();
+  unsigned int num_slots = data_frame.GetNSlots();
+  std::shared_ptr<TH1D> model_histogram = model.GetHistogram();
+  unsigned long num_cells = static_cast<unsigned long>(model_histogram->GetNcells());
+  HistogramStorage storage = (num_cells >= bounded_min_cells) ? histogram_storage : HistogramStorage::per_slot;
+  BinPrecision precision = (samples[sample_idx]->weighted_sample && bin_precision == BinPrecision::integer_counts) ? BinPrecision::double_precision : bin_precision;
+  add_projected_memory(storage_name(storage), BoundedBinStorage::projected_bytes(storage, precision, num_cells, num_slots));
+  std::string histogram_weight = samples[sample_idx]->weighted_sample ? samples[sample_idx]->weight_column : "";
+  ColumnType value_type = get_column_type(data_frame, axis.variable_name, axis.value_type);
+  ColumnType weight_type = get_column_type(data_frame, histogram_weight, axis.weight_type);
+  if (storage == HistogramStorage::per_slot) {
+    ROOT::RDF::RResultPtr<TH1D> histogram;
+    if (book_typed_1d_histogram(data_frame, model, axis.variable_name, value_type, histogram_weight, weight_type, histogram))
+      return histogram;
+    if (expression_cache != nullptr && expression_cache->histo_1d(data_frame, model, axis.variable_name, histogram_weight, histogram))
+      return histogram;
+    PhaseReport::add_jitted_expressions();
+    if (samples[sample_idx]->weighted_sample)
+      return data_frame.Histo1D(model,axis.variable_name,samples[sample_idx]->weight_column);
+    return data_frame.Histo1D(model,axis.variable_name);
+  }
+  ROOT::RDF::RNode bounded_data_frame = define_converted_column<double>(data_frame, "bounded_value_"+axis.variable_name,
+      axis.variable_name, value_type, "double");
+  bounded_data_frame = define_weight_column(bounded_data_frame, "bounded_weight", histogram_weight, weight_type);
+  return bounded_data_frame.Book<double, double>(BoundedHistogram1DHelper(model_histogram, storage, precision, num_slots),
+    {"bounded_value_"+axis.variable_name, "bounded_weight"});
+}
+
+ROOT::RDF::RResultPtr<TH2D> SampleCollection::book_2d_result(ROOT::RDF::RNode data_frame, ROOT::RDF::TH2DModel model, VariableAxis x_axis, VariableAxis y_axis, unsigned int sample_idx) {
+  samples[sample_idx]->add_booked_result();
+  unsigned int num_slots = data_frame.GetNSlots();
+  std::shared_ptr<TH2D> model_histogram = model.GetHistogram();
+  unsigned long num_cells = static_cast<unsigned long>(model_histogram->GetNcells());
+  HistogramStorage storage = (num_cells >= bounded_min_cells) ? histogram_storage : HistogramStorage::per_slot;
+  BinPrecision precision = (samples[sample_idx]->weighted_sample && bin_precision == BinPrecision::integer_counts) ? BinPrecision::double_precision : bin_precision;
+  add_projected_memory(storage_name(storage), BoundedBinStorage::projected_bytes(storage, precision, num_cells, num_slots));
+  std::string histogram_weight = samples[sample_idx]->weighted_sample ? samples[sample_idx]->weight_column : "";
+  ColumnType x_type = get_column_type(data_frame, x_axis.variable_name, x_axis.value_type);
+  ColumnType y_type = get_column_type(data_frame, y_axis.variable_name, y_axis.value_type);
+  ColumnType weight_type = get_column_type(data_frame, histogram_weight, x_axis.weight_type);
+  if (storage == HistogramStorage::per_slot) {
+    ROOT::RDF::RResultPtr<TH2D> histogram;
+    ROOT::RDF::RNode typed_data_frame = data_frame;
+    bool typed_weight = (histogram_weight == "" || weight_type == ColumnType::float_value || weight_type == ColumnType::double_value);
+    if (typed_weight && define_double_column(typed_data_frame, "typed_x_"+x_axis.variable_name, x_axis.variable_name, x_type)
+        && define_double_column(typed_data_frame, "typed_y_"+y_axis.variable_name, y_axis.variable_name, y_type)) {
+      if (histogram_weight == "")
+        return typed_data_frame.Histo2D<double, double>(model, "typed_x_"+x_axis.variable_name, "typed_y_"+y_axis.variable_name);
+      if (weight_type == ColumnType::float_value)
+        return typed_data_frame.Histo2D<double, double, float>(model, "typed_x_"+x_axis.variable_name, "typed_y_"+y_axis.variable_name, histogram_weight);
+      return typed_data_frame.Histo2D<double, double, double>(model, "typed_x_"+x_axis.variable_name, "typed_y_"+y_axis.variable_name, histogram_weight);
+    }
+    if (expression_cache != nullptr && expression_cache->histo_2d(data_frame, model, x_axis.variable_name,
+        y_axis.variable_name, histogram_weight, histogram))
+      return histogram;
+    PhaseReport::add_jitted_expressions();
+    if (samples[sample_idx]->weighted_sample)
+      return data_frame.Histo2D(model,x_axis.variable_name,y_axis.variable_name,samples[sample_idx]->weight_column);
+    return data_frame.Histo2D(model,x_axis.variable_name,y_axis.variable_name);
+  }
+  ROOT::RDF::RNode bounded_data_frame = define_converted_column<double>(data_frame, "bounded_x_"+x_axis.variable_name,
+      x_axis.variable_name, x_type, "double");
+  bounded_data_frame = define_converted_column<double>(bounded_data_frame, "bounded_y_"+y_axis.variable_name,
+      y_axis.variable_name, y_type, "double");
+  bounded_data_frame = define_weight_column(bounded_data_frame, "bounded_weight", histogram_weight, weight_type);
+  return bounded_data_frame.Book<double, double, double>(BoundedHistogram2DHelper(model_histogram, storage, precision, num_slots),
+    {"bounded_x_"+x_axis.variable_name, "bounded_y_"+y_axis.variable_name, "bounded_weight"});
+}
+
+/**
+ * internal functions to book per-sample histograms of each region in the merged event loop, see MergedSampleLoop
+ * samples with cached histograms are skipped; if numerator_cut is not empty, it is applied to all samples
+ */
+std::vector<ROOT::RDF::RResultPtr<SampleHistograms>> SampleCollection::book_merged_1d_results(VariableAxis axis, RegionCollection* regions, std::vector<std::vector<std::shared_ptr<TH1D>>> cached_histograms, std::string numerator_cut) {
+  std::vector<ROOT::RDF::RResultPtr<SampleHistograms>> merged_results;
+  unsigned int num_regions = (regions != nullptr) ? regions->size() : 1;
+  std::string value_column = "merged_value_"+axis.variable_name;
+  for (unsigned int region_idx = 0; region_idx < num_regions; region_idx++) {
+    std::vector<std::shared_ptr<TH1D>> models;
+    std::vector<std::string> sample_cuts;
+    unsigned long num_booked_cells = 0;
+    for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
+      sample_cuts.push_back(regions != nullptr ? regions->get_cuts(region_idx, samples[sample_idx]) : "");
+      if (cached_histograms[sample_idx][region_idx]) {
+        models.push_back(nullptr);
+        continue;
+      }
+      models.push_back(get_1d_histogram_model(axis,sample_idx,regions,region_idx).GetHistogram());
+      num_booked_cells += static_cast<unsigned long>(models.back()->GetNcells());
+    }
+    if (num_booked_cells == 0) {
+      merged_results.push_back(ROOT::RDF::RResultPtr<SampleHistograms>());
+      continue;
+    }
+    ROOT::RDF::RNode region_data_frame = merged_loop->get_selected_data_frame(sample_cuts);
+    if (numerator_cut != "")
+      region_data_frame = PhaseReport::jitted_filter(region_data_frame, numerator_cut);
+    unsigned int num_slots = region_data_frame.GetNSlots();
+    add_projected_memory("merged_loop", 2*sizeof(double)*num_booked_cells*(num_slots+1));
+    merged_results.push_back(define_converted_column<double>(region_data_frame, value_column, axis.variable_name, axis.value_type, "double")
+      .Book<double, double, unsigned int>(SampleHistogram1DHelper(models, num_slots), {value_column, merged_loop->get_weight_column(), "sample_idx"}));
+  }
+  return merged_results;
+}
+
+std::vector<ROOT::RDF::RResultPtr<SampleHistograms>> SampleCollection::book_merged_2d_results(VariableAxis x_axis, VariableAxis y_axis, RegionCollection* regions, std::vector<std::vector<std::shared_ptr<TH2D>>> cached_histograms, std::string numerator_cut) {
+  std::vector<ROOT::RDF::RResultPtr<SampleHistograms>> merged_results;
+  unsigned int num_regions = (regions != nullptr) ? regions->size() : 1;
+  std::string x_value_column = "merged_x_"+x_axis.variable_name;
+  std::string y_value_column = "merged_y_"+y_axis.variable_name;
+  for (unsigned int region_idx = 0; region_idx < num_regions; region_idx++) {
+    std::vector<std::shared_ptr<TH2D>> models;
+    std::vector<std::string> sample_cuts;
+    unsigned long num_booked_cells = 0;
+    for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
+      sample_cuts.push_back(regions != nullptr ? regions->get_cuts(region_idx, samples[sample_idx]) : "");
+      if (cached_histograms[sample_idx][region_idx]) {
+        models.push_back(nullptr);
+        continue;
+      }
+      models.push_back(get_2d_histogram_model(x_axis,y_axis,sample_idx,regions,region_idx).GetHistogram());
+      num_booked_cells += static_cast<unsigned long>(models.back()->GetNcells());
+    }
+    if (num_booked_cells == 0) {
+      merged_results.push_back(ROOT::RDF::RResultPtr<SampleHistograms>());
+      continue;
+    }
+    ROOT::RDF::RNode region_data_frame = merged_loop->get_selected_data_frame(sample_cuts);
+    if (numerator_cut != "")
+      region_data_frame = PhaseReport::jitted_filter(region_data_frame, numerator_cut);
+    unsigned int num_slots = region_data_frame.GetNSlots();
+    add_projected_memory("merged_loop", 2*sizeof(double)*num_booked_cells*(num_slots+1));
+    region_data_frame = define_converted_column<double>(region_data_frame, x_value_column, x_axis.variable_name, x_axis.value_type, "double");
+    region_data_frame = define_converted_column<double>(region_data_frame, y_value_column, y_axis.variable_name, y_axis.value_type, "double");
+    merged_results.push_back(region_data_frame
+      .Book<double, double, double, unsigned int>(SampleHistogram2DHelper(models, num_slots),
+        {x_value_column, y_value_column, merged_loop->get_weight_column(), "sample_idx"}));
+  }
+  return merged_results;
+}
+
+/**
+ * method to set how subsequently booked 1d/2d histograms are stored while filling, see HistogramStorage
+ */
+SampleCollection* SampleCollection::set_histogram_storage(HistogramStorage i_histogram_storage, BinPrecision i_bin_precision, unsigned long min_cells) {
+  if (merged_loop && i_histogram_storage != HistogramStorage::per_slot) {
+    std::cout << "ERROR: only per-slot histogram storage is supported with a merged event loop" << std::endl;
+    return this;
+  }
+  histogram_storage = i_histogram_storage;
+  bin_precision = i_bin_precision;
+  bounded_min_cells = min_cells;
+  return this;
+}
+
+/**
+ * method to set a limit (in MB) on projected histogram memory, a warning is printed when a booking exceeds it
+ */
+SampleCollection* SampleCollection::set_histogram_memory_limit(double limit_mb) {
+  histogram_memory_limit = limit_mb;
+  return this;
+}
+
+/**
+ * internal function to add projected memory of a booked histogram under category (ex. storage mode)
+ */
+void SampleCollection::add_projected_memory(std::string category, unsigned long bytes) {
+  double previous_memory = get_projected_histogram_memory();
+  projected_histogram_bytes[category] += bytes;
+  if (histogram_memory_limit > 0 && previous_memory <= histogram_memory_limit && get_projected_histogram_memory() > histogram_memory_limit) {
+    std::cout << "WARNING: projected histogram memory " << get_projected_histogram_memory() << " MB exceeds limit of "
+        << histogram_memory_limit << " MB, consider set_histogram_storage" << std::endl;
+  }
+}
+
+/**
+ * returns projected histogram memory of all bookings so far in MB
+ */
+double SampleCollection::get_projected_histogram_memory() {
+  unsigned long total_bytes = 0;
+  for (std::pair<const std::string, unsigned long> category_bytes : projected_histogram_bytes)
+    total_bytes += category_bytes.second;
+  return static_cast<double>(total_bytes)/1024./1024.;
+}
+
+/**
+ * method to print projected histogram memory of all bookings so far, by storage mode
+ */
+SampleCollection* SampleCollection::print_histogram_memory() {
+  std::cout << "Projected histogram memory:" << std::endl;
+  for (std::pair<const std::string, unsigned long> category_bytes : projected_histogram_bytes)
+    std::cout << "  " << category_bytes.first << ": " << static_cast<double>(category_bytes.second)/1024./1024. << " MB" << std::endl;
+  std::cout << "  total: " << get_projected_histogram_memory() << " MB" << std::endl;
   return this;
 }
 
@@ -151,42 +1081,480 @@ ROOT::RDF::TH1DModel SampleCollection::get_1d_histogram_model(VariableAxis axis,
   return ROOT::RDF::TH1DModel(hist_name.c_str(),hist_description.c_str(),axis.nbins,axis.bins);
 }
 
+/**
+ * method to run the event loops of all samples in num_shards forked local processes and merge their results
+ * should be called after booking and before drawing or printing
+ */
+SampleCollection* SampleCollection::run_shards(unsigned int num_shards, std::string shard_directory) {
+  if (num_shards < 2) return this;
+  if (merged_loop) {
+    std::cout << "ERROR: sharding is not supported with a merged event loop, running in a single process" << std::endl;
+    return this;
+  }
+  const char* shard_index = getenv("SHARD_INDEX");
+  if (shard_index != nullptr) {
+    //separately launched batch job, the merge is done by a later run with SHARD_MERGE_ONLY set
+    run_shard(static_cast<unsigned int>(std::stoul(shard_index)), num_shards, shard_directory);
+    exit(0);
+  }
+  if (getenv("SHARD_MERGE_ONLY") == nullptr) {
+    if (ROOT::IsImplicitMTEnabled()) {
+      std::cout << "ERROR: implicit multithreading must not be enabled before forking shards, running in a single process" << std::endl;
+      return this;
+    }
+    std::vector<pid_t> shard_pids;
+    for (unsigned int shard_idx = 0; shard_idx < num_shards; shard_idx++) {
+      pid_t shard_pid = fork();
+      if (shard_pid == 0) {
+        //skip exit handlers of the parent (ex. open output files) in the forked process
+        try {
+          run_shard(shard_idx, num_shards, shard_directory);
+        }
+        catch (...) {
+          _exit(1);
+        }
+        _exit(0);
+      }
+      if (shard_pid < 0) {
+        std::cout << "ERROR: unable to fork shard " << shard_idx << std::endl;
+        break;
+      }
+      shard_pids.push_back(shard_pid);
+    }
+    bool shards_succeeded = (shard_pids.size() == num_shards);
+    for (pid_t shard_pid : shard_pids) {
+      int shard_status = 0;
+      waitpid(shard_pid, &shard_status, 0);
+      if (!WIFEXITED(shard_status) || WEXITSTATUS(shard_status) != 0)
+        shards_succeeded = false;
+    }
+    if (!shards_succeeded) {
+      std::cout << "ERROR: a shard process failed, results will be computed in a single process" << std::endl;
+      return this;
+    }
+  }
+  return merge_shards(num_shards, shard_directory);
+}
+
+/**
+ * method to run the event loops of shard shard_idx of num_shards and store its results under shard_directory
+ */
+void SampleCollection::run_shard(unsigned int shard_idx, unsigned int num_shards, std::string shard_directory) {
+  mkdir(shard_directory.c_str(), 0755);
+  ResultCache shard_cache(shard_directory+"/shard_"+std::to_string(shard_idx));
+  for (SampleWrapper* sample : samples)
+    sample->set_shard(shard_idx, num_shards);
+  for (SampleWrapper* sample : samples)
+    sample->store_shard_results(&shard_cache);
+  for (PlotCollection* plot_collection : booked_plots)
+    plot_collection->store_shard_results(&shard_cache);
+  for (TableCollection* table_collection : booked_tables)
+    table_collection->store_shard_results(&shard_cache);
+  for (NdHistogramCollection* nd_histogram_collection : booked_nd_histograms)
+    nd_histogram_collection->store_shard_results(&shard_cache);
+}
+
+/**
+ * method to replace booked results with the sum of the results stored by num_shards shards under shard_directory
+ */
+SampleCollection* SampleCollection::merge_shards(unsigned int num_shards, std::string shard_directory) {
+  PhaseScope merge_phase("merge");
+  std::vector<std::unique_ptr<ResultCache>> owned_shard_caches;
+  std::vector<ResultCache*> shard_caches;
+  for (unsigned int shard_idx = 0; shard_idx < num_shards; shard_idx++) {
+    owned_shard_caches.emplace_back(new ResultCache(shard_directory+"/shard_"+std::to_string(shard_idx)));
+    shard_caches.push_back(owned_shard_caches.back().get());
+  }
+  for (SampleWrapper* sample : samples)
+    sample->merge_shard_results(shard_caches);
+  for (PlotCollection* plot_collection : booked_plots)
+    plot_collection->merge_shard_results(shard_caches);
+  for (TableCollection* table_collection : booked_tables)
+    table_collection->merge_shard_results(shard_caches);
+  for (NdHistogramCollection* nd_histogram_collection : booked_nd_histograms)
+    nd_histogram_collection->merge_shard_results(shard_caches);
+  return this;
+}
+
+/**
+ * method to run the event loops of all samples as work units served over TCP on port, merging results as they arrive
+ * should be called after booking and before drawing or printing
+ */
+SampleCollection* SampleCollection::run_distributed(unsigned short port, unsigned int num_local_workers,
+    unsigned long entries_per_unit, std::string work_directory) {
+  if (merged_loop) {
+    std::cout << "ERROR: work distribution is not supported with a merged event loop, running in a single process" << std::endl;
+    return this;
+  }
+  const char* coordinator_address = getenv("COORDINATOR_ADDRESS");
+  if (coordinator_address != nullptr) {
+    std::string address(coordinator_address);
+    size_t port_position = address.rfind(':');
+    if (port_position == std::string::npos) {
+      std::cout << "ERROR: COORDINATOR_ADDRESS should be host:port" << std::endl;
+      exit(1);
+    }
+    run_worker(address.substr(0, port_position),
+        static_cast<unsigned short>(std::stoul(address.substr(port_position+1))), work_directory);
+    exit(0);
+  }
+  std::vector<WorkUnit> units;
+  for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
+    for (std::pair<ULong64_t, ULong64_t> cluster_range : samples[sample_idx]->get_cluster_ranges(entries_per_unit))
+      units.push_back({sample_idx, cluster_range.first, cluster_range.second});
+  }
+  WorkCoordinator coordinator(units, work_directory);
+  std::unique_ptr<Checkpoint> checkpoint;
+  if (checkpoint_directory != "") {
+    checkpoint.reset(new Checkpoint(checkpoint_directory, get_checkpoint_hash(units)));
+    coordinator.set_checkpoint(checkpoint.get(), checkpoint_seconds);
+  }
+  if (coordinator.is_done())
+    num_local_workers = 0;
+  if (num_local_workers > 0 && ROOT::IsImplicitMTEnabled()) {
+    std::cout << "ERROR: implicit multithreading must not be enabled before forking workers, running in a single process" << std::endl;
+    return this;
+  }
+  const char* coordinator_interface = getenv("COORDINATOR_INTERFACE");
+  std::string interface = coordinator_interface != nullptr ? coordinator_interface : "127.0.0.1";
+  const char* coordinator_token = getenv("COORDINATOR_TOKEN");
+  std::string token = coordinator_token != nullptr ? coordinator_token : "";
+  std::string local_host = interface == "0.0.0.0" ? "127.0.0.1" : interface;
+  //local workers retry connecting until the coordinator below is listening
+  std::vector<pid_t> worker_pids;
+  for (unsigned int worker_idx = 0; worker_idx < num_local_workers; worker_idx++) {
+    pid_t worker_pid = fork();
+    if (worker_pid == 0) {
+      try {
+        run_worker(local_host, port, work_directory);
+      }
+      catch (...) {
+        _exit(1);
+      }
+      _exit(0);
+    }
+    if (worker_pid < 0) {
+      std::cout << "ERROR: unable to fork worker " << worker_idx << std::endl;
+      break;
+    }
+    worker_pids.push_back(worker_pid);
+  }
+  bool served = true;
+  {
+    //event loops run in the workers, so serving counts as looping
+    PhaseScope loop_phase("loop");
+    served = coordinator.is_done() || coordinator.serve(port, interface, token);
+    for (pid_t worker_pid : worker_pids) {
+      int worker_status = 0;
+      waitpid(worker_pid, &worker_status, 0);
+    }
+  }
+  if (!served) {
+    std::cout << "ERROR: work distribution failed, results will be computed in a single process" << std::endl;
+    return this;
+  }
+  PhaseScope merge_phase("merge");
+  std::vector<ResultCache*> merged_caches = {coordinator.get_merged_cache()};
+  for (SampleWrapper* sample : samples)
+    sample->merge_shard_results(merged_caches);
+  for (PlotCollection* plot_collection : booked_plots)
+    plot_collection->merge_shard_results(merged_caches);
+  for (TableCollection* table_collection : booked_tables)
+    table_collection->merge_shard_results(merged_caches);
+  for (NdHistogramCollection* nd_histogram_collection : booked_nd_histograms)
+    nd_histogram_collection->merge_shard_results(merged_caches);
+  return this;
+}
+
+/**
+ * internal function returning hash of the graphs, bookings, and work units of all samples, used to name checkpoints
+ */
+std::string SampleCollection::get_checkpoint_hash(std::vector<WorkUnit> units) {
+  std::string description = "";
+  for (SampleWrapper* sample : samples)
+    description += sample->get_graph_description()+"\n";
+  for (PlotCollection* plot_collection : booked_plots) {
+    for (std::string key : plot_collection->get_result_keys())
+      description += "plot:"+key+"\n";
+  }
+  for (TableCollection* table_collection : booked_tables) {
+    for (std::string key : table_collection->get_result_keys())
+      description += "table:"+key+"\n";
+  }
+  for (NdHistogramCollection* nd_histogram_collection : booked_nd_histograms) {
+    for (std::string key : nd_histogram_collection->get_result_keys())
+      description += "nd_histogram:"+key+"\n";
+  }
+  for (WorkUnit unit : units)
+    description += "unit:"+std::to_string(unit.sample_idx)+":"+std::to_string(unit.begin_entry)+":"+std::to_string(unit.end_entry)+"\n";
+  return ResultCache::hash(description);
+}
+
+/**
+ * method to save completed work units and partial results of run_distributed periodically, see run_distributed
+ */
+SampleCollection* SampleCollection::set_checkpoint(std::string i_checkpoint_directory, unsigned int i_checkpoint_seconds) {
+  checkpoint_directory = i_checkpoint_directory;
+  checkpoint_seconds = i_checkpoint_seconds;
+  return this;
+}
+
+/**
+ * method to request and process work units from the coordinator at host:port until it is done
+ */
+void SampleCollection::run_worker(std::string host, unsigned short port, std::string work_directory) {
+  mkdir(work_directory.c_str(), 0755);
+  std::unique_ptr<WorkConnection> connection;
+  //the coordinator may not be listening yet
+  for (unsigned int attempt = 0; attempt < 60 && !connection; attempt++) {
+    connection.reset(WorkConnection::connect_to(host, port));
+    if (!connection) sleep(1);
+  }
+  if (!connection) {
+    std::cout << "ERROR: unable to connect to coordinator " << host << ":" << port << std::endl;
+    return;
+  }
+  const char* coordinator_token = getenv("COORDINATOR_TOKEN");
+  if (!connection->send_line("HELLO "+std::string(coordinator_token != nullptr ? coordinator_token : ""))) {
+    std::cout << "ERROR: unable to authenticate with coordinator " << host << ":" << port << std::endl;
+    return;
+  }
+  std::string message;
+  while (connection->send_line("REQUEST") && connection->receive_line(message)) {
+    if (message == "DONE") break;
+    if (message == "WAIT") {
+      sleep(1);
+      continue;
+    }
+    std::istringstream message_stream(message);
+    std::string command;
+    unsigned int unit_idx = 0, unit_sample_idx = 0;
+    ULong64_t begin_entry = 0, end_entry = 0;
+    message_stream >> command >> unit_idx >> unit_sample_idx >> begin_entry >> end_entry;
+    if (command != "UNIT" || unit_sample_idx >= samples.size()) break;
+    //each unit runs in a fresh process since the booked actions of an event loop can only be run once
+    std::string unit_directory = work_directory+"/worker_"+std::to_string(getpid())+"_unit_"+std::to_string(unit_idx);
+    pid_t unit_pid = fork();
+    if (unit_pid == 0) {
+      try {
+        ResultCache unit_cache(unit_directory);
+        //the unit sample only chains the files overlapping the unit, with an entry list if they are partially selected
+        for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
+          if (sample_idx == unit_sample_idx)
+            samples[sample_idx]->set_entry_range(begin_entry, end_entry);
+          else
+            samples[sample_idx]->set_entry_range(0, 0);
+        }
+        samples[unit_sample_idx]->store_shard_results(&unit_cache);
+        for (PlotCollection* plot_collection : booked_plots)
+          plot_collection->store_shard_results(&unit_cache, samples[unit_sample_idx]);
+        for (TableCollection* table_collection : booked_tables)
+          table_collection->store_shard_results(&unit_cache, samples[unit_sample_idx]);
+        for (NdHistogramCollection* nd_histogram_collection : booked_nd_histograms)
+          nd_histogram_collection->store_shard_results(&unit_cache, samples[unit_sample_idx]);
+      }
+      catch (...) {
+        _exit(1);
+      }
+      _exit(0);
+    }
+    int unit_status = 1;
+    if (unit_pid > 0)
+      waitpid(unit_pid, &unit_status, 0);
+    if (unit_pid < 0 || !WIFEXITED(unit_status) || WEXITSTATUS(unit_status) != 0) {
+      std::cout << "ERROR: work unit " << unit_idx << " failed" << std::endl;
+      if (!connection->send_line("FAILED "+std::to_string(unit_idx))) break;
+      continue;
+    }
+    ResultCache unit_cache(unit_directory);
+    std::vector<std::string> unit_keys = unit_cache.list_keys();
+    bool sent = connection->send_line("RESULT "+std::to_string(unit_idx)+" "+std::to_string(unit_keys.size()));
+    for (std::string key : unit_keys) {
+      sent = sent && connection->send_file(unit_cache.get_filename(key), key+".harc");
+      std::remove(unit_cache.get_filename(key).c_str());
+    }
+    rmdir(unit_directory.c_str());
+    if (!sent) break;
+  }
+}
+
 /**
  * method to make 1d histograms of variable with weight weight in each region specified by regions, see RInterface::Histo1D
  */
 PlotCollection* SampleCollection::book_1d_histogram(VariableAxis axis, RegionCollection* regions) {
   std::vector<std::vector<ROOT::RDF::RResultPtr<TH1D>>> histograms;
+  std::vector<std::vector<std::shared_ptr<TH1D>>> cached_histograms;
+  std::vector<std::vector<std::string>> result_keys;
+  unsigned int num_regions = (regions != nullptr) ? regions->size() : 1;
   //loop over samples
   for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
     histograms.push_back(std::vector<ROOT::RDF::RResultPtr<TH1D>>());
-    if (regions != nullptr) {
-      //loop over regions
-      for (unsigned int region_idx = 0; region_idx < regions->size(); region_idx++) {
-        //filter sample to region
-        ROOT::RDF::RInterface<ROOT::Detail::RDF::RJittedFilter, void> region_data_frame = samples[sample_idx]->data_frame().Filter(regions->get_cuts(region_idx, samples[sample_idx]));
-	if (samples[sample_idx]->weighted_sample) {
-          histograms[sample_idx].push_back(region_data_frame.Histo1D(
-            get_1d_histogram_model(axis,sample_idx,regions,region_idx),axis.variable_name,samples[sample_idx]->weight_column));
-        }
-	else {
-          histograms[sample_idx].push_back(region_data_frame.Histo1D(
-            get_1d_histogram_model(axis,sample_idx,regions,region_idx),axis.variable_name));
-	}
-      }  
+    cached_histograms.push_back(std::vector<std::shared_ptr<TH1D>>());
+    result_keys.push_back(std::vector<std::string>());
+    //loop over regions
+    for (unsigned int region_idx = 0; region_idx < num_regions; region_idx++) {
+      std::string result_key = get_result_key(sample_idx, regions, region_idx, "histo1d:"+axis_description(axis));
+      std::shared_ptr<TH1D> cached_histogram;
+      if (result_cache != nullptr)
+        cached_histogram.reset(result_cache->load_1d_histogram(result_key));
+      result_keys[sample_idx].push_back(result_key);
+      cached_histograms[sample_idx].push_back(cached_histogram);
+      if (cached_histogram || merged_loop) {
+        //no action is booked for cached results, so fully cached samples never run their event loop
+        histograms[sample_idx].push_back(ROOT::RDF::RResultPtr<TH1D>());
+        continue;
+      }
+      histograms[sample_idx].push_back(book_1d_result(get_region_data_frame(sample_idx,regions,region_idx),
+        get_1d_histogram_model(axis,sample_idx,regions,region_idx),axis,sample_idx));
+    }
+  }
+  PlotCollection* plot_collection = new PlotCollection(axis, histograms, samples, regions);
+  //keys are set even without a cache so results can be merged from shards
+  plot_collection->set_cached_results(result_cache, cached_histograms, std::vector<std::vector<std::shared_ptr<TH1D>>>(), result_keys, std::vector<std::vector<std::string>>());
+  if (merged_loop)
+    plot_collection->set_merged_results(book_merged_1d_results(axis, regions, cached_histograms));
+  booked_plots.push_back(plot_collection);
+  set_plot_output(plot_collection);
+  return plot_collection;
+}
+
+/**
+ * method to make 1d histograms with several weight variations filled in a single pass, see MultiWeightHistogramHelper
+ */
+PlotCollection* SampleCollection::book_1d_histogram_variations(VariableAxis axis, std::vector<std::string> weight_columns, RegionCollection* regions) {
+  std::vector<std::function<ROOT::RDF::RNode(ROOT::RDF::RNode, std::string)>> weights_definitions;
+  std::vector<std::string> weights_descriptions;
+  std::vector<std::string> variation_names = {"nominal"};
+  for (std::string weight_column : weight_columns)
+    variation_names.push_back(weight_column);
+  for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
+    std::string nominal_weight = samples[sample_idx]->weighted_sample ? samples[sample_idx]->weight_column : "1.0";
+    std::vector<std::string> sample_weights = {nominal_weight};
+    //the description keeps the form of the former jitted expression, so cached results stay valid
+    std::string weights_description = "ROOT::RVec<double>{static_cast<double>("+nominal_weight+")";
+    for (std::string weight_column : weight_columns) {
+      sample_weights.push_back(samples[sample_idx]->is_data ? nominal_weight : weight_column);
+      weights_description += ",static_cast<double>("+sample_weights.back()+")";
+    }
+    weights_descriptions.push_back(weights_description+"}");
+    weights_definitions.push_back([sample_weights](ROOT::RDF::RNode node, std::string weights_column) {
+      return define_vector_column<double>(node, weights_column, sample_weights, {}, "double");
+    });
+  }
+  return book_1d_multi_weight_histogram(axis, weights_definitions, weights_descriptions, variation_names, regions);
+}
+
+/**
+ * method to make 1d histograms with weight variations from a vector column of relative weights (ex. LHEPdfWeight)
+ */
+PlotCollection* SampleCollection::book_1d_histogram_vector_variations(VariableAxis axis, std::string weight_vector_column, std::vector<std::string> variation_names, RegionCollection* regions) {
+  std::vector<std::string> weights_expressions;
+  variation_names.insert(variation_names.begin(), "nominal");
+  for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
+    std::string nominal_weight = "static_cast<double>("+(samples[sample_idx]->weighted_sample ? samples[sample_idx]->weight_column : std::string("1.0"))+")";
+    if (samples[sample_idx]->is_data) {
+      weights_expressions.push_back("ROOT::RVec<double>("+std::to_string(variation_names.size())+","+nominal_weight+")");
     }
     else {
-      //no regions
-      if (samples[sample_idx]->weighted_sample) {
-        histograms[sample_idx].push_back(samples[sample_idx]->data_frame().Histo1D(
-          get_1d_histogram_model(axis,sample_idx),axis.variable_name,samples[sample_idx]->weight_column));
+      weights_expressions.push_back("ROOT::VecOps::Concatenate(ROOT::RVec<double>{"+nominal_weight+"},"
+        +nominal_weight+"*ROOT::RVec<double>("+weight_vector_column+".begin(),"+weight_vector_column+".end()))");
+    }
+  }
+  return book_1d_multi_weight_histogram(axis, weights_expressions, variation_names, regions);
+}
+
+/**
+ * method to make 1d histograms with Poisson bootstrap replicas filled in a single pass, see BootstrapWeights
+ */
+PlotCollection* SampleCollection::book_1d_histogram_bootstrap(VariableAxis axis, unsigned int num_replicas, RegionCollection* regions, ULong64_t seed, std::vector<std::string> event_key_columns) {
+  std::vector<std::string> variation_names = {"nominal"};
+  for (unsigned int replica_idx = 1; replica_idx <= num_replicas; replica_idx++)
+    variation_names.push_back("replica_"+std::to_string(replica_idx));
+  std::string key_expression = "ROOT::RVec<ULong64_t>{";
+  for (std::string event_key_column : event_key_columns)
+    key_expression += "static_cast<ULong64_t>("+event_key_column+"),";
+  key_expression += "}";
+  std::string key_column = "bootstrap_key_"+axis.variable_name;
+  std::string nominal_column = "bootstrap_nominal_"+axis.variable_name;
+  std::vector<std::function<ROOT::RDF::RNode(ROOT::RDF::RNode, std::string)>> weights_definitions;
+  std::vector<std::string> weights_descriptions;
+  for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
+    //data is resampled as well, since its statistical uncertainties are what replicas estimate
+    std::string nominal_weight = samples[sample_idx]->weighted_sample ? samples[sample_idx]->weight_column : "1.0";
+    weights_descriptions.push_back("bootstrap:"+std::to_string(num_replicas)+":"+std::to_string(seed)+":"+key_expression+":"+nominal_weight);
+    std::string weight_column = samples[sample_idx]->weighted_sample ? samples[sample_idx]->weight_column : "";
+    weights_definitions.push_back([key_column, event_key_columns, nominal_column, weight_column, num_replicas, seed](ROOT::RDF::RNode node, std::string weights_column) {
+      ROOT::RDF::RNode key_node = define_vector_column<ULong64_t>(node, key_column, event_key_columns, {}, "ULong64_t");
+      return ROOT::RDF::RNode(define_weight_column(key_node, nominal_column, weight_column)
+          .Define(weights_column, BootstrapWeights(num_replicas, seed), {key_column, nominal_column}));
+    });
+  }
+  return book_1d_multi_weight_histogram(axis, weights_definitions, weights_descriptions, variation_names, regions);
+}
+
+/**
+ * internal function to book multi-weight histograms given a jitted expression for the RVec of weights of each sample
+ */
+PlotCollection* SampleCollection::book_1d_multi_weight_histogram(VariableAxis axis, std::vector<std::string> weights_expressions, std::vector<std::string> variation_names, RegionCollection* regions) {
+  std::vector<std::function<ROOT::RDF::RNode(ROOT::RDF::RNode, std::string)>> weights_definitions;
+  for (std::string weights_expression : weights_expressions) {
+    weights_definitions.push_back([weights_expression](ROOT::RDF::RNode node, std::string weights_column) {
+      return PhaseReport::jitted_define(node, weights_column, weights_expression);
+    });
+  }
+  return book_1d_multi_weight_histogram(axis, weights_definitions, weights_expressions, variation_names, regions);
+}
+
+/**
+ * internal function to book multi-weight histograms given a function defining the RVec of weights of each sample
+ */
+PlotCollection* SampleCollection::book_1d_multi_weight_histogram(VariableAxis axis, std::vector<std::function<ROOT::RDF::RNode(ROOT::RDF::RNode, std::string)>> weights_definitions, std::vector<std::string> weights_descriptions, std::vector<std::string> variation_names, RegionCollection* regions) {
+  std::vector<std::vector<ROOT::RDF::RResultPtr<MultiWeightHistogram>>> variation_results;
+  std::vector<std::vector<std::shared_ptr<MultiWeightHistogram>>> cached_variation_results;
+  std::vector<std::vector<std::string>> result_keys;
+  unsigned int num_regions = (regions != nullptr) ? regions->size() : 1;
+  unsigned int num_variations = static_cast<unsigned int>(variation_names.size());
+  std::string value_column = "multi_weight_value_"+axis.variable_name;
+  std::string weights_column = "multi_weight_weights_"+axis.variable_name;
+  std::string variations_description = "";
+  for (std::string variation_name : variation_names)
+    variations_description += ":"+variation_name;
+  //loop over samples
+  for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
+    variation_results.push_back(std::vector<ROOT::RDF::RResultPtr<MultiWeightHistogram>>());
+    cached_variation_results.push_back(std::vector<std::shared_ptr<MultiWeightHistogram>>());
+    result_keys.push_back(std::vector<std::string>());
+    //loop over regions
+    for (unsigned int region_idx = 0; region_idx < num_regions; region_idx++) {
+      std::string result_key = get_result_key(sample_idx, regions, region_idx, "multi_weight:"+axis_description(axis)
+          +"|weights:"+weights_descriptions[sample_idx]+"|variations"+variations_description);
+      std::shared_ptr<MultiWeightHistogram> cached_result;
+      std::vector<double> cached_values;
+      if (result_cache != nullptr && result_cache->load_values(result_key, cached_values)) {
+        cached_result = MultiWeightHistogramHelper(axis, num_variations, 0).GetResultPtr();
+        if (!cached_result->set_values(cached_values)) cached_result = nullptr;
       }
-      else {
-        histograms[sample_idx].push_back(samples[sample_idx]->data_frame().Histo1D(
-          get_1d_histogram_model(axis,sample_idx),axis.variable_name));
+      result_keys[sample_idx].push_back(result_key);
+      cached_variation_results[sample_idx].push_back(cached_result);
+      if (cached_result) {
+        variation_results[sample_idx].push_back(ROOT::RDF::RResultPtr<MultiWeightHistogram>());
+        continue;
       }
+      ROOT::RDF::RNode region_data_frame = weights_definitions[sample_idx](define_converted_column<double>(
+        get_region_data_frame(sample_idx,regions,region_idx), value_column, axis.variable_name, axis.value_type, "double"), weights_column);
+      MultiWeightHistogramHelper helper(axis, num_variations, region_data_frame.GetNSlots());
+      add_projected_memory("multi_weight", 2*sizeof(double)*variation_names.size()*static_cast<unsigned long>(axis.nbins+2)*(region_data_frame.GetNSlots()+1));
+      variation_results[sample_idx].push_back(region_data_frame.Book<double, ROOT::RVec<double>>(
+        std::move(helper), {value_column, weights_column}));
+      samples[sample_idx]->add_booked_result();
     }
   }
-  return new PlotCollection(axis, histograms, samples, regions);
+  PlotCollection* plot_collection = new PlotCollection(axis, variation_results, variation_names, samples, regions);
+  //keys are set even without a cache so results can be merged from shards
+  plot_collection->set_cached_results(result_cache, cached_variation_results, result_keys);
+  booked_plots.push_back(plot_collection);
+  set_plot_output(plot_collection);
+  return plot_collection;
 }
 
 /**
@@ -195,50 +1563,56 @@ PlotCollection* SampleCollection::book_1d_histogram(VariableAxis axis, RegionCol
 PlotCollection* SampleCollection::book_1d_efficiency_plot(VariableAxis axis, std::string numerator_cut, std::string numerator_description, RegionCollection* regions) {
   std::vector<std::vector<ROOT::RDF::RResultPtr<TH1D>>> histograms;
   std::vector<std::vector<ROOT::RDF::RResultPtr<TH1D>>> denominator_histograms;
+  std::vector<std::vector<std::shared_ptr<TH1D>>> cached_histograms;
+  std::vector<std::vector<std::shared_ptr<TH1D>>> cached_denominator_histograms;
+  std::vector<std::vector<std::string>> result_keys;
+  std::vector<std::vector<std::string>> denominator_result_keys;
+  unsigned int num_regions = (regions != nullptr) ? regions->size() : 1;
   //loop over samples
   for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
     histograms.push_back(std::vector<ROOT::RDF::RResultPtr<TH1D>>());
     denominator_histograms.push_back(std::vector<ROOT::RDF::RResultPtr<TH1D>>());
-    if (regions != nullptr) {
-      //loop over regions
-      for (unsigned int region_idx = 0; region_idx < regions->size(); region_idx++) {
-        //filter sample to region
-        ROOT::RDF::RInterface<ROOT::Detail::RDF::RJittedFilter, void> region_data_frame = samples[sample_idx]->data_frame().Filter(regions->get_cuts(region_idx, samples[sample_idx]));
-	if (samples[sample_idx]->weighted_sample) {
-          denominator_histograms[sample_idx].push_back(region_data_frame.Histo1D(
-            get_1d_histogram_model(axis,sample_idx,regions,region_idx),axis.variable_name,samples[sample_idx]->weight_column));
-          region_data_frame = region_data_frame.Filter(numerator_cut);
-          histograms[sample_idx].push_back(region_data_frame.Histo1D(
-            get_1d_histogram_model(axis,sample_idx,regions,region_idx),axis.variable_name,samples[sample_idx]->weight_column));
-	}
-	else {
-          denominator_histograms[sample_idx].push_back(region_data_frame.Histo1D(
-            get_1d_histogram_model(axis,sample_idx,regions,region_idx),axis.variable_name));
-          region_data_frame = region_data_frame.Filter(numerator_cut);
-          histograms[sample_idx].push_back(region_data_frame.Histo1D(
-           get_1d_histogram_model(axis,sample_idx,regions,region_idx),axis.variable_name));
-	}
-      }  
-    }
-    else {
-      //no regions
-      if (samples[sample_idx]->weighted_sample) {
-        denominator_histograms[sample_idx].push_back(samples[sample_idx]->data_frame().Histo1D(
-          get_1d_histogram_model(axis,sample_idx),axis.variable_name,samples[sample_idx]->weight_column));
-        ROOT::RDF::RInterface<ROOT::Detail::RDF::RJittedFilter, void> numerator_data_frame = samples[sample_idx]->data_frame().Filter(numerator_cut);
-        histograms[sample_idx].push_back(numerator_data_frame.Histo1D(
-          get_1d_histogram_model(axis,sample_idx),axis.variable_name,samples[sample_idx]->weight_column));
-      }
-      else {
+    cached_histograms.push_back(std::vector<std::shared_ptr<TH1D>>());
+    cached_denominator_histograms.push_back(std::vector<std::shared_ptr<TH1D>>());
+    result_keys.push_back(std::vector<std::string>());
+    denominator_result_keys.push_back(std::vector<std::string>());
+    //loop over regions
+    for (unsigned int region_idx = 0; region_idx < num_regions; region_idx++) {
+      //denominator is the plain histogram, so it shares cache entries with book_1d_histogram
+      std::string denominator_result_key = get_result_key(sample_idx, regions, region_idx, "histo1d:"+axis_description(axis));
+      std::string result_key = get_result_key(sample_idx, regions, region_idx, "numerator:"+numerator_cut+"|histo1d:"+axis_description(axis));
+      std::shared_ptr<TH1D> cached_histogram, cached_denominator_histogram;
+      if (result_cache != nullptr) {
+        cached_histogram.reset(result_cache->load_1d_histogram(result_key));
+        cached_denominator_histogram.reset(result_cache->load_1d_histogram(denominator_result_key));
       }
-        denominator_histograms[sample_idx].push_back(samples[sample_idx]->data_frame().Histo1D(
-          get_1d_histogram_model(axis,sample_idx),axis.variable_name));
-        ROOT::RDF::RInterface<ROOT::Detail::RDF::RJittedFilter, void> numerator_data_frame = samples[sample_idx]->data_frame().Filter(numerator_cut);
-        histograms[sample_idx].push_back(numerator_data_frame.Histo1D(
-          get_1d_histogram_model(axis,sample_idx),axis.variable_name));
+      result_keys[sample_idx].push_back(result_key);
+      denominator_result_keys[sample_idx].push_back(denominator_result_key);
+      cached_histograms[sample_idx].push_back(cached_histogram);
+      cached_denominator_histograms[sample_idx].push_back(cached_denominator_histogram);
+      //filter sample to region
+      ROOT::RDF::RNode region_data_frame = get_region_data_frame(sample_idx,regions,region_idx);
+      if (cached_denominator_histogram || merged_loop)
+        denominator_histograms[sample_idx].push_back(ROOT::RDF::RResultPtr<TH1D>());
+      else
+        denominator_histograms[sample_idx].push_back(book_1d_result(region_data_frame,
+          get_1d_histogram_model(axis,sample_idx,regions,region_idx),axis,sample_idx));
+      if (cached_histogram || merged_loop)
+        histograms[sample_idx].push_back(ROOT::RDF::RResultPtr<TH1D>());
+      else
+        histograms[sample_idx].push_back(book_1d_result(PhaseReport::jitted_filter(region_data_frame, numerator_cut),
+          get_1d_histogram_model(axis,sample_idx,regions,region_idx),axis,sample_idx));
     }
   }
-  return new PlotCollection(axis, histograms, denominator_histograms, samples, numerator_description, regions);
+  PlotCollection* plot_collection = new PlotCollection(axis, histograms, denominator_histograms, samples, numerator_description, regions);
+  //keys are set even without a cache so results can be merged from shards
+  plot_collection->set_cached_results(result_cache, cached_histograms, cached_denominator_histograms, result_keys, denominator_result_keys);
+  if (merged_loop)
+    plot_collection->set_merged_results(book_merged_1d_results(axis, regions, cached_histograms, numerator_cut),
+      book_merged_1d_results(axis, regions, cached_denominator_histograms));
+  booked_plots.push_back(plot_collection);
+  set_plot_output(plot_collection);
+  return plot_collection;
 }
 
 ///**
@@ -304,37 +1678,104 @@ ROOT::RDF::TH2DModel SampleCollection::get_2d_histogram_model(VariableAxis x_axi
  */
 PlotCollection* SampleCollection::book_2d_histogram(VariableAxis x_axis, VariableAxis y_axis, RegionCollection* regions) {
   std::vector<std::vector<ROOT::RDF::RResultPtr<TH2D>>> histograms;
+  std::vector<std::vector<std::shared_ptr<TH2D>>> cached_histograms;
+  std::vector<std::vector<std::string>> result_keys;
+  unsigned int num_regions = (regions != nullptr) ? regions->size() : 1;
   //loop over samples
   for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
     histograms.push_back(std::vector<ROOT::RDF::RResultPtr<TH2D>>());
-    if (regions != nullptr) {
-      //loop over regions
-      for (unsigned int region_idx = 0; region_idx < regions->size(); region_idx++) {
-        //filter sample to region
-        ROOT::RDF::RInterface<ROOT::Detail::RDF::RJittedFilter, void> region_data_frame = samples[sample_idx]->data_frame().Filter(regions->get_cuts(region_idx, samples[sample_idx]));
-	if (samples[sample_idx]->weighted_sample) {
-          histograms[sample_idx].push_back(region_data_frame.Histo2D(
-            get_2d_histogram_model(x_axis,y_axis,sample_idx,regions,region_idx),x_axis.variable_name,y_axis.variable_name,samples[sample_idx]->weight_column));
-	}
-	else {
-          histograms[sample_idx].push_back(region_data_frame.Histo2D(
-            get_2d_histogram_model(x_axis,y_axis,sample_idx,regions,region_idx),x_axis.variable_name,y_axis.variable_name));
-	}
-      }  
+    cached_histograms.push_back(std::vector<std::shared_ptr<TH2D>>());
+    result_keys.push_back(std::vector<std::string>());
+    //loop over regions
+    for (unsigned int region_idx = 0; region_idx < num_regions; region_idx++) {
+      std::string result_key = get_result_key(sample_idx, regions, region_idx, "histo2d:"+axis_description(x_axis)+"|"+axis_description(y_axis));
+      std::shared_ptr<TH2D> cached_histogram;
+      if (result_cache != nullptr)
+        cached_histogram.reset(result_cache->load_2d_histogram(result_key));
+      result_keys[sample_idx].push_back(result_key);
+      cached_histograms[sample_idx].push_back(cached_histogram);
+      if (cached_histogram || merged_loop) {
+        histograms[sample_idx].push_back(ROOT::RDF::RResultPtr<TH2D>());
+        continue;
+      }
+      histograms[sample_idx].push_back(book_2d_result(get_region_data_frame(sample_idx,regions,region_idx),
+        get_2d_histogram_model(x_axis,y_axis,sample_idx,regions,region_idx),x_axis,y_axis,sample_idx));
     }
-    else {
-      //no regions
-      if (samples[sample_idx]->weighted_sample) {
-        histograms[sample_idx].push_back(samples[sample_idx]->data_frame().Histo2D(
-          get_2d_histogram_model(x_axis,y_axis,sample_idx),x_axis.variable_name,y_axis.variable_name,samples[sample_idx]->weight_column));
+  }
+  PlotCollection* plot_collection = new PlotCollection(x_axis, y_axis, histograms, samples, regions);
+  //keys are set even without a cache so results can be merged from shards
+  plot_collection->set_cached_results(result_cache, cached_histograms, std::vector<std::vector<std::shared_ptr<TH2D>>>(), result_keys, std::vector<std::vector<std::string>>());
+  if (merged_loop)
+    plot_collection->set_merged_results(book_merged_2d_results(x_axis, y_axis, regions, cached_histograms));
+  booked_plots.push_back(plot_collection);
+  set_plot_output(plot_collection);
+  return plot_collection;
+}
+
+/**
+ * method to make one n-dimensional histogram per sample and region filled with a single bin computation per event
+ */
+NdHistogramCollection* SampleCollection::book_nd_histogram(std::vector<VariableAxis> axes, RegionCollection* regions, unsigned long max_dense_cells) {
+  std::vector<std::vector<ROOT::RDF::RResultPtr<NdHistogram>>> nd_histograms;
+  unsigned int num_regions = (regions != nullptr) ? regions->size() : 1;
+  std::string values_column = "nd_values";
+  std::vector<std::string> value_columns;
+  std::vector<ColumnType> value_types;
+  for (unsigned int axis_idx = 0; axis_idx < axes.size(); axis_idx++) {
+    values_column += "_"+axes[axis_idx].variable_name;
+    value_columns.push_back(axes[axis_idx].variable_name);
+    value_types.push_back(axes[axis_idx].value_type);
+  }
+  std::string weight_column = values_column+"_weight";
+  unsigned long num_cells = 1;
+  std::string axes_description = "";
+  for (VariableAxis axis : axes) {
+    num_cells *= static_cast<unsigned long>(axis.nbins+2);
+    axes_description += "|axis:"+axis_description(axis);
+  }
+  std::vector<std::vector<std::shared_ptr<NdHistogram>>> cached_nd_histograms;
+  std::vector<std::vector<std::string>> result_keys;
+  //loop over samples
+  for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
+    nd_histograms.push_back(std::vector<ROOT::RDF::RResultPtr<NdHistogram>>());
+    cached_nd_histograms.push_back(std::vector<std::shared_ptr<NdHistogram>>());
+    result_keys.push_back(std::vector<std::string>());
+    std::string sample_weight = samples[sample_idx]->weighted_sample ? samples[sample_idx]->weight_column : "";
+    //loop over regions
+    for (unsigned int region_idx = 0; region_idx < num_regions; region_idx++) {
+      //dense and sparse histograms store the same cells, so max_dense_cells is not part of the key
+      std::string result_key = get_result_key(sample_idx, regions, region_idx, "nd_histogram"+axes_description);
+      std::shared_ptr<NdHistogram> cached_nd_histogram;
+      std::vector<double> cached_values;
+      if (result_cache != nullptr && result_cache->load_values(result_key, cached_values)) {
+        cached_nd_histogram = NdHistogramHelper(axes, 0, max_dense_cells).GetResultPtr();
+        if (!cached_nd_histogram->set_cell_values(cached_values)) cached_nd_histogram = nullptr;
       }
-      else {
-        histograms[sample_idx].push_back(samples[sample_idx]->data_frame().Histo2D(
-          get_2d_histogram_model(x_axis,y_axis,sample_idx),x_axis.variable_name,y_axis.variable_name));
+      result_keys[sample_idx].push_back(result_key);
+      cached_nd_histograms[sample_idx].push_back(cached_nd_histogram);
+      if (cached_nd_histogram) {
+        nd_histograms[sample_idx].push_back(ROOT::RDF::RResultPtr<NdHistogram>());
+        continue;
       }
+      ROOT::RDF::RNode region_data_frame = define_weight_column(define_vector_column<double>(get_region_data_frame(sample_idx,regions,region_idx),
+          values_column, value_columns, value_types, "double"), weight_column, sample_weight);
+      NdHistogramHelper helper(axes, region_data_frame.GetNSlots(), max_dense_cells);
+      //sparse histograms grow with the number of filled cells, so only dense storage is projected
+      if (num_cells <= max_dense_cells)
+        add_projected_memory("nd_dense", 2*sizeof(double)*num_cells*(region_data_frame.GetNSlots()+1));
+      nd_histograms[sample_idx].push_back(region_data_frame.Book<ROOT::RVec<double>, double>(
+        std::move(helper), {values_column, weight_column}));
+      samples[sample_idx]->add_booked_result();
     }
   }
-  return new PlotCollection(x_axis, y_axis, histograms, samples, regions);
+  NdHistogramCollection* nd_histogram_collection = new NdHistogramCollection(axes, nd_histograms, samples, regions, max_dense_cells);
+  //keys are set even without a cache so results can be merged from shards
+  nd_histogram_collection->set_cached_results(result_cache, cached_nd_histograms, result_keys);
+  nd_histogram_collection->set_default_output_sink(default_output_sink.get());
+  if (output_sink != nullptr)
+    nd_histogram_collection->set_output_sink(output_sink);
+  booked_nd_histograms.push_back(nd_histogram_collection);
+  return nd_histogram_collection;
 }
 
 /**
@@ -343,51 +1784,57 @@ PlotCollection* SampleCollection::book_2d_histogram(VariableAxis x_axis, Variabl
 PlotCollection* SampleCollection::book_2d_efficiency_plot(VariableAxis x_axis, VariableAxis y_axis, std::string numerator_cut, std::string numerator_description, RegionCollection* regions) {
   std::vector<std::vector<ROOT::RDF::RResultPtr<TH2D>>> histograms;
   std::vector<std::vector<ROOT::RDF::RResultPtr<TH2D>>> denominator_histograms;
+  std::vector<std::vector<std::shared_ptr<TH2D>>> cached_histograms;
+  std::vector<std::vector<std::shared_ptr<TH2D>>> cached_denominator_histograms;
+  std::vector<std::vector<std::string>> result_keys;
+  std::vector<std::vector<std::string>> denominator_result_keys;
+  unsigned int num_regions = (regions != nullptr) ? regions->size() : 1;
   //loop over samples
   for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
     histograms.push_back(std::vector<ROOT::RDF::RResultPtr<TH2D>>());
     denominator_histograms.push_back(std::vector<ROOT::RDF::RResultPtr<TH2D>>());
-    if (regions != nullptr) {
-      //loop over regions
-      for (unsigned int region_idx = 0; region_idx < regions->size(); region_idx++) {
-        //filter sample to region
-        ROOT::RDF::RInterface<ROOT::Detail::RDF::RJittedFilter, void> region_data_frame = samples[sample_idx]->data_frame().Filter(regions->get_cuts(region_idx, samples[sample_idx]));
-	if (samples[sample_idx]->weighted_sample) {
-          denominator_histograms[sample_idx].push_back(region_data_frame.Histo2D(
-            get_2d_histogram_model(x_axis,y_axis,sample_idx,regions,region_idx),x_axis.variable_name,y_axis.variable_name,samples[sample_idx]->weight_column));
-          region_data_frame = region_data_frame.Filter(numerator_cut);
-          histograms[sample_idx].push_back(region_data_frame.Histo2D(
-            get_2d_histogram_model(x_axis,y_axis,sample_idx,regions,region_idx),x_axis.variable_name,y_axis.variable_name,samples[sample_idx]->weight_column));
-	}
-	else {
-          denominator_histograms[sample_idx].push_back(region_data_frame.Histo2D(
-            get_2d_histogram_model(x_axis,y_axis,sample_idx,regions,region_idx),x_axis.variable_name,y_axis.variable_name));
-          region_data_frame = region_data_frame.Filter(numerator_cut);
-          histograms[sample_idx].push_back(region_data_frame.Histo2D(
-            get_2d_histogram_model(x_axis,y_axis,sample_idx,regions,region_idx),x_axis.variable_name,y_axis.variable_name));
-	}
-      }  
-    }
-    else {
-      //no regions
-      if (samples[sample_idx]->weighted_sample) {
-        denominator_histograms[sample_idx].push_back(samples[sample_idx]->data_frame().Histo2D(
-          get_2d_histogram_model(x_axis,y_axis,sample_idx),x_axis.variable_name,y_axis.variable_name,samples[sample_idx]->weight_column));
-        ROOT::RDF::RInterface<ROOT::Detail::RDF::RJittedFilter, void> numerator_data_frame = samples[sample_idx]->data_frame().Filter(numerator_cut);
-        histograms[sample_idx].push_back(numerator_data_frame.Histo2D(
-          get_2d_histogram_model(x_axis,y_axis,sample_idx),x_axis.variable_name,y_axis.variable_name,samples[sample_idx]->weight_column));
-      }
-      else {
-        denominator_histograms[sample_idx].push_back(samples[sample_idx]->data_frame().Histo2D(
-          get_2d_histogram_model(x_axis,y_axis,sample_idx),x_axis.variable_name,y_axis.variable_name));
-        ROOT::RDF::RInterface<ROOT::Detail::RDF::RJittedFilter, void> numerator_data_frame = samples[sample_idx]->data_frame().Filter(numerator_cut);
-        histograms[sample_idx].push_back(numerator_data_frame.Histo2D(
-          get_2d_histogram_model(x_axis,y_axis,sample_idx),x_axis.variable_name,y_axis.variable_name));
+    cached_histograms.push_back(std::vector<std::shared_ptr<TH2D>>());
+    cached_denominator_histograms.push_back(std::vector<std::shared_ptr<TH2D>>());
+    result_keys.push_back(std::vector<std::string>());
+    denominator_result_keys.push_back(std::vector<std::string>());
+    //loop over regions
+    for (unsigned int region_idx = 0; region_idx < num_regions; region_idx++) {
+      std::string axes_description = axis_description(x_axis)+"|"+axis_description(y_axis);
+      std::string denominator_result_key = get_result_key(sample_idx, regions, region_idx, "histo2d:"+axes_description);
+      std::string result_key = get_result_key(sample_idx, regions, region_idx, "numerator:"+numerator_cut+"|histo2d:"+axes_description);
+      std::shared_ptr<TH2D> cached_histogram, cached_denominator_histogram;
+      if (result_cache != nullptr) {
+        cached_histogram.reset(result_cache->load_2d_histogram(result_key));
+        cached_denominator_histogram.reset(result_cache->load_2d_histogram(denominator_result_key));
       }
+      result_keys[sample_idx].push_back(result_key);
+      denominator_result_keys[sample_idx].push_back(denominator_result_key);
+      cached_histograms[sample_idx].push_back(cached_histogram);
+      cached_denominator_histograms[sample_idx].push_back(cached_denominator_histogram);
+      //filter sample to region
+      ROOT::RDF::RNode region_data_frame = get_region_data_frame(sample_idx,regions,region_idx);
+      if (cached_denominator_histogram || merged_loop)
+        denominator_histograms[sample_idx].push_back(ROOT::RDF::RResultPtr<TH2D>());
+      else
+        denominator_histograms[sample_idx].push_back(book_2d_result(region_data_frame,
+          get_2d_histogram_model(x_axis,y_axis,sample_idx,regions,region_idx),x_axis,y_axis,sample_idx));
+      if (cached_histogram || merged_loop)
+        histograms[sample_idx].push_back(ROOT::RDF::RResultPtr<TH2D>());
+      else
+        histograms[sample_idx].push_back(book_2d_result(PhaseReport::jitted_filter(region_data_frame, numerator_cut),
+          get_2d_histogram_model(x_axis,y_axis,sample_idx,regions,region_idx),x_axis,y_axis,sample_idx));
     }
   }
-  return new PlotCollection(x_axis, y_axis, histograms, denominator_histograms, samples, 
+  PlotCollection* plot_collection = new PlotCollection(x_axis, y_axis, histograms, denominator_histograms, samples, 
     numerator_description, regions);
+  //keys are set even without a cache so results can be merged from shards
+  plot_collection->set_cached_results(result_cache, cached_histograms, cached_denominator_histograms, result_keys, denominator_result_keys);
+  if (merged_loop)
+    plot_collection->set_merged_results(book_merged_2d_results(x_axis, y_axis, regions, cached_histograms, numerator_cut),
+      book_merged_2d_results(x_axis, y_axis, regions, cached_denominator_histograms));
+  booked_plots.push_back(plot_collection);
+  set_plot_output(plot_collection);
+  return plot_collection;
 }
 
 ///**
@@ -429,8 +1876,93 @@ PlotCollection* SampleCollection::book_2d_efficiency_plot(VariableAxis x_axis, V
  */
 TableCollection* SampleCollection::book_cutflow_table() {
   std::vector<ROOT::RDF::RResultPtr<ROOT::RDF::RCutFlowReport>> tables;
+  std::vector<std::string> report_keys;
+  std::vector<std::vector<double>> report_values;
   for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
-    tables.push_back(samples[sample_idx]->data_frame().Report());
+    std::string report_key = ResultCache::hash(samples[sample_idx]->get_graph_description()+"|report");
+    std::vector<double> cached_values;
+    report_keys.push_back(report_key);
+    if (result_cache != nullptr && result_cache->load_values(report_key, cached_values)
+        && cached_values.size() == 2*samples[sample_idx]->cuts.size()) {
+      tables.push_back(ROOT::RDF::RResultPtr<ROOT::RDF::RCutFlowReport>());
+      report_values.push_back(cached_values);
+    }
+    else {
+      //samples in a merged event loop use the per-sample counts of its filters instead of a report
+      if (merged_loop)
+        tables.push_back(ROOT::RDF::RResultPtr<ROOT::RDF::RCutFlowReport>());
+      else {
+        tables.push_back(samples[sample_idx]->data_frame().Report());
+        samples[sample_idx]->add_booked_result();
+      }
+      report_values.push_back(std::vector<double>());
+    }
+  }
+  TableCollection* table_collection = new TableCollection(tables, samples);
+  table_collection->set_result_cache(result_cache, report_keys, report_values);
+  booked_tables.push_back(table_collection);
+  return table_collection;
+}
+
+/**
+ * method to make sequential, N-1, and first-failing-cut tables for cuts in every region in a single pass
+ * each cut and region selection is evaluated once per event and packed into bitmasks (at most 64 of each, further
+ * cuts and regions are dropped with an error), see CutMaskHelper; cuts are applied on top of existing filters, and
+ * are not added as filters; cut_descriptions default to the cut expressions
+ */
+TableCollection* SampleCollection::book_cut_mask_table(std::vector<std::string> cuts, std::vector<std::string> cut_descriptions, RegionCollection* regions) {
+  if (cut_descriptions.size() != cuts.size())
+    cut_descriptions = cuts;
+  if (cuts.size() > 64) {
+    std::cout << "ERROR: cut bitmask tables support at most 64 cuts, only the first 64 of " << cuts.size() << " are tabulated" << std::endl;
+    cuts.resize(64);
+    cut_descriptions.resize(64);
+  }
+  if (regions != nullptr && regions->size() > 64) {
+    std::cout << "ERROR: cut bitmask tables support at most 64 regions, only the first 64 of " << regions->size() << " are tabulated" << std::endl;
+    //the table keeps a pointer to its regions, so the truncated collection lives as long as this collection
+    truncated_regions.emplace_back(regions->get_first_regions(64));
+    regions = truncated_regions.back().get();
+  }
+  unsigned int num_regions = (regions != nullptr) ? regions->size() : 0;
+  std::string cut_mask_expression = get_cut_mask_expression(cuts);
+  std::vector<ROOT::RDF::RResultPtr<CutMaskYields>> cut_mask_yields;
+  std::vector<std::string> report_keys;
+  std::vector<std::vector<double>> report_values;
+  std::string cuts_description = "";
+  for (std::string cut : cuts)
+    cuts_description += "|cut:"+cut;
+  for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
+    //region cuts can depend on sample flags
+    std::vector<std::string> region_cuts;
+    std::string regions_description = "";
+    for (unsigned int region_idx = 0; region_idx < num_regions; region_idx++) {
+      region_cuts.push_back(regions->get_cuts(region_idx, samples[sample_idx]));
+      regions_description += "|region:"+region_cuts.back();
+    }
+    std::string weight_expression = samples[sample_idx]->weighted_sample ? "static_cast<double>("+samples[sample_idx]->weight_column+")" : "1.0";
+    std::string report_key = ResultCache::hash(samples[sample_idx]->get_graph_description()+"|selection:"+samples[sample_idx]->selection_string()
+        +"|cut_mask"+cuts_description+regions_description+"|weight:"+weight_expression);
+    std::vector<double> cached_values;
+    report_keys.push_back(report_key);
+    if (result_cache != nullptr && result_cache->load_values(report_key, cached_values)
+        && cached_values.size() == CutMaskYields::num_values(static_cast<unsigned int>(cuts.size()), num_regions)) {
+      cut_mask_yields.push_back(ROOT::RDF::RResultPtr<CutMaskYields>());
+      report_values.push_back(cached_values);
+      continue;
+    }
+    ROOT::RDF::RNode mask_data_frame = PhaseReport::jitted_define(samples[sample_idx]->data_frame(), "cut_mask", cut_mask_expression);
+    mask_data_frame = PhaseReport::jitted_define(mask_data_frame, "cut_mask_regions", get_cut_mask_expression(region_cuts));
+    mask_data_frame = define_weight_column(mask_data_frame, "cut_mask_weight", samples[sample_idx]->weighted_sample ? samples[sample_idx]->weight_column : "");
+    CutMaskHelper helper(static_cast<unsigned int>(cuts.size()), num_regions, mask_data_frame.GetNSlots());
+    cut_mask_yields.push_back(mask_data_frame.Book<ULong64_t, ULong64_t, double>(
+      std::move(helper), {"cut_mask", "cut_mask_regions", "cut_mask_weight"}));
+    samples[sample_idx]->add_booked_result();
+    report_values.push_back(std::vector<double>());
   }
-  return new TableCollection(tables, samples);
+  TableCollection* table_collection = new TableCollection(cut_mask_yields, cut_descriptions, samples, regions);
+  //keys are set even without a cache so results can be merged from shards
+  table_collection->set_result_cache(result_cache, report_keys, report_values);
+  booked_tables.push_back(table_collection);
+  return table_collection;
 }
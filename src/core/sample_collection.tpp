@@ -6,12 +6,25 @@
  */
 template<typename F>
 SampleCollection* SampleCollection::define(const char* name, F expression, const std::vector<std::string> columns, std::vector<std::string> flags) {
+  //compiled functions are identified by type and by the executable they were built into
+  std::string define_description = "define:"+std::string(name)+"=fn:"+std::string(typeid(F).name())+"(";
+  for (std::string column : columns)
+    define_description += column+",";
+  define_description += ")"+ResultCache::executable_identity();
+  if (merged_loop) {
+    //compiled functions cannot be made sample-specific, so they are evaluated for all samples of the merged loop
+    merged_loop->define(name, expression, columns);
+    for (unsigned int sample_idx : get_flagged_samples(flags))
+      samples[sample_idx]->append_graph_description(define_description);
+    return this;
+  }
   if (flags.size() > 0) {
     //if flags provided, define this column only for samples with flag flag
     for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
       for (std::string flag : flags) {
         if (samples[sample_idx]->check_flag(flag)) {
-      	samples[sample_idx]->data_frame() = samples[sample_idx]->data_frame().Define(name, expression, columns);
+      	samples[sample_idx]->define(name, expression, columns);
+          samples[sample_idx]->append_graph_description(define_description);
           break;
         }
       }
@@ -20,7 +33,8 @@ SampleCollection* SampleCollection::define(const char* name, F expression, const
   else {
     //if no flags provided, define for all samples
     for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
-      samples[sample_idx]->data_frame() = samples[sample_idx]->data_frame().Define(name, expression, columns);
+      samples[sample_idx]->define(name, expression, columns);
+      samples[sample_idx]->append_graph_description(define_description);
     }
   }
   return this;
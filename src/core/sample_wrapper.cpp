@@ -1,11 +1,51 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <iostream>
+#include <iomanip>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <sstream>
 #include <string>
 #include <vector>
 
+#include <glob.h>
+#include <sys/stat.h>
+
+#include "TBranch.h"
+#include "TChain.h"
+#include "TEntryList.h"
+#include "TFile.h"
+#include "TLeaf.h"
+#include "TTree.h"
+#include "TROOT.h"
+
 #include "ROOT/RDataFrame.hxx"
 #include "ROOT/RResultPtr.hxx"
 #include "ROOT/RDF/RInterface.hxx"
 
+#include "core/result_cache.hxx"
+#include "core/cut_mask.hxx"
+#include "core/bootstrap_weights.hxx"
 #include "core/sample_wrapper.hxx"
+#include "core/merged_sample_loop.hxx"
+#include "core/column_cache.hxx"
+#include "core/phase_report.hxx"
+#include "core/compiled_expression_cache.hxx"
+#include "core/friend_column_cache.hxx"
+#include "core/dataset_manifest.hxx"
+
+/**
+ * internal function returning a new chain of tree_name in filenames (file names or patterns)
+ */
+static TChain* new_input_chain(const char* tree_name, std::vector<std::string> filenames) {
+  TChain* chain = new TChain(tree_name);
+  for (std::string filename : filenames)
+    chain->Add(filename.c_str());
+  return chain;
+}
 
 /**
  * SampleWrapper constructor
@@ -17,7 +57,9 @@
  * tree_name - name of TTree to read from files
  */
 SampleWrapper::SampleWrapper(std::string i_sample_name, std::vector<std::string> i_sample_filenames, short i_sample_color, std::string i_sample_description, bool i_is_data, const char* tree_name)
-  : sample_data_frame(ROOT::RDataFrame(tree_name,i_sample_filenames).Filter("1"))
+  : input_chain(new_input_chain(tree_name, i_sample_filenames)),
+    sample_data_frame(ROOT::RDataFrame(*input_chain)),
+    entry_data_frame(sample_data_frame)
 {
   sample_name = i_sample_name;
   if (i_sample_description == "")
@@ -32,6 +74,32 @@ SampleWrapper::SampleWrapper(std::string i_sample_name, std::vector<std::string>
   lumi_weight_column = "";
   luminosity = 1.;
   cross_section = 1.;
+  sum_of_weights = -1.;
+  normalized_at_fill = false;
+  result_cache = nullptr;
+  expression_cache = nullptr;
+  total_yield_realized = false;
+  total_yield_value = 0.;
+  sample_tree_name = tree_name;
+  adaptive_filter_order = false;
+  adaptive_warmup_events = 10000;
+  adaptive_cutflow_period = 100;
+  range_begin = 0;
+  range_end = std::numeric_limits<ULong64_t>::max();
+  merged_loop = nullptr;
+  merged_sample_idx = 0;
+  merged_loop_nodes = 0;
+  column_cache_used = false;
+  num_booked_results = 0;
+  friend_directory = "friend_cache";
+  friend_version = "";
+  friend_writers_enabled = std::make_shared<bool>(true);
+  sampled_fraction = 1.;
+  column_cache_source = nullptr;
+  input_files_loaded = false;
+  graph_description = "tree:"+std::string(tree_name);
+  for (std::string sample_filename : sample_filenames)
+    graph_description += "|"+ResultCache::file_identity(sample_filename);
 }
 
 /**
@@ -48,13 +116,29 @@ SampleWrapper* SampleWrapper::add_flag(std::string flag) {
  * full_weight_column_name is the name of the column to use when weighting event; if unspecified, lumi_weight_column_name will be used
  */
 SampleWrapper* SampleWrapper::set_weight_branches(std::string lumi_weight_column_name, std::string full_weight_column_name) {
+  if (normalized_at_fill) {
+    std::cout << "ERROR: weight branches of " << sample_name << " cannot be changed after normalizing at fill time" << std::endl;
+    return this;
+  }
+  apply_pending_filters();
   weighted_sample = true;
   lumi_weight_column = lumi_weight_column_name;
   if (full_weight_column_name=="")
     weight_column = lumi_weight_column_name;
   else
     weight_column = full_weight_column_name;
-  total_yield = sample_data_frame.Sum(lumi_weight_column);
+  total_yield_key = ResultCache::hash(graph_description+"|sum:"+lumi_weight_column);
+  total_yield_realized = false;
+  std::vector<double> cached_values;
+  if (result_cache != nullptr && result_cache->load_values(total_yield_key, cached_values) && cached_values.size() == 1) {
+    //no action is booked, so a fully cached sample never runs its event loop
+    total_yield_realized = true;
+    total_yield_value = cached_values[0];
+  }
+  else if (merged_loop == nullptr) {
+    //samples in a merged event loop get their sums from the loop, see MergedSampleLoop::update_weights
+    total_yield = sum_node(sample_data_frame, lumi_weight_column);
+  }
   return this;
 }
 
@@ -72,8 +156,8 @@ bool SampleWrapper::check_flag(std::string flag) {
  * get scaling weight based on assigned luminosity and cross section
  */
 float SampleWrapper::scale_weight() {
-  if (weighted_sample)
-    return cross_section*luminosity*1000./(*(total_yield));
+  if (weighted_sample && !normalized_at_fill)
+    return cross_section*luminosity*1000./get_total_yield();
   return 1.;
 }
 
@@ -81,6 +165,10 @@ float SampleWrapper::scale_weight() {
  * method for setting cross section of process. Used for rescaling events appropriately for luminosity
  */
 SampleWrapper* SampleWrapper::set_cross_section(float i_cross_section) {
+  if (normalized_at_fill) {
+    std::cout << "ERROR: cross section of " << sample_name << " cannot be changed after normalizing at fill time" << std::endl;
+    return this;
+  }
   cross_section = i_cross_section;
   return this;
 }
@@ -89,23 +177,752 @@ SampleWrapper* SampleWrapper::set_cross_section(float i_cross_section) {
  * method for setting luminosity for rescaling
  */
 SampleWrapper* SampleWrapper::set_luminosity(float i_luminosity) {
+  if (normalized_at_fill) {
+    std::cout << "ERROR: luminosity of " << sample_name << " cannot be changed after normalizing at fill time" << std::endl;
+    return this;
+  }
   luminosity = i_luminosity;
   return this;
 }
 
+/**
+ * method for setting sum of lumi weights from metadata, avoids a pre-pass when normalizing at fill time
+ */
+SampleWrapper* SampleWrapper::set_sum_of_weights(double i_sum_of_weights) {
+  sum_of_weights = i_sum_of_weights;
+  return this;
+}
+
+/**
+ * method for setting sum of lumi weights from a small metadata tree, ex. the NanoAOD Runs tree
+ */
+SampleWrapper* SampleWrapper::set_sum_of_weights_from_tree(std::string metadata_tree_name, std::string sum_of_weights_column) {
+  //metadata trees have one entry per run/file so this is much cheaper than a pass over events
+  ROOT::RDataFrame metadata_data_frame(metadata_tree_name, sample_filenames);
+  sum_of_weights = *(metadata_data_frame.Sum(sum_of_weights_column));
+  return this;
+}
+
+/**
+ * method that folds cross section * luminosity / sum of weights into the weight column so that
+ * histograms and yields booked afterwards are born normalized
+ */
+SampleWrapper* SampleWrapper::normalize_at_fill() {
+  if (is_data || normalized_at_fill) return this;
+  if (merged_loop != nullptr) {
+    std::cout << "ERROR: normalize_at_fill is not supported for samples in a merged event loop, " << sample_name << " is scaled when drawing" << std::endl;
+    return this;
+  }
+  if (!weighted_sample) {
+    std::cout << "ERROR: set_weight_branches must be called before normalize_at_fill for " << sample_name << std::endl;
+    return this;
+  }
+  if (cuts.size() > 0) {
+    std::cout << "ERROR: normalize_at_fill must be called before filtering " << sample_name << std::endl;
+    return this;
+  }
+  if (sum_of_weights < 0) {
+    //pre-pass over the lumi weight column, booked in set_weight_branches
+    if (!total_yield_realized)
+      std::cout << "WARNING: no sum of weights set for " << sample_name << ", running an extra event loop to compute it (see set_sum_of_weights_from_tree)" << std::endl;
+    sum_of_weights = get_total_yield();
+  }
+  double fill_scale = cross_section*luminosity*1000./sum_of_weights;
+  std::ostringstream normalized_weight_expression;
+  normalized_weight_expression << std::setprecision(17) << weight_column << "*" << fill_scale;
+  std::string normalized_weight_column = weight_column+"_normalized";
+  std::string weight_type = sample_data_frame.GetColumnType(weight_column);
+  if (weight_type == "float" || weight_type == "Float_t")
+    define(normalized_weight_column.c_str(), [fill_scale](float weight) { return weight*fill_scale; }, {weight_column});
+  else if (weight_type == "double" || weight_type == "Double_t")
+    define(normalized_weight_column.c_str(), [fill_scale](double weight) { return weight*fill_scale; }, {weight_column});
+  else
+    define(normalized_weight_column.c_str(), normalized_weight_expression.str().c_str());
+  graph_description += "|define:"+normalized_weight_column+"="+normalized_weight_expression.str();
+  weight_column = normalized_weight_column;
+  normalized_at_fill = true;
+  return this;
+}
+
+/**
+ * method for checking if sample weights are normalized at fill time
+ */
+bool SampleWrapper::is_normalized_at_fill() {
+  return normalized_at_fill;
+}
+
+/**
+ * method to define data frame columns, see RInterface::Define
+ */
+SampleWrapper* SampleWrapper::define(const char* name, const char* expression) {
+  if (merged_loop != nullptr) {
+    std::cout << "ERROR: columns of " << sample_name << " should be defined through its merged event loop" << std::endl;
+    return this;
+  }
+  apply_pending_filters();
+  sample_data_frame = define_node(sample_data_frame, name, expression);
+  std::string column_name(name), column_expression(expression);
+  column_definitions[column_name] = "expression:"+column_expression;
+  graph_replay.push_back([this, column_name, column_expression](ROOT::RDF::RNode node) {
+    return define_node(node, column_name, column_expression);
+  });
+  return this;
+}
+
+/**
+ * internal functions applying a string define, filter, or sum to node, compiled if the expression cache has them
+ */
+ROOT::RDF::RNode SampleWrapper::define_node(ROOT::RDF::RNode node, std::string name, std::string expression) {
+  if (expression_cache != nullptr && expression_cache->define(node, name, expression))
+    return node;
+  return PhaseReport::jitted_define(node, name, expression);
+}
+
+ROOT::RDF::RNode SampleWrapper::filter_node(ROOT::RDF::RNode node, std::string expression, std::string filter_name) {
+  if (expression_cache != nullptr && expression_cache->filter(node, expression, filter_name))
+    return node;
+  return PhaseReport::jitted_filter(node, expression, filter_name);
+}
+
+ROOT::RDF::RResultPtr<ROOT::Detail::RDF::SumReturnType_t<double>> SampleWrapper::sum_node(ROOT::RDF::RNode node, std::string column) {
+  ROOT::RDF::RResultPtr<ROOT::Detail::RDF::SumReturnType_t<double>> column_sum;
+  add_booked_result();
+  if (expression_cache != nullptr && expression_cache->sum(node, column, column_sum))
+    return column_sum;
+  PhaseReport::add_jitted_expressions();
+  return node.Sum(column);
+}
+
+/**
+ * returns names of root files of this sample
+ */
+std::vector<std::string> SampleWrapper::get_filenames() {
+  return sample_filenames;
+}
+
+/**
+ * returns name of the tree read from the files of this sample
+ */
+std::string SampleWrapper::get_tree_name() {
+  return sample_tree_name;
+}
+
+/**
+ * returns "name:type" of each branch of the tree of the first input file, from the dataset manifest if one is used
+ */
+std::vector<std::string> SampleWrapper::get_branches() {
+  if (manifest) return manifest->get_branches();
+  //only the first file is opened, adding files with wildcards to a chain does not open them
+  TChain chain(sample_tree_name.c_str());
+  add_input_files(chain);
+  if (chain.GetListOfFiles()->GetEntries() == 0) return std::vector<std::string>();
+  std::string first_filename = chain.GetListOfFiles()->At(0)->GetTitle();
+  std::unique_ptr<TFile> input_file(TFile::Open(first_filename.c_str(), "READ"));
+  if (!input_file || input_file->IsZombie()) return std::vector<std::string>();
+  TTree* tree = input_file->Get<TTree>(sample_tree_name.c_str());
+  if (tree == nullptr) return std::vector<std::string>();
+  std::vector<std::string> branches;
+  TObjArray* branch_list = tree->GetListOfBranches();
+  for (int branch_idx = 0; branch_idx < branch_list->GetEntries(); branch_idx++) {
+    TBranch* branch = static_cast<TBranch*>(branch_list->At(branch_idx));
+    std::string branch_type = "";
+    if (branch->GetListOfLeaves()->GetEntries() > 0)
+      branch_type = static_cast<TLeaf*>(branch->GetListOfLeaves()->At(0))->GetTypeName();
+    branches.push_back(std::string(branch->GetName())+":"+branch_type);
+  }
+  return branches;
+}
+
+/**
+ * returns name of the column used when normalizing weights, see set_weight_branches
+ */
+std::string SampleWrapper::get_lumi_weight_column() {
+  return lumi_weight_column;
+}
+
 /**
  * method for filtering sample
  */
 SampleWrapper* SampleWrapper::filter(std::string expression, std::string filter_description) {
+  if (merged_loop != nullptr) {
+    std::cout << "ERROR: " << sample_name << " should be filtered through its merged event loop" << std::endl;
+    return this;
+  }
   std::string internal_description = filter_description;
   if (internal_description == "") internal_description = expression;
-  sample_data_frame = sample_data_frame.Filter(expression, internal_description);
+  //cut bitmasks are 64 bits wide, so longer runs of adaptive filters are split into batches
+  if (pending_filter_expressions.size() == 64) apply_pending_filters();
+  graph_description += "|filter:"+expression;
   cuts.push_back(internal_description);
-  if (weighted_sample)
-    cut_yields.push_back(sample_data_frame.Sum(weight_column));
+  if (adaptive_filter_order) {
+    pending_filter_expressions.push_back(expression);
+    pending_filter_descriptions.push_back(internal_description);
+    cut_adaptive_batch.push_back(static_cast<int>(adaptive_batch_results.size()));
+    cut_adaptive_index.push_back(static_cast<unsigned int>(pending_filter_expressions.size()-1));
+    if (weighted_sample) {
+      //yields of adaptive cuts come from the batch cutflow, see get_adaptive_cut_yield
+      cut_yield_keys.push_back("");
+      cut_yields.push_back(ROOT::RDF::RResultPtr<ROOT::Detail::RDF::SumReturnType_t<double>>());
+      cut_yields_realized.push_back(false);
+      cut_yield_values.push_back(0.);
+    }
+    return this;
+  }
+  cut_adaptive_batch.push_back(-1);
+  cut_adaptive_index.push_back(0);
+  apply_filter(expression, internal_description);
+  return this;
+}
+
+/**
+ * internal function to apply a filter in declared order and book its cut yield
+ */
+void SampleWrapper::apply_filter(std::string expression, std::string internal_description) {
+  sample_data_frame = filter_node(sample_data_frame, expression, internal_description);
+  graph_replay.push_back([this, expression](ROOT::RDF::RNode node) {
+    return filter_node(node, expression, "");
+  });
+  if (weighted_sample) {
+    std::string cut_yield_key = ResultCache::hash(graph_description+"|sum:"+weight_column);
+    std::vector<double> cached_values;
+    cut_yield_keys.push_back(cut_yield_key);
+    if (result_cache != nullptr && result_cache->load_values(cut_yield_key, cached_values) && cached_values.size() == 1) {
+      cut_yields.push_back(ROOT::RDF::RResultPtr<ROOT::Detail::RDF::SumReturnType_t<double>>());
+      cut_yields_realized.push_back(true);
+      cut_yield_values.push_back(cached_values[0]);
+    }
+    else {
+      cut_yields.push_back(sum_node(sample_data_frame, weight_column));
+      cut_yields_realized.push_back(false);
+      cut_yield_values.push_back(0.);
+    }
+  }
+}
+
+/**
+ * method to let subsequent consecutive filters run in the order minimizing expected cost per event
+ * cost and rejection of each filter are measured on warmup_events events of the first file before the
+ * filters are applied (on the next access to the data frame); cut yields and tables keep declared order
+ * if filters are reordered, the declared-order filters an event skipped are only evaluated for one in
+ * cutflow_period rejected events, so intermediate cut yields are estimates while the total and final yields
+ * stay exact; cutflow_period 1 gives an exact cutflow, which is never cheaper than the declared order
+ */
+SampleWrapper* SampleWrapper::set_adaptive_filter_order(unsigned int warmup_events, unsigned int cutflow_period) {
+  if (merged_loop != nullptr) {
+    std::cout << "ERROR: adaptive filter order is not supported for samples in a merged event loop" << std::endl;
+    return this;
+  }
+  if (cutflow_period == 0) {
+    std::cout << "ERROR: cutflow period of adaptive filter order must be positive" << std::endl;
+    return this;
+  }
+  adaptive_filter_order = true;
+  adaptive_warmup_events = warmup_events;
+  adaptive_cutflow_period = cutflow_period;
+  return this;
+}
+
+/**
+ * internal struct holding warm-up timings of one slot, aligned so slots do not share cache lines
+ */
+struct alignas(64) FilterWarmupTimings {
+  std::chrono::steady_clock::time_point last_time;
+  std::vector<double> seconds;
+  std::vector<double> squared_seconds;
+  std::vector<double> passes;
+};
+
+/**
+ * internal function returning expected cost per event of running filters in order, given their costs and pass fractions
+ * events rejected by a filter are evaluated, for one in cutflow_period of them, on the earlier declared filters that
+ * did not run yet until one fails (see get_rejected_mask_expression); filters are assumed to pass independently
+ */
+static double expected_filter_cost(std::vector<unsigned int> order, std::vector<double> costs, std::vector<double> pass_fractions,
+                                   unsigned int cutflow_period) {
+  double expected_cost = 0.;
+  double reach_fraction = 1.;
+  std::vector<bool> has_run(order.size(), false);
+  for (unsigned int cut_idx : order) {
+    expected_cost += reach_fraction*costs[cut_idx];
+    double recovery_cost = 0.;
+    double recovery_reach = 1.;
+    for (unsigned int missing_idx = 0; missing_idx < cut_idx; missing_idx++) {
+      if (has_run[missing_idx]) continue;
+      recovery_cost += recovery_reach*costs[missing_idx];
+      recovery_reach *= pass_fractions[missing_idx];
+    }
+    expected_cost += reach_fraction*(1.-pass_fractions[cut_idx])*recovery_cost/static_cast<double>(cutflow_period);
+    reach_fraction *= pass_fractions[cut_idx];
+    has_run[cut_idx] = true;
+  }
+  return expected_cost;
+}
+
+/**
+ * internal function returning order (indices into expressions) minimizing expected cost per event
+ * cost and pass fraction of each filter are measured in one loop over warm-up entries of the first file
+ * the declared order is kept unless the expected gain, including the cost of recovering the declared-order
+ * cutflow, exceeds the timing noise
+ */
+std::vector<unsigned int> SampleWrapper::measure_filter_order(std::vector<std::string> expressions) {
+  std::vector<unsigned int> order(expressions.size());
+  std::iota(order.begin(), order.end(), 0u);
+  if (expressions.size() < 2 || adaptive_warmup_events == 0) return order;
+  load_input_files();
+  if (input_filenames.size() == 0 || input_file_entries[0] == 0) return order;
+  //warm-up entries are selected with an entry list, so only their clusters are read, also in multithreaded loops
+  Long64_t warmup_entries = static_cast<Long64_t>(std::min(static_cast<ULong64_t>(adaptive_warmup_events), input_file_entries[0]));
+  TChain warmup_chain(sample_tree_name.c_str());
+  warmup_chain.Add(input_filenames[0].c_str(), static_cast<Long64_t>(input_file_entries[0]));
+  TEntryList warmup_entry_list;
+  warmup_entry_list.SetTree(sample_tree_name.c_str(), input_filenames[0].c_str());
+  warmup_entry_list.EnterRange(0, warmup_entries);
+  warmup_chain.SetEntryList(&warmup_entry_list);
+  //rebuild the graph up to this point on the warm-up entries only
+  ROOT::RDF::RNode warmup_data_frame = ROOT::RDataFrame(warmup_chain);
+  for (std::function<ROOT::RDF::RNode(ROOT::RDF::RNode)> replay : graph_replay)
+    warmup_data_frame = replay(warmup_data_frame);
+  unsigned int num_cuts = static_cast<unsigned int>(expressions.size());
+  FilterWarmupTimings empty_timings;
+  empty_timings.seconds.assign(num_cuts, 0.);
+  empty_timings.squared_seconds.assign(num_cuts, 0.);
+  empty_timings.passes.assign(num_cuts, 0.);
+  std::vector<FilterWarmupTimings> slot_timings(warmup_data_frame.GetNSlots(), empty_timings);
+  //always-passing typed filters run in sequence, so each measures the time to evaluate the pass flag of its filter,
+  //including the lazily evaluated defines it is the first in declared order to read
+  warmup_data_frame = warmup_data_frame.Filter([&slot_timings](unsigned int slot) {
+    slot_timings[slot].last_time = std::chrono::steady_clock::now();
+    return true;
+  }, {"rdfslot_"});
+  for (unsigned int cut_idx = 0; cut_idx < num_cuts; cut_idx++) {
+    std::string pass_column = "adaptive_warmup_pass_"+std::to_string(cut_idx);
+    warmup_data_frame = PhaseReport::jitted_define(warmup_data_frame, pass_column, "static_cast<bool>("+expressions[cut_idx]+")")
+      .Filter([&slot_timings, cut_idx](unsigned int slot, bool pass) {
+        FilterWarmupTimings &timings = slot_timings[slot];
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(now-timings.last_time).count();
+        timings.seconds[cut_idx] += seconds;
+        timings.squared_seconds[cut_idx] += seconds*seconds;
+        if (pass) timings.passes[cut_idx] += 1.;
+        timings.last_time = now;
+        return true;
+      }, {"rdfslot_", pass_column});
+  }
+  double warmup_count = static_cast<double>(*(warmup_data_frame.Count()));
+  if (warmup_count <= 0) return order;
+  std::vector<double> costs(num_cuts, 0.), pass_fractions(num_cuts, 0.), ranks;
+  double squared_noise = 0.;
+  std::cout << "Adaptive filter order warm-up for " << sample_name << " (" << warmup_count << " events):" << std::endl;
+  for (unsigned int cut_idx = 0; cut_idx < num_cuts; cut_idx++) {
+    double seconds = 0., squared_seconds = 0., passes = 0.;
+    for (FilterWarmupTimings &timings : slot_timings) {
+      seconds += timings.seconds[cut_idx];
+      squared_seconds += timings.squared_seconds[cut_idx];
+      passes += timings.passes[cut_idx];
+    }
+    costs[cut_idx] = seconds/warmup_count;
+    pass_fractions[cut_idx] = passes/warmup_count;
+    //variance of the mean cost per event
+    squared_noise += std::max(squared_seconds/warmup_count-costs[cut_idx]*costs[cut_idx], 0.)/warmup_count;
+    //expected cost per event is minimized by running filters in increasing cost per rejected event
+    double rejection = 1.-pass_fractions[cut_idx];
+    ranks.push_back(rejection > 0. ? costs[cut_idx]/rejection : std::numeric_limits<double>::infinity());
+    std::cout << "  " << expressions[cut_idx] << ": " << costs[cut_idx]*1.0e6 << " us/event, pass fraction " << pass_fractions[cut_idx] << std::endl;
+  }
+  std::vector<unsigned int> measured_order = order;
+  std::stable_sort(measured_order.begin(), measured_order.end(), [&ranks](unsigned int first, unsigned int second) {
+    return ranks[first] < ranks[second];
+  });
+  double declared_cost = expected_filter_cost(order, costs, pass_fractions, adaptive_cutflow_period);
+  double measured_cost = expected_filter_cost(measured_order, costs, pass_fractions, adaptive_cutflow_period);
+  if (declared_cost-measured_cost <= 2.*sqrt(squared_noise)) {
+    std::cout << "  gain of " << (declared_cost-measured_cost)*1.0e6 << " us/event is within timing noise, keeping declared order" << std::endl;
+    return order;
+  }
+  return measured_order;
+}
+
+/**
+ * internal function returning jitted expression for the pass mask of an event rejected by the filter at declared index
+ * rejected_idx, given the mask of filters that already passed; earlier declared filters that did not run yet are
+ * evaluated in declared order until one fails, which is enough to find the first failing declared filter
+ */
+static std::string get_rejected_mask_expression(std::vector<std::string> expressions, unsigned int rejected_idx, ULong64_t passed_mask) {
+  std::vector<unsigned int> missing_idx;
+  for (unsigned int cut_idx = 0; cut_idx < rejected_idx; cut_idx++) {
+    if (((passed_mask >> cut_idx) & 1ull) == 0) missing_idx.push_back(cut_idx);
+  }
+  std::vector<ULong64_t> partial_masks = {passed_mask};
+  for (unsigned int cut_idx : missing_idx)
+    partial_masks.push_back(partial_masks.back() | (1ull << cut_idx));
+  std::string expression = std::to_string(partial_masks.back())+"ull";
+  for (unsigned int missing_pos = static_cast<unsigned int>(missing_idx.size()); missing_pos > 0; missing_pos--) {
+    expression = "!("+expressions[missing_idx[missing_pos-1]]+") ? "+std::to_string(partial_masks[missing_pos-1])
+        +"ull : ("+expression+")";
+  }
+  return "static_cast<ULong64_t>("+expression+")";
+}
+
+/**
+ * internal function to apply filters deferred by adaptive ordering, see set_adaptive_filter_order
+ */
+void SampleWrapper::apply_pending_filters() {
+  if (pending_filter_expressions.size() == 0) return;
+  std::vector<std::string> expressions = pending_filter_expressions;
+  std::vector<std::string> descriptions = pending_filter_descriptions;
+  pending_filter_expressions.clear();
+  pending_filter_descriptions.clear();
+  std::vector<unsigned int> order = measure_filter_order(expressions);
+  unsigned int num_cuts = static_cast<unsigned int>(expressions.size());
+  std::string column_prefix = "adaptive_"+std::to_string(adaptive_batch_results.size())+"_";
+  std::string weight_expression = weighted_sample ? "static_cast<double>("+weight_column+")" : "1.0";
+  sample_data_frame = PhaseReport::jitted_define(sample_data_frame, column_prefix+"weight", weight_expression)
+    .Define(column_prefix+"regions", []() { return 0ull; });
+  std::vector<std::string> helper_columns = {column_prefix+"mask", column_prefix+"regions", column_prefix+"weight"};
+  ULong64_t cutflow_period = static_cast<ULong64_t>(adaptive_cutflow_period);
+  std::vector<ROOT::RDF::RResultPtr<CutMaskYields>> batch_results, sampled_results, sampled_totals;
+  ULong64_t passed_mask = 0;
+  for (unsigned int cut_idx : order) {
+    //the pass flag is a define so the filter and its complement share one evaluation per event
+    std::string pass_column = column_prefix+"pass_"+std::to_string(cut_idx);
+    sample_data_frame = PhaseReport::jitted_define(sample_data_frame, pass_column, "static_cast<bool>("+expressions[cut_idx]+")");
+    ROOT::RDF::RNode rejected_node = sample_data_frame.Filter([](bool pass) { return !pass; }, {pass_column});
+    //the totals of rejected events are exact, their first failing filter is cut_idx only if all earlier declared
+    //filters already passed
+    ULong64_t rejected_mask = passed_mask;
+    CutMaskHelper rejected_helper(num_cuts, 0, sample_data_frame.GetNSlots());
+    ROOT::RDF::RResultPtr<CutMaskYields> rejected_result = rejected_node.Define(column_prefix+"mask", [rejected_mask]() { return rejected_mask; })
+      .Book<ULong64_t, ULong64_t, double>(std::move(rejected_helper), helper_columns);
+    if ((passed_mask | ~((1ull << cut_idx)-1ull)) == ~0ull) {
+      batch_results.push_back(rejected_result);
+    }
+    else {
+      //earlier declared filters that did not run yet decide the first failing filter, they are only evaluated on
+      //a reproducible subset of rejected events and the result is scaled to the exact totals
+      CutMaskHelper sampled_helper(num_cuts, 0, sample_data_frame.GetNSlots());
+      ROOT::RDF::RNode sampled_node = rejected_node.Filter([cutflow_period](ULong64_t entry) {
+        return BootstrapWeights::mix(entry)%cutflow_period == 0;
+      }, {"rdfentry_"});
+      sampled_results.push_back(PhaseReport::jitted_define(sampled_node, column_prefix+"mask",
+          get_rejected_mask_expression(expressions, cut_idx, passed_mask))
+        .Book<ULong64_t, ULong64_t, double>(std::move(sampled_helper), helper_columns));
+      sampled_totals.push_back(rejected_result);
+    }
+    sample_data_frame = sample_data_frame.Filter([](bool pass) { return pass; }, {pass_column}, descriptions[cut_idx]);
+    std::string expression = expressions[cut_idx];
+    graph_replay.push_back([expression](ROOT::RDF::RNode node) {
+      return PhaseReport::jitted_filter(node, expression);
+    });
+    passed_mask |= (1ull << cut_idx);
+  }
+  CutMaskHelper passed_helper(num_cuts, 0, sample_data_frame.GetNSlots());
+  batch_results.push_back(sample_data_frame.Define(column_prefix+"mask", [passed_mask]() { return passed_mask; })
+    .Book<ULong64_t, ULong64_t, double>(std::move(passed_helper), helper_columns));
+  adaptive_batch_results.push_back(batch_results);
+  adaptive_batch_sampled_results.push_back(sampled_results);
+  adaptive_batch_sampled_totals.push_back(sampled_totals);
+  add_booked_result();
+  adaptive_batch_yields.push_back(nullptr);
+}
+
+/**
+ * internal function returning merged declared-order cutflow of an adaptive batch of filters
+ * sampled results of events rejected out of declared order are scaled to the exact totals of those events
+ */
+std::shared_ptr<CutMaskYields> SampleWrapper::get_adaptive_batch_yields(unsigned int batch_idx) {
+  if (!adaptive_batch_yields[batch_idx]) {
+    wait_for_event_loop();
+    std::vector<ROOT::RDF::RResultPtr<CutMaskYields>> &batch_results = adaptive_batch_results[batch_idx];
+    adaptive_batch_yields[batch_idx] = std::make_shared<CutMaskYields>(*batch_results[0]);
+    for (unsigned int result_idx = 1; result_idx < batch_results.size(); result_idx++)
+      adaptive_batch_yields[batch_idx]->add(*batch_results[result_idx]);
+    std::vector<ROOT::RDF::RResultPtr<CutMaskYields>> &sampled_results = adaptive_batch_sampled_results[batch_idx];
+    std::vector<ROOT::RDF::RResultPtr<CutMaskYields>> &sampled_totals = adaptive_batch_sampled_totals[batch_idx];
+    for (unsigned int result_idx = 0; result_idx < sampled_results.size(); result_idx++) {
+      const CutMaskYields &sampled = *sampled_results[result_idx];
+      const CutMaskYields &totals = *sampled_totals[result_idx];
+      double sampled_count = sampled.get_total(0, false);
+      //without sampled events, the first failing filter is unknown and the event is counted at the rejecting filter
+      if (sampled_count <= 0.) {
+        adaptive_batch_yields[batch_idx]->add(totals);
+        continue;
+      }
+      double sampled_sumw2 = std::accumulate(sampled.first_failing_sumw2.begin(), sampled.first_failing_sumw2.end(), 0.);
+      double total_sumw2 = std::accumulate(totals.first_failing_sumw2.begin(), totals.first_failing_sumw2.end(), 0.);
+      double sampled_yield = sampled.get_total(0, true);
+      double yield_scale = std::fabs(sampled_yield) > 0. ? totals.get_total(0, true)/sampled_yield : 0.;
+      double sumw2_scale = sampled_sumw2 > 0. ? total_sumw2/sampled_sumw2 : 0.;
+      adaptive_batch_yields[batch_idx]->add_scaled(sampled, yield_scale, sumw2_scale, totals.get_total(0, false)/sampled_count);
+    }
+  }
+  return adaptive_batch_yields[batch_idx];
+}
+
+/**
+ * returns true if cut cut_idx was applied with adaptive ordering
+ */
+bool SampleWrapper::is_adaptive_cut(unsigned int cut_idx) {
+  return cut_idx < cut_adaptive_batch.size() && cut_adaptive_batch[cut_idx] >= 0;
+}
+
+/**
+ * returns declared-order yield (weighted or not) after cut cut_idx, or entering it if before_cut is true
+ * only valid for cuts applied with adaptive ordering
+ */
+double SampleWrapper::get_adaptive_cut_yield(unsigned int cut_idx, bool weighted, bool before_cut) {
+  if (!is_adaptive_cut(cut_idx)) {
+    std::cout << "ERROR: cut " << cut_idx << " of " << sample_name << " was not applied with adaptive ordering" << std::endl;
+    return 0.;
+  }
+  apply_pending_filters();
+  std::shared_ptr<CutMaskYields> batch_yields = get_adaptive_batch_yields(static_cast<unsigned int>(cut_adaptive_batch[cut_idx]));
+  unsigned int batch_cut_idx = cut_adaptive_index[cut_idx];
+  //the inclusive selection has index 0 since batches have no regions
+  if (!before_cut)
+    return batch_yields->get_yield(CutflowView::sequential, 0, batch_cut_idx, weighted);
+  if (batch_cut_idx == 0)
+    return batch_yields->get_total(0, weighted);
+  return batch_yields->get_yield(CutflowView::sequential, 0, batch_cut_idx-1, weighted);
+}
+
+/**
+ * method to read columns from memory-mapped column caches of the input files instead of the ROOT files
+ * must be called before set_weight_branches, define, and filter
+ */
+SampleWrapper* SampleWrapper::use_column_cache(std::vector<std::string> columns, std::string cache_directory, bool compress) {
+  if (graph_replay.size() > 0 || weighted_sample || cuts.size() > 0 || merged_loop != nullptr) {
+    std::cout << "ERROR: column cache of " << sample_name << " must be set before weights, defines, and filters" << std::endl;
+    return this;
+  }
+  mkdir(cache_directory.c_str(), 0755);
+  std::vector<std::string> cache_filenames;
+  for (std::string sample_filename : sample_filenames) {
+    //input files are chained in the same (sorted) order as by TChain
+    glob_t glob_result;
+    std::vector<std::string> matched_filenames;
+    if (glob(sample_filename.c_str(), 0, nullptr, &glob_result) == 0) {
+      for (size_t match_idx = 0; match_idx < glob_result.gl_pathc; match_idx++)
+        matched_filenames.push_back(glob_result.gl_pathv[match_idx]);
+    }
+    globfree(&glob_result);
+    for (std::string matched_filename : matched_filenames) {
+      std::string cache_filename = ColumnCacheWriter::get_cache_filename(cache_directory, matched_filename, sample_tree_name, columns, compress);
+      struct stat file_status;
+      if (stat(cache_filename.c_str(), &file_status) != 0) {
+        std::cout << "Building column cache of " << matched_filename << std::endl;
+        if (!ColumnCacheWriter::build(matched_filename, sample_tree_name, columns, cache_filename, compress)) {
+          std::cout << "ERROR: unable to build column cache, " << sample_name << " is read from its ROOT files" << std::endl;
+          return this;
+        }
+      }
+      cache_filenames.push_back(cache_filename);
+    }
+  }
+  std::unique_ptr<ColumnCacheDataSource> data_source(new ColumnCacheDataSource(cache_filenames));
+  if (cache_filenames.size() == 0 || !data_source->is_open()) {
+    std::cout << "ERROR: unable to read column cache, " << sample_name << " is read from its ROOT files" << std::endl;
+    return this;
+  }
+  //the data frame owns the data source, which lives as long as the data frames of this sample
+  column_cache_source = data_source.get();
+  sample_data_frame = ROOT::RDataFrame(std::move(data_source));
+  entry_data_frame = sample_data_frame;
+  column_cache_used = true;
+  if (range_begin > 0 || range_end < std::numeric_limits<ULong64_t>::max() || sampled_ranges.size() > 0)
+    restrict_input();
+  return this;
+}
+
+/**
+ * returns true if columns are read from column caches, see use_column_cache
+ */
+bool SampleWrapper::uses_column_cache() {
+  return column_cache_used;
+}
+
+/**
+ * method to record that a result was booked on the event loop of this sample rather than loaded from a ResultCache
+ */
+SampleWrapper* SampleWrapper::add_booked_result() {
+  num_booked_results++;
   return this;
 }
 
+/**
+ * returns number of results booked on the event loop of this sample so far
+ */
+unsigned int SampleWrapper::get_num_booked_results() {
+  return num_booked_results;
+}
+
+/**
+ * method to set the future of the event loop of this sample run on a background thread
+ */
+SampleWrapper* SampleWrapper::set_event_loop(std::shared_future<void> i_event_loop) {
+  event_loop = i_event_loop;
+  return this;
+}
+
+/**
+ * method to wait until the event loop set by set_event_loop has finished, rethrowing its exception if it failed
+ */
+void SampleWrapper::wait_for_event_loop() {
+  if (event_loop.valid())
+    event_loop.get();
+}
+
+/**
+ * method to build the chain of input files from a DatasetManifest stored in manifest_directory
+ * must be called before set_weight_branches, define, and filter
+ */
+SampleWrapper* SampleWrapper::use_dataset_manifest(std::string manifest_directory, unsigned int num_threads) {
+  if (graph_replay.size() > 0 || weighted_sample || cuts.size() > 0 || merged_loop != nullptr || column_cache_used) {
+    std::cout << "ERROR: dataset manifest of " << sample_name << " must be set before weights, defines, filters, and column caches" << std::endl;
+    return this;
+  }
+  std::unique_ptr<DatasetManifest> sample_manifest(new DatasetManifest(sample_filenames, sample_tree_name, manifest_directory, num_threads));
+  if (!sample_manifest->is_valid() || sample_manifest->get_filenames().size() == 0) {
+    std::cout << "ERROR: unable to build dataset manifest, " << sample_name << " is read without it" << std::endl;
+    return this;
+  }
+  manifest = std::move(sample_manifest);
+  //patterns are replaced by the matched files, so nothing is globbed again
+  sample_filenames = manifest->get_filenames();
+  input_files_loaded = false;
+  input_chain->Reset();
+  add_input_files(*input_chain);
+  sample_data_frame = ROOT::RDataFrame(*input_chain);
+  entry_data_frame = sample_data_frame;
+  if (range_begin > 0 || range_end < std::numeric_limits<ULong64_t>::max() || sampled_ranges.size() > 0)
+    restrict_input();
+  return this;
+}
+
+/**
+ * internal function adding the input files to chain, with their number of entries if a dataset manifest is used
+ */
+void SampleWrapper::add_input_files(TChain &chain) {
+  if (manifest) {
+    manifest->add_to_chain(chain);
+    return;
+  }
+  for (std::string sample_filename : sample_filenames)
+    chain.Add(sample_filename.c_str());
+}
+
+/**
+ * method to materialize columns defined afterwards with compiled functions as friend trees under cache_directory
+ * columns must be defined before set_weight_branches and filter
+ */
+SampleWrapper* SampleWrapper::cache_defined_columns(std::vector<std::string> columns, std::string version, std::string cache_directory) {
+  mkdir(cache_directory.c_str(), 0755);
+  friend_directory = cache_directory;
+  friend_version = version;
+  friend_columns.insert(friend_columns.end(), columns.begin(), columns.end());
+  return this;
+}
+
+/**
+ * internal function returning true if column_name should be read from or written to friend trees
+ */
+bool SampleWrapper::is_friend_column(std::string column_name) {
+  if (std::find(friend_columns.begin(), friend_columns.end(), column_name) == friend_columns.end())
+    return false;
+  //the data frame is rebuilt when friend trees are attached, so nothing but defines may be booked before
+  if (weighted_sample || cuts.size() > 0 || merged_loop != nullptr || column_cache_used) {
+    std::cout << "ERROR: cached column " << column_name << " of " << sample_name << " must be defined before weights and filters, and is not cached with merged event loops or column caches" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+/**
+ * internal function returning friend file of a column with definition for each input file, and setting
+ * file_entries to the number of entries of each input file
+ */
+std::vector<std::string> SampleWrapper::get_friend_filenames(std::string definition, std::vector<ULong64_t> &file_entries) {
+  std::vector<std::string> friend_filenames;
+  load_input_files();
+  file_entries = input_file_entries;
+  for (std::string input_filename : input_filenames)
+    friend_filenames.push_back(FriendColumnCache::get_filename(friend_directory, input_filename, sample_tree_name, definition));
+  return friend_filenames;
+}
+
+/**
+ * internal function reading column_name from friend_filenames: the data frame is rebuilt on a chain of the input
+ * files with all attached friend trees, and defines and friend writers booked so far are replayed on it
+ */
+void SampleWrapper::attach_friend_column(std::string column_name, std::vector<std::string> friend_filenames) {
+  attached_friends.push_back(std::make_pair(column_name, friend_filenames));
+  //friend files have the entries of their input files, so they are chained without being opened
+  friend_chains.emplace_back(new TChain(FriendColumnCache::get_tree_name(column_name).c_str()));
+  for (unsigned int file_idx = 0; file_idx < friend_filenames.size() && file_idx < input_file_entries.size(); file_idx++)
+    friend_chains.back()->Add(friend_filenames[file_idx].c_str(), static_cast<Long64_t>(input_file_entries[file_idx]));
+  input_chain->AddFriend(friend_chains.back().get());
+  if (range_begin > 0 || range_end < std::numeric_limits<ULong64_t>::max() || sampled_ranges.size() > 0)
+    restrict_input();
+  //the data frame is rebuilt so that the friend columns are found
+  friend_writer_results.clear();
+  sample_data_frame = ROOT::RDataFrame(*input_chain);
+  entry_data_frame = sample_data_frame;
+  for (std::function<ROOT::RDF::RNode(ROOT::RDF::RNode)> replay : graph_replay)
+    sample_data_frame = replay(sample_data_frame);
+  for (std::function<ROOT::RDF::RResultPtr<ULong64_t>(ROOT::RDF::RNode)> booking : friend_writer_bookings)
+    friend_writer_results.push_back(booking(sample_data_frame));
+}
+
+/**
+ * method to process this sample as sample i_merged_sample_idx of a merged event loop, see MergedSampleLoop
+ */
+SampleWrapper* SampleWrapper::set_merged_loop(MergedSampleLoop* i_merged_loop, unsigned int i_merged_sample_idx) {
+  if (cuts.size() > 0) {
+    std::cout << "ERROR: " << sample_name << " must be added to a merged event loop before filtering" << std::endl;
+    return this;
+  }
+  if (column_cache_used) {
+    std::cout << "ERROR: " << sample_name << " reads a column cache, which is not supported in a merged event loop" << std::endl;
+    return this;
+  }
+  merged_loop = i_merged_loop;
+  merged_sample_idx = i_merged_sample_idx;
+  //the per-sample data frame is released, so it never runs its own event loop
+  merged_loop_nodes = merged_loop->get_num_nodes();
+  sample_data_frame = merged_loop->get_sample_data_frame(merged_sample_idx);
+  entry_data_frame = sample_data_frame;
+  return this;
+}
+
+/**
+ * returns true if this sample is processed in a merged event loop
+ */
+bool SampleWrapper::uses_merged_loop() {
+  return merged_loop != nullptr;
+}
+
+/**
+ * method to record filter filter_idx of the merged event loop as a cut of this sample
+ */
+SampleWrapper* SampleWrapper::add_merged_cut(unsigned int filter_idx, std::string expression, std::string filter_description) {
+  graph_description += "|filter:"+expression;
+  cuts.push_back(filter_description == "" ? expression : filter_description);
+  merged_cut_filters.push_back(filter_idx);
+  return this;
+}
+
+/**
+ * returns yield (weighted or not) after cut cut_idx, or entering it if before_cut is true
+ */
+double SampleWrapper::get_merged_cut_yield(unsigned int cut_idx, bool weighted, bool before_cut) {
+  unsigned int filter_idx = merged_cut_filters[cut_idx];
+  if (!before_cut)
+    return merged_loop->get_filter_yield(filter_idx, merged_sample_idx, weighted);
+  //filters of other samples pass all entries of this sample, so the previous filter of the loop gives the input
+  if (filter_idx == 0)
+    return merged_loop->get_entry_yield(merged_sample_idx, weighted);
+  return merged_loop->get_filter_yield(filter_idx-1, merged_sample_idx, weighted);
+}
+
 /**
  * method for getting formatted string of all cuts applied
  */
@@ -120,9 +937,403 @@ std::string SampleWrapper::selection_string() {
   return selection_string;
 }
 
+/**
+ * method to memoize sums of weights and cut yields in a ResultCache
+ * should be called before set_weight_branches and filter for their results to be cached
+ */
+SampleWrapper* SampleWrapper::set_result_cache(ResultCache* i_result_cache) {
+  result_cache = i_result_cache;
+  return this;
+}
+
+/**
+ * method to book string defines, filters, and sums with compiled code from a CompiledExpressionCache
+ */
+SampleWrapper* SampleWrapper::set_expression_cache(CompiledExpressionCache* i_expression_cache) {
+  expression_cache = i_expression_cache;
+  return this;
+}
+
+/**
+ * returns canonical description of everything defined, filtered, and weighted on this sample so far
+ */
+std::string SampleWrapper::get_graph_description() {
+  return graph_description;
+}
+
+/**
+ * method to record a new node (ex. a define) in the graph description
+ */
+SampleWrapper* SampleWrapper::append_graph_description(std::string node_description) {
+  graph_description += "|"+node_description;
+  return this;
+}
+
+/**
+ * returns sum of lumi weights before any cuts, from cache if possible
+ */
+double SampleWrapper::get_total_yield() {
+  if (!total_yield_realized) {
+    if (merged_loop != nullptr)
+      total_yield_value = merged_loop->get_total_yield(merged_sample_idx);
+    else {
+      wait_for_event_loop();
+      total_yield_value = *(total_yield);
+    }
+    total_yield_realized = true;
+    if (result_cache != nullptr)
+      result_cache->store_values(total_yield_key, {total_yield_value});
+  }
+  return total_yield_value/sampled_fraction;
+}
+
+/**
+ * returns weighted yield after cut cut_idx, from cache if possible
+ */
+double SampleWrapper::get_cut_yield(unsigned int cut_idx) {
+  if (merged_loop != nullptr)
+    return get_merged_cut_yield(cut_idx, true);
+  if (is_adaptive_cut(cut_idx))
+    return get_adaptive_cut_yield(cut_idx, true)/sampled_fraction;
+  if (!cut_yields_realized[cut_idx]) {
+    wait_for_event_loop();
+    cut_yield_values[cut_idx] = *(cut_yields[cut_idx]);
+    cut_yields_realized[cut_idx] = true;
+    if (result_cache != nullptr)
+      result_cache->store_values(cut_yield_keys[cut_idx], {cut_yield_values[cut_idx]});
+  }
+  return cut_yield_values[cut_idx]/sampled_fraction;
+}
+
+/**
+ * internal function filling input_filenames and input_file_entries, the matched input files in chain order and
+ * their number of entries; files are opened once unless a dataset manifest is used
+ */
+void SampleWrapper::load_input_files() {
+  if (input_files_loaded) return;
+  input_files_loaded = true;
+  input_filenames.clear();
+  input_file_entries.clear();
+  if (manifest) {
+    input_filenames = manifest->get_filenames();
+    input_file_entries = manifest->get_file_entries();
+    return;
+  }
+  TChain chain(sample_tree_name.c_str());
+  add_input_files(chain);
+  ULong64_t num_entries = static_cast<ULong64_t>(chain.GetEntries());
+  for (int tree_idx = 0; tree_idx < chain.GetNtrees(); tree_idx++) {
+    ULong64_t tree_offset = static_cast<ULong64_t>(chain.GetTreeOffset()[tree_idx]);
+    ULong64_t tree_end = (tree_idx+1 < chain.GetNtrees()) ? static_cast<ULong64_t>(chain.GetTreeOffset()[tree_idx+1]) : num_entries;
+    input_filenames.push_back(chain.GetListOfFiles()->At(tree_idx)->GetTitle());
+    input_file_entries.push_back(tree_end-tree_offset);
+  }
+}
+
+/**
+ * internal function returning sorted [begin, end) ranges of chain entries processed by this process, the
+ * intersection of its entry range and sampled clusters
+ */
+std::vector<std::pair<ULong64_t, ULong64_t>> SampleWrapper::get_selected_ranges() {
+  std::vector<std::pair<ULong64_t, ULong64_t>> selected_ranges;
+  if (sampled_ranges.size() == 0) {
+    if (range_end > range_begin) selected_ranges.push_back(std::make_pair(range_begin, range_end));
+    return selected_ranges;
+  }
+  for (std::pair<ULong64_t, ULong64_t> sampled_range : sampled_ranges) {
+    ULong64_t selected_begin = std::max(range_begin, sampled_range.first);
+    ULong64_t selected_end = std::min(range_end, sampled_range.second);
+    if (selected_end > selected_begin) selected_ranges.push_back(std::make_pair(selected_begin, selected_end));
+  }
+  return selected_ranges;
+}
+
+/**
+ * internal function restricting the input of the data frame to the selected ranges: only input files overlapping
+ * them are chained, with an entry list if files are partially selected, so skipped entries and files are never read
+ */
+void SampleWrapper::restrict_input() {
+  if (merged_loop != nullptr) return;
+  std::vector<std::pair<ULong64_t, ULong64_t>> selected_ranges = get_selected_ranges();
+  //friend trees are aligned with whole input files by global entry, which restricted chains do not provide
+  bool all_selected = selected_ranges.size() == 1 && selected_ranges[0].first == 0;
+  if (column_cache_source != nullptr) {
+    //data source entries keep their global numbers, so only the ranges handed to slots change
+    column_cache_source->set_entry_ranges(selected_ranges);
+    return;
+  }
+  load_input_files();
+  ULong64_t num_entries = std::accumulate(input_file_entries.begin(), input_file_entries.end(), 0ull);
+  all_selected = all_selected && selected_ranges[0].second >= num_entries;
+  if (!all_selected && *friend_writers_enabled && friend_writer_results.size() > 0)
+    std::cout << "WARNING: " << sample_name << " processes part of its entries, friend trees of cached columns are not written" << std::endl;
+  *friend_writers_enabled = all_selected;
+  //the chain keeps its friends and the data frames reading it, only its files and entry list change
+  input_chain->SetEntryList(nullptr);
+  input_entry_list.reset();
+  input_chain->Reset();
+  for (std::unique_ptr<TChain> &friend_chain : friend_chains)
+    friend_chain->Reset();
+  //selected entries of each file, as ranges of local entry numbers
+  std::vector<std::vector<std::pair<Long64_t, Long64_t>>> file_ranges(input_filenames.size());
+  bool partial_files = false;
+  ULong64_t file_begin = 0;
+  for (unsigned int file_idx = 0; file_idx < input_filenames.size(); file_idx++) {
+    ULong64_t file_end = file_begin+input_file_entries[file_idx];
+    ULong64_t file_selected_entries = 0;
+    for (std::pair<ULong64_t, ULong64_t> selected_range : selected_ranges) {
+      ULong64_t overlap_begin = std::max(file_begin, selected_range.first);
+      ULong64_t overlap_end = std::min(file_end, selected_range.second);
+      if (overlap_end <= overlap_begin) continue;
+      file_ranges[file_idx].push_back(std::make_pair(static_cast<Long64_t>(overlap_begin-file_begin), static_cast<Long64_t>(overlap_end-file_begin)));
+      file_selected_entries += overlap_end-overlap_begin;
+    }
+    if (file_selected_entries > 0) {
+      //entries are known, so files are chained without being opened
+      input_chain->Add(input_filenames[file_idx].c_str(), static_cast<Long64_t>(input_file_entries[file_idx]));
+      for (unsigned int friend_idx = 0; friend_idx < friend_chains.size(); friend_idx++)
+        friend_chains[friend_idx]->Add(attached_friends[friend_idx].second[file_idx].c_str(), static_cast<Long64_t>(input_file_entries[file_idx]));
+      if (file_selected_entries < input_file_entries[file_idx]) partial_files = true;
+    }
+    file_begin = file_end;
+  }
+  //without partially selected files, every chained entry is processed and no entry list is built
+  if (!partial_files) return;
+  //a chain with an entry list skips files without a sub-list, so fully selected files get one as well
+  std::unique_ptr<TEntryList> entry_list(new TEntryList());
+  for (unsigned int file_idx = 0; file_idx < input_filenames.size(); file_idx++) {
+    if (file_ranges[file_idx].size() == 0) continue;
+    entry_list->SetTree(sample_tree_name.c_str(), input_filenames[file_idx].c_str());
+    for (std::pair<Long64_t, Long64_t> file_range : file_ranges[file_idx])
+      entry_list->EnterRange(file_range.first, file_range.second);
+  }
+  input_entry_list = std::move(entry_list);
+  input_chain->SetEntryList(input_entry_list.get());
+}
+
+/**
+ * internal function returning number of entries in [begin, end) processed in sampled runs, see set_sampled_fraction
+ */
+ULong64_t SampleWrapper::count_sampled_entries(ULong64_t begin, ULong64_t end) {
+  if (end <= begin) return 0;
+  if (sampled_ranges.size() == 0) return end-begin;
+  ULong64_t num_entries = 0;
+  for (std::pair<ULong64_t, ULong64_t> sampled_range : sampled_ranges) {
+    ULong64_t overlap_begin = std::max(begin, sampled_range.first);
+    ULong64_t overlap_end = std::min(end, sampled_range.second);
+    if (overlap_end > overlap_begin) num_entries += overlap_end-overlap_begin;
+  }
+  return num_entries;
+}
+
+/**
+ * method to restrict the event loop of this process to shard i_shard_idx of i_num_shards contiguous entry ranges
+ * must be called before the event loop runs; only input files overlapping the shard are read, see set_entry_range
+ */
+SampleWrapper* SampleWrapper::set_shard(unsigned int i_shard_idx, unsigned int i_num_shards) {
+  load_input_files();
+  ULong64_t num_entries = std::accumulate(input_file_entries.begin(), input_file_entries.end(), 0ull);
+  //shard k holds entries with floor(entry*num_shards/num_entries) == k
+  return set_entry_range((num_entries*i_shard_idx+i_num_shards-1)/i_num_shards,
+      (num_entries*(i_shard_idx+1)+i_num_shards-1)/i_num_shards);
+}
+
+/**
+ * method to restrict the event loop of this process to entries [i_range_begin, i_range_end) of the chained input files
+ * must be called before the event loop runs
+ */
+SampleWrapper* SampleWrapper::set_entry_range(ULong64_t i_range_begin, ULong64_t i_range_end) {
+  range_begin = i_range_begin;
+  range_end = i_range_end;
+  restrict_input();
+  return this;
+}
+
+/**
+ * method to process only about fraction of the entries of this sample, for quick looks during development
+ * must be called before set_weight_branches and filter
+ */
+SampleWrapper* SampleWrapper::set_sampled_fraction(double fraction) {
+  if (weighted_sample || cuts.size() > 0 || merged_loop != nullptr) {
+    std::cout << "ERROR: sampled fraction of " << sample_name << " must be set before weights and filters, and is not supported with merged event loops" << std::endl;
+    return this;
+  }
+  if (fraction <= 0. || fraction >= 1.) {
+    std::cout << "ERROR: sampled fraction of " << sample_name << " must be between 0 and 1, all entries are processed" << std::endl;
+    return this;
+  }
+  //one range per cluster, so whole clusters are read or skipped
+  std::vector<std::pair<ULong64_t, ULong64_t>> cluster_ranges = get_cluster_ranges(1);
+  if (cluster_ranges.size() == 0) return this;
+  sampled_ranges.clear();
+  ULong64_t num_entries = 0;
+  ULong64_t num_sampled_entries = 0;
+  //clusters are selected at even intervals over the chain from a start derived from the sample name, which is uniform
+  //over names, so each cluster is selected with probability fraction and yields divided by it are unbiased
+  double accumulated_fraction = static_cast<double>(std::stoull(ResultCache::hash(sample_name).substr(0, 8), nullptr, 16))/4294967296.;
+  for (std::pair<ULong64_t, ULong64_t> cluster_range : cluster_ranges) {
+    num_entries += cluster_range.second-cluster_range.first;
+    accumulated_fraction += fraction;
+    if (accumulated_fraction < 1.) continue;
+    accumulated_fraction -= 1.;
+    sampled_ranges.push_back(cluster_range);
+    num_sampled_entries += cluster_range.second-cluster_range.first;
+  }
+  sampled_fraction = fraction;
+  if (sampled_ranges.size() == 0) {
+    //with fewer clusters than 1/fraction, the middle cluster is always read and yields are extrapolated with its entries
+    sampled_ranges.push_back(cluster_ranges[cluster_ranges.size()/2]);
+    num_sampled_entries = sampled_ranges[0].second-sampled_ranges[0].first;
+    sampled_fraction = static_cast<double>(num_sampled_entries)/static_cast<double>(num_entries);
+  }
+  std::ostringstream sampled_description;
+  sampled_description << "sampled:" << fraction;
+  append_graph_description(sampled_description.str());
+  restrict_input();
+  return this;
+}
+
+/**
+ * returns probability with which each cluster is processed, 1 unless set_sampled_fraction was called
+ */
+double SampleWrapper::get_sampled_fraction() {
+  return sampled_fraction;
+}
+
+/**
+ * returns number of entries of the chained input files within the entry range of this process, including entries
+ * skipped by set_sampled_fraction
+ */
+ULong64_t SampleWrapper::get_num_entries() {
+  load_input_files();
+  ULong64_t num_entries = std::min(std::accumulate(input_file_entries.begin(), input_file_entries.end(), 0ull), range_end);
+  return num_entries > range_begin ? num_entries-range_begin : 0;
+}
+
+/**
+ * returns number of entries of each input file processed by this process (within its entry range)
+ */
+std::vector<ULong64_t> SampleWrapper::get_file_entries() {
+  std::vector<ULong64_t> file_entries;
+  load_input_files();
+  ULong64_t tree_offset = 0;
+  for (ULong64_t input_entries : input_file_entries) {
+    ULong64_t tree_end = tree_offset+input_entries;
+    file_entries.push_back(count_sampled_entries(std::max(tree_offset, range_begin), std::min(tree_end, range_end)));
+    tree_offset = tree_end;
+  }
+  return file_entries;
+}
+
+/**
+ * returns data frame of all entries processed by this process, before defines and filters
+ */
+ROOT::RDF::RNode & SampleWrapper::unfiltered_data_frame() {
+  return entry_data_frame;
+}
+
+/**
+ * returns [begin, end) entry ranges covering the chained input files, each within one file, aligned to
+ * cluster boundaries, and holding about entries_per_range entries (at least one cluster)
+ */
+std::vector<std::pair<ULong64_t, ULong64_t>> SampleWrapper::get_cluster_ranges(ULong64_t entries_per_range) {
+  std::vector<std::pair<ULong64_t, ULong64_t>> cluster_ranges;
+  if (manifest) {
+    //clusters are known from the manifest, so no file is opened
+    std::vector<ULong64_t> file_entries = manifest->get_file_entries();
+    ULong64_t tree_offset = 0;
+    for (unsigned int file_idx = 0; file_idx < file_entries.size(); file_idx++) {
+      std::vector<ULong64_t> cluster_starts = manifest->get_cluster_starts(file_idx);
+      ULong64_t range_start = 0;
+      for (unsigned int cluster_idx = 0; cluster_idx < cluster_starts.size(); cluster_idx++) {
+        ULong64_t cluster_end = (cluster_idx+1 < cluster_starts.size()) ? cluster_starts[cluster_idx+1] : file_entries[file_idx];
+        if (cluster_end-range_start >= entries_per_range || cluster_end == file_entries[file_idx]) {
+          cluster_ranges.push_back(std::make_pair(tree_offset+range_start, tree_offset+cluster_end));
+          range_start = cluster_end;
+        }
+      }
+      tree_offset += file_entries[file_idx];
+    }
+    return cluster_ranges;
+  }
+  TChain chain(sample_tree_name.c_str());
+  add_input_files(chain);
+  Long64_t num_entries = chain.GetEntries();
+  for (int tree_idx = 0; tree_idx < chain.GetNtrees(); tree_idx++) {
+    Long64_t tree_offset = chain.GetTreeOffset()[tree_idx];
+    Long64_t tree_end = (tree_idx+1 < chain.GetNtrees()) ? chain.GetTreeOffset()[tree_idx+1] : num_entries;
+    if (tree_end <= tree_offset || chain.LoadTree(tree_offset) < 0) continue;
+    TTree::ClusterIterator cluster_iterator = chain.GetTree()->GetClusterIterator(0);
+    Long64_t range_start = 0;
+    Long64_t cluster_start = 0;
+    while ((cluster_start = cluster_iterator.Next()) < tree_end-tree_offset) {
+      Long64_t cluster_end = std::min(cluster_iterator.GetNextEntry(), tree_end-tree_offset);
+      if (static_cast<ULong64_t>(cluster_end-range_start) >= entries_per_range || cluster_end == tree_end-tree_offset) {
+        cluster_ranges.push_back(std::make_pair(static_cast<ULong64_t>(tree_offset+range_start), static_cast<ULong64_t>(tree_offset+cluster_end)));
+        range_start = cluster_end;
+      }
+      if (cluster_end >= tree_end-tree_offset) break;
+    }
+  }
+  return cluster_ranges;
+}
+
+/**
+ * method to realize booked sums of weights and cut yields and store them in shard_cache, used by shard processes
+ * results already loaded from the result cache are not stored, so they are not counted once per shard
+ */
+void SampleWrapper::store_shard_results(ResultCache* shard_cache) {
+  if (!weighted_sample) return;
+  if (!total_yield_realized)
+    shard_cache->store_values(total_yield_key, {*(total_yield)});
+  for (unsigned int cut_idx = 0; cut_idx < cut_yields.size(); cut_idx++) {
+    //adaptive cuts have no key, their batch cutflow is realized in the merging process
+    if (!cut_yields_realized[cut_idx] && !is_adaptive_cut(cut_idx))
+      shard_cache->store_values(cut_yield_keys[cut_idx], {*(cut_yields[cut_idx])});
+  }
+}
+
+/**
+ * internal function returning sum over shards of the single value stored under key, false if a shard is missing it
+ */
+static bool sum_shard_values(std::vector<ResultCache*> shard_caches, std::string key, double &sum) {
+  sum = 0.;
+  for (ResultCache* shard_cache : shard_caches) {
+    std::vector<double> shard_values;
+    if (!shard_cache->load_values(key, shard_values) || shard_values.size() != 1) return false;
+    sum += shard_values[0];
+  }
+  return true;
+}
+
+/**
+ * method to replace booked sums of weights and cut yields with the sum of the results of all shards
+ */
+void SampleWrapper::merge_shard_results(std::vector<ResultCache*> shard_caches) {
+  if (!weighted_sample) return;
+  if (!total_yield_realized && sum_shard_values(shard_caches, total_yield_key, total_yield_value)) {
+    total_yield_realized = true;
+    if (result_cache != nullptr)
+      result_cache->store_values(total_yield_key, {total_yield_value});
+  }
+  for (unsigned int cut_idx = 0; cut_idx < cut_yields.size(); cut_idx++) {
+    if (cut_yields_realized[cut_idx] || is_adaptive_cut(cut_idx)) continue;
+    if (sum_shard_values(shard_caches, cut_yield_keys[cut_idx], cut_yield_values[cut_idx])) {
+      cut_yields_realized[cut_idx] = true;
+      if (result_cache != nullptr)
+        result_cache->store_values(cut_yield_keys[cut_idx], {cut_yield_values[cut_idx]});
+    }
+  }
+}
+
 /**
  * internal RDataFrame object
  */
-ROOT::RDF::RInterface<ROOT::Detail::RDF::RJittedFilter, void> &SampleWrapper::data_frame() {
+ROOT::RDF::RNode &SampleWrapper::data_frame() {
+  if (merged_loop != nullptr && merged_loop_nodes != merged_loop->get_num_nodes()) {
+    merged_loop_nodes = merged_loop->get_num_nodes();
+    sample_data_frame = merged_loop->get_sample_data_frame(merged_sample_idx);
+  }
+  apply_pending_filters();
   return sample_data_frame;
 }
@@ -0,0 +1,73 @@
+//this gets included directly into sample_wrapper.hxx in order to get general templates
+
+#include <functional>
+#include <type_traits>
+#include <typeinfo>
+
+#include "ROOT/TypeTraits.hxx"
+
+/**
+ * internal trait true for std::function, whose type does not identify the wrapped callable
+ */
+template<typename F>
+struct IsStdFunction : std::false_type {};
+
+template<typename R, typename... Args>
+struct IsStdFunction<std::function<R(Args...)>> : std::true_type {};
+
+/**
+ * method to define data frame columns, see RInterface::Define
+ */
+template<typename F>
+SampleWrapper* SampleWrapper::define(const char* name, F expression, const std::vector<std::string> columns) {
+  using T = typename std::decay<typename ROOT::TypeTraits::CallableTraits<F>::ret_type>::type;
+  apply_pending_filters();
+  std::string column_name(name);
+  //definitions of input columns are included so friend trees are not reused when an upstream define changes
+  std::string definition = column_name+":"+std::string(typeid(F).name())+":"+std::string(typeid(T).name())+"(";
+  for (std::string column : columns) {
+    definition += column;
+    if (column_definitions.count(column) > 0)
+      definition += "{"+column_definitions[column]+"}";
+    definition += ",";
+  }
+  definition += ")";
+  column_definitions[column_name] = definition;
+  bool friend_column = is_friend_column(column_name);
+  //the type of a lambda or functor identifies it, the type of a function pointer only gives its signature
+  if (friend_column && friend_version == "" && (!std::is_class<F>::value || IsStdFunction<F>::value)) {
+    std::cout << "ERROR: cached column " << column_name << " of " << sample_name << " is defined by a function pointer or std::function, which is only cached with a version, see cache_defined_columns" << std::endl;
+    friend_column = false;
+  }
+  //keep a copy of the callable so the graph can be rebuilt on warm-up samples, columns read from friend trees are kept
+  graph_replay.push_back([column_name, expression, columns, friend_column](ROOT::RDF::RNode node) {
+    if (friend_column && node.HasColumn(column_name)) return node;
+    return ROOT::RDF::RNode(node.Define(column_name, expression, columns));
+  });
+  if (!friend_column) {
+    sample_data_frame = sample_data_frame.Define(name, expression, columns);
+    return this;
+  }
+  std::vector<ULong64_t> file_entries;
+  std::vector<std::string> friend_filenames = get_friend_filenames(definition+"|version:"+friend_version, file_entries);
+  if (FriendColumnCache::all_exist(friend_filenames)) {
+    attach_friend_column(column_name, friend_filenames);
+    return this;
+  }
+  sample_data_frame = sample_data_frame.Define(name, expression, columns);
+  //friend trees must hold every entry of their input files, see restrict_input
+  if (!*friend_writers_enabled) {
+    std::cout << "WARNING: " << sample_name << " processes part of its entries, friend trees of " << column_name << " are not written" << std::endl;
+    return this;
+  }
+  //friend trees are written by whichever event loop runs first, the booking is replayed if the data frame is rebuilt
+  //cached columns are defined before any filter (see is_friend_column), so writers see every entry of the input
+  std::shared_ptr<bool> writers_enabled = friend_writers_enabled;
+  friend_writer_bookings.push_back([column_name, friend_filenames, file_entries, writers_enabled](ROOT::RDF::RNode node) {
+    return node.Book<T, ULong64_t>(FriendColumnHelper<T>(column_name, friend_filenames, file_entries, node.GetNSlots(),
+        writers_enabled), {column_name, "rdfentry_"});
+  });
+  friend_writer_results.push_back(friend_writer_bookings.back()(sample_data_frame));
+  add_booked_result();
+  return this;
+}
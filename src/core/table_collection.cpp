@@ -1,5 +1,6 @@
 #include <iostream>
 #include <fstream>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -7,7 +8,11 @@
 #include "ROOT/RDF/InterfaceUtils.hxx"
 #include "ROOT/RDF/RCutFlowReport.hxx"
 
+#include "core/histogram_archive.hxx"
+#include "core/result_cache.hxx"
+#include "core/cut_mask.hxx"
 #include "core/table_collection.hxx"
+#include "core/phase_report.hxx"
 
 /**
  * constructor to generate collection from a vector of vectors
@@ -16,6 +21,111 @@ TableCollection::TableCollection(std::vector<ROOT::RDF::RResultPtr<ROOT::RDF::RC
   cutflows = i_cutflows;
   samples = i_samples;
   luminosity = 1.0;
+  result_cache = nullptr;
+  regions = nullptr;
+  cutflow_view = CutflowView::sequential;
+}
+
+/**
+ * constructor to generate collection from cut bitmask yields, one per sample, see CutMaskHelper
+ * regions may be nullptr, in which case only the inclusive table is made
+ */
+TableCollection::TableCollection(std::vector<ROOT::RDF::RResultPtr<CutMaskYields>> i_cut_mask_yields, std::vector<std::string> i_cut_names, std::vector<SampleWrapper*> i_samples, RegionCollection* i_regions) {
+  cut_mask_yields = i_cut_mask_yields;
+  mask_cut_names = i_cut_names;
+  samples = i_samples;
+  regions = i_regions;
+  luminosity = 1.0;
+  result_cache = nullptr;
+  cutflow_view = CutflowView::sequential;
+}
+
+/**
+ * function to memoize unweighted cutflow reports, report_values[sample] holds (pass, all) per cut if loaded from cache
+ * for bitmask tables, report_values[sample] holds CutMaskYields::get_values if loaded from cache
+ */
+TableCollection* TableCollection::set_result_cache(ResultCache* i_result_cache, std::vector<std::string> i_report_keys, std::vector<std::vector<double>> i_report_values) {
+  result_cache = i_result_cache;
+  report_keys = i_report_keys;
+  report_values = i_report_values;
+  return this;
+}
+
+/**
+ * internal function returning true if the unweighted report of a sample has been realized
+ */
+bool TableCollection::report_realized(unsigned int sample_idx) {
+  return report_values.size() > sample_idx && report_values[sample_idx].size() > 0;
+}
+
+/**
+ * internal function returning true if the report of a sample is booked, false if it was loaded or merged
+ */
+bool TableCollection::report_booked(unsigned int sample_idx) {
+  if (cut_mask_yields.size() > 0) return static_cast<bool>(cut_mask_yields[sample_idx]);
+  return static_cast<bool>(cutflows[sample_idx]);
+}
+
+/**
+ * internal function returning number of values in the report of a sample
+ */
+unsigned int TableCollection::report_size(unsigned int sample_idx) {
+  if (cut_mask_yields.size() > 0)
+    return CutMaskYields::num_values(static_cast<unsigned int>(mask_cut_names.size()), num_mask_regions()-1);
+  return static_cast<unsigned int>(2*samples[sample_idx]->cuts.size());
+}
+
+/**
+ * internal function to realize the unweighted report of a sample as (pass, all) per cut
+ * for bitmask tables, the report holds the values of the cut bitmask yields, see CutMaskYields::get_values
+ */
+void TableCollection::realize_report(unsigned int sample_idx) {
+  if (report_realized(sample_idx)) return;
+  if (report_values.size() < samples.size()) report_values.resize(samples.size());
+  samples[sample_idx]->wait_for_event_loop();
+  if (cut_mask_yields.size() > 0) {
+    report_values[sample_idx] = cut_mask_yields[sample_idx]->get_values();
+    if (result_cache != nullptr && report_keys.size() > sample_idx)
+      result_cache->store_values(report_keys[sample_idx], report_values[sample_idx]);
+    return;
+  }
+  for (unsigned int cut_idx = 0; cut_idx < samples[sample_idx]->cuts.size(); cut_idx++) {
+    if (samples[sample_idx]->uses_merged_loop()) {
+      //the merged loop has no per-sample report, its per-sample filter counts are used instead
+      report_values[sample_idx].push_back(samples[sample_idx]->get_merged_cut_yield(cut_idx, false));
+      report_values[sample_idx].push_back(samples[sample_idx]->get_merged_cut_yield(cut_idx, false, true));
+      continue;
+    }
+    if (samples[sample_idx]->is_adaptive_cut(cut_idx)) {
+      //the report follows execution order, so use the declared-order cutflow of the sample
+      report_values[sample_idx].push_back(samples[sample_idx]->get_adaptive_cut_yield(cut_idx, false));
+      report_values[sample_idx].push_back(samples[sample_idx]->get_adaptive_cut_yield(cut_idx, false, true));
+      continue;
+    }
+    std::string cut_name = samples[sample_idx]->cuts[cut_idx];
+    report_values[sample_idx].push_back(static_cast<double>(cutflows[sample_idx]->At(cut_name).GetPass()));
+    report_values[sample_idx].push_back(static_cast<double>(cutflows[sample_idx]->At(cut_name).GetAll()));
+  }
+  if (result_cache != nullptr && report_keys.size() > sample_idx)
+    result_cache->store_values(report_keys[sample_idx], report_values[sample_idx]);
+}
+
+/**
+ * internal function returning number of unweighted events passing cut cut_idx, extrapolated in sampled runs
+ */
+double TableCollection::cut_pass(unsigned int sample_idx, unsigned int cut_idx) {
+  realize_report(sample_idx);
+  return report_values[sample_idx][2*cut_idx]/samples[sample_idx]->get_sampled_fraction();
+}
+
+/**
+ * internal function returning unweighted efficiency of cut cut_idx
+ */
+double TableCollection::cut_eff(unsigned int sample_idx, unsigned int cut_idx) {
+  realize_report(sample_idx);
+  double cut_all = report_values[sample_idx][2*cut_idx+1];
+  if (cut_all <= 0) return 0.;
+  return report_values[sample_idx][2*cut_idx]/cut_all;
 }
 
 /**
@@ -27,14 +137,165 @@ TableCollection* TableCollection::set_luminosity(float i_luminosity) {
   return this;
 }
 
+/**
+ * function to set view (sequential, N-1, or first failing cut) printed and saved by bitmask tables
+ */
+TableCollection* TableCollection::set_cutflow_view(CutflowView i_cutflow_view) {
+  cutflow_view = i_cutflow_view;
+  return this;
+}
+
+/**
+ * internal function returning number of regions in bitmask tables, including the inclusive selection
+ */
+unsigned int TableCollection::num_mask_regions() {
+  if (regions != nullptr) return regions->size()+1;
+  return 1;
+}
+
+/**
+ * internal function returning description of a region in bitmask tables
+ */
+std::string TableCollection::mask_region_description(unsigned int region_idx) {
+  //the inclusive selection is stored after the regions
+  if (regions == nullptr || region_idx == regions->size()) return "Inclusive";
+  return regions->get_description(region_idx);
+}
+
+/**
+ * internal function returning row names of the current view in bitmask tables
+ */
+std::vector<std::string> TableCollection::mask_row_names() {
+  std::vector<std::string> row_names = mask_cut_names;
+  if (cutflow_view == CutflowView::n_minus_one)
+    row_names.push_back("All cuts");
+  else if (cutflow_view == CutflowView::first_failing)
+    row_names.push_back("Pass all");
+  return row_names;
+}
+
+/**
+ * internal function returning the (booked or loaded) cut bitmask yields of a sample
+ */
+const CutMaskYields& TableCollection::get_cut_mask_yields(unsigned int sample_idx) {
+  if (loaded_cut_mask_yields.size() < samples.size()) loaded_cut_mask_yields.resize(samples.size());
+  if (!loaded_cut_mask_yields[sample_idx]) {
+    //booked yields are realized through the report, so cached, merged, and booked yields are read the same way
+    realize_report(sample_idx);
+    loaded_cut_mask_yields[sample_idx] = CutMaskHelper(static_cast<unsigned int>(mask_cut_names.size()), num_mask_regions()-1, 0).GetResultPtr();
+    loaded_cut_mask_yields[sample_idx]->set_values(report_values[sample_idx]);
+  }
+  return *loaded_cut_mask_yields[sample_idx];
+}
+
+/**
+ * internal function returning (scaled, if MC) yield of row row_idx of the current view in bitmask tables
+ */
+double TableCollection::mask_yield(unsigned int sample_idx, unsigned int region_idx, unsigned int row_idx) {
+  bool weighted = samples[sample_idx]->weighted_sample;
+  double yield = get_cut_mask_yields(sample_idx).get_yield(cutflow_view, region_idx, row_idx, weighted);
+  if (weighted && !samples[sample_idx]->is_data) yield = yield*samples[sample_idx]->scale_weight();
+  return yield/samples[sample_idx]->get_sampled_fraction();
+}
+
+/**
+ * internal function returning efficiency of row row_idx of the current view in bitmask tables
+ * relative to the previous cut for sequential, the fraction of N-1 events passing the cut for n_minus_one,
+ * and the fraction of all events for first_failing
+ */
+double TableCollection::mask_eff(unsigned int sample_idx, unsigned int region_idx, unsigned int row_idx) {
+  bool weighted = samples[sample_idx]->weighted_sample;
+  const CutMaskYields &yields = get_cut_mask_yields(sample_idx);
+  double numerator = yields.get_yield(cutflow_view, region_idx, row_idx, weighted);
+  double denominator = yields.get_total(region_idx, weighted);
+  if (cutflow_view == CutflowView::sequential && row_idx > 0)
+    denominator = yields.get_yield(cutflow_view, region_idx, row_idx-1, weighted);
+  else if (cutflow_view == CutflowView::n_minus_one && row_idx < yields.num_cuts) {
+    numerator = yields.get_yield(cutflow_view, region_idx, yields.num_cuts, weighted);
+    denominator = yields.get_yield(cutflow_view, region_idx, row_idx, weighted);
+  }
+  if (denominator <= 0) return 0.;
+  return numerator/denominator;
+}
+
+/**
+ * internal functions to print/save bitmask tables, if only_sample is not null only its yields are printed
+ */
+void TableCollection::print_mask_tables(SampleWrapper* only_sample) {
+  std::vector<std::string> row_names = mask_row_names();
+  for (unsigned int region_idx = 0; region_idx < num_mask_regions(); region_idx++) {
+    std::cout << "Region: " << mask_region_description(region_idx) << std::endl;
+    for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
+      if (only_sample != nullptr && samples[sample_idx] != only_sample) continue;
+      std::cout << samples[sample_idx]->sample_description << std::endl;
+      for (unsigned int row_idx = 0; row_idx < row_names.size(); row_idx++) {
+        std::cout << row_names[row_idx] << ": " << mask_yield(sample_idx, region_idx, row_idx) << " : " 
+                  << mask_eff(sample_idx, region_idx, row_idx) << std::endl;
+      }
+    }
+  }
+}
+
+void TableCollection::save_mask_tables(std::string filename) {
+  if (samples.size() == 0) {
+    std::cout << "ERROR: No tables booked." << std::endl; 
+    return;
+  }
+  std::vector<std::string> row_names = mask_row_names();
+  std::ofstream output_file;
+  output_file.open(("tables/"+filename).c_str());
+  output_file << "\\documentclass[10pt,oneside]{report}\n";
+  output_file << "\\usepackage{graphicx,xspace,amssymb,amsmath,colordvi,colortbl,verbatim,multicol}\n";
+  output_file << "\\usepackage{multirow, rotating}\n";
+  output_file << "\\usepackage[active,tightpage]{preview}\n";
+  output_file << "\\usepackage{siunitx}\n";
+  output_file << "\\sisetup{round-mode = figures, round-precision=2}\n";
+  output_file << "\\renewcommand{\\arraystretch}{1.1}\n\n";
+  output_file << "\\begin{document}\n";
+  output_file << "\\begin{preview}\n";
+  output_file << "\\begin{tabular}{l";
+  for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) output_file << "|r|r";
+  output_file << "}\\hline\\hline\n";
+  output_file << "Cut ";
+  for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) output_file << "& " << samples[sample_idx]->sample_description << "& Eff.";
+  output_file << "\\\\ \\hline\n";
+  for (unsigned int region_idx = 0; region_idx < num_mask_regions(); region_idx++) {
+    //one block of rows per region
+    output_file << "\\multicolumn{" << 2*samples.size()+1 << "}{c}{" << mask_region_description(region_idx) << "}\\\\ \\hline\n";
+    for (unsigned int row_idx = 0; row_idx < row_names.size(); row_idx++) {
+      output_file << row_names[row_idx];
+      for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++)
+        output_file << "& " << mask_yield(sample_idx, region_idx, row_idx) << "& " << mask_eff(sample_idx, region_idx, row_idx);
+      output_file << "\\\\ \n";
+    }
+    output_file << "\\hline\n";
+  }
+  output_file << "\\hline \n";
+  output_file << "\\end{tabular}\n";
+  output_file << "\\end{preview}\n";
+  output_file << "\\end{document}\n";
+  output_file.close();
+}
+
 /**
  * function to print table to terminal
+ * if only_sample is not null, only its table is printed
  */
-void TableCollection::print() {
+void TableCollection::print(SampleWrapper* only_sample) {
+  PhaseScope save_phase("save");
+  if (cut_mask_yields.size() > 0) {
+    print_mask_tables(only_sample);
+    return;
+  }
   for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
+    if (only_sample != nullptr && samples[sample_idx] != only_sample) continue;
     std::cout << samples[sample_idx]->sample_description << std::endl;
-    std::cout << "Default print: \n";
-    cutflows[sample_idx]->Print();
+    if (cutflows[sample_idx]) {
+      //default print is only available when the report was not loaded from cache
+      std::cout << "Default print: \n";
+      samples[sample_idx]->wait_for_event_loop();
+      cutflows[sample_idx]->Print();
+    }
     std::cout << "Custom print: \n";
     float previous_cut_yield = -1;
     float current_cut_yield = -1;
@@ -43,20 +304,20 @@ void TableCollection::print() {
       std::cout << cut_name << ": ";
       if (samples[sample_idx]->weighted_sample) {
         if (cut_idx == 0) {
-	  current_cut_yield = *(samples[sample_idx]->cut_yields[cut_idx]);
+	  current_cut_yield = samples[sample_idx]->get_cut_yield(cut_idx);
 	  if (!samples[sample_idx]->is_data) current_cut_yield = current_cut_yield*samples[sample_idx]->scale_weight();
           std::cout << current_cut_yield << " : -" << std::endl;
 	  previous_cut_yield = current_cut_yield;
 	}
 	else {
-	  current_cut_yield = *(samples[sample_idx]->cut_yields[cut_idx]);
+	  current_cut_yield = samples[sample_idx]->get_cut_yield(cut_idx);
 	  if (!samples[sample_idx]->is_data) current_cut_yield = current_cut_yield*samples[sample_idx]->scale_weight();
           std::cout << current_cut_yield << " : " << current_cut_yield/previous_cut_yield << std::endl;
 	  previous_cut_yield = current_cut_yield;
 	}
       }
       else
-        std::cout << cutflows[sample_idx]->At(cut_name).GetPass() << " : " << cutflows[sample_idx]->At(cut_name).GetEff() << std::endl;
+        std::cout << cut_pass(sample_idx, cut_idx) << " : " << cut_eff(sample_idx, cut_idx) << std::endl;
     }
   }
 }
@@ -65,6 +326,11 @@ void TableCollection::print() {
  * function to save table to tex file
  */
 void TableCollection::save(std::string filename) {
+  PhaseScope save_phase("save");
+  if (cut_mask_yields.size() > 0) {
+    save_mask_tables(filename);
+    return;
+  }
   if (samples.size() == 0) {
     std::cout << "ERROR: No tables booked." << std::endl; 
     return;
@@ -103,20 +369,20 @@ void TableCollection::save(std::string filename) {
       std::string cut_name = samples[sample_idx]->cuts[cut_idx];
       if (samples[sample_idx]->weighted_sample) {
 	if (cut_idx == 0) {
-	  current_cut_yield.push_back(*(samples[sample_idx]->cut_yields[cut_idx]));
+	  current_cut_yield.push_back(samples[sample_idx]->get_cut_yield(cut_idx));
 	  if (!samples[sample_idx]->is_data) current_cut_yield[sample_idx] = current_cut_yield[sample_idx]*samples[sample_idx]->scale_weight();
           output_file << "& " << current_cut_yield[sample_idx] << "& -";
 	  previous_cut_yield.push_back(current_cut_yield[sample_idx]);
 	}
 	else {
-	  current_cut_yield[sample_idx] = *(samples[sample_idx]->cut_yields[cut_idx]);
+	  current_cut_yield[sample_idx] = samples[sample_idx]->get_cut_yield(cut_idx);
 	  if (!samples[sample_idx]->is_data) current_cut_yield[sample_idx] = current_cut_yield[sample_idx]*samples[sample_idx]->scale_weight();
           output_file << "& " << current_cut_yield[sample_idx] << "& " << current_cut_yield[sample_idx]/previous_cut_yield[sample_idx];
 	  previous_cut_yield[sample_idx] = current_cut_yield[sample_idx];
 	}
       }
       else {
-        output_file << "& " << cutflows[sample_idx]->At(cut_name).GetPass() << "& " << cutflows[sample_idx]->At(cut_name).GetEff();
+        output_file << "& " << cut_pass(sample_idx, cut_idx) << "& " << cut_eff(sample_idx, cut_idx);
       }
     }
     output_file << "\\\\ \n";
@@ -127,3 +393,92 @@ void TableCollection::save(std::string filename) {
   output_file << "\\end{document}\n";
   output_file.close();
 }
+
+/**
+ * function returning keys under which unweighted reports (or bitmask yields) are stored, see set_result_cache
+ */
+std::vector<std::string> TableCollection::get_result_keys() {
+  return report_keys;
+}
+
+/**
+ * function to realize unweighted reports (or bitmask yields) and store them in shard_cache under their keys, used by shard processes
+ * if only_sample is not null, only the report of that sample is realized and stored
+ */
+void TableCollection::store_shard_results(ResultCache* shard_cache, SampleWrapper* only_sample) {
+  //shard processes never write their partial reports to the shared cache
+  result_cache = nullptr;
+  for (unsigned int sample_idx = 0; sample_idx < samples.size() && sample_idx < report_keys.size(); sample_idx++) {
+    if (only_sample != nullptr && samples[sample_idx] != only_sample) continue;
+    if (report_realized(sample_idx) || !report_booked(sample_idx)) continue;
+    realize_report(sample_idx);
+    shard_cache->store_values(report_keys[sample_idx], report_values[sample_idx]);
+  }
+}
+
+/**
+ * function to replace booked unweighted reports (or bitmask yields) with the sum of the reports stored by all shards
+ */
+void TableCollection::merge_shard_results(std::vector<ResultCache*> shard_caches) {
+  if (report_values.size() < samples.size()) report_values.resize(samples.size());
+  for (unsigned int sample_idx = 0; sample_idx < samples.size() && sample_idx < report_keys.size(); sample_idx++) {
+    if (report_realized(sample_idx)) continue;
+    std::vector<double> merged_values(report_size(sample_idx), 0.);
+    bool all_shards_found = true;
+    for (ResultCache* shard_cache : shard_caches) {
+      std::vector<double> shard_values;
+      if (!shard_cache->load_values(report_keys[sample_idx], shard_values) || shard_values.size() != merged_values.size()) {
+        all_shards_found = false;
+        break;
+      }
+      for (unsigned int value_idx = 0; value_idx < merged_values.size(); value_idx++)
+        merged_values[value_idx] += shard_values[value_idx];
+    }
+    if (!all_shards_found) continue;
+    report_values[sample_idx] = merged_values;
+    //the booked report would rerun the full event loop, so default printing is skipped as for cached reports
+    if (cut_mask_yields.size() > 0)
+      cut_mask_yields[sample_idx] = ROOT::RDF::RResultPtr<CutMaskYields>();
+    else
+      cutflows[sample_idx] = ROOT::RDF::RResultPtr<ROOT::RDF::RCutFlowReport>();
+    if (result_cache != nullptr)
+      result_cache->store_values(report_keys[sample_idx], report_values[sample_idx]);
+  }
+}
+
+/**
+ * function to write realized cutflow yields to an archive under (cutflow, sample, inclusive, cutflow)
+ * if only_sample is not null, only its yields are written
+ */
+void TableCollection::save_archive(HistogramArchiveWriter* archive_writer, SampleWrapper* only_sample) {
+  if (cut_mask_yields.size() > 0) {
+    //bitmask tables are written as the current view in each region
+    std::vector<std::string> row_names = mask_row_names();
+    for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
+      if (only_sample != nullptr && samples[sample_idx] != only_sample) continue;
+      for (unsigned int region_idx = 0; region_idx < num_mask_regions(); region_idx++) {
+        std::vector<double> row_yields;
+        for (unsigned int row_idx = 0; row_idx < row_names.size(); row_idx++)
+          row_yields.push_back(mask_yield(sample_idx, region_idx, row_idx));
+        std::string region_name = (regions == nullptr || region_idx == regions->size()) ? "inclusive" : regions->get_name(region_idx);
+        archive_writer->add(row_names, row_yields, "cutflow", samples[sample_idx]->sample_name, region_name, "cutflow");
+      }
+    }
+    return;
+  }
+  for (unsigned int sample_idx = 0; sample_idx < samples.size(); sample_idx++) {
+    if (only_sample != nullptr && samples[sample_idx] != only_sample) continue;
+    std::vector<double> cut_yields;
+    for (unsigned int cut_idx = 0; cut_idx < samples[sample_idx]->cuts.size(); cut_idx++) {
+      if (samples[sample_idx]->weighted_sample) {
+        double cut_yield = samples[sample_idx]->get_cut_yield(cut_idx);
+        if (!samples[sample_idx]->is_data) cut_yield = cut_yield*samples[sample_idx]->scale_weight();
+        cut_yields.push_back(cut_yield);
+      }
+      else {
+        cut_yields.push_back(cut_pass(sample_idx, cut_idx));
+      }
+    }
+    archive_writer->add(samples[sample_idx]->cuts, cut_yields, "cutflow", samples[sample_idx]->sample_name, "inclusive", "cutflow");
+  }
+}
@@ -4,6 +4,35 @@
 #include "core/generic_utils.hxx"
 #include "core/variable_axis.hxx"
 
+/**
+ * function returning ColumnType of a column type name as given by RInterface::GetColumnType, or automatic if unsupported
+ */
+ColumnType column_type_from_name(std::string type_name) {
+  //vector columns are reported as ROOT::VecOps::RVec<T>, ROOT::RVec<T>, or ROOT::RVecF depending on the ROOT version
+  for (std::string prefix : {"ROOT::VecOps::", "ROOT::"}) {
+    if (type_name.compare(0, prefix.size(), prefix) == 0)
+      type_name = type_name.substr(prefix.size());
+  }
+  if (type_name == "float" || type_name == "Float_t") return ColumnType::float_value;
+  if (type_name == "double" || type_name == "Double_t") return ColumnType::double_value;
+  if (type_name == "int" || type_name == "Int_t") return ColumnType::int_value;
+  if (type_name == "unsigned int" || type_name == "UInt_t") return ColumnType::unsigned_int_value;
+  if (type_name == "bool" || type_name == "Bool_t") return ColumnType::bool_value;
+  if (type_name == "unsigned char" || type_name == "UChar_t") return ColumnType::unsigned_char_value;
+  if (type_name == "long long" || type_name == "Long64_t") return ColumnType::long64_value;
+  if (type_name == "unsigned long long" || type_name == "ULong64_t") return ColumnType::unsigned_long64_value;
+  if (type_name == "short" || type_name == "Short_t") return ColumnType::short_value;
+  if (type_name == "unsigned short" || type_name == "UShort_t") return ColumnType::unsigned_short_value;
+  if (type_name == "char" || type_name == "Char_t") return ColumnType::char_value;
+  if (type_name == "RVec<float>" || type_name == "RVec<Float_t>" || type_name == "RVecF") return ColumnType::float_vector;
+  if (type_name == "RVec<int>" || type_name == "RVec<Int_t>" || type_name == "RVecI") return ColumnType::int_vector;
+  if (type_name == "RVec<double>" || type_name == "RVec<Double_t>" || type_name == "RVecD") return ColumnType::double_vector;
+  if (type_name == "RVec<unsigned char>" || type_name == "RVec<UChar_t>") return ColumnType::unsigned_char_vector;
+  if (type_name == "RVec<bool>" || type_name == "RVec<Bool_t>" || type_name == "RVecB") return ColumnType::bool_vector;
+  if (type_name == "RVec<short>" || type_name == "RVec<Short_t>") return ColumnType::short_vector;
+  return ColumnType::automatic;
+}
+
 /**
  * uniform bin constructor
  */
@@ -17,6 +46,8 @@ VariableAxis::VariableAxis(std::string i_variable_name, std::string i_variable_d
   low = i_low;
   high = i_high;
   uniform_bins = true;
+  value_type = ColumnType::automatic;
+  weight_type = ColumnType::automatic;
 }
 
 /**
@@ -33,6 +64,17 @@ VariableAxis::VariableAxis(std::string i_variable_name, std::string i_variable_d
   high = -1;
   bins = i_bins;
   uniform_bins = false;
+  value_type = ColumnType::automatic;
+  weight_type = ColumnType::automatic;
+}
+
+/**
+ * method to set the C++ types of the variable column and of the weight column of weighted samples
+ */
+VariableAxis& VariableAxis::set_column_types(ColumnType i_value_type, ColumnType i_weight_type) {
+  value_type = i_value_type;
+  weight_type = i_weight_type;
+  return *this;
 }
 
 /**
@@ -0,0 +1,435 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "core/result_cache.hxx"
+#include "core/checkpoint.hxx"
+#include "core/work_distribution.hxx"
+
+//largest result file accepted from a worker
+static const size_t max_result_file_size = 1ul << 30;
+
+/**
+ * constructor, takes ownership of a connected socket
+ */
+WorkConnection::WorkConnection(int i_socket_fd) {
+  socket_fd = i_socket_fd;
+}
+
+/**
+ * destructor, closes the socket
+ */
+WorkConnection::~WorkConnection() {
+  if (socket_fd >= 0) close(socket_fd);
+}
+
+/**
+ * returns a new connection to host:port, or nullptr if the connection fails; caller owns connection
+ */
+WorkConnection* WorkConnection::connect_to(std::string host, unsigned short port) {
+  addrinfo hints;
+  std::memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* addresses = nullptr;
+  if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses) != 0) return nullptr;
+  int connected_fd = -1;
+  for (addrinfo* address = addresses; address != nullptr && connected_fd < 0; address = address->ai_next) {
+    connected_fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+    if (connected_fd >= 0 && connect(connected_fd, address->ai_addr, address->ai_addrlen) != 0) {
+      close(connected_fd);
+      connected_fd = -1;
+    }
+  }
+  freeaddrinfo(addresses);
+  if (connected_fd < 0) return nullptr;
+  return new WorkConnection(connected_fd);
+}
+
+/**
+ * returns underlying socket, used to poll several connections
+ */
+int WorkConnection::get_socket() const {
+  return socket_fd;
+}
+
+/**
+ * returns true if a complete line has already been received and can be read without blocking
+ */
+bool WorkConnection::has_buffered_line() const {
+  return read_buffer.find('\n') != std::string::npos;
+}
+
+/**
+ * internal function to read more data into the buffer, returns false if the connection is closed
+ */
+bool WorkConnection::fill_buffer() {
+  char chunk[65536];
+  ssize_t bytes_read = recv(socket_fd, chunk, sizeof(chunk), 0);
+  if (bytes_read <= 0) return false;
+  read_buffer.append(chunk, static_cast<size_t>(bytes_read));
+  return true;
+}
+
+/**
+ * methods to send and receive one line (without the newline), return false if the connection is closed
+ */
+bool WorkConnection::send_line(std::string line) {
+  line += "\n";
+  size_t bytes_sent = 0;
+  while (bytes_sent < line.size()) {
+    //MSG_NOSIGNAL so a dead peer is reported as an error instead of killing the process
+    ssize_t sent = send(socket_fd, line.data()+bytes_sent, line.size()-bytes_sent, MSG_NOSIGNAL);
+    if (sent <= 0) return false;
+    bytes_sent += static_cast<size_t>(sent);
+  }
+  return true;
+}
+
+bool WorkConnection::receive_line(std::string &line) {
+  while (!has_buffered_line()) {
+    if (!fill_buffer()) return false;
+  }
+  size_t newline_position = read_buffer.find('\n');
+  line = read_buffer.substr(0, newline_position);
+  read_buffer.erase(0, newline_position+1);
+  return true;
+}
+
+/**
+ * method to send the file filename under name, the file is read and sent in chunks
+ */
+bool WorkConnection::send_file(std::string filename, std::string name) {
+  struct stat file_status;
+  if (stat(filename.c_str(), &file_status) != 0) return false;
+  std::ifstream input_file(filename.c_str(), std::ios::binary);
+  if (!input_file.is_open()) return false;
+  size_t bytes_left = static_cast<size_t>(file_status.st_size);
+  if (!send_line("FILE "+name+" "+std::to_string(bytes_left))) return false;
+  char chunk[65536];
+  while (bytes_left > 0) {
+    size_t chunk_size = std::min(sizeof(chunk), bytes_left);
+    if (!input_file.read(chunk, static_cast<std::streamsize>(chunk_size))) return false;
+    size_t bytes_sent = 0;
+    while (bytes_sent < chunk_size) {
+      ssize_t sent = send(socket_fd, chunk+bytes_sent, chunk_size-bytes_sent, MSG_NOSIGNAL);
+      if (sent <= 0) return false;
+      bytes_sent += static_cast<size_t>(sent);
+    }
+    bytes_left -= chunk_size;
+  }
+  return true;
+}
+
+/**
+ * method to receive one file of at most max_file_size bytes into directory, name is set to the name it was sent under
+ * the file is written in chunks to a temporary name and renamed, so readers never see partial files
+ */
+bool WorkConnection::receive_file(std::string directory, std::string &name, size_t max_file_size) {
+  std::string header;
+  if (!receive_line(header)) return false;
+  std::istringstream header_stream(header);
+  std::string tag;
+  size_t file_size = 0;
+  header_stream >> tag >> name >> file_size;
+  if (tag != "FILE" || name == "" || name == "." || name == ".." || name.find('/') != std::string::npos) return false;
+  if (file_size > max_file_size) {
+    std::cout << "ERROR: received file " << name << " of " << file_size << " bytes exceeds the limit of " << max_file_size << " bytes" << std::endl;
+    return false;
+  }
+  std::string filename = directory+"/"+name;
+  std::string temporary_filename = filename+".tmp";
+  std::ofstream output_file(temporary_filename.c_str(), std::ios::binary);
+  if (!output_file.is_open()) return false;
+  //bytes already buffered with the header are written first, the rest is written as it arrives
+  size_t buffered_bytes = std::min(file_size, read_buffer.size());
+  output_file.write(read_buffer.data(), static_cast<std::streamsize>(buffered_bytes));
+  read_buffer.erase(0, buffered_bytes);
+  size_t bytes_left = file_size-buffered_bytes;
+  char chunk[65536];
+  while (bytes_left > 0 && output_file) {
+    ssize_t bytes_read = recv(socket_fd, chunk, std::min(sizeof(chunk), bytes_left), 0);
+    if (bytes_read <= 0) break;
+    output_file.write(chunk, static_cast<std::streamsize>(bytes_read));
+    bytes_left -= static_cast<size_t>(bytes_read);
+  }
+  output_file.close();
+  if (bytes_left > 0 || !output_file) {
+    std::remove(temporary_filename.c_str());
+    return false;
+  }
+  std::rename(temporary_filename.c_str(), filename.c_str());
+  return true;
+}
+
+/**
+ * internal function returning true if token matches expected_token, taking the same time for any mismatch position
+ */
+static bool tokens_match(std::string token, std::string expected_token) {
+  unsigned char difference = (token.size() == expected_token.size()) ? 0 : 1;
+  for (size_t char_idx = 0; char_idx < token.size(); char_idx++) {
+    char expected_char = expected_token.size() > 0 ? expected_token[char_idx % expected_token.size()] : '\0';
+    difference = static_cast<unsigned char>(difference | (token[char_idx] ^ expected_char));
+  }
+  return difference == 0;
+}
+
+/**
+ * constructor
+ * i_work_directory - directory in which received and merged results are stored
+ * i_max_unit_failures - number of failures or lost workers after which a unit is not reassigned
+ * i_worker_timeout_seconds - time without any connected worker after which serving stops
+ */
+WorkCoordinator::WorkCoordinator(std::vector<WorkUnit> i_units, std::string i_work_directory, unsigned int i_max_unit_failures,
+    unsigned int i_worker_timeout_seconds)
+  : units(i_units), work_directory(i_work_directory)
+{
+  mkdir(work_directory.c_str(), 0755);
+  merged_cache.reset(new ResultCache(work_directory+"/merged"));
+  //results merged by an earlier (ex. killed) coordinator are not counted again
+  merged_cache->clear();
+  unit_owners.assign(units.size(), -1);
+  units_done.assign(units.size(), false);
+  unit_failures.assign(units.size(), 0);
+  num_units_done = 0;
+  max_unit_failures = i_max_unit_failures;
+  worker_timeout_seconds = i_worker_timeout_seconds;
+  units_failed = false;
+  checkpoint = nullptr;
+  checkpoint_seconds = 0;
+}
+
+/**
+ * method to resume from i_checkpoint and save a checkpoint every i_checkpoint_seconds, must be called before serve
+ */
+WorkCoordinator* WorkCoordinator::set_checkpoint(Checkpoint* i_checkpoint, unsigned int i_checkpoint_seconds) {
+  checkpoint = i_checkpoint;
+  checkpoint_seconds = i_checkpoint_seconds;
+  last_checkpoint = std::chrono::steady_clock::now();
+  std::vector<unsigned int> completed_units;
+  if (!checkpoint->load(completed_units, merged_cache.get())) return this;
+  for (unsigned int unit_idx : completed_units) {
+    if (unit_idx >= units.size() || units_done[unit_idx]) continue;
+    units_done[unit_idx] = true;
+    num_units_done++;
+  }
+  return this;
+}
+
+/**
+ * returns true if all units are done (ex. all were loaded from a checkpoint)
+ */
+bool WorkCoordinator::is_done() {
+  return num_units_done == units.size();
+}
+
+/**
+ * internal function to save completed units and merged results to the checkpoint, if set
+ */
+void WorkCoordinator::save_checkpoint() {
+  if (checkpoint == nullptr) return;
+  std::vector<unsigned int> completed_units;
+  for (unsigned int unit_idx = 0; unit_idx < units.size(); unit_idx++) {
+    if (units_done[unit_idx]) completed_units.push_back(unit_idx);
+  }
+  checkpoint->save(completed_units, merged_cache.get());
+  last_checkpoint = std::chrono::steady_clock::now();
+}
+
+/**
+ * internal function to reassign unit unit_idx after a failure, or to stop serving if it failed too often
+ */
+void WorkCoordinator::reassign(unsigned int unit_idx) {
+  if (units_done[unit_idx]) return;
+  unit_owners[unit_idx] = -1;
+  unit_failures[unit_idx]++;
+  if (unit_failures[unit_idx] >= max_unit_failures) {
+    //a unit that keeps failing (ex. crashes on a corrupt file) would otherwise be retried forever
+    std::cout << "ERROR: work unit " << unit_idx << " failed " << unit_failures[unit_idx] << " times, stopping" << std::endl;
+    units_failed = true;
+    return;
+  }
+  std::cout << "Reassigning unit " << unit_idx << std::endl;
+}
+
+/**
+ * internal function to close connection connection_idx and reassign its unfinished units
+ */
+void WorkCoordinator::disconnect(unsigned int connection_idx) {
+  connections[connection_idx].reset();
+  for (unsigned int unit_idx = 0; unit_idx < units.size(); unit_idx++) {
+    if (unit_owners[unit_idx] == static_cast<int>(connection_idx) && !units_done[unit_idx]) {
+      std::cout << "Worker lost unit " << unit_idx << std::endl;
+      reassign(unit_idx);
+    }
+  }
+}
+
+/**
+ * internal function to handle one message from connection connection_idx, returns false if it disconnected
+ */
+bool WorkCoordinator::handle_message(unsigned int connection_idx) {
+  WorkConnection* connection = connections[connection_idx].get();
+  std::string message;
+  if (!connection->receive_line(message)) return false;
+  std::istringstream message_stream(message);
+  std::string command;
+  message_stream >> command;
+  if (!connections_authenticated[connection_idx]) {
+    //nothing else is accepted (ex. files) before the worker sent the shared token
+    std::string worker_token;
+    message_stream >> worker_token;
+    if (command != "HELLO" || !tokens_match(worker_token, token)) {
+      std::cout << "ERROR: rejected worker connection with an invalid token" << std::endl;
+      return false;
+    }
+    connections_authenticated[connection_idx] = true;
+    return true;
+  }
+  if (command == "REQUEST") {
+    for (unsigned int unit_idx = 0; unit_idx < units.size(); unit_idx++) {
+      if (unit_owners[unit_idx] < 0 && !units_done[unit_idx]) {
+        unit_owners[unit_idx] = static_cast<int>(connection_idx);
+        return connection->send_line("UNIT "+std::to_string(unit_idx)+" "+std::to_string(units[unit_idx].sample_idx)
+            +" "+std::to_string(units[unit_idx].begin_entry)+" "+std::to_string(units[unit_idx].end_entry));
+      }
+    }
+    //units still owned by live workers may be reassigned if they are lost
+    return connection->send_line(num_units_done < units.size() ? "WAIT" : "DONE");
+  }
+  unsigned int unit_idx = 0;
+  message_stream >> unit_idx;
+  if (unit_idx >= units.size()) return false;
+  if (command == "FAILED") {
+    std::cout << "Worker failed unit " << unit_idx << std::endl;
+    //only the owner may give a unit back, so a late report does not reassign a unit twice
+    if (unit_owners[unit_idx] == static_cast<int>(connection_idx)) reassign(unit_idx);
+    return true;
+  }
+  if (command == "RESULT") {
+    unsigned int num_files = 0;
+    message_stream >> num_files;
+    std::string unit_directory = work_directory+"/unit_"+std::to_string(unit_idx);
+    ResultCache unit_cache(unit_directory);
+    unit_cache.clear();
+    for (unsigned int file_idx = 0; file_idx < num_files; file_idx++) {
+      std::string file_name;
+      if (!connection->receive_file(unit_directory, file_name, max_result_file_size)) return false;
+    }
+    //a unit may have been reassigned and completed by another worker in the meantime
+    if (!units_done[unit_idx]) {
+      for (std::string key : unit_cache.list_keys())
+        merged_cache->accumulate(key, &unit_cache);
+      units_done[unit_idx] = true;
+      num_units_done++;
+      std::cout << "Merged unit " << unit_idx << " (" << num_units_done << "/" << units.size() << ")" << std::endl;
+      //the last checkpoint is saved by serve once all units are done
+      if (checkpoint != nullptr && num_units_done < units.size() && std::chrono::steady_clock::now()-last_checkpoint
+          >= std::chrono::seconds(checkpoint_seconds))
+        save_checkpoint();
+    }
+    return true;
+  }
+  return false;
+}
+
+/**
+ * method to serve units on port until all are done, returns false if the port cannot be opened, a unit failed
+ * too often, or no worker was connected for the worker timeout
+ * i_interface - IPv4 address of the interface to listen on, other interfaces than loopback require a token
+ * i_token - shared secret that workers must send before any other message
+ */
+bool WorkCoordinator::serve(unsigned short port, std::string i_interface, std::string i_token) {
+  token = i_token;
+  sockaddr_in listen_address;
+  std::memset(&listen_address, 0, sizeof(listen_address));
+  listen_address.sin_family = AF_INET;
+  listen_address.sin_port = htons(port);
+  if (inet_pton(AF_INET, i_interface.c_str(), &listen_address.sin_addr) != 1) {
+    std::cout << "ERROR: " << i_interface << " is not an IPv4 interface address" << std::endl;
+    return false;
+  }
+  //workers on other nodes can write result files here, so they must prove they belong to this job
+  bool loopback = (ntohl(listen_address.sin_addr.s_addr) >> 24) == 127;
+  if (!loopback && token == "") {
+    std::cout << "ERROR: a token is required to serve work units on " << i_interface << std::endl;
+    return false;
+  }
+  int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  int reuse_address = 1;
+  setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse_address, sizeof(reuse_address));
+  if (listen_fd < 0 || bind(listen_fd, reinterpret_cast<sockaddr*>(&listen_address), sizeof(listen_address)) != 0
+      || listen(listen_fd, 64) != 0) {
+    std::cout << "ERROR: unable to listen on port " << port << std::endl;
+    if (listen_fd >= 0) close(listen_fd);
+    return false;
+  }
+  std::cout << "Serving " << units.size() << " work units on " << i_interface << ":" << port << std::endl;
+  std::chrono::steady_clock::time_point last_connected = std::chrono::steady_clock::now();
+  while (num_units_done < units.size() && !units_failed) {
+    std::vector<pollfd> poll_fds;
+    std::vector<unsigned int> poll_connections;
+    pollfd listen_poll_fd = {listen_fd, POLLIN, 0};
+    poll_fds.push_back(listen_poll_fd);
+    bool has_buffered_message = false;
+    for (unsigned int connection_idx = 0; connection_idx < connections.size(); connection_idx++) {
+      if (!connections[connection_idx]) continue;
+      pollfd connection_poll_fd = {connections[connection_idx]->get_socket(), POLLIN, 0};
+      poll_fds.push_back(connection_poll_fd);
+      poll_connections.push_back(connection_idx);
+      if (connections[connection_idx]->has_buffered_line()) has_buffered_message = true;
+    }
+    if (poll_connections.size() > 0) {
+      last_connected = std::chrono::steady_clock::now();
+    }
+    else if (std::chrono::steady_clock::now()-last_connected >= std::chrono::seconds(worker_timeout_seconds)) {
+      std::cout << "ERROR: no worker connected for " << worker_timeout_seconds << " seconds, stopping" << std::endl;
+      break;
+    }
+    if (poll(poll_fds.data(), poll_fds.size(), has_buffered_message ? 0 : 1000) < 0) continue;
+    if (poll_fds[0].revents & POLLIN) {
+      int connection_fd = accept(listen_fd, nullptr, nullptr);
+      if (connection_fd >= 0) {
+        connections.emplace_back(new WorkConnection(connection_fd));
+        connections_authenticated.push_back(false);
+      }
+    }
+    for (unsigned int poll_idx = 1; poll_idx < poll_fds.size(); poll_idx++) {
+      unsigned int connection_idx = poll_connections[poll_idx-1];
+      if (!(poll_fds[poll_idx].revents & (POLLIN | POLLHUP | POLLERR)) && !connections[connection_idx]->has_buffered_line())
+        continue;
+      if (!handle_message(connection_idx))
+        disconnect(connection_idx);
+    }
+  }
+  //closing the connections tells waiting workers that there is no more work
+  connections.clear();
+  connections_authenticated.clear();
+  close(listen_fd);
+  //completed units are kept even if serving stopped, so a restart only processes the rest
+  save_checkpoint();
+  return num_units_done == units.size();
+}
+
+/**
+ * returns cache holding the sum of the results of all units
+ */
+ResultCache* WorkCoordinator::get_merged_cache() {
+  return merged_cache.get();
+}
@@ -12,6 +12,8 @@
 #include "core/sample_wrapper.hxx"
 #include "core/sample_collection.hxx"
 #include "core/region_collection.hxx"
+#include "core/phase_report.hxx"
+#include "core/compiled_expression_cache.hxx"
 #include "core/plot_collection.hxx"
 #include "higgsino/higgsino_utils.hxx"
 
@@ -614,15 +616,38 @@
 //std::vector<std::string> Flag_JetID_args = {"Jet_pt","Jet_jetId"};
 
 
+//returns true if option was given on the command line
+bool has_option(int argc, char *argv[], std::string option) {
+	for (int arg_idx = 1; arg_idx < argc; arg_idx++) {
+		if (std::string(argv[arg_idx]) == option) return true;
+	}
+	return false;
+}
+
 //main function
-int main() {
+//options: --progress to print live event loop progress, --phase-report to print time and memory per phase,
+//  --expression-cache to compile string defines and filters once and reuse them across runs,
+//  --cache-columns to store derived lepton and jet columns in friend trees and read them in later runs,
+//  --dataset-manifest to take file entries and clusters from a manifest instead of opening every file
+int main(int argc, char *argv[]) {
+	if (has_option(argc, argv, "--phase-report"))
+		PhaseReport::enable();
 	ROOT::EnableImplicitMT();
 	//SampleWrapper *met2018d = (new SampleWrapper("met__run2018d",{"/net/cms25/cms25r5/pico/NanoAODv5/nano/2018/data/MET__Run2018D__Nano1June2019_ver2-v1__30000__*"},kBlack,"MET 2018D",1.0,true,"Events"))->add_flag("2018");
 	SampleWrapper *met2016c = (new SampleWrapper("met__run2016c",{"/net/cms25/cms25r5/pico/NanoAODv5/nano/2016/data/MET__Run2016C*"},kBlack,"MET 2016C",true,"Events"))->add_flag("2016");
 	SampleWrapper *met2018d = (new SampleWrapper("met__run2018d",{"/net/cms25/cms25r5/pico/NanoAODv7/nano/2018/data/MET__Run2018D*"},kBlack,"MET 2018D",true,"Events"))->add_flag("2018");
 	SampleCollection* samples = new SampleCollection;
+	CompiledExpressionCache* expression_cache = nullptr;
+	if (has_option(argc, argv, "--expression-cache")) {
+		expression_cache = new CompiledExpressionCache();
+		samples->set_expression_cache(expression_cache);
+	}
 	samples->add(met2016c);
 	samples->add(met2018d);
+	if (has_option(argc, argv, "--dataset-manifest"))
+		samples->use_dataset_manifest();
+	if (has_option(argc, argv, "--cache-columns"))
+		samples->cache_defined_columns({"Electron_sig","Muon_sig","Jet_isLep","MHT_pt","HT_pt"});
 
 	samples->define("Electron_isInPico",Electron_isInPico,Electron_isInPico_args);
 	samples->define("Electron_isVeto",Electron_isVeto,Electron_isVeto_args);
@@ -671,10 +696,15 @@ int main() {
 	samples->filter("Flag_HEMDPhiVetoFilter","HEMDPhiVetoFilter",{"2018"});
 	samples->filter("Flag_JetID","Jet ID");
 
+	if (has_option(argc, argv, "--progress"))
+		samples->set_progress_monitor(60.);
 	std::cout << "Booking histograms and tables." << std::endl;
 	TableCollection* cutflow = samples->book_cutflow_table();
 	cutflow->print();
+	if (expression_cache != nullptr)
+		expression_cache->compile();
 	delete samples;
+	delete expression_cache;
 	delete met2018d;
 	delete met2016c;
 	delete cutflow;
@@ -0,0 +1,46 @@
+/**
+ * test of adaptive filter order: when a cheap filter rejecting most events is moved before an expensive one, the
+ * declared-order cutflow recovered on sampled events matches the exact yields of the declared order
+ */
+
+#include <cstdio>
+#include <string>
+
+#include "core/sample_wrapper.hxx"
+#include "test/test_utils.hxx"
+
+int main() {
+  TestCounter test("test_adaptive_filter");
+  const unsigned int num_entries = 100000;
+  std::string input_filename = test_path("test_adaptive_filter")+".root";
+  write_test_tree(input_filename, num_entries);
+  //the expensive filter passes 3 in 4 events, the cheap one rejects all warm-up events and passes the last 10%
+  std::string expensive_filter = "[&]() { double sum = 0.; for (int term = 0; term < 500; term++) sum += std::sqrt(x+term); return sum > 0.; }() && n != 0";
+  std::string cheap_filter = "x >= 90000";
+
+  //cutflow period 1 recovers every event, which is never cheaper than the declared order, so it is kept
+  SampleWrapper declared_sample("declared", {input_filename}, 1);
+  declared_sample.set_adaptive_filter_order(10000, 1);
+  declared_sample.filter(expensive_filter, "expensive");
+  declared_sample.filter(cheap_filter, "cheap");
+  test.check_close(declared_sample.get_adaptive_cut_yield(0, false, true), 100000., 1e-9, "declared order total");
+  test.check_close(declared_sample.get_adaptive_cut_yield(0, false), 75000., 1e-9, "declared order yield after expensive filter");
+  test.check_close(declared_sample.get_adaptive_cut_yield(1, false), 7500., 1e-9, "declared order yield after cheap filter");
+
+  //reordered filters give exact totals and final yields, while the yield after the expensive filter is estimated on
+  //one in ten events rejected by the cheap filter, a binomial uncertainty of about 400 events
+  SampleWrapper reordered_sample("reordered", {input_filename}, 1);
+  reordered_sample.set_adaptive_filter_order(10000, 10);
+  reordered_sample.filter(expensive_filter, "expensive");
+  reordered_sample.filter(cheap_filter, "cheap");
+  test.check_close(reordered_sample.get_adaptive_cut_yield(0, false, true), declared_sample.get_adaptive_cut_yield(0, false, true), 1e-9,
+      "reordered total");
+  test.check_close(reordered_sample.get_adaptive_cut_yield(0, false), declared_sample.get_adaptive_cut_yield(0, false), 2000.,
+      "reordered yield after expensive filter");
+  test.check_close(reordered_sample.get_adaptive_cut_yield(1, false), declared_sample.get_adaptive_cut_yield(1, false), 1e-9,
+      "reordered yield after cheap filter");
+  test.check_close(reordered_sample.get_adaptive_cut_yield(0, true), reordered_sample.get_adaptive_cut_yield(0, false), 1e-9,
+      "weighted and unweighted yields of an unweighted sample");
+  std::remove(input_filename.c_str());
+  return test.report();
+}
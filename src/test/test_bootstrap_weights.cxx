@@ -0,0 +1,83 @@
+/**
+ * test of BootstrapWeights: counts follow a Poisson distribution of mean 1, replicas are reproducible per event and
+ * independent of processing order, and the spread of replica yields estimates the statistical uncertainty
+ */
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "Rtypes.h"
+#include "ROOT/RVec.hxx"
+
+#include "core/bootstrap_weights.hxx"
+#include "test/test_utils.hxx"
+
+int main() {
+  TestCounter test("test_bootstrap_weights");
+
+  //moments and P(0) of the counts, tolerances are about five standard deviations
+  const unsigned int num_counts = 200000;
+  double count_sum = 0., count_square_sum = 0., num_zeros = 0.;
+  for (unsigned int counter = 0; counter < num_counts; counter++) {
+    double count = static_cast<double>(BootstrapWeights::poisson_count(BootstrapWeights::mix(counter)));
+    count_sum += count;
+    count_square_sum += count*count;
+    if (count < 0.5) num_zeros += 1.;
+  }
+  double count_mean = count_sum/num_counts;
+  test.check_close(count_mean, 1., 0.012, "mean of counts");
+  test.check_close(count_square_sum/num_counts-count_mean*count_mean, 1., 0.02, "variance of counts");
+  test.check_close(num_zeros/num_counts, std::exp(-1.), 0.006, "fraction of zero counts");
+  test.check(BootstrapWeights::poisson_count(0ull) == 0 && BootstrapWeights::poisson_count(~0ull) <= 20, "counts at the ends of the range");
+
+  //weights of an event only depend on the seed and the event key
+  const unsigned int num_replicas = 200;
+  BootstrapWeights bootstrap_weights(num_replicas, 17);
+  BootstrapWeights same_seed_weights(num_replicas, 17);
+  BootstrapWeights other_seed_weights(num_replicas, 18);
+  ROOT::RVec<ULong64_t> event_key = {1, 42, 123456};
+  ROOT::RVec<double> weights = bootstrap_weights(event_key, 0.5);
+  test.check(weights.size() == num_replicas+1, "number of weights");
+  test.check_close(weights[0], 0.5, 0., "nominal weight");
+  ROOT::RVec<double> same_seed = same_seed_weights(event_key, 0.5);
+  ROOT::RVec<double> other_seed = other_seed_weights(event_key, 0.5);
+  ROOT::RVec<double> other_event = bootstrap_weights({1, 42, 123457}, 0.5);
+  unsigned int num_same = 0, num_other_seed_same = 0, num_other_event_same = 0, num_not_multiple = 0;
+  for (unsigned int replica_idx = 1; replica_idx <= num_replicas; replica_idx++) {
+    if (std::fabs(same_seed[replica_idx]-weights[replica_idx]) < 1e-12) num_same++;
+    if (std::fabs(other_seed[replica_idx]-weights[replica_idx]) < 1e-12) num_other_seed_same++;
+    if (std::fabs(other_event[replica_idx]-weights[replica_idx]) < 1e-12) num_other_event_same++;
+    double count = weights[replica_idx]/0.5;
+    if (std::fabs(count-std::round(count)) > 1e-12) num_not_multiple++;
+  }
+  test.check(num_same == num_replicas, "weights of the same seed and event differ");
+  //independent replicas agree when their counts do, which happens for about 37% of them
+  test.check(num_other_seed_same < num_replicas*3/4, "weights of other seeds are correlated");
+  test.check(num_other_event_same < num_replicas*3/4, "weights of other events are correlated");
+  test.check(num_not_multiple == 0, "replica weights are not counts times the nominal weight");
+
+  //replica yields scatter around the nominal yield with variance sum(w^2)
+  const unsigned int num_events = 2000;
+  std::vector<double> replica_yields(num_replicas+1, 0.);
+  double nominal_square_sum = 0.;
+  for (unsigned int event_idx = 0; event_idx < num_events; event_idx++) {
+    double nominal_weight = 0.5+static_cast<double>(event_idx%3u)*0.25;
+    nominal_square_sum += nominal_weight*nominal_weight;
+    ROOT::RVec<double> event_weights = bootstrap_weights({1, 7, static_cast<ULong64_t>(event_idx)}, nominal_weight);
+    for (unsigned int replica_idx = 0; replica_idx <= num_replicas; replica_idx++)
+      replica_yields[replica_idx] += event_weights[replica_idx];
+  }
+  double yield_sum = 0., yield_square_sum = 0.;
+  for (unsigned int replica_idx = 1; replica_idx <= num_replicas; replica_idx++) {
+    yield_sum += replica_yields[replica_idx];
+    yield_square_sum += replica_yields[replica_idx]*replica_yields[replica_idx];
+  }
+  double yield_mean = yield_sum/num_replicas;
+  double yield_deviation = std::sqrt(yield_square_sum/num_replicas-yield_mean*yield_mean);
+  double expected_deviation = std::sqrt(nominal_square_sum);
+  test.check_close(yield_mean, replica_yields[0], 5.*expected_deviation/std::sqrt(static_cast<double>(num_replicas)), "mean of replica yields");
+  //the relative uncertainty of a standard deviation from n replicas is about 1/sqrt(2n)
+  test.check_close(yield_deviation/expected_deviation, 1., 0.25, "standard deviation of replica yields");
+  return test.report();
+}
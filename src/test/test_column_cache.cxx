@@ -0,0 +1,78 @@
+/**
+ * test of ColumnCacheWriter and ColumnCacheDataSource: scalar and array columns read back from raw and compressed
+ * caches match the input tree, including when only selected entry ranges are read
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Rtypes.h"
+#include "ROOT/RDataFrame.hxx"
+#include "ROOT/RVec.hxx"
+
+#include "core/column_cache.hxx"
+#include "test/test_utils.hxx"
+
+/**
+ * function to check that entries in ranges of the cache read through a data source hold the values written by
+ * write_test_tree
+ */
+void check_read_back(TestCounter &test, std::string cache_filename, std::vector<std::pair<ULong64_t, ULong64_t>> ranges, std::string description) {
+  std::unique_ptr<ColumnCacheDataSource> data_source(new ColumnCacheDataSource({cache_filename}));
+  test.check(data_source->is_open(), description+": cache not opened");
+  if (!data_source->is_open()) return;
+  test.check(data_source->HasColumn("x") && data_source->HasColumn("v") && !data_source->HasColumn("y"), description+": columns");
+  test.check(data_source->GetTypeName("v") == "ROOT::VecOps::RVec<"+data_source->GetTypeName("x")+">", description+": array column type");
+  data_source->set_entry_ranges(ranges);
+  ROOT::RDataFrame data_frame(std::move(data_source));
+  ROOT::RDF::RResultPtr<std::vector<float>> x_values = data_frame.Take<float>("x");
+  ROOT::RDF::RResultPtr<std::vector<int>> n_values = data_frame.Take<int>("n");
+  ROOT::RDF::RResultPtr<std::vector<ROOT::RVec<float>>> v_values = data_frame.Take<ROOT::RVec<float>>("v");
+
+  std::vector<ULong64_t> entries;
+  for (std::pair<ULong64_t, ULong64_t> range : ranges)
+    for (ULong64_t entry = range.first; entry < range.second; entry++)
+      entries.push_back(entry);
+  test.check(x_values->size() == entries.size(), description+": number of entries read");
+  if (x_values->size() != entries.size()) return;
+  //entries are handed out in order without implicit multithreading
+  unsigned int num_wrong_entries = 0;
+  for (unsigned int read_idx = 0; read_idx < entries.size(); read_idx++) {
+    float x = static_cast<float>(entries[read_idx]);
+    int n = static_cast<int>(entries[read_idx]%4u);
+    //values are copied bit for bit, the tolerance only avoids comparing floats for equality
+    bool is_right = std::fabs((*x_values)[read_idx]-x) < 1e-3f && (*n_values)[read_idx] == n
+        && (*v_values)[read_idx].size() == static_cast<size_t>(n);
+    for (size_t element_idx = 0; is_right && element_idx < (*v_values)[read_idx].size(); element_idx++)
+      is_right = std::fabs((*v_values)[read_idx][element_idx]-x-static_cast<float>(element_idx)) < 1e-3f;
+    if (!is_right) num_wrong_entries++;
+  }
+  test.check(num_wrong_entries == 0, description+": "+std::to_string(num_wrong_entries)+" entries differ from the input tree");
+}
+
+int main() {
+  TestCounter test("test_column_cache");
+  const unsigned int num_entries = 1000;
+  std::string input_filename = test_path("test_column_cache")+".root";
+  write_test_tree(input_filename, num_entries);
+
+  for (bool compress : {false, true}) {
+    std::string description = compress ? "compressed" : "raw";
+    std::string cache_filename = test_path("test_column_cache_"+description)+".colcache";
+    //small blocks so that ranges span several blocks and start and end within blocks
+    test.check(ColumnCacheWriter::build(input_filename, "tree", {"x", "n", "v"}, cache_filename, compress, 64), description+": cache not built");
+    check_read_back(test, cache_filename, {{0, num_entries}}, description);
+    check_read_back(test, cache_filename, {{10, 20}, {100, 230}, {999, 1000}}, description+" entry ranges");
+    std::remove(cache_filename.c_str());
+  }
+
+  test.check(!ColumnCacheWriter::build(input_filename, "tree", {"missing"}, test_path("test_column_cache_missing"), false), "cache of missing column built");
+  std::unique_ptr<ColumnCacheDataSource> missing_source(new ColumnCacheDataSource({test_path("test_column_cache_absent")}));
+  test.check(!missing_source->is_open(), "missing cache opened");
+  std::remove(input_filename.c_str());
+  return test.report();
+}
@@ -0,0 +1,101 @@
+/**
+ * test of CutMaskHelper: sequential, N-1, and first-failing views derived from cut bitmasks match yields counted
+ * directly from the cut results of each event, in every region and the inclusive selection
+ */
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "Rtypes.h"
+
+#include "core/cut_mask.hxx"
+#include "test/test_utils.hxx"
+
+int main() {
+  TestCounter test("test_cut_mask");
+  const unsigned int num_cuts = 4;
+  const unsigned int num_regions = 2;
+  const unsigned int num_slots = 2;
+  const unsigned int num_events = 1000;
+
+  //expected yields indexed [region][cut], region num_regions is inclusive and cut num_cuts is all cuts passed
+  std::vector<std::vector<double>> sequential(num_regions+1, std::vector<double>(num_cuts+1, 0.));
+  std::vector<std::vector<double>> n_minus_one(num_regions+1, std::vector<double>(num_cuts+1, 0.));
+  std::vector<std::vector<double>> first_failing(num_regions+1, std::vector<double>(num_cuts+1, 0.));
+  std::vector<std::vector<double>> n_minus_one_counts(num_regions+1, std::vector<double>(num_cuts+1, 0.));
+  std::vector<double> totals(num_regions+1, 0.);
+
+  CutMaskHelper helper(num_cuts, num_regions, num_slots);
+  helper.Initialize();
+  for (unsigned int slot = 0; slot < num_slots; slot++)
+    helper.InitTask(nullptr, slot);
+  for (unsigned int event_idx = 0; event_idx < num_events; event_idx++) {
+    //cut passing fractions differ so that all views have distinct yields
+    std::vector<bool> passes = {event_idx%10u != 0, event_idx%3u != 0, event_idx%7u > 1, (event_idx/5u)%4u != 0};
+    ULong64_t cut_mask = 0;
+    for (unsigned int cut_idx = 0; cut_idx < num_cuts; cut_idx++)
+      if (passes[cut_idx]) cut_mask |= (1ull << cut_idx);
+    ULong64_t region_mask = (event_idx%2u == 0 ? 1ull : 0ull) | (event_idx%5u < 2 ? 2ull : 0ull);
+    double weight = 0.25*static_cast<double>(1u+event_idx%4u);
+    helper.Exec(event_idx%num_slots, cut_mask, region_mask, weight);
+
+    for (unsigned int region_idx = 0; region_idx <= num_regions; region_idx++) {
+      if (region_idx < num_regions && ((region_mask >> region_idx) & 1ull) == 0) continue;
+      totals[region_idx] += weight;
+      bool passes_previous = true;
+      unsigned int num_failed = 0;
+      for (unsigned int cut_idx = 0; cut_idx < num_cuts; cut_idx++) {
+        if (!passes[cut_idx]) num_failed++;
+        if (passes_previous && !passes[cut_idx])
+          first_failing[region_idx][cut_idx] += weight;
+        passes_previous = passes_previous && passes[cut_idx];
+        if (passes_previous)
+          sequential[region_idx][cut_idx] += weight;
+      }
+      if (passes_previous) {
+        sequential[region_idx][num_cuts] += weight;
+        first_failing[region_idx][num_cuts] += weight;
+        n_minus_one[region_idx][num_cuts] += weight;
+      }
+      for (unsigned int cut_idx = 0; cut_idx < num_cuts; cut_idx++) {
+        if (num_failed == 0 || (num_failed == 1 && !passes[cut_idx])) {
+          n_minus_one[region_idx][cut_idx] += weight;
+          n_minus_one_counts[region_idx][cut_idx] += 1.;
+        }
+      }
+    }
+  }
+  helper.Finalize();
+  const CutMaskYields &yields = *helper.GetResultPtr();
+
+  for (unsigned int region_idx = 0; region_idx <= num_regions; region_idx++) {
+    std::string region = " in region "+std::to_string(region_idx);
+    test.check_close(yields.get_total(region_idx), totals[region_idx], 1e-9, "total"+region);
+    for (unsigned int cut_idx = 0; cut_idx <= num_cuts; cut_idx++) {
+      std::string cut = " of cut "+std::to_string(cut_idx)+region;
+      test.check_close(yields.get_yield(CutflowView::sequential, region_idx, cut_idx), sequential[region_idx][cut_idx], 1e-9, "sequential yield"+cut);
+      test.check_close(yields.get_yield(CutflowView::n_minus_one, region_idx, cut_idx), n_minus_one[region_idx][cut_idx], 1e-9, "N-1 yield"+cut);
+      test.check_close(yields.get_yield(CutflowView::first_failing, region_idx, cut_idx), first_failing[region_idx][cut_idx], 1e-9, "first failing yield"+cut);
+      if (cut_idx < num_cuts)
+        test.check_close(yields.get_yield(CutflowView::n_minus_one, region_idx, cut_idx, false), n_minus_one_counts[region_idx][cut_idx], 1e-9, "unweighted N-1 yield"+cut);
+    }
+  }
+
+  //values stored in a ResultCache restore the same views, and results of other graph branches add up
+  CutMaskYields restored_yields;
+  restored_yields.num_cuts = num_cuts;
+  restored_yields.num_regions = num_regions;
+  test.check(yields.get_values().size() == CutMaskYields::num_values(num_cuts, num_regions), "number of values");
+  test.check(restored_yields.set_values(yields.get_values()), "values not restored");
+  test.check(!restored_yields.set_values(std::vector<double>(3, 0.)), "values of other cuts restored");
+  restored_yields.add(yields);
+  for (unsigned int cut_idx = 0; cut_idx <= num_cuts; cut_idx++) {
+    test.check_close(restored_yields.get_yield(CutflowView::n_minus_one, num_regions, cut_idx), 2.*n_minus_one[num_regions][cut_idx], 1e-9,
+        "added N-1 yield of cut "+std::to_string(cut_idx));
+    test.check_close(restored_yields.get_uncertainty(CutflowView::sequential, num_regions, cut_idx),
+        std::sqrt(2.)*yields.get_uncertainty(CutflowView::sequential, num_regions, cut_idx), 1e-9,
+        "added sequential uncertainty of cut "+std::to_string(cut_idx));
+  }
+  return test.report();
+}
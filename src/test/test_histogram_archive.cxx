@@ -0,0 +1,125 @@
+/**
+ * test of HistogramArchiveWriter and HistogramArchive: histograms and values read back from an archive match the
+ * written ones, and truncated or corrupt archives are not opened
+ */
+
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "TH1.h"
+#include "TH2.h"
+
+#include "core/histogram_archive.hxx"
+#include "test/test_utils.hxx"
+
+/**
+ * function to check that two 1d histograms have the same binning, contents, uncertainties, and entries
+ */
+void check_same_histogram(TestCounter &test, TH1D* histogram, TH1D* read_histogram) {
+  test.check(read_histogram != nullptr, "1d histogram not found in archive");
+  if (read_histogram == nullptr) return;
+  test.check(read_histogram->GetNbinsX() == histogram->GetNbinsX(), "1d histogram number of bins differs");
+  if (read_histogram->GetNbinsX() != histogram->GetNbinsX()) return;
+  for (int bin = 0; bin <= histogram->GetNbinsX()+1; bin++) {
+    test.check_close(read_histogram->GetXaxis()->GetBinLowEdge(bin), histogram->GetXaxis()->GetBinLowEdge(bin), 0., "1d bin edge");
+    test.check_close(read_histogram->GetBinContent(bin), histogram->GetBinContent(bin), 0., "1d bin content");
+    test.check_close(read_histogram->GetBinError(bin), histogram->GetBinError(bin), 0., "1d bin uncertainty");
+  }
+  test.check_close(read_histogram->GetEntries(), histogram->GetEntries(), 0., "1d number of entries");
+}
+
+int main() {
+  TestCounter test("test_histogram_archive");
+  TH1::AddDirectory(false);
+  std::string filename = test_path("test_histogram_archive")+".bin";
+
+  //variable bins check that edges are stored rather than recomputed from the range
+  std::vector<double> edges = {0., 10., 25., 50., 100., 200.};
+  TH1D histogram("met", "ttbar;p_{T}^{miss} [GeV];Events", static_cast<int>(edges.size()-1), edges.data());
+  TH2D twodim_histogram("met_vs_ht", "ttbar;H_{T} [GeV];p_{T}^{miss} [GeV]", 4, 0., 400., 3, 0., 300.);
+  for (unsigned int event_idx = 0; event_idx < 200; event_idx++) {
+    double value = static_cast<double>((event_idx*37u)%230u);
+    double weight = 0.5+static_cast<double>(event_idx%3u);
+    histogram.Fill(value, weight);
+    twodim_histogram.Fill(static_cast<double>((event_idx*53u)%450u), value, weight);
+  }
+  std::vector<std::string> labels = {"all", "met>100", "ht>200"};
+  std::vector<double> values = {200., 61.5, 17.25};
+  {
+    HistogramArchiveWriter writer(filename);
+    writer.add(&histogram, "met", "ttbar", "signal_region", "histogram");
+    writer.add(&twodim_histogram, "met_vs_ht", "ttbar", "signal_region", "histogram");
+    writer.add(labels, values, "cutflow", "ttbar", "inclusive", "yields");
+    writer.close();
+  }
+
+  //round trip
+  {
+    HistogramArchive archive(filename);
+    test.check(archive.is_open(), "archive not opened");
+    test.check(archive.contains("met", "ttbar", "signal_region", "histogram"), "archive does not contain 1d histogram");
+    test.check(!archive.contains("met", "ttbar", "control_region", "histogram"), "archive contains missing key");
+    std::unique_ptr<TH1D> read_histogram(archive.get_1d_histogram("met", "ttbar", "signal_region", "histogram"));
+    check_same_histogram(test, &histogram, read_histogram.get());
+    std::unique_ptr<TH1D> missing_histogram(archive.get_1d_histogram("met", "dy", "signal_region", "histogram"));
+    test.check(!missing_histogram, "missing 1d histogram returned");
+
+    std::unique_ptr<TH2D> read_twodim_histogram(archive.get_2d_histogram("met_vs_ht", "ttbar", "signal_region", "histogram"));
+    test.check(read_twodim_histogram != nullptr, "2d histogram not found in archive");
+    if (read_twodim_histogram) {
+      for (int bin = 0; bin < twodim_histogram.GetNcells(); bin++) {
+        test.check_close(read_twodim_histogram->GetBinContent(bin), twodim_histogram.GetBinContent(bin), 0., "2d bin content");
+        test.check_close(read_twodim_histogram->GetBinError(bin), twodim_histogram.GetBinError(bin), 0., "2d bin uncertainty");
+      }
+    }
+
+    unsigned int num_cells = 0;
+    const double* contents = archive.get_contents("met", "ttbar", "signal_region", "histogram", num_cells);
+    test.check(contents != nullptr && num_cells == static_cast<unsigned int>(histogram.GetNcells()), "in-place contents");
+    if (contents != nullptr)
+      test.check_close(contents[1], histogram.GetBinContent(1), 0., "in-place bin content");
+
+    std::vector<std::string> read_labels;
+    std::vector<double> read_values;
+    test.check(archive.get_values("cutflow", "ttbar", "inclusive", "yields", read_labels, read_values), "values not found in archive");
+    test.check(read_labels == labels, "value labels differ");
+    test.check(read_values == values, "values differ");
+  }
+
+  //corrupt archives are rejected when opened rather than when histograms are read
+  std::string content = read_test_file(filename);
+  std::string corrupt_filename = filename+".corrupt";
+  write_test_file(corrupt_filename, content.substr(0, content.size()/2));
+  {
+    HistogramArchive archive(corrupt_filename);
+    test.check(!archive.is_open(), "truncated archive opened");
+  }
+  std::string bad_magic = content;
+  bad_magic[0] = static_cast<char>(bad_magic[0]+1);
+  write_test_file(corrupt_filename, bad_magic);
+  {
+    HistogramArchive archive(corrupt_filename);
+    test.check(!archive.is_open(), "archive with wrong magic opened");
+  }
+  //the first entry follows the header; a number of bins not matching its cells would read past its arrays
+  std::string bad_binning = content;
+  uint32_t wrong_nbins = 100000;
+  bad_binning.replace(sizeof(ArchiveHeader)+offsetof(ArchiveEntryHeader, nbins_x), sizeof(wrong_nbins),
+      reinterpret_cast<const char*>(&wrong_nbins), sizeof(wrong_nbins));
+  write_test_file(corrupt_filename, bad_binning);
+  {
+    HistogramArchive archive(corrupt_filename);
+    test.check(!archive.is_open(), "archive with inconsistent binning opened");
+  }
+  {
+    HistogramArchive archive(filename+".missing");
+    test.check(!archive.is_open(), "missing archive opened");
+  }
+
+  std::remove(filename.c_str());
+  std::remove(corrupt_filename.c_str());
+  return test.report();
+}
@@ -0,0 +1,110 @@
+/**
+ * test of ResultCache keys and storage: keys change when input files, filters, or the booked action change, stored
+ * results are read back, and missing or corrupt cache files are cache misses
+ */
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "TH1.h"
+
+#include "core/result_cache.hxx"
+#include "core/sample_wrapper.hxx"
+#include "test/test_utils.hxx"
+
+int main() {
+  TestCounter test("test_result_cache");
+  TH1::AddDirectory(false);
+  std::string input_filename = test_path("test_result_cache")+".root";
+  std::string cache_directory = test_path("test_result_cache_directory");
+
+  //keys
+  test.check(ResultCache::hash("histo1d:met") == ResultCache::hash("histo1d:met"), "hash is not deterministic");
+  test.check(ResultCache::hash("histo1d:met") != ResultCache::hash("histo1d:ht"), "different actions have the same key");
+  test.check(ResultCache::hash("").size() == 16, "key is not 16 hexadecimal digits");
+
+  //input file identity changes when the file is rewritten or touched
+  write_test_tree(input_filename, 100);
+  std::string identity = ResultCache::file_identity(input_filename);
+  test.check(identity == ResultCache::file_identity(input_filename), "file identity is not deterministic");
+  struct stat file_status;
+  stat(input_filename.c_str(), &file_status);
+  struct timeval file_times[2];
+  file_times[0].tv_sec = file_status.st_atime;
+  file_times[0].tv_usec = 0;
+  file_times[1].tv_sec = file_status.st_mtime+100;
+  file_times[1].tv_usec = 0;
+  utimes(input_filename.c_str(), file_times);
+  test.check(identity != ResultCache::file_identity(input_filename), "touched file keeps its identity");
+  identity = ResultCache::file_identity(input_filename);
+
+  //graph descriptions, which results are keyed by, follow filters and input files
+  std::string graph_description;
+  {
+    SampleWrapper sample("sample", {input_filename}, 1);
+    SampleWrapper same_sample("sample", {input_filename}, 1);
+    SampleWrapper other_sample("sample", {input_filename}, 1);
+    sample.filter("x>10");
+    same_sample.filter("x>10");
+    other_sample.filter("x>20");
+    graph_description = sample.get_graph_description();
+    test.check(graph_description == same_sample.get_graph_description(), "same filters give different keys");
+    test.check(graph_description != other_sample.get_graph_description(), "different filters give the same key");
+    same_sample.filter("n>1");
+    test.check(graph_description != same_sample.get_graph_description(), "added filter keeps the key");
+  }
+  write_test_tree(input_filename, 200);
+  test.check(identity != ResultCache::file_identity(input_filename), "rewritten file keeps its identity");
+  {
+    SampleWrapper sample("sample", {input_filename}, 1);
+    sample.filter("x>10");
+    test.check(graph_description != sample.get_graph_description(), "rewritten input file keeps the key");
+  }
+
+  //storage
+  ResultCache result_cache(cache_directory);
+  result_cache.clear();
+  std::string values_key = ResultCache::hash(graph_description+"|sum:weight");
+  std::string histogram_key = ResultCache::hash(graph_description+"|histo1d:x");
+  std::vector<double> values;
+  test.check(!result_cache.load_values(values_key, values), "empty cache hit");
+  result_cache.store_values(values_key, {1.5, 2.5});
+  test.check(result_cache.load_values(values_key, values) && values == std::vector<double>({1.5, 2.5}), "stored values not read back");
+  TH1D histogram("x", "x", 10, 0., 100.);
+  for (unsigned int fill_idx = 0; fill_idx < 50; fill_idx++)
+    histogram.Fill(static_cast<double>(fill_idx*2u), 0.5);
+  result_cache.store(histogram_key, &histogram);
+  std::unique_ptr<TH1D> read_histogram(result_cache.load_1d_histogram(histogram_key));
+  test.check(read_histogram != nullptr, "stored histogram not read back");
+  if (read_histogram) {
+    for (int bin = 0; bin < histogram.GetNcells(); bin++)
+      test.check_close(read_histogram->GetBinContent(bin), histogram.GetBinContent(bin), 0., "stored histogram bin content");
+  }
+  test.check(result_cache.list_keys().size() == 2, "list_keys does not return the stored keys");
+
+  //partial results merge elementwise
+  ResultCache shard_cache(cache_directory+"_shard");
+  shard_cache.clear();
+  shard_cache.store_values(values_key, {1., 1.});
+  result_cache.accumulate(values_key, &shard_cache);
+  test.check(result_cache.load_values(values_key, values) && values == std::vector<double>({2.5, 3.5}), "accumulated values not added");
+  shard_cache.clear();
+
+  //a corrupt cache file is a miss rather than a wrong result
+  std::string content = read_test_file(result_cache.get_filename(histogram_key));
+  write_test_file(result_cache.get_filename(histogram_key), content.substr(0, content.size()-8));
+  read_histogram.reset(result_cache.load_1d_histogram(histogram_key));
+  test.check(!read_histogram, "corrupt cache file read");
+
+  result_cache.clear();
+  test.check(!result_cache.load_values(values_key, values), "cleared cache hit");
+  std::remove(input_filename.c_str());
+  rmdir(cache_directory.c_str());
+  rmdir((cache_directory+"_shard").c_str());
+  return test.report();
+}
@@ -0,0 +1,191 @@
+/**
+ * test of WorkCoordinator: a worker killed after taking a unit has the unit reassigned to another worker, and the
+ * results merged from all units equal the results of a single process reading every entry
+ */
+
+#include <csignal>
+#include <cstdio>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "Rtypes.h"
+#include "TH1.h"
+#include "ROOT/RDataFrame.hxx"
+
+#include "core/result_cache.hxx"
+#include "core/work_distribution.hxx"
+#include "test/test_utils.hxx"
+
+/**
+ * function to store the histogram, sum, and count of x over entries [begin_entry, end_entry) of the test tree
+ */
+void store_unit_results(ResultCache* unit_cache, std::string input_filename, ULong64_t begin_entry, ULong64_t end_entry) {
+  ROOT::RDataFrame data_frame("tree", input_filename);
+  ROOT::RDF::RNode unit_frame = data_frame.Range(begin_entry, end_entry);
+  ROOT::RDF::RResultPtr<TH1D> histogram = unit_frame.Histo1D<float>({"x", "x", 10, 0., 1000.}, "x");
+  ROOT::RDF::RResultPtr<double> x_sum = unit_frame.Sum("x");
+  ROOT::RDF::RResultPtr<ULong64_t> count = unit_frame.Count();
+  unit_cache->store(ResultCache::hash("histo1d:x"), histogram.GetPtr());
+  unit_cache->store_values(ResultCache::hash("sum:x"), {*x_sum, static_cast<double>(*count)});
+}
+
+/**
+ * returns a new connection to the coordinator on localhost port that sent the (empty) token, or nullptr; caller owns
+ * connection
+ */
+WorkConnection* connect_worker(unsigned short port) {
+  std::unique_ptr<WorkConnection> connection;
+  //the coordinator may not be listening yet
+  for (unsigned int attempt = 0; attempt < 60 && !connection; attempt++) {
+    connection.reset(WorkConnection::connect_to("127.0.0.1", port));
+    if (!connection) sleep(1);
+  }
+  if (!connection || !connection->send_line("HELLO ")) return nullptr;
+  return connection.release();
+}
+
+/**
+ * function to request and process units from the coordinator on localhost port until it is done, see
+ * SampleCollection::run_worker
+ */
+void run_test_worker(unsigned short port, std::string work_directory, std::string input_filename) {
+  std::unique_ptr<WorkConnection> connection(connect_worker(port));
+  if (!connection) return;
+  std::string message;
+  while (connection->send_line("REQUEST") && connection->receive_line(message)) {
+    if (message == "DONE") break;
+    if (message == "WAIT") {
+      sleep(1);
+      continue;
+    }
+    std::istringstream message_stream(message);
+    std::string command;
+    unsigned int unit_idx = 0, sample_idx = 0;
+    ULong64_t begin_entry = 0, end_entry = 0;
+    message_stream >> command >> unit_idx >> sample_idx >> begin_entry >> end_entry;
+    if (command != "UNIT") break;
+    std::string unit_directory = work_directory+"/worker_unit_"+std::to_string(unit_idx);
+    ResultCache unit_cache(unit_directory);
+    store_unit_results(&unit_cache, input_filename, begin_entry, end_entry);
+    std::vector<std::string> unit_keys = unit_cache.list_keys();
+    bool sent = connection->send_line("RESULT "+std::to_string(unit_idx)+" "+std::to_string(unit_keys.size()));
+    for (std::string key : unit_keys)
+      sent = sent && connection->send_file(unit_cache.get_filename(key), key+".harc");
+    unit_cache.clear();
+    rmdir(unit_directory.c_str());
+    if (!sent) break;
+  }
+}
+
+int main() {
+  TestCounter test("test_work_distribution");
+  TH1::AddDirectory(false);
+  const unsigned int num_entries = 1000;
+  const unsigned int num_units = 4;
+  //the port is derived from the process id so that concurrent test runs do not collide
+  const unsigned short port = static_cast<unsigned short>(20000+getpid()%20000);
+  std::string input_filename = test_path("test_work_distribution")+".root";
+  std::string work_directory = test_path("test_work_distribution_work");
+  std::string reference_directory = test_path("test_work_distribution_reference");
+  write_test_tree(input_filename, num_entries);
+
+  std::vector<WorkUnit> units;
+  for (unsigned int unit_idx = 0; unit_idx < num_units; unit_idx++)
+    units.push_back({0, unit_idx*num_entries/num_units, (unit_idx+1)*num_entries/num_units});
+  WorkCoordinator coordinator(units, work_directory, 3, 60);
+
+  //the doomed worker takes the first unit and reports it through a pipe without processing it, the other worker
+  //kills it before asking for any unit, so the first unit can only be completed if it is reassigned
+  int doomed_pipe[2];
+  test.check(pipe(doomed_pipe) == 0, "pipe not opened");
+  pid_t worker_pid = fork();
+  if (worker_pid == 0) {
+    close(doomed_pipe[0]);
+    pid_t doomed_pid = fork();
+    if (doomed_pid == 0) {
+      std::unique_ptr<WorkConnection> connection(connect_worker(port));
+      std::string message;
+      if (connection && connection->send_line("REQUEST") && connection->receive_line(message)) {
+        std::istringstream message_stream(message);
+        std::string command;
+        int unit_idx = -1;
+        message_stream >> command >> unit_idx;
+        if (command == "UNIT") {
+          std::string taken_unit = std::to_string(unit_idx)+"\n";
+          //holds the unit until it is killed
+          if (write(doomed_pipe[1], taken_unit.data(), taken_unit.size()) == static_cast<ssize_t>(taken_unit.size()))
+            while (true) pause();
+        }
+      }
+      _exit(1);
+    }
+    std::string taken_unit;
+    char taken_char = '\0';
+    while (read(doomed_pipe[0], &taken_char, 1) == 1 && taken_char != '\n')
+      taken_unit += taken_char;
+    if (doomed_pid > 0) {
+      kill(doomed_pid, SIGKILL);
+      waitpid(doomed_pid, nullptr, 0);
+    }
+    run_test_worker(port, work_directory, input_filename);
+    _exit(taken_unit == "0" ? 0 : 1);
+  }
+  //only the workers use the pipe, so the surviving worker reads end of file if the doomed worker exits without a unit
+  close(doomed_pipe[0]);
+  close(doomed_pipe[1]);
+  bool served = coordinator.serve(port);
+  int worker_status = 1;
+  if (worker_pid > 0)
+    waitpid(worker_pid, &worker_status, 0);
+  test.check(served, "serving stopped before all units were done");
+  test.check(coordinator.is_done(), "units not done");
+  test.check(worker_pid > 0 && WIFEXITED(worker_status) && WEXITSTATUS(worker_status) == 0,
+      "doomed worker did not take the first unit");
+  //the coordinator keeps the results received for each unit
+  test.check(ResultCache(work_directory+"/unit_0").list_keys().size() == 2, "first unit not reassigned and completed");
+
+  //merged results equal those of a single process reading all entries
+  ResultCache reference_cache(reference_directory);
+  reference_cache.clear();
+  store_unit_results(&reference_cache, input_filename, 0, num_entries);
+  ResultCache* merged_cache = coordinator.get_merged_cache();
+  std::vector<double> merged_values, reference_values;
+  test.check(merged_cache->load_values(ResultCache::hash("sum:x"), merged_values), "merged sum missing");
+  test.check(reference_cache.load_values(ResultCache::hash("sum:x"), reference_values), "reference sum missing");
+  test.check(merged_values.size() == 2 && reference_values.size() == 2, "number of merged values");
+  if (merged_values.size() == 2 && reference_values.size() == 2) {
+    test.check_close(merged_values[0], reference_values[0], 1e-6, "merged sum of x");
+    test.check_close(merged_values[1], reference_values[1], 0., "merged count");
+    test.check_close(merged_values[1], static_cast<double>(num_entries), 0., "merged count of all entries");
+  }
+  std::unique_ptr<TH1D> merged_histogram(merged_cache->load_1d_histogram(ResultCache::hash("histo1d:x")));
+  std::unique_ptr<TH1D> reference_histogram(reference_cache.load_1d_histogram(ResultCache::hash("histo1d:x")));
+  test.check(merged_histogram && reference_histogram, "merged or reference histogram missing");
+  if (merged_histogram && reference_histogram) {
+    for (int bin = 0; bin < reference_histogram->GetNcells(); bin++) {
+      test.check_close(merged_histogram->GetBinContent(bin), reference_histogram->GetBinContent(bin), 1e-9,
+          "merged content of bin "+std::to_string(bin));
+      test.check_close(merged_histogram->GetBinError(bin), reference_histogram->GetBinError(bin), 1e-9,
+          "merged uncertainty of bin "+std::to_string(bin));
+    }
+  }
+
+  reference_cache.clear();
+  rmdir(reference_directory.c_str());
+  for (unsigned int unit_idx = 0; unit_idx < num_units; unit_idx++) {
+    ResultCache(work_directory+"/unit_"+std::to_string(unit_idx)).clear();
+    rmdir((work_directory+"/unit_"+std::to_string(unit_idx)).c_str());
+  }
+  merged_cache->clear();
+  rmdir((work_directory+"/merged").c_str());
+  rmdir(work_directory.c_str());
+  std::remove(input_filename.c_str());
+  return test.report();
+}